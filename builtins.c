@@ -77,7 +77,11 @@ static struct {
 #endif
 #if ENABLE_SCHEME_INTEGRATION
 	{ b_scheme_eval,	"scheme-eval" },
+	{ b_kernel_load,	"kernel-load" },
 	{ b_hypergraph_encode,	"hypergraph-encode" },
+	{ b_hypergraph_query,	"hypergraph-query" },
+	{ b_hypergraph_save,	"hypergraph-save" },
+	{ b_hypergraph_load,	"hypergraph-load" },
 	{ b_pattern_match,	"pattern-match" },
 	{ b_attention_allocate,	"attention-allocate" },
 	{ b_pln_infer,		"pln-infer" },
@@ -86,18 +90,30 @@ static struct {
 #if ENABLE_TENSOR_OPERATIONS
 	{ b_tensor_create,	"tensor-create" },
 	{ b_tensor_op,		"tensor-op" },
+	{ b_tensor_destroy,	"tensor-destroy" },
+	{ b_tensor_list,	"tensor-list" },
 	{ b_membrane_alloc,	"membrane-alloc" },
 	{ b_membrane_create,	"membrane-create" },
+	{ b_membrane_flush,	"membrane-flush" },
 	{ b_membrane_list,	"membrane-list" },
 	{ b_membrane_info,	"membrane-info" },
 	{ b_membrane_destroy,	"membrane-destroy" },
 	{ b_membrane_set,	"membrane-set" },
 	{ b_membrane_get,	"membrane-get" },
+	{ b_membrane_load,	"membrane-load" },
+	{ b_membrane_dump,	"membrane-dump" },
 	{ b_membrane_fill,	"membrane-fill" },
 	{ b_membrane_add_object, "membrane-add-object" },
 	{ b_membrane_remove_object, "membrane-remove-object" },
 	{ b_membrane_transfer,	"membrane-transfer" },
 	{ b_membrane_reshape,	"membrane-reshape" },
+	{ b_membrane_view,	"membrane-view" },
+	{ b_membrane_op,	"membrane-op" },
+	{ b_membrane_rule,	"membrane-rule" },
+	{ b_membrane_evolve,	"membrane-evolve" },
+	{ b_membrane_snapshot,	"membrane-snapshot" },
+	{ b_membrane_diff,	"membrane-diff" },
+	{ b_membrane_patch,	"membrane-patch" },
 #endif
 #if ENABLE_DISTRIBUTED_PROTOCOLS
 	{ b_agent_discover,	"agent-discover" },
@@ -114,6 +130,7 @@ static struct {
 	{ b_orchestrator_status,	"orchestrator-status" },
 	{ b_orchestrator_load_model,	"orchestrator-load-model" },
 	{ b_orchestrator_inference,	"orchestrator-inference" },
+	{ b_orchestrator_coordinate,	"orchestrator-coordinate" },
 	{ b_airchat_create,	"airchat-create" },
 	{ b_airchat_load,	"airchat-load" },
 	{ b_airchat_chat,	"airchat-chat" },
@@ -7,6 +7,12 @@
 #include "gguf.h"
 #include "or.h"
 #include "air.h"
+#include "hypergraph.h"
+#include "pattern.h"
+#include "ecan.h"
+#include "pln.h"
+#include "scheme-vm.h"
+#include "registry.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -16,19 +22,41 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <errno.h>
+#include <dlfcn.h>
+#include <pthread.h>
 
 /* Global cognitive state */
-static CognitiveModule *modules_head = NULL;
+static Registry module_registry = REGISTRY_INIT;
+static CognitiveModule *retired_modules = NULL; /* replaced or removed, cleaned up at exit */
+static pthread_mutex_t retired_lock = PTHREAD_MUTEX_INITIALIZER;
 static HookFunction hooks[HOOK_COUNT][8]; /* Max 8 hooks per type */
 static int hook_counts[HOOK_COUNT] = {0};
 static AttentionState global_attention = {0};
 
 /* Module Management */
+
+/* Keep a module that left the registry until cognitive_cleanup, since
+ * a command may still be running it */
+static void retire_module(CognitiveModule *module) {
+    pthread_mutex_lock(&retired_lock);
+    CognitiveModule *m = retired_modules;
+    while (m && m != module) m = m->next;
+    if (!m) {
+        module->next = retired_modules;
+        retired_modules = module;
+    }
+    pthread_mutex_unlock(&retired_lock);
+}
+
+/* Registering a module under a taken name replaces the old one.  The
+ * old module may still be serving a command, so its cleanup runs with
+ * everything else in cognitive_cleanup. */
 int register_cognitive_module(CognitiveModule *module) {
     if (!module || !module->name) return -1;
     
-    module->next = modules_head;
-    modules_head = module;
+    CognitiveModule *old;
+    if (registry_swap(&module_registry, module->name, module, (void **)&old) != 0) return -1;
+    if (old && old != module) retire_module(old);
     
     if (module->init) {
         return module->init();
@@ -37,42 +65,54 @@ int register_cognitive_module(CognitiveModule *module) {
 }
 
 CognitiveModule *find_cognitive_module(const char *name) {
-    CognitiveModule *module = modules_head;
-    while (module) {
-        if (strcmp(module->name, name) == 0) {
-            return module;
-        }
-        module = module->next;
-    }
-    return NULL;
+    return registry_lookup(&module_registry, name);
 }
 
+/* Like a replaced module, a removed one is cleaned up at exit */
 void unregister_cognitive_module(const char *name) {
-    CognitiveModule **current = &modules_head;
-    while (*current) {
-        if (strcmp((*current)->name, name) == 0) {
-            CognitiveModule *to_remove = *current;
-            *current = (*current)->next;
-            if (to_remove->cleanup) {
-                to_remove->cleanup();
-            }
-            break;
-        }
-        current = &(*current)->next;
+    CognitiveModule *module;
+    if (registry_swap(&module_registry, name, NULL, (void **)&module) == 0 && module) {
+        retire_module(module);
     }
 }
 
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(const char **)a, *(const char **)b);
+}
+
+/* The names in a registry, sorted, as a malloc'd array */
+static const char **sorted_names(Registry *registry, size_t *count) {
+    size_t max = registry_names(registry, NULL, 0);
+    const char **names = malloc((max + 1) * sizeof(names[0]));
+    
+    *count = 0;
+    if (!names) return NULL;
+    *count = registry_names(registry, names, max);
+    if (*count > max) *count = max;
+    qsort(names, *count, sizeof(names[0]), compare_names);
+    return names;
+}
+
 void list_cognitive_modules(void) {
-    CognitiveModule *module = modules_head;
+    size_t count;
+    const char **names = sorted_names(&module_registry, &count);
+    
     fprint(1, "Registered Cognitive Modules:\n");
-    while (module) {
+    for (size_t i = 0; i < count; i++) {
+        CognitiveModule *module = find_cognitive_module(names[i]);
+        if (!module) continue;
         fprint(1, "  %s", module->name);
         if (module->version) {
             fprint(1, " (v%s)", module->version);
         }
         fprint(1, "\n");
-        module = module->next;
     }
+    free(names);
+}
+
+static void release_module(void *value) {
+    CognitiveModule *module = value;
+    if (module->cleanup) module->cleanup();
 }
 
 /* Hook Management */
@@ -139,33 +179,106 @@ static HypergraphKernel default_kernel = {
     .transform = default_kernel_transform
 };
 
+/* Kernels are copied into entries so callers can pass temporaries.  A
+ * replaced entry, and the library its functions live in, are kept
+ * until cognitive_cleanup since a command may still be running it. */
+typedef struct KernelEntry {
+    HypergraphKernel kernel;    /* first: a kernel pointer is its entry */
+    void *library;              /* dlopen handle, or NULL */
+    struct KernelEntry *next;   /* retired entries */
+} KernelEntry;
+
+static Registry kernel_registry = REGISTRY_INIT;
+static KernelEntry *retired_kernels = NULL;
+
+static int install_hypergraph_kernel(const char *name, const HypergraphKernel *kernel, void *library) {
+    KernelEntry *entry = malloc(sizeof(KernelEntry));
+    KernelEntry *old;
+    if (!entry) return -1;
+    entry->kernel = *kernel;
+    entry->library = library;
+    entry->next = NULL;
+    
+    if (registry_swap(&kernel_registry, name, entry, (void **)&old) != 0) {
+        free(entry);
+        return -1;
+    }
+    if (old) {
+        pthread_mutex_lock(&retired_lock);
+        old->next = retired_kernels;
+        retired_kernels = old;
+        pthread_mutex_unlock(&retired_lock);
+    }
+    return 0;
+}
+
+int register_hypergraph_kernel(const char *name, const HypergraphKernel *kernel) {
+    if (!name || !kernel) return -1;
+    return install_hypergraph_kernel(name, kernel, NULL);
+}
+
+int load_hypergraph_kernel(const char *name, const char *path, const char **error) {
+    *error = NULL;
+    if (!name || !path) {
+        *error = "missing kernel name or library";
+        return -1;
+    }
+    
+    void *library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!library) {
+        *error = dlerror();
+        return -1;
+    }
+    const HypergraphKernel *kernel = dlsym(library, "hypergraph_kernel");
+    if (!kernel) {
+        *error = "library has no hypergraph_kernel";
+    } else if (install_hypergraph_kernel(name, kernel, library) != 0) {
+        *error = "cannot register kernel";
+    } else {
+        return 0;
+    }
+    dlclose(library);
+    return -1;
+}
+
 HypergraphKernel *find_hypergraph_kernel(const char *name) {
-    /* For now, return a default kernel stub */
-    if (name && strcmp(name, "default") == 0) {
-        return &default_kernel;
+    return registry_lookup(&kernel_registry, name);
+}
+
+static void release_kernel(void *value) {
+    KernelEntry *entry = value;
+    if (entry->library) dlclose(entry->library);
+    free(entry);
+}
+
+static void release_kernels(void) {
+    registry_clear(&kernel_registry, release_kernel);
+    pthread_mutex_lock(&retired_lock);
+    while (retired_kernels) {
+        KernelEntry *next = retired_kernels->next;
+        release_kernel(retired_kernels);
+        retired_kernels = next;
     }
-    return NULL;
+    pthread_mutex_unlock(&retired_lock);
 }
 
+/* Attention for a piece of text: the text is encoded into the store,
+ * its ListLink is stimulated out of the ECAN funds and one tick spreads
+ * that stimulus to the words.  Returns the STI the text holds after
+ * the tick. */
 float calculate_ecan_attention(const char *input, ECANValues *ecan) {
     if (!input || !ecan) return 0.0f;
     
-    /* Basic ECAN calculation based on input complexity */
-    size_t len = strlen(input);
-    float complexity = (float)len / 10.0f;
-    
-    /* Simple heuristic attention allocation */
-    ecan->short_term_importance = 0.6f + (complexity * 0.1f);
-    ecan->long_term_importance = 0.3f + (complexity * 0.05f);
-    ecan->very_long_term_importance = 0.06f + (complexity * 0.01f);
-    ecan->stimulation_level = 12.0f + complexity;
+    memset(ecan, 0, sizeof *ecan);
+    Atom root = hypergraph_encode_words(input);
+    if (!root) return 0.0f;
     
-    /* Total attention is weighted sum */
-    float total = ecan->short_term_importance * len + 
-                  ecan->long_term_importance * 20.0f +
-                  ecan->very_long_term_importance * 5.0f;
-    
-    return total;
+    uint32_t words;
+    hypergraph_outgoing(root, &words);
+    ecan->stimulation_level = ecan_stimulate(root, ECAN_STIMULUS * words);
+    ecan_tick(NULL);
+    hypergraph_get_av(root, &ecan->short_term_importance, &ecan->long_term_importance);
+    return ecan->short_term_importance;
 }
 
 /* IPC Extension Implementation */
@@ -295,12 +408,140 @@ void rc_ipc_cleanup(void) {
 }
 #endif
 
+/* Hypergraph Store Access */
+
+/* Add the next root in text to the store and advance past it: an
+ * S-expression as written, or the rest of the text as a word sequence */
+static Atom hypergraph_insert(const char **text, const char **error) {
+    const char *p = *text;
+    Atom atom;
+    
+    *error = NULL;
+    while (*p == ' ' || *p == '\t' || *p == '\n') p++;
+    if (*p == '(') {
+        atom = hypergraph_parse(&p, 1, error);
+        if (!atom) return 0;
+    } else if (*p) {
+        atom = hypergraph_encode_words(p);
+        if (!atom) *error = "out of memory";
+        p += strlen(p);
+    } else {
+        atom = 0;
+    }
+    while (*p == ' ' || *p == '\t' || *p == '\n') p++;
+    *text = p;
+    return atom;
+}
+
+/* An atom as a malloc'd S-expression */
+static char *hypergraph_text(Atom atom) {
+    int len = hypergraph_format(atom, NULL, 0);
+    char *text = malloc(len + 1);
+    if (text) hypergraph_format(atom, text, len + 1);
+    return text;
+}
+
+/* An atom argument: a handle, or a single S-expression that is looked
+ * up without being added.  Returns 0 with error set when it names no
+ * atom. */
+static Atom hypergraph_ref(const char *ref, const char **error) {
+    char *end;
+    
+    if (*ref == '(') {
+        Atom atom = hypergraph_parse(&ref, 0, error);
+        if (*error) return 0;
+        while (*ref == ' ' || *ref == '\t' || *ref == '\n') ref++;
+        if (*ref) {
+            *error = "trailing text";
+            return 0;
+        }
+        if (!atom) *error = "atom not found";
+        return atom;
+    }
+    *error = "atom not found";
+    unsigned long handle = strtoul(ref, &end, 10);
+    if (end == ref || *end || !hypergraph_valid((Atom)handle)) return 0;
+    *error = NULL;
+    return (Atom)handle;
+}
+
+static void hypergraph_print(Atom atom) {
+    char *text = hypergraph_text(atom);
+    if (!text) return;
+    fprint(1, "%d %s\n", (int)atom, text);
+    free(text);
+}
+
+/* An atom as a malloc'd S-expression with its truth value, which
+ * hypergraph_parse reads back */
+static char *hypergraph_text_tv(Atom atom) {
+    char *text = hypergraph_text(atom), *result;
+    char tv[64];
+    float strength, confidence;
+    
+    if (!text) return NULL;
+    hypergraph_get_tv(atom, &strength, &confidence);
+    snprintf(tv, sizeof(tv), "(stv %g %g)", strength, confidence);
+    size_t type = strcspn(text, " )");
+    result = malloc(strlen(text) + strlen(tv) + 2);
+    if (result) sprintf(result, "%.*s %s%s", (int)type, text, tv, text + type);
+    free(text);
+    return result;
+}
+
+/* Add every root in each of texts to the store; returns a malloc'd
+ * array of them, or NULL with error set.  With handles set, a text
+ * that is a number is the handle of an atom already there. */
+static Atom *hypergraph_insert_all(char **texts, int handles, size_t *count, const char **error) {
+    Atom *atoms = NULL, *grown;
+    size_t capacity = 0;
+    
+    *count = 0;
+    for (; *texts; texts++) {
+        const char *p = *texts;
+        char *end;
+        int handle = 0;
+        if (handles) {
+            strtoul(p, &end, 10);
+            handle = end != p && !*end;
+        }
+        while (*p) {
+            Atom atom;
+            if (handle) {
+                atom = hypergraph_ref(p, error);
+                p += strlen(p);
+            } else {
+                atom = hypergraph_insert(&p, error);
+            }
+            if (*error) {
+                free(atoms);
+                return NULL;
+            }
+            if (!atom) break;
+            if (*count == capacity) {
+                capacity = capacity ? capacity * 2 : 8;
+                if (!(grown = realloc(atoms, capacity * sizeof(Atom)))) {
+                    free(atoms);
+                    *error = "out of memory";
+                    return NULL;
+                }
+                atoms = grown;
+            }
+            atoms[(*count)++] = atom;
+        }
+    }
+    if (!atoms) *error = "nothing to add";
+    return atoms;
+}
+
 /* Scheme Integration Implementation */
 #if ENABLE_SCHEME_INTEGRATION
-#include <dlfcn.h>
 
 static void *scheme_lib_handle = NULL;
-static char scheme_eval_buffer[4096];
+static char *scheme_output = NULL;     /* result or error of the last scheme_eval */
+static int scheme_vm_ready = 0;
+
+static int scheme_register_bindings(void);
 
 /* Function pointers for dynamically loaded Scheme interpreter */
 typedef int (*scheme_init_func_t)(void);
@@ -313,138 +554,19 @@ static scheme_eval_func_t scheme_eval_func = NULL;
 static scheme_call_func_t scheme_call_func = NULL;
 static scheme_cleanup_func_t scheme_cleanup_func = NULL;
 
-/* Hypergraph Node Structure */
-typedef struct HypergraphNode {
-    char *name;
-    float attention_value;
-    int concept_type;  /* 0=concept, 1=link, 2=predicate */
-    struct HypergraphNode **children;
-    int child_count;
-    struct HypergraphNode *next;
-} HypergraphNode;
-
-static HypergraphKernel *grammar_kernels = NULL;
-static int kernel_count = 0;
-static HypergraphNode *hypergraph_root = NULL;
-
-int register_hypergraph_kernel(HypergraphKernel *kernel) {
-    /* Simple array-based registration for now */
-    if (kernel_count >= 16) return -1; /* Max 16 kernels */
-    
-    if (!grammar_kernels) {
-        grammar_kernels = malloc(16 * sizeof(HypergraphKernel));
-        if (!grammar_kernels) return -1;
-    }
-    
-    grammar_kernels[kernel_count++] = *kernel;
-    return 0;
-}
-
-/* Core Hypergraph Operations */
-HypergraphNode *create_hypergraph_node(const char *name, int concept_type) {
-    HypergraphNode *node = malloc(sizeof(HypergraphNode));
-    if (!node) return NULL;
-    
-    node->name = ecpy(name);
-    node->attention_value = 0.0f;
-    node->concept_type = concept_type;
-    node->children = NULL;
-    node->child_count = 0;
-    node->next = NULL;
-    
-    return node;
-}
-
-void destroy_hypergraph_node(HypergraphNode *node) {
-    if (!node) return;
-    
-    if (node->name) efree(node->name);
-    if (node->children) {
-        for (int i = 0; i < node->child_count; i++) {
-            destroy_hypergraph_node(node->children[i]);
-        }
-        efree(node->children);
-    }
-    efree(node);
-}
-
-int add_hypergraph_child(HypergraphNode *parent, HypergraphNode *child) {
-    if (!parent || !child) return -1;
-    
-    HypergraphNode **new_children = realloc(parent->children, 
-        (parent->child_count + 1) * sizeof(HypergraphNode*));
-    if (!new_children) return -1;
-    
-    parent->children = new_children;
-    parent->children[parent->child_count++] = child;
-    return 0;
-}
-
-/* PLN Inference */
-TruthValue pln_deduction(TruthValue premise1, TruthValue premise2) {
-    TruthValue result;
-    
-    /* PLN deduction rule: if A->B and B->C then A->C */
-    result.strength = premise1.strength * premise2.strength;
-    result.confidence = premise1.confidence * premise2.confidence;
-    
-    return result;
-}
-
-TruthValue pln_induction(TruthValue evidence, float prior_strength) {
-    TruthValue result;
-    
-    /* PLN induction: generalize from evidence */
-    result.strength = (evidence.strength + prior_strength) / 2.0f;
-    result.confidence = evidence.confidence * 0.8f; /* Lower confidence for induction */
-    
-    return result;
-}
-
-/* Hypergraph Encoding in Scheme-like Syntax */
+/* Hypergraph encoding adds the input to the store; the output is the
+ * last root atom as an S-expression */
 int encode_to_hypergraph(const char *input, char **output) {
     if (!input || !output) return -1;
     
-    /* Parse input and create hypergraph representation */
-    char *result = malloc(strlen(input) * 4 + 256);
-    if (!result) return -1;
-    
-    /* Create nodes for each significant word */
-    char *words[32];
-    int word_count = 0;
-    char *input_copy = ecpy(input);
-    char *token = strtok(input_copy, " \t\n");
-    
-    while (token && word_count < 32) {
-        words[word_count++] = token;
-        token = strtok(NULL, " \t\n");
-    }
-    
-    /* Generate Scheme-like hypergraph encoding */
-    strcpy(result, "(hypergraph ");
-    for (int i = 0; i < word_count; i++) {
-        strcat(result, "(concept \"");
-        strcat(result, words[i]);
-        strcat(result, "\") ");
-    }
-    
-    /* Add relationship links */
-    if (word_count > 1) {
-        strcat(result, "(link sequence ");
-        for (int i = 0; i < word_count - 1; i++) {
-            strcat(result, "(ordered-link \"");
-            strcat(result, words[i]);
-            strcat(result, "\" \"");
-            strcat(result, words[i + 1]);
-            strcat(result, "\") ");
-        }
-        strcat(result, ")");
-    }
-    strcat(result, ")");
+    const char *error = NULL;
+    Atom root = 0;
+    while (*input && (root = hypergraph_insert(&input, &error)) != 0)
+        ;
+    if (error || !root) return -1;
     
-    efree(input_copy);
-    *output = result;
-    return 0;
+    *output = hypergraph_text(root);
+    return *output ? 0 : -1;
 }
 
 /* Default Hypergraph Kernel Implementation */
@@ -496,22 +618,38 @@ static int default_kernel_transform(const char *pattern, const char *input, char
     return 0;
 }
 
+/* The premises are added to the store and chained forward; the result
+ * is the most confident conclusion drawn */
 static int default_kernel_pln_infer(const char *premises, char **conclusion, TruthValue *tv) {
     if (!premises || !conclusion || !tv) return -1;
     
-    /* Simple PLN inference example */
-    TruthValue premise_tv = {0.8f, 0.9f}; /* Default premise truth value */
-    TruthValue prior_tv = {0.5f, 0.5f};   /* Default prior */
-    
-    *tv = pln_induction(premise_tv, prior_tv.strength);
-    
-    char *result = malloc(strlen(premises) + 128);
-    if (!result) return -1;
-    
-    sprintf(result, "(conclusion \"%s\" (tv %d %d))", premises, (int)(tv->strength * 100), (int)(tv->confidence * 100));
-    *conclusion = result;
+    char *texts[2] = { (char *)premises, NULL };
+    const char *error = NULL;
+    size_t count;
+    Atom *atoms = hypergraph_insert_all(texts, 0, &count, &error);
+    if (!atoms) return -1;
+    int result = pln_forward(atoms, count, NULL, NULL);
+    free(atoms);
+    if (result < 0) return -1;
+    
+    size_t n = pln_conclusions(NULL, 0);
+    if (n == 0 || !(atoms = malloc(n * sizeof(Atom)))) return -1;
+    pln_conclusions(atoms, n);
+    Atom best = 0;
+    tv->confidence = 0.0f;
+    for (size_t i = 0; i < n; i++) {
+        float strength, confidence;
+        hypergraph_get_tv(atoms[i], &strength, &confidence);
+        if (confidence > tv->confidence) {
+            best = atoms[i];
+            tv->strength = strength;
+            tv->confidence = confidence;
+        }
+    }
+    free(atoms);
     
-    return 0;
+    *conclusion = hypergraph_text_tv(best);
+    return *conclusion ? 0 : -1;
 }
 
 int scheme_init(void) {
@@ -532,39 +670,25 @@ int scheme_init(void) {
         }
     }
     
-    /* Fallback: initialize built-in minimal Scheme evaluator */
-    memset(scheme_eval_buffer, 0, sizeof(scheme_eval_buffer));
-    return 0;
+    /* Fallback: the embedded VM, with the cognitive bindings */
+    if (scheme_vm_init() != 0) return -1;
+    scheme_vm_ready = 1;
+    return scheme_register_bindings();
 }
 
+/* Returns 0 or -1; scheme_output holds the written value of the last
+ * expression, or the error */
 int scheme_eval(const char *expr) {
-    /* Evaluate Scheme expression */
     if (!expr) return -1;
     
     if (scheme_eval_func) {
         return scheme_eval_func(expr);
     }
     
-    /* Fallback: simple built-in evaluator for basic expressions */
-    if (strncmp(expr, "(+ ", 3) == 0) {
-        /* Simple addition */
-        int a, b;
-        if (sscanf(expr, "(+ %d %d)", &a, &b) == 2) {
-            snprintf(scheme_eval_buffer, sizeof(scheme_eval_buffer), "%d", a + b);
-            return a + b;
-        }
-    } else if (strncmp(expr, "(* ", 3) == 0) {
-        /* Simple multiplication */
-        int a, b;
-        if (sscanf(expr, "(* %d %d)", &a, &b) == 2) {
-            snprintf(scheme_eval_buffer, sizeof(scheme_eval_buffer), "%d", a * b);
-            return a * b;
-        }
-    }
-    
-    /* Default: echo the expression */
-    strncpy(scheme_eval_buffer, expr, sizeof(scheme_eval_buffer) - 1);
-    return 0;
+    free(scheme_output);
+    scheme_output = NULL;
+    if (!scheme_vm_ready) return -1;
+    return scheme_vm_eval(expr, &scheme_output);
 }
 
 char *scheme_call(const char *func, char **args) {
@@ -575,6 +699,13 @@ char *scheme_call(const char *func, char **args) {
         return scheme_call_func(func, args);
     }
     
+    /* Procedures defined in the VM take the arguments as strings */
+    if (scheme_vm_ready) {
+        char *output = NULL;
+        if (scheme_vm_call(func, args, &output) == 0) return output;
+        free(output);
+    }
+    
     /* Fallback: simple function calls */
     if (strcmp(func, "hypergraph-encode") == 0 && args && args[0]) {
         HypergraphKernel *kernel = find_hypergraph_kernel("default");
@@ -609,7 +740,7 @@ char *scheme_call(const char *func, char **args) {
         return result;
     }
     
-    return ecpy("scheme_call_result");
+    return NULL;
 }
 
 void scheme_cleanup(void) {
@@ -623,11 +754,13 @@ void scheme_cleanup(void) {
         scheme_lib_handle = NULL;
     }
     
-    if (grammar_kernels) {
-        free(grammar_kernels);
-        grammar_kernels = NULL;
-        kernel_count = 0;
+    if (scheme_vm_ready) {
+        scheme_vm_cleanup();
+        scheme_vm_ready = 0;
     }
+    free(scheme_output);
+    scheme_output = NULL;
+
 }
 #endif
 
@@ -635,110 +768,324 @@ void scheme_cleanup(void) {
 #if ENABLE_TENSOR_OPERATIONS
 #include <math.h>
 #include "tensor-membrane.h"
-
-/* Simple tensor structure (minimal implementation without ggml dependency) */
+#include "psystem.h"
+#include "snapshot.h"
+#include "tensor-expr.h"
+#include "tensor-kernels.h"
+#include "intern.h"
+
+/* Simple tensor structure (minimal implementation without ggml dependency).
+ * Operations do not touch the data; they replace the tensor's expression,
+ * and the data is computed when a result is asked for. */
 typedef struct {
-    int ndims;
-    int dims[4];  /* Support up to 4D tensors */
-    float *data;
-    size_t size;
-    char name[64];
+    TensorExpr *expr;
+    uint32_t handle;
+    uint32_t name;              /* interned, see intern.h */
 } SimpleTensor;
 
-static SimpleTensor *tensor_registry[32]; /* Track up to 32 tensors */
-static int tensor_count = 0;
+/* Tensor registry: a slot map like the membrane one.  A handle packs the
+ * slot index plus one in the low 24 bits and the slot's generation
+ * above it, so a handle to a destroyed tensor stops resolving.  Names
+ * are interned and hashed to slots. */
+#define TENSOR_INDEX_BITS 24
+#define TENSOR_INDEX_MASK ((1u << TENSOR_INDEX_BITS) - 1)
+#define TENSOR_GENERATION_MAX 0x7F
+#define TENSOR_SLOT_NONE UINT32_MAX
+
+typedef struct {
+    SimpleTensor *tensor;       /* NULL while the slot is free */
+    uint32_t generation;
+    uint32_t next_free;
+} TensorSlot;
+
+static TensorSlot *tensor_slots = NULL;
+static uint32_t tensor_slot_capacity = 0;
+static uint32_t tensor_slot_high = 0;
+static uint32_t tensor_free_slot = TENSOR_SLOT_NONE;
+static uint32_t *tensor_names = NULL;   /* open addressing, holds slot index + 1 */
+static uint32_t tensor_name_capacity = 0;
+static uint32_t tensor_count = 0;
 
 static TensorMembrane *membrane_registry[16];
 static int membrane_count = 0;
 
-void *tensor_create(int *dims, int ndims) {
-    if (!dims || ndims <= 0 || ndims > 4 || tensor_count >= 32) {
-        return NULL;
+static uint32_t tensor_name_hash(uint32_t symbol) {
+    return (symbol * 2654435761u) & (tensor_name_capacity - 1);
+}
+
+/* Index in tensor_names holding symbol, or the empty one where it goes */
+static uint32_t tensor_name_search(uint32_t symbol) {
+    uint32_t mask = tensor_name_capacity - 1;
+    uint32_t i = tensor_name_hash(symbol);
+    while (tensor_names[i] && tensor_slots[tensor_names[i] - 1].tensor->name != symbol) {
+        i = (i + 1) & mask;
     }
+    return i;
+}
+
+static int tensor_names_grow(void) {
+    uint32_t *old = tensor_names;
+    uint32_t old_capacity = tensor_name_capacity;
+    uint32_t capacity = old_capacity ? old_capacity * 2 : 64;
     
-    SimpleTensor *tensor = malloc(sizeof(SimpleTensor));
-    if (!tensor) return NULL;
+    tensor_names = calloc(capacity, sizeof(uint32_t));
+    if (!tensor_names) {
+        tensor_names = old;
+        return -1;
+    }
+    tensor_name_capacity = capacity;
+    for (uint32_t i = 0; i < old_capacity; i++) {
+        if (old[i]) {
+            tensor_names[tensor_name_search(tensor_slots[old[i] - 1].tensor->name)] = old[i];
+        }
+    }
+    free(old);
+    return 0;
+}
+
+static void tensor_name_remove(uint32_t symbol) {
+    if (!tensor_name_capacity) return;
+    
+    uint32_t mask = tensor_name_capacity - 1;
+    uint32_t hole = tensor_name_search(symbol);
+    if (!tensor_names[hole]) return;
+    
+    /* Backward-shift deletion keeps probe chains intact */
+    for (uint32_t j = (hole + 1) & mask; tensor_names[j]; j = (j + 1) & mask) {
+        uint32_t home = tensor_name_hash(tensor_slots[tensor_names[j] - 1].tensor->name);
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            tensor_names[hole] = tensor_names[j];
+            hole = j;
+        }
+    }
+    tensor_names[hole] = 0;
+}
+
+static int tensor_name_taken(const char *name) {
+    uint32_t symbol = symbol_lookup(name);
+    return symbol && tensor_name_capacity && tensor_names[tensor_name_search(symbol)] != 0;
+}
+
+/* Give tensor a slot, a handle and its name; fails if the name is taken */
+static int tensor_register(SimpleTensor *tensor, const char *name) {
+    uint32_t index;
+    
+    if ((tensor_count + 1) * 2 > tensor_name_capacity && tensor_names_grow() != 0) return -1;
+    
+    if (tensor_free_slot != TENSOR_SLOT_NONE) {
+        index = tensor_free_slot;
+    } else {
+        if (tensor_slot_high >= TENSOR_INDEX_MASK) return -1;
+        if (tensor_slot_high == tensor_slot_capacity) {
+            uint32_t capacity = tensor_slot_capacity ? tensor_slot_capacity * 2 : 64;
+            TensorSlot *slots = realloc(tensor_slots, capacity * sizeof(TensorSlot));
+            if (!slots) return -1;
+            tensor_slots = slots;
+            tensor_slot_capacity = capacity;
+        }
+        index = tensor_slot_high;
+        tensor_slots[index].generation = 0;
+    }
+    
+    char default_name[48];
+    if (!name) {
+        /* Default names share the namespace with chosen ones, so step
+         * past one a user already took */
+        uint32_t handle = (tensor_slots[index].generation << TENSOR_INDEX_BITS) | (index + 1);
+        snprintf(default_name, sizeof(default_name), "tensor_%u", handle);
+        for (int n = 2; tensor_name_taken(default_name); n++) {
+            snprintf(default_name, sizeof(default_name), "tensor_%u_%d", handle, n);
+        }
+        name = default_name;
+    }
+    tensor->name = symbol_intern(name);
+    if (!tensor->name) return -1;
+    uint32_t *name_slot = &tensor_names[tensor_name_search(tensor->name)];
+    if (*name_slot) return -1;
     
-    tensor->ndims = ndims;
-    tensor->size = 1;
+    if (index == tensor_free_slot) tensor_free_slot = tensor_slots[index].next_free;
+    else tensor_slot_high++;
     
+    tensor_slots[index].tensor = tensor;
+    tensor_slots[index].next_free = TENSOR_SLOT_NONE;
+    tensor->handle = (tensor_slots[index].generation << TENSOR_INDEX_BITS) | (index + 1);
+    *name_slot = index + 1;
+    tensor_count++;
+    return 0;
+}
+
+static void tensor_unregister(SimpleTensor *tensor) {
+    TensorSlot *slot = &tensor_slots[(tensor->handle & TENSOR_INDEX_MASK) - 1];
+    
+    tensor_name_remove(tensor->name);
+    slot->tensor = NULL;
+    tensor_count--;
+    if (slot->generation == TENSOR_GENERATION_MAX) return; /* retired */
+    
+    slot->generation++;
+    slot->next_free = tensor_free_slot;
+    tensor_free_slot = (uint32_t)(slot - tensor_slots);
+}
+
+/* Resolve a handle, or failing that a name */
+void *tensor_find(const char *ref) {
+    if (!ref || !*ref) return NULL;
+    
+    char *end;
+    unsigned long handle = strtoul(ref, &end, 10);
+    if (*end == '\0') {
+        uint32_t index = (uint32_t)(handle & TENSOR_INDEX_MASK) - 1;
+        if (handle > UINT32_MAX || (handle & TENSOR_INDEX_MASK) == 0 || index >= tensor_slot_high) {
+            return NULL;
+        }
+        TensorSlot *slot = &tensor_slots[index];
+        if (!slot->tensor || slot->generation != handle >> TENSOR_INDEX_BITS) return NULL;
+        return slot->tensor;
+    }
+    
+    uint32_t symbol = symbol_lookup(ref);
+    if (!symbol || !tensor_name_capacity) return NULL;
+    uint32_t i = tensor_names[tensor_name_search(symbol)];
+    return i ? tensor_slots[i - 1].tensor : NULL;
+}
+
+uint32_t tensor_handle(void *tensor_ptr) {
+    SimpleTensor *tensor = (SimpleTensor*)tensor_ptr;
+    return tensor ? tensor->handle : 0;
+}
+
+const char *tensor_name(void *tensor_ptr) {
+    SimpleTensor *tensor = (SimpleTensor*)tensor_ptr;
+    return tensor ? symbol_name(tensor->name) : NULL;
+}
+
+/* Names may not look like handles */
+static int tensor_name_valid(const char *name) {
+    if (!name || !*name) return 0;
+    for (const char *p = name; *p; p++) {
+        if (*p < '0' || *p > '9') return 1;
+    }
+    return 0;
+}
+
+void *tensor_create_named(int *dims, int ndims, const char *name) {
+    if (!dims || ndims <= 0 || ndims > TENSOR_MAX_DIMS) return NULL;
+    if (name && !tensor_name_valid(name)) return NULL;
+    
+    size_t size = 1;
     for (int i = 0; i < ndims; i++) {
-        tensor->dims[i] = dims[i];
-        tensor->size *= dims[i];
+        if (dims[i] <= 0 || size > SIZE_MAX / sizeof(float) / (size_t)dims[i]) return NULL;
+        size *= (size_t)dims[i];
     }
     
-    tensor->data = malloc(tensor->size * sizeof(float));
-    if (!tensor->data) {
+    SimpleTensor *tensor = malloc(sizeof(SimpleTensor));
+    if (!tensor) return NULL;
+    
+    float *data = tensor_alloc(size);
+    if (!data) {
         free(tensor);
         return NULL;
     }
     
     /* Initialize with random values */
-    for (size_t i = 0; i < tensor->size; i++) {
-        tensor->data[i] = (float)rand() / RAND_MAX;
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (float)rand() / RAND_MAX;
+    }
+    
+    tensor->expr = tensor_expr_leaf(data, dims, ndims);
+    if (!tensor->expr) {
+        tensor_free(data);
+        free(tensor);
+        return NULL;
     }
     
-    snprintf(tensor->name, sizeof(tensor->name), "tensor_%d", tensor_count);
-    tensor_registry[tensor_count++] = tensor;
+    if (tensor_register(tensor, name) != 0) {
+        tensor_expr_release(tensor->expr);
+        free(tensor);
+        return NULL;
+    }
     
     return tensor;
 }
 
+void *tensor_create(int *dims, int ndims) {
+    return tensor_create_named(dims, ndims, NULL);
+}
+
 void tensor_destroy(void *tensor_ptr) {
     SimpleTensor *tensor = (SimpleTensor*)tensor_ptr;
     if (!tensor) return;
     
-    /* Remove from registry */
-    for (int i = 0; i < tensor_count; i++) {
-        if (tensor_registry[i] == tensor) {
-            for (int j = i; j < tensor_count - 1; j++) {
-                tensor_registry[j] = tensor_registry[j + 1];
-            }
-            tensor_count--;
-            break;
-        }
-    }
-    
-    if (tensor->data) {
-        free(tensor->data);
-    }
+    tensor_unregister(tensor);
+    tensor_expr_release(tensor->expr);
     free(tensor);
 }
 
-int tensor_compute(void *tensor_ptr, const char *op) {
+/* Replace the tensor's expression with next, which refers to the old one */
+static int tensor_update(SimpleTensor *tensor, TensorExpr *next) {
+    if (!next) return -1;
+    tensor_expr_release(tensor->expr);
+    tensor->expr = next;
+    return 0;
+}
+
+/* Operations without an operand.  Reductions evaluate the tensor, store
+ * the result in *result and return 1; "eval" stores the tensor's value;
+ * elementwise maps are only recorded and return 0. */
+int tensor_compute(void *tensor_ptr, const char *op, float *result) {
     SimpleTensor *tensor = (SimpleTensor*)tensor_ptr;
     if (!tensor || !op) return -1;
     
-    if (strcmp(op, "sum") == 0) {
-        float sum = 0.0f;
-        for (size_t i = 0; i < tensor->size; i++) {
-            sum += tensor->data[i];
-        }
-        return (int)sum;
-    } else if (strcmp(op, "mean") == 0) {
-        float sum = 0.0f;
-        for (size_t i = 0; i < tensor->size; i++) {
-            sum += tensor->data[i];
-        }
-        return (int)(sum / tensor->size);
-    } else if (strcmp(op, "norm") == 0) {
-        float norm = 0.0f;
-        for (size_t i = 0; i < tensor->size; i++) {
-            norm += tensor->data[i] * tensor->data[i];
-        }
-        return (int)sqrt(norm);
-    } else if (strcmp(op, "relu") == 0) {
-        for (size_t i = 0; i < tensor->size; i++) {
-            if (tensor->data[i] < 0) {
-                tensor->data[i] = 0;
-            }
-        }
-        return 0;
+    TensorReduceOp reduce;
+    TensorMapOp map;
+    int takes_operand;
+    
+    if (tensor_reduce_op(op, &reduce) == 0) {
+        float value;
+        if (tensor_expr_reduce(tensor->expr, reduce, &value) != 0) return -1;
+        if (result) *result = value;
+        return 1;
+    } else if (strcmp(op, "eval") == 0) {
+        return tensor_expr_eval(tensor->expr) ? 0 : -1;
+    } else if (tensor_map_op(op, &map, &takes_operand) == 0 && !takes_operand) {
+        return tensor_update(tensor, tensor_expr_map(tensor->expr, map, 0.0f));
     }
     
     return -1; /* Unknown operation */
 }
 
+/* Operations with a constant (scale, shift) or a second tensor (add, sub,
+ * mul, matmul, conv2d); all are recorded for later evaluation */
+int tensor_apply(void *tensor_ptr, const char *op, float operand, void *other_ptr) {
+    SimpleTensor *tensor = (SimpleTensor*)tensor_ptr;
+    SimpleTensor *other = (SimpleTensor*)other_ptr;
+    if (!tensor || !op) return -1;
+    
+    TensorMapOp map;
+    TensorBinaryOp binary;
+    int takes_operand;
+    
+    if (tensor_map_op(op, &map, &takes_operand) == 0 && takes_operand) {
+        return tensor_update(tensor, tensor_expr_map(tensor->expr, map, operand));
+    } else if (other && tensor_binary_op(op, &binary) == 0) {
+        return tensor_update(tensor, tensor_expr_binary(tensor->expr, binary, other->expr));
+    } else if (other && strcmp(op, "matmul") == 0) {
+        return tensor_update(tensor, tensor_expr_matmul(tensor->expr, other->expr));
+    } else if (other && strcmp(op, "conv2d") == 0) {
+        return tensor_update(tensor, tensor_expr_conv2d(tensor->expr, other->expr));
+    }
+    
+    return -1;
+}
+
+/* The tensor's pending expression, and the passes over memory a
+ * reduction of it would take */
+int tensor_describe(void *tensor_ptr, char *buf, size_t size) {
+    SimpleTensor *tensor = (SimpleTensor*)tensor_ptr;
+    if (!tensor || tensor_expr_format(tensor->expr, buf, size) < 0) return -1;
+    return tensor_expr_passes(tensor->expr);
+}
+
 void *tensor_membrane_alloc(int prime_factors[], int count) {
     if (!prime_factors || count <= 0 || count > 16) {
         return NULL;
@@ -754,6 +1101,527 @@ void tensor_membrane_free(void *membrane_ptr) {
 }
 #endif
 
+/* Scheme Bindings
+ * Atoms are passed as handles; an S-expression string stands for the
+ * atom it names.  Procedures that change the store return handles. */
+#if ENABLE_SCHEME_INTEGRATION
+
+static Atom scheme_atom(SchemeValue v) {
+    long handle;
+    const char *text, *error;
+    if (scheme_get_integer(v, &handle)) {
+        return handle > 0 && handle <= UINT32_MAX && hypergraph_valid((Atom)handle) ? (Atom)handle : 0;
+    }
+    text = scheme_get_string(v);
+    return text ? hypergraph_ref(text, &error) : 0;
+}
+
+static SchemeValue scheme_atom_list(const Atom *atoms, size_t count) {
+    SchemeValue list = SCHEME_NIL;
+    while (count-- > 0) list = scheme_cons(scheme_integer(atoms[count]), list);
+    return list;
+}
+
+static SchemeValue scheme_reverse(SchemeValue list) {
+    SchemeValue reversed = SCHEME_NIL;
+    for (; scheme_is_pair(list); list = scheme_cdr(list)) reversed = scheme_cons(scheme_car(list), reversed);
+    return reversed;
+}
+
+/* Truth and attention values are floats; pass them on as the decimal
+ * they print as rather than their exact binary value */
+static SchemeValue scheme_float(float f) {
+    char text[32];
+    snprintf(text, sizeof(text), "%g", f);
+    return scheme_real(strtod(text, NULL));
+}
+
+static SchemeValue scheme_text(char *text, const char *who) {
+    SchemeValue s;
+    if (!text) return scheme_fail(who, "out of memory");
+    s = scheme_string(text);
+    free(text);
+    return s;
+}
+
+/* (hypergraph-add "sexpr-or-text") adds every root and returns the last */
+static SchemeValue sb_hypergraph_add(int argc, SchemeValue *argv) {
+    const char *text = scheme_get_string(argv[0]), *error = NULL;
+    Atom atom = 0, root;
+    (void)argc;
+    if (!text) return scheme_fail("hypergraph-add", "not a string");
+    while (*text && (root = hypergraph_insert(&text, &error)) != 0) atom = root;
+    if (error) return scheme_fail("hypergraph-add", error);
+    return atom ? scheme_integer(atom) : SCHEME_FALSE;
+}
+
+/* (hypergraph-node type name) */
+static SchemeValue sb_hypergraph_node(int argc, SchemeValue *argv) {
+    const char *type = scheme_get_string(argv[0]), *name = scheme_get_string(argv[1]);
+    uint16_t t;
+    Atom atom;
+    (void)argc;
+    if (!type || !name) return scheme_fail("hypergraph-node", "type and name must be strings");
+    t = hypergraph_type(type);
+    if (!t || hypergraph_type_is_link(t)) return scheme_fail("hypergraph-node", "not a node type");
+    atom = hypergraph_add_node(t, name);
+    return atom ? scheme_integer(atom) : scheme_fail("hypergraph-node", "out of memory");
+}
+
+/* (hypergraph-link type atom...) */
+static SchemeValue sb_hypergraph_link(int argc, SchemeValue *argv) {
+    const char *type = scheme_get_string(argv[0]);
+    Atom outgoing[64], atom;
+    uint16_t t;
+    int i;
+    if (!type) return scheme_fail("hypergraph-link", "type must be a string");
+    if (argc - 1 > 64) return scheme_fail("hypergraph-link", "too many atoms");
+    t = hypergraph_type(type);
+    if (!t || !hypergraph_type_is_link(t)) return scheme_fail("hypergraph-link", "not a link type");
+    for (i = 1; i < argc; i++) {
+        if (!(outgoing[i - 1] = scheme_atom(argv[i]))) return scheme_fail("hypergraph-link", "atom not found");
+    }
+    atom = hypergraph_add_link(t, outgoing, argc - 1);
+    return atom ? scheme_integer(atom) : scheme_fail("hypergraph-link", "out of memory");
+}
+
+/* (hypergraph-find atom) is the handle, or #f */
+static SchemeValue sb_hypergraph_find(int argc, SchemeValue *argv) {
+    Atom atom = scheme_atom(argv[0]);
+    (void)argc;
+    return atom ? scheme_integer(atom) : SCHEME_FALSE;
+}
+
+#define SCHEME_ATOM_ARG(who, v, atom) \
+    if (!((atom) = scheme_atom(v))) return scheme_fail(who, "atom not found")
+
+static SchemeValue sb_atom_type(int argc, SchemeValue *argv) {
+    Atom atom;
+    (void)argc;
+    SCHEME_ATOM_ARG("atom-type", argv[0], atom);
+    return scheme_symbol(hypergraph_type_name(hypergraph_atom_type(atom)));
+}
+
+static SchemeValue sb_atom_name(int argc, SchemeValue *argv) {
+    Atom atom;
+    const char *name;
+    (void)argc;
+    SCHEME_ATOM_ARG("atom-name", argv[0], atom);
+    name = hypergraph_atom_name(atom);
+    return name ? scheme_string(name) : SCHEME_FALSE;
+}
+
+static SchemeValue sb_atom_outgoing(int argc, SchemeValue *argv) {
+    Atom atom;
+    uint32_t arity;
+    const Atom *out;
+    (void)argc;
+    SCHEME_ATOM_ARG("atom-outgoing", argv[0], atom);
+    out = hypergraph_outgoing(atom, &arity);
+    return scheme_atom_list(out, out ? arity : 0);
+}
+
+static SchemeValue sb_atom_incoming(int argc, SchemeValue *argv) {
+    Atom atom, link;
+    uint32_t cursor = 0;
+    SchemeValue list = SCHEME_NIL;
+    (void)argc;
+    SCHEME_ATOM_ARG("atom-incoming", argv[0], atom);
+    while ((link = hypergraph_incoming_next(atom, &cursor)) != 0) {
+        list = scheme_cons(scheme_integer(link), list);
+    }
+    return list;
+}
+
+/* (atom-tv atom) is (strength confidence) */
+static SchemeValue sb_atom_tv(int argc, SchemeValue *argv) {
+    Atom atom;
+    float strength, confidence;
+    (void)argc;
+    SCHEME_ATOM_ARG("atom-tv", argv[0], atom);
+    hypergraph_get_tv(atom, &strength, &confidence);
+    return scheme_cons(scheme_float(strength), scheme_cons(scheme_float(confidence), SCHEME_NIL));
+}
+
+static SchemeValue sb_atom_set_tv(int argc, SchemeValue *argv) {
+    Atom atom;
+    double strength, confidence;
+    (void)argc;
+    SCHEME_ATOM_ARG("atom-set-tv!", argv[0], atom);
+    if (!scheme_get_real(argv[1], &strength) || !scheme_get_real(argv[2], &confidence) ||
+        strength < 0 || strength > 1 || confidence < 0 || confidence > 1) {
+        return scheme_fail("atom-set-tv!", "strength and confidence must be in [0,1]");
+    }
+    hypergraph_set_tv(atom, (float)strength, (float)confidence);
+    return scheme_integer(atom);
+}
+
+/* (atom-av atom) is (sti lti) */
+static SchemeValue sb_atom_av(int argc, SchemeValue *argv) {
+    Atom atom;
+    float sti, lti;
+    (void)argc;
+    SCHEME_ATOM_ARG("atom-av", argv[0], atom);
+    hypergraph_get_av(atom, &sti, &lti);
+    return scheme_cons(scheme_float(sti), scheme_cons(scheme_float(lti), SCHEME_NIL));
+}
+
+static SchemeValue sb_atom_to_string(int argc, SchemeValue *argv) {
+    Atom atom;
+    (void)argc;
+    SCHEME_ATOM_ARG("atom->string", argv[0], atom);
+    return scheme_text(hypergraph_text_tv(atom), "atom->string");
+}
+
+static SchemeValue sb_atoms_of_type(int argc, SchemeValue *argv) {
+    const char *type = scheme_get_string(argv[0]);
+    const Atom *atoms;
+    size_t count = 0;
+    uint16_t t;
+    (void)argc;
+    if (!type) return scheme_fail("atoms-of-type", "type must be a string");
+    t = hypergraph_type_lookup(type);
+    if (!t) return SCHEME_NIL;
+    atoms = hypergraph_atoms_of_type(t, &count);
+    return scheme_atom_list(atoms, atoms ? count : 0);
+}
+
+typedef struct {
+    Atom *groundings;
+    size_t count, capacity;
+    int vars, failed;
+} SchemeMatches;
+
+static void scheme_collect_grounding(void *ctx, const Atom *grounding) {
+    SchemeMatches *m = ctx;
+    if (m->failed) return;
+    if (m->count + m->vars > m->capacity) {
+        size_t capacity = m->capacity ? m->capacity * 2 : 64 * (size_t)m->vars;
+        Atom *grown = realloc(m->groundings, capacity * sizeof(Atom));
+        if (!grown) {
+            m->failed = 1;
+            return;
+        }
+        m->groundings = grown;
+        m->capacity = capacity;
+    }
+    memcpy(m->groundings + m->count, grounding, m->vars * sizeof(Atom));
+    m->count += m->vars;
+}
+
+/* (pattern-match clause...) is a list of groundings, each an alist
+ * from variable names to handles */
+static SchemeValue sb_pattern_match(int argc, SchemeValue *argv) {
+    const char *clauses[PATTERN_MAX_CLAUSES], *error;
+    SchemeMatches m = { NULL, 0, 0, 0, 0 };
+    SchemeValue result = SCHEME_NIL, names = SCHEME_NIL;
+    Pattern *pattern;
+    int i;
+    if (argc > PATTERN_MAX_CLAUSES) return scheme_fail("pattern-match", "too many clauses");
+    for (i = 0; i < argc; i++) {
+        if (!(clauses[i] = scheme_get_string(argv[i]))) return scheme_fail("pattern-match", "clauses must be strings");
+    }
+    pattern = pattern_compile(clauses, argc, &error);
+    if (!pattern) return scheme_fail("pattern-match", error);
+    m.vars = pattern_var_count(pattern);
+    if (m.vars > 0) pattern_run(pattern, 0, scheme_collect_grounding, &m);
+    for (i = m.vars; i-- > 0;) names = scheme_cons(scheme_symbol(pattern_var_name(pattern, i)), names);
+    pattern_free(pattern);
+    if (m.failed) {
+        free(m.groundings);
+        return scheme_fail("pattern-match", "out of memory");
+    }
+    while (m.count > 0) {
+        SchemeValue row = SCHEME_NIL, n = names;
+        const Atom *g;
+        m.count -= m.vars;
+        g = m.groundings + m.count;
+        for (i = 0; i < m.vars; i++, n = scheme_cdr(n)) {
+            row = scheme_cons(scheme_cons(scheme_car(n), scheme_integer(g[i])), row);
+        }
+        row = scheme_reverse(row);
+        result = scheme_cons(row, result);
+    }
+    free(m.groundings);
+    return result;
+}
+
+static SchemeValue scheme_conclusions(void) {
+    size_t count = pln_conclusions(NULL, 0);
+    Atom *atoms = count ? malloc(count * sizeof(Atom)) : NULL;
+    SchemeValue list;
+    if (count && !atoms) return scheme_fail("pln-infer", "out of memory");
+    count = pln_conclusions(atoms, count);
+    list = scheme_atom_list(atoms, count);
+    free(atoms);
+    return list;
+}
+
+/* (pln-infer atom...) forward chains from the premises and returns the
+ * atoms whose truth value changed */
+static SchemeValue sb_pln_infer(int argc, SchemeValue *argv) {
+    PlnBudget budget = { PLN_MAX_STEPS, PLN_MAX_SECONDS };
+    PlnStats stats;
+    Atom premises[64];
+    int i;
+    if (argc > 64) return scheme_fail("pln-infer", "too many premises");
+    for (i = 0; i < argc; i++) {
+        if (!(premises[i] = scheme_atom(argv[i]))) return scheme_fail("pln-infer", "atom not found");
+    }
+    if (pln_forward(premises, argc, &budget, &stats) != 0) return scheme_fail("pln-infer", "out of memory");
+    return scheme_conclusions();
+}
+
+/* (pln-backward target) derives the target's truth value */
+static SchemeValue sb_pln_backward(int argc, SchemeValue *argv) {
+    PlnBudget budget = { PLN_MAX_STEPS, PLN_MAX_SECONDS };
+    PlnStats stats;
+    Atom target;
+    (void)argc;
+    SCHEME_ATOM_ARG("pln-backward", argv[0], target);
+    if (pln_backward(target, &budget, &stats) != 0) return scheme_fail("pln-backward", "out of memory");
+    return sb_atom_tv(1, argv);
+}
+
+/* (attention-stimulate atom [amount]) returns the STI given */
+static SchemeValue sb_attention_stimulate(int argc, SchemeValue *argv) {
+    Atom atom;
+    double amount = ECAN_STIMULUS;
+    SCHEME_ATOM_ARG("attention-stimulate", argv[0], atom);
+    if (argc > 1 && !scheme_get_real(argv[1], &amount)) return scheme_fail("attention-stimulate", "amount must be a number");
+    return scheme_float(ecan_stimulate(atom, (float)amount));
+}
+
+/* (attention-tick [n]) returns the focus size */
+static SchemeValue sb_attention_tick(int argc, SchemeValue *argv) {
+    EcanTick tick;
+    long n = 1;
+    memset(&tick, 0, sizeof(tick));
+    if (argc > 0 && (!scheme_get_integer(argv[0], &n) || n < 0)) return scheme_fail("attention-tick", "bad tick count");
+    while (n-- > 0) {
+        if (ecan_tick(&tick) != 0) return scheme_fail("attention-tick", "out of memory");
+    }
+    return scheme_integer((long)ecan_focus(NULL, 0));
+}
+
+/* (attention-focus [max]) lists focus atoms by descending STI */
+static SchemeValue sb_attention_focus(int argc, SchemeValue *argv) {
+    long max = 10;
+    Atom *atoms;
+    size_t count;
+    SchemeValue list;
+    if (argc > 0 && (!scheme_get_integer(argv[0], &max) || max < 0)) return scheme_fail("attention-focus", "bad count");
+    atoms = malloc((max ? max : 1) * sizeof(Atom));
+    if (!atoms) return scheme_fail("attention-focus", "out of memory");
+    count = ecan_focus(atoms, max);
+    if (count > (size_t)max) count = max;
+    list = scheme_atom_list(atoms, count);
+    free(atoms);
+    return list;
+}
+
+#if ENABLE_TENSOR_OPERATIONS
+static void *scheme_tensor(SchemeValue v) {
+    long handle;
+    char ref[32];
+    if (scheme_get_integer(v, &handle)) {
+        snprintf(ref, sizeof(ref), "%ld", handle);
+        return tensor_find(ref);
+    }
+    return scheme_get_string(v) ? tensor_find(scheme_get_string(v)) : NULL;
+}
+
+/* (tensor-create name dim...) returns the handle; name may be #f */
+static SchemeValue sb_tensor_create(int argc, SchemeValue *argv) {
+    int dims[TENSOR_MAX_DIMS];
+    long d;
+    int i;
+    void *tensor;
+    if (argc - 1 > TENSOR_MAX_DIMS) return scheme_fail("tensor-create", "too many dimensions");
+    for (i = 1; i < argc; i++) {
+        if (!scheme_get_integer(argv[i], &d) || d <= 0 || d > INT32_MAX) return scheme_fail("tensor-create", "bad dimension");
+        dims[i - 1] = (int)d;
+    }
+    tensor = tensor_create_named(dims, argc - 1, argv[0] == SCHEME_FALSE ? NULL : scheme_get_string(argv[0]));
+    if (!tensor) return scheme_fail("tensor-create", "cannot create tensor");
+    return scheme_integer(tensor_handle(tensor));
+}
+
+/* (tensor-op tensor op [operand]): reductions return their value,
+ * other operations the tensor's handle */
+static SchemeValue sb_tensor_op(int argc, SchemeValue *argv) {
+    void *tensor = scheme_tensor(argv[0]), *other = NULL;
+    const char *op = scheme_get_string(argv[1]);
+    double operand = 0.0;
+    float value;
+    int result;
+    if (!tensor) return scheme_fail("tensor-op", "tensor not found");
+    if (!op) return scheme_fail("tensor-op", "operation must be a string");
+    if (argc < 3) {
+        result = tensor_compute(tensor, op, &value);
+        if (result < 0) return scheme_fail("tensor-op", "unknown operation");
+        return result == 1 ? scheme_float(value) : scheme_integer(tensor_handle(tensor));
+    }
+    if (!scheme_get_real(argv[2], &operand) && !(other = scheme_tensor(argv[2]))) {
+        return scheme_fail("tensor-op", "operand not found");
+    }
+    if (tensor_apply(tensor, op, (float)operand, other) != 0) return scheme_fail("tensor-op", "operation failed");
+    return scheme_integer(tensor_handle(tensor));
+}
+
+static SchemeValue sb_tensor_destroy(int argc, SchemeValue *argv) {
+    void *tensor = scheme_tensor(argv[0]);
+    (void)argc;
+    if (!tensor) return scheme_fail("tensor-destroy", "tensor not found");
+    tensor_destroy(tensor);
+    return SCHEME_TRUE;
+}
+
+static void *scheme_membrane(SchemeValue v) {
+    long id;
+    return scheme_get_integer(v, &id) && id > 0 && id <= UINT32_MAX ?
+        tensor_membrane_find_by_id_prime((uint32_t)id) : NULL;
+}
+
+/* (membrane-create prime...) returns the membrane id */
+static SchemeValue sb_membrane_create(int argc, SchemeValue *argv) {
+    int factors[16];
+    long f;
+    int i;
+    void *membrane;
+    if (argc > 16) return scheme_fail("membrane-create", "too many factors");
+    for (i = 0; i < argc; i++) {
+        if (!scheme_get_integer(argv[i], &f) || f < 2 || f > INT32_MAX) return scheme_fail("membrane-create", "bad prime factor");
+        factors[i] = (int)f;
+    }
+    membrane = tensor_membrane_create_prime(factors, argc);
+    if (!membrane) return scheme_fail("membrane-create", "cannot create membrane");
+    return scheme_integer(tensor_membrane_get_id_prime(membrane));
+}
+
+static int scheme_indices(SchemeValue *argv, int count, uint32_t *indices) {
+    long index;
+    for (int i = 0; i < count; i++) {
+        if (!scheme_get_integer(argv[i], &index) || index < 0 || index > UINT32_MAX) return -1;
+        indices[i] = (uint32_t)index;
+    }
+    return 0;
+}
+
+/* (membrane-get id index...) */
+static SchemeValue sb_membrane_get(int argc, SchemeValue *argv) {
+    void *membrane = scheme_membrane(argv[0]);
+    uint32_t indices[16];
+    float value;
+    if (!membrane) return scheme_fail("membrane-get", "membrane not found");
+    if (argc - 1 > 16 || scheme_indices(argv + 1, argc - 1, indices) != 0 ||
+        tensor_membrane_get_element_prime(membrane, indices, argc - 1, &value) != 0) {
+        return scheme_fail("membrane-get", "bad index");
+    }
+    return scheme_float(value);
+}
+
+/* (membrane-set! id value index...) */
+static SchemeValue sb_membrane_set(int argc, SchemeValue *argv) {
+    void *membrane = scheme_membrane(argv[0]);
+    uint32_t indices[16];
+    double value;
+    if (!membrane) return scheme_fail("membrane-set!", "membrane not found");
+    if (!scheme_get_real(argv[1], &value)) return scheme_fail("membrane-set!", "value must be a number");
+    if (argc - 2 > 16 || scheme_indices(argv + 2, argc - 2, indices) != 0 ||
+        tensor_membrane_set_element_prime(membrane, indices, argc - 2, (float)value) != 0) {
+        return scheme_fail("membrane-set!", "bad index");
+    }
+    return SCHEME_UNSPECIFIED;
+}
+
+/* (membrane-add-object! id symbol [count]) */
+static SchemeValue sb_membrane_add_object(int argc, SchemeValue *argv) {
+    void *membrane = scheme_membrane(argv[0]);
+    const char *symbol = scheme_get_string(argv[1]);
+    long count = 1;
+    if (!membrane) return scheme_fail("membrane-add-object!", "membrane not found");
+    if (!symbol) return scheme_fail("membrane-add-object!", "object must be a symbol");
+    if (argc > 2 && (!scheme_get_integer(argv[2], &count) || count <= 0 || count > INT32_MAX)) {
+        return scheme_fail("membrane-add-object!", "bad count");
+    }
+    if (tensor_membrane_add_objects_prime(membrane, symbol, (int)count) != 0) {
+        return scheme_fail("membrane-add-object!", "cannot add objects");
+    }
+    return SCHEME_UNSPECIFIED;
+}
+
+/* (membrane-rule id "a b -> c (d, out)") */
+static SchemeValue sb_membrane_rule(int argc, SchemeValue *argv) {
+    long id;
+    const char *text = scheme_get_string(argv[1]), *error = NULL;
+    (void)argc;
+    if (!scheme_get_integer(argv[0], &id) || !scheme_membrane(argv[0])) return scheme_fail("membrane-rule", "membrane not found");
+    if (!text) return scheme_fail("membrane-rule", "rule must be a string");
+    if (psystem_add_rule((uint32_t)id, text, &error) != 0) return scheme_fail("membrane-rule", error ? error : "cannot add rule");
+    return SCHEME_UNSPECIFIED;
+}
+
+/* (membrane-evolve steps [seed]) returns the rule applications */
+static SchemeValue sb_membrane_evolve(int argc, SchemeValue *argv) {
+    PSystemStats stats;
+    long steps, seed = 0;
+    if (!scheme_get_integer(argv[0], &steps) || steps < 0 || steps > UINT32_MAX) return scheme_fail("membrane-evolve", "bad step count");
+    if (argc > 1 && !scheme_get_integer(argv[1], &seed)) return scheme_fail("membrane-evolve", "bad seed");
+    if (psystem_evolve((uint32_t)steps, (uint64_t)seed, &stats) != 0) return scheme_fail("membrane-evolve", "evolution failed");
+    return scheme_integer((long)stats.applications);
+}
+#endif
+
+static const struct {
+    const char *name;
+    SchemePrimitive fn;
+    int min_args, max_args;
+} scheme_bindings[] = {
+    { "hypergraph-add", sb_hypergraph_add, 1, 1 },
+    { "hypergraph-node", sb_hypergraph_node, 2, 2 },
+    { "hypergraph-link", sb_hypergraph_link, 1, -1 },
+    { "hypergraph-find", sb_hypergraph_find, 1, 1 },
+    { "atom-type", sb_atom_type, 1, 1 },
+    { "atom-name", sb_atom_name, 1, 1 },
+    { "atom-outgoing", sb_atom_outgoing, 1, 1 },
+    { "atom-incoming", sb_atom_incoming, 1, 1 },
+    { "atom-tv", sb_atom_tv, 1, 1 },
+    { "atom-set-tv!", sb_atom_set_tv, 3, 3 },
+    { "atom-av", sb_atom_av, 1, 1 },
+    { "atom->string", sb_atom_to_string, 1, 1 },
+    { "atoms-of-type", sb_atoms_of_type, 1, 1 },
+    { "pattern-match", sb_pattern_match, 1, -1 },
+    { "pln-infer", sb_pln_infer, 1, -1 },
+    { "pln-backward", sb_pln_backward, 1, 1 },
+    { "attention-stimulate", sb_attention_stimulate, 1, 2 },
+    { "attention-tick", sb_attention_tick, 0, 1 },
+    { "attention-focus", sb_attention_focus, 0, 1 },
+#if ENABLE_TENSOR_OPERATIONS
+    { "tensor-create", sb_tensor_create, 2, -1 },
+    { "tensor-op", sb_tensor_op, 2, 3 },
+    { "tensor-destroy", sb_tensor_destroy, 1, 1 },
+    { "membrane-create", sb_membrane_create, 1, -1 },
+    { "membrane-get", sb_membrane_get, 2, -1 },
+    { "membrane-set!", sb_membrane_set, 3, -1 },
+    { "membrane-add-object!", sb_membrane_add_object, 2, 3 },
+    { "membrane-rule", sb_membrane_rule, 2, 2 },
+    { "membrane-evolve", sb_membrane_evolve, 1, 2 },
+#endif
+    { NULL, NULL, 0, 0 }
+};
+
+static int scheme_register_bindings(void) {
+    for (int i = 0; scheme_bindings[i].name; i++) {
+        if (scheme_vm_define(scheme_bindings[i].name, scheme_bindings[i].fn,
+                             scheme_bindings[i].min_args, scheme_bindings[i].max_args) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+#endif
+
 /* Distributed Network Protocols Implementation */
 #if ENABLE_DISTRIBUTED_PROTOCOLS
 
@@ -975,59 +1843,326 @@ void b_ipc_recv(char **av) {
     fprint(1, "Received %d bytes: %s\n", received, buffer);
 }
 
+/* Reads a whole file into a malloc'd string */
+static char *scheme_read_file(const char *path) {
+    int fd = open(path, O_RDONLY);
+    size_t len = 0, size = 4096;
+    char *text = malloc(size);
+    ssize_t n;
+    if (fd < 0 || !text) {
+        if (fd >= 0) close(fd);
+        free(text);
+        return NULL;
+    }
+    while ((n = read(fd, text + len, size - len - 1)) > 0) {
+        len += n;
+        if (len + 1 == size) {
+            char *grown = realloc(text, size * 2);
+            if (!grown) break;
+            text = grown;
+            size *= 2;
+        }
+    }
+    close(fd);
+    if (n != 0) {
+        free(text);
+        return NULL;
+    }
+    text[len] = '\0';
+    return text;
+}
+
+/* scheme-eval [-f file] [expr ...] evaluates the file, then the
+ * arguments joined by spaces, and prints the value of the last
+ * expression; the status is false when that value is #f.
+ * scheme-eval -s prints the collector's statistics. */
 void b_scheme_eval(char **av) {
-    if (!av[1]) {
-        rc_error("scheme-eval: missing expression argument");
+    const char *file = NULL;
+    char *text;
+    size_t len = 0;
+    int i, result;
+    
+    if (av[1] && strcmp(av[1], "-s") == 0) {
+#if ENABLE_SCHEME_INTEGRATION
+        SchemeStats stats;
+        if (av[2]) {
+            rc_error("scheme-eval: usage: scheme-eval -s");
+            return;
+        }
+        if (!scheme_vm_ready) {
+            rc_error("scheme-eval: no interpreter");
+            return;
+        }
+        scheme_vm_stats(&stats);
+        fprint(1, "heap: %d bytes live, %d allocated since, %d collections (%d ms), %d symbols\n",
+               (int)stats.heap_bytes, (int)stats.allocated, (int)stats.collections,
+               (int)(stats.gc_seconds * 1000.0), (int)stats.symbols);
+#endif
+        return;
+    }
+    if (av[1] && strcmp(av[1], "-f") == 0) {
+        file = av[2];
+        if (!file) {
+            rc_error("scheme-eval: usage: scheme-eval [-f file] [expr ...] | -s");
+            return;
+        }
+        av += 2;
+    }
+    if (!file && !av[1]) {
+        rc_error("scheme-eval: usage: scheme-eval [-f file] [expr ...] | -s");
         return;
     }
-    int result = scheme_eval(av[1]);
-    fprint(1, "Scheme evaluation result: %d\n", result);
+    if (file) {
+        text = scheme_read_file(file);
+        if (!text) {
+            fprint(2, "scheme-eval: cannot read %s\n", file);
+            rc_error(NULL);
+            return;
+        }
+        len = strlen(text);
+    } else {
+        text = NULL;
+    }
+    for (i = 1; av[i]; i++) {
+        size_t n = strlen(av[i]);
+        char *grown = realloc(text, len + n + 2);
+        if (!grown) {
+            free(text);
+            rc_error("scheme-eval: out of memory");
+            return;
+        }
+        text = grown;
+        if (len > 0) text[len++] = file && i == 1 ? '\n' : ' ';
+        memcpy(text + len, av[i], n + 1);
+        len += n;
+    }
+    result = scheme_eval(text);
+    free(text);
     
-    /* Show result buffer if available */
-    #if ENABLE_SCHEME_INTEGRATION
-    if (strlen(scheme_eval_buffer) > 0) {
-        fprint(1, "Scheme output: %s\n", scheme_eval_buffer);
+#if ENABLE_SCHEME_INTEGRATION
+    if (result != 0) {
+        fprint(2, "scheme-eval: %s\n", scheme_output ? scheme_output : "no interpreter");
+        rc_error(NULL);
+        return;
     }
-    #endif
+    if (scheme_output && *scheme_output) fprint(1, "%s\n", scheme_output);
+    set(!scheme_output || strcmp(scheme_output, "#f") != 0);
+#else
+    set(result == 0);
+#endif
 }
 
+/* hypergraph-encode <data>...: adds S-expressions to the store as
+ * written, plain text as a word sequence, and prints each root with its
+ * handle.  Each argument is encoded on its own. */
 void b_hypergraph_encode(char **av) {
     if (!av[1]) {
         rc_error("hypergraph-encode: missing data argument");
         return;
     }
     
-    /* Use the registered hypergraph kernel */
-    HypergraphKernel *kernel = find_hypergraph_kernel("default");
-    if (kernel && kernel->encode) {
-        char *result = NULL;
-        int status = kernel->encode(av[1], &result);
-        if (status == 0 && result) {
-            fprint(1, "Hypergraph encoding: %s\n", result);
-            efree(result);
+    for (int i = 1; av[i]; i++) {
+        const char *text = av[i];
+        const char *error = NULL;
+        while (*text) {
+            Atom atom = hypergraph_insert(&text, &error);
+            if (error) {
+                fprint(2, "hypergraph-encode: %s\n", error);
+                rc_error(NULL);
+                return;
+            }
+            if (atom) hypergraph_print(atom);
+        }
+    }
+}
+
+/* hypergraph-query <atom> | -n <name> | -t <type> | -i <atom> | -o <atom> | -s
+ * Every form is an index lookup: by handle or hash, by type list, or
+ * along an incoming or outgoing set.  An atom is a handle or an
+ * S-expression, which is looked up without being added. */
+void b_hypergraph_query(char **av) {
+    if (!av[1]) {
+        rc_error("hypergraph-query: usage: hypergraph-query <atom> | -n <name> | -t <type> | -i <atom> | -o <atom> | -s");
+        return;
+    }
+    
+    if (strcmp(av[1], "-s") == 0) {
+        size_t count = hypergraph_atom_count(), links = hypergraph_link_count();
+        fprint(1, "atoms: %d (nodes: %d, links: %d)\n", (int)count, (int)(count - links), (int)links);
+        for (uint16_t t = 1; t <= hypergraph_type_count(); t++) {
+            size_t n;
+            hypergraph_atoms_of_type(t, &n);
+            if (n) fprint(1, "  %s: %d\n", hypergraph_type_name(t), (int)n);
+        }
+        return;
+    }
+    
+    if (av[1][0] != '-') {
+        const char *error;
+        Atom atom = hypergraph_ref(av[1], &error);
+        if (!atom) {
+            fprint(2, "hypergraph-query: %s\n", error);
+            rc_error(NULL);
             return;
         }
+        hypergraph_print(atom);
+        return;
     }
     
-    /* Fallback: use scheme_call */
-    char *result = scheme_call("hypergraph-encode", &av[1]);
-    if (result) {
-        fprint(1, "Hypergraph encoding: %s\n", result);
-        efree(result);
-    } else {
-        /* Last fallback: simple encoding simulation */
-        fprint(1, "Hypergraph encoded: [%s]\n", av[1]);
+    if (!av[2] || av[1][1] == '\0' || av[1][2] != '\0') {
+        rc_error("hypergraph-query: usage: hypergraph-query <atom> | -n <name> | -t <type> | -i <atom> | -o <atom> | -s");
+        return;
+    }
+    
+    switch (av[1][1]) {
+    case 'n': {
+        Atom found[HYPERGRAPH_MAX_TYPES];
+        size_t n = hypergraph_find_name(av[2], found, HYPERGRAPH_MAX_TYPES);
+        for (size_t i = 0; i < n && i < HYPERGRAPH_MAX_TYPES; i++) hypergraph_print(found[i]);
+        break;
+    }
+    case 't': {
+        uint16_t type = hypergraph_type_lookup(av[2]);
+        if (!type) {
+            rc_error("hypergraph-query: unknown atom type");
+            return;
+        }
+        size_t n;
+        const Atom *atoms = hypergraph_atoms_of_type(type, &n);
+        for (size_t i = 0; i < n; i++) hypergraph_print(atoms[i]);
+        break;
+    }
+    case 'i': {
+        const char *error;
+        Atom atom = hypergraph_ref(av[2], &error);
+        if (!atom) {
+            fprint(2, "hypergraph-query: %s\n", error);
+            rc_error(NULL);
+            return;
+        }
+        uint32_t cursor = 0;
+        Atom link;
+        while ((link = hypergraph_incoming_next(atom, &cursor)) != 0) hypergraph_print(link);
+        break;
+    }
+    case 'o': {
+        const char *error;
+        Atom atom = hypergraph_ref(av[2], &error);
+        if (!atom) {
+            fprint(2, "hypergraph-query: %s\n", error);
+            rc_error(NULL);
+            return;
+        }
+        uint32_t arity;
+        const Atom *out = hypergraph_outgoing(atom, &arity);
+        for (uint32_t i = 0; i < arity; i++) hypergraph_print(out[i]);
+        break;
+    }
+    default:
+        rc_error("hypergraph-query: usage: hypergraph-query <atom> | -n <name> | -t <type> | -i <atom> | -o <atom> | -s");
+    }
+}
+
+/* hypergraph-save <file> writes the store as a binary image */
+void b_hypergraph_save(char **av) {
+    if (!av[1]) {
+        rc_error("hypergraph-save: usage: hypergraph-save <file>");
+        return;
     }
+    
+    const char *error;
+    if (hypergraph_save(av[1], &error) != 0) {
+        fprint(2, "hypergraph-save: %s: %s\n", av[1], error);
+        rc_error(NULL);
+        return;
+    }
+    fprint(1, "Saved %d atoms (%d links) to %s\n", (int)hypergraph_atom_count(),
+           (int)hypergraph_link_count(), av[1]);
 }
 
+/* hypergraph-load <file> replaces the store with a saved image.  PLN
+ * derivations are forgotten and the attentional focus is rebuilt from
+ * the STI the loaded atoms carry. */
+void b_hypergraph_load(char **av) {
+    if (!av[1]) {
+        rc_error("hypergraph-load: usage: hypergraph-load <file>");
+        return;
+    }
+    
+    const char *error;
+    if (hypergraph_load(av[1], &error) != 0) {
+        fprint(2, "hypergraph-load: %s: %s\n", av[1], error);
+        rc_error(NULL);
+        return;
+    }
+    pln_reset();
+    ecan_refocus();
+    fprint(1, "Loaded %d atoms (%d links) from %s\n", (int)hypergraph_atom_count(),
+           (int)hypergraph_link_count(), av[1]);
+}
+
+static void pattern_print(void *ctx, const Atom *grounding) {
+    int vars = *(int*)ctx;
+    for (int i = 0; i < vars; i++) {
+        fprint(1, i ? " %d" : "%d", (int)grounding[i]);
+    }
+    if (vars) fprint(1, "\n");
+}
+
+/* pattern-match [-p] [-l limit] <clause>...
+ * Clauses are atom S-expressions with $variables, matched against the
+ * hypergraph store.  Each grounding is printed as one line of handles,
+ * one per variable in order of first appearance, so that a backquote
+ * reads them as a list.  -p prints the join plan first.  The status is
+ * false when nothing matches.
+ * pattern-match <pattern> <data> with plain text arguments still goes
+ * to the pattern_recognition module, or to substring search. */
 void b_pattern_match(char **av) {
-    if (!av[1] || !av[2]) {
-        rc_error("pattern-match: missing pattern or data argument");
+    int explain = 0;
+    size_t limit = 0;
+    
+    for (av++; *av && (*av)[0] == '-'; av++) {
+        if (strcmp(*av, "-p") == 0) {
+            explain = 1;
+        } else if (strcmp(*av, "-l") == 0 && av[1]) {
+            limit = strtoul(*++av, NULL, 10);
+        } else {
+            break;
+        }
+    }
+    if (!av[0] || (av[0][0] != '(' && !av[1])) {
+        rc_error("pattern-match: usage: pattern-match [-p] [-l limit] <clause>...");
         return;
     }
     
-    const char *pattern = av[1];
-    const char *data = av[2];
+    if (av[0][0] == '(') {
+        int count = 0;
+        while (av[count]) count++;
+        const char *error;
+        Pattern *pattern = pattern_compile((const char **)av, count, &error);
+        if (!pattern) {
+            fprint(2, "pattern-match: %s\n", error);
+            rc_error(NULL);
+            return;
+        }
+        if (explain) {
+            char plan[512];
+            pattern_explain(pattern, plan, sizeof(plan));
+            fprint(1, "plan:");
+            for (int i = 0; i < pattern_var_count(pattern); i++) {
+                fprint(1, " $%s", pattern_var_name(pattern, i));
+            }
+            fprint(1, "; %s\n", plan);
+        }
+        int vars = pattern_var_count(pattern);
+        size_t matched = pattern_run(pattern, limit, pattern_print, &vars);
+        pattern_free(pattern);
+        set(matched != 0);
+        return;
+    }
+    
+    const char *text = av[0];
+    const char *data = av[1];
     
     /* Simple pattern matching using cognitive modules */
     CognitiveModule *module = find_cognitive_module("pattern_recognition");
@@ -1042,39 +2177,114 @@ void b_pattern_match(char **av) {
         }
     } else {
         /* Fallback: simple string matching */
-        if (strstr(data, pattern)) {
-            fprint(1, "Pattern matched: %s found in %s\n", pattern, data);
+        if (strstr(data, text)) {
+            fprint(1, "Pattern matched: %s found in %s\n", text, data);
         } else {
-            fprint(1, "Pattern not matched: %s not found in %s\n", pattern, data);
+            fprint(1, "Pattern not matched: %s not found in %s\n", text, data);
         }
     }
 }
 
+#define ECAN_REPORT 10                  /* focus atoms listed without -f */
+
+static void attention_print(Atom atom) {
+    char *text = hypergraph_text(atom);
+    char av[64];
+    float sti, lti;
+    
+    if (!text) return;
+    hypergraph_get_av(atom, &sti, &lti);
+    snprintf(av, sizeof av, "(av %g %g)", sti, lti);
+    fprint(1, "%d %s %s\n", (int)atom, av, text);
+    free(text);
+}
+
+/* attention-allocate [-n ticks] [-f] [<atom> | <text>] [amount]
+ * Drives the ECAN engine.  An atom argument (a handle or an S-expression
+ * already in the store) is stimulated directly; any other text is
+ * encoded first and its ListLink stimulated.  The stimulus comes out of
+ * the funds, so less than the amount asked for may be given.  Then the
+ * engine ticks (once by default) and the focus is reported: a summary
+ * line and the most important atoms, or every focus atom with -f. */
 void b_attention_allocate(char **av) {
-    if (!av[1]) {
-        rc_error("attention-allocate: missing resources argument");
+    unsigned long ticks = 1;
+    int full = 0;
+    
+    while (*++av && **av == '-') {
+        char *end;
+        if (strcmp(*av, "-f") == 0) {
+            full = 1;
+        } else if (strcmp(*av, "-n") == 0 && av[1]) {
+            ticks = strtoul(*++av, &end, 10);
+            if (end == *av || *end) ticks = 0;
+        } else {
+            ticks = 0;
+        }
+        if (ticks == 0) break;
+    }
+    if (ticks == 0 || (av[0] && av[1] && av[2])) {
+        rc_error("attention-allocate: usage: attention-allocate [-n ticks] [-f] [<atom> | <text>] [amount]");
         return;
     }
     
-    const char *resources = av[1];
+    float given = 0.0f;
+    if (*av) {
+        float amount = ECAN_STIMULUS;
+        if (av[1]) {
+            char *end;
+            amount = strtof(av[1], &end);
+            if (end == av[1] || *end || !(amount >= 0.0f)) {
+                rc_error("attention-allocate: bad stimulus amount");
+                return;
+            }
+        }
+        const char *error;
+        Atom atom = hypergraph_ref(av[0], &error);
+        if (!atom && !(atom = hypergraph_encode_words(av[0]))) {
+            rc_error("attention-allocate: nothing to stimulate");
+            return;
+        }
+        given = ecan_stimulate(atom, amount);
+    }
     
-    /* Use ECAN attention allocation */
-    ECANValues ecan;
-    float total_attention = calculate_ecan_attention(resources, &ecan);
+    EcanTick tick;
+    double seconds = 0.0;
+    size_t forgotten = 0;
+    for (unsigned long i = 0; i < ticks; i++) {
+        if (ecan_tick(&tick) < 0) {
+            rc_error("attention-allocate: out of memory");
+            return;
+        }
+        seconds += tick.seconds;
+        forgotten += tick.forgotten;
+    }
+    
+    EcanParams params;
+    char line[160];
+    ecan_get_params(&params);
+    snprintf(line, sizeof line, "ECAN tick %lu: focus %d/%d, stimulus %g, forgotten %d, funds %g, %.3f ms",
+             tick.ticks, (int)tick.focus, (int)params.focus_size, given, (int)forgotten,
+             params.funds, seconds * 1000.0 / ticks);
+    fprint(1, "%s\n", line);
     
     AttentionState *state = get_attention_state();
-    state->total_attention = total_attention;
-    state->active_patterns = ecan.stimulation_level / 10; /* Rough estimate */
+    state->total_attention = params.funds;
+    state->active_patterns = (int)tick.focus;
     state->timestamp = time(NULL);
     
-    fprint(1, "ECAN Attention Allocated:\n");
-    fprint(1, "  Total Attention: %d\n", (int)(total_attention * 100));
-    fprint(1, "  Short-term Importance: %d\n", (int)(ecan.short_term_importance * 100));
-    fprint(1, "  Long-term Importance: %d\n", (int)(ecan.long_term_importance * 100));
-    fprint(1, "  Very Long-term Importance: %d\n", (int)(ecan.very_long_term_importance * 100));
-    fprint(1, "  Stimulation Level: %d\n", (int)ecan.stimulation_level);
+    if (tick.focus == 0) return;
+    Atom *focus = malloc(tick.focus * sizeof *focus);
+    if (!focus) {
+        rc_error("attention-allocate: out of memory");
+        return;
+    }
+    size_t n = ecan_focus(focus, tick.focus);
+    if (!full && n > ECAN_REPORT) n = ECAN_REPORT;
+    for (size_t i = 0; i < n; i++) attention_print(focus[i]);
+    free(focus);
 }
 
+/* tensor-create <dims> [name] */
 void b_tensor_create(char **av) {
     if (!av[1]) {
         rc_error("tensor-create: missing dimensions argument");
@@ -1082,12 +2292,12 @@ void b_tensor_create(char **av) {
     }
     
     /* Parse dimensions from string like "2,3,4" */
-    int dims[4];
+    int dims[TENSOR_MAX_DIMS];
     int ndims = 0;
     char *dims_str = ecpy(av[1]);
     char *token = strtok(dims_str, ",");
     
-    while (token && ndims < 4) {
+    while (token && ndims < TENSOR_MAX_DIMS) {
         dims[ndims++] = atoi(token);
         token = strtok(NULL, ",");
     }
@@ -1098,9 +2308,9 @@ void b_tensor_create(char **av) {
         return;
     }
     
-    void *tensor = tensor_create(dims, ndims);
+    void *tensor = tensor_create_named(dims, ndims, av[2]);
     if (!tensor) {
-        rc_error("tensor-create: failed to create tensor");
+        rc_error("tensor-create: failed to create tensor (bad dimensions, or name taken or numeric)");
         return;
     }
     
@@ -1109,29 +2319,84 @@ void b_tensor_create(char **av) {
         fprint(1, "%d", dims[i]);
         if (i < ndims - 1) fprint(1, "x");
     }
-    fprint(1, " (ptr: %lx)\n", (unsigned long)tensor);
+    fprint(1, " (handle: %d, name: %s)\n", (int)tensor_handle(tensor), tensor_name(tensor));
+}
+
+void b_tensor_destroy(char **av) {
+    if (!av[1]) {
+        rc_error("tensor-destroy: usage: tensor-destroy <tensor>");
+        return;
+    }
+    
+    void *tensor = tensor_find(av[1]);
+    if (!tensor) {
+        rc_error("tensor-destroy: tensor not found");
+        return;
+    }
+    
+    fprint(1, "Destroyed tensor %s\n", tensor_name(tensor));
+    tensor_destroy(tensor);
 }
 
+void b_tensor_list(char **av) {
+    (void)av;
+    char plan[256];
+    
+    for (uint32_t i = 0; i < tensor_slot_high; i++) {
+        SimpleTensor *tensor = tensor_slots[i].tensor;
+        if (!tensor) continue;
+        tensor_describe(tensor, plan, sizeof(plan));
+        fprint(1, "%d %s %s\n", (int)tensor->handle, symbol_name(tensor->name), plan);
+    }
+}
+
+/* tensor-op <tensor> <op> [value|tensor], tensors given by handle or
+ * name.  Elementwise operations, matmul and
+ * conv2d only extend the tensor's expression; reductions evaluate it,
+ * fusing the pending elementwise chain into a single pass. */
 void b_tensor_op(char **av) {
     if (!av[1] || !av[2]) {
         rc_error("tensor-op: missing tensor or operation argument");
         return;
     }
     
-    /* Parse tensor pointer from hex string */
-    void *tensor = NULL;
-    unsigned long ptr_val;
-    if (sscanf(av[1], "%lx", &ptr_val) != 1) {
-        rc_error("tensor-op: invalid tensor pointer");
+    void *tensor = tensor_find(av[1]);
+    if (!tensor) {
+        rc_error("tensor-op: tensor not found");
         return;
     }
-    tensor = (void*)ptr_val;
     
     const char *operation = av[2];
-    int result = tensor_compute(tensor, operation);
+    char plan[256];
+    float result;
+    int status;
+    
+    if (strcmp(operation, "plan") == 0) {
+        int passes = tensor_describe(tensor, plan, sizeof(plan));
+        if (passes < 0) {
+            rc_error("tensor-op: invalid tensor");
+            return;
+        }
+        fprint(1, "%s: %d pass%s\n", plan, passes, passes == 1 ? "" : "es");
+        return;
+    }
     
-    if (result >= 0) {
-        fprint(1, "Tensor operation '%s' result: %d\n", operation, result);
+    if (av[3]) {
+        void *other = strcmp(operation, "scale") == 0 || strcmp(operation, "shift") == 0
+                      ? NULL : tensor_find(av[3]);
+        status = tensor_apply(tensor, operation, (float)atof(av[3]), other);
+    } else {
+        status = tensor_compute(tensor, operation, &result);
+    }
+    
+    if (status > 0) {
+        char value[32];
+        snprintf(value, sizeof(value), "%g", result);
+        fprint(1, "Tensor operation '%s' result: %s\n", operation, value);
+    } else if (status == 0) {
+        tensor_describe(tensor, plan, sizeof(plan));
+        fprint(1, "Tensor operation '%s' %s: %s\n", operation,
+               strcmp(operation, "eval") == 0 ? "stored" : "recorded", plan);
     } else {
         fprint(1, "Tensor operation '%s' failed\n", operation);
     }
@@ -1176,48 +2441,103 @@ void b_membrane_alloc(char **av) {
 
 /* Enhanced Tensor Membrane Commands */
 
+/* membrane-create [-r] [-f file | -s name] <factors|-> [parent].  With
+ * -f the membrane lives in file, created with the given shape if
+ * missing; "-" or no factors opens an existing file with its own shape,
+ * and -r maps it read-only.  -s does the same with a named shared memory
+ * segment, for membranes shared between shells and pipeline stages. */
 void b_membrane_create(char **av) {
-    if (!av[1]) {
-        rc_error("membrane-create: missing prime factors argument (e.g., [2,3,5])");
+    const char *path = NULL;
+    int flags = 0;
+    
+    for (; av[1] && av[1][0] == '-' && av[1][1] != '\0'; av++) {
+        if (strcmp(av[1], "-r") == 0) {
+            flags |= MEMBRANE_READONLY;
+        } else if ((strcmp(av[1], "-f") == 0 || strcmp(av[1], "-s") == 0) && av[2] && !path) {
+            if (av[1][1] == 's') flags |= MEMBRANE_SHM;
+            path = av[2];
+            av++;
+        } else {
+            rc_error("membrane-create: usage: membrane-create [-r] [-f file | -s name] <factors|-> [parent]");
+            return;
+        }
+    }
+    if ((flags & MEMBRANE_READONLY) && !path) {
+        rc_error("membrane-create: -r needs -f file or -s name");
         return;
     }
     
-    /* Parse prime factors from string like "[2,3,5]" or "2,3,5" */
-    char *factors_str = av[1];
-    
-    /* Remove brackets if present */
-    if (factors_str[0] == '[') {
-        factors_str++;
-        char *end = strchr(factors_str, ']');
-        if (end) *end = '\0';
+    if (!av[1] && !path) {
+        rc_error("membrane-create: missing prime factors argument (e.g., [2,3,5])");
+        return;
     }
     
     int primes[16];
     int count = 0;
-    char *primes_copy = ecpy(factors_str);
-    char *token = strtok(primes_copy, ",");
-    
-    while (token && count < 16) {
-        int prime = atoi(token);
-        if (prime > 0) {
-            primes[count++] = prime;
+    if (av[1] && strcmp(av[1], "-") != 0) {
+        /* Parse prime factors from string like "[2,3,5]" or "2,3,5" */
+        char *factors_str = av[1];
+        
+        /* Remove brackets if present */
+        if (factors_str[0] == '[') {
+            factors_str++;
+            char *end = strchr(factors_str, ']');
+            if (end) *end = '\0';
+        }
+        
+        char *primes_copy = ecpy(factors_str);
+        char *token = strtok(primes_copy, ",");
+        
+        while (token && count < 16) {
+            int prime = atoi(token);
+            if (prime > 0) {
+                primes[count++] = prime;
+            }
+            token = strtok(NULL, ",");
+        }
+        efree(primes_copy);
+        
+        if (count == 0) {
+            rc_error("membrane-create: invalid prime factors format");
+            return;
         }
-        token = strtok(NULL, ",");
     }
-    efree(primes_copy);
     
-    if (count == 0) {
-        rc_error("membrane-create: invalid prime factors format");
-        return;
+    /* An optional second argument nests the membrane in a parent */
+    void *parent = NULL;
+    if (av[1] && av[2]) {
+        parent = tensor_membrane_find_by_id_prime((uint32_t)atoi(av[2]));
+        if (!parent) {
+            rc_error("membrane-create: parent membrane not found");
+            return;
+        }
     }
     
-    void *membrane = tensor_membrane_create_prime(primes, count);
+    void *membrane;
+    const char *error = NULL;
+    if (path) {
+        membrane = tensor_membrane_open_prime(path, count ? primes : NULL, count, flags,
+                                              parent, &error);
+    } else if (parent) {
+        membrane = tensor_membrane_create_child_prime(parent, primes, count);
+    } else {
+        membrane = tensor_membrane_create_prime(primes, count);
+    }
     if (!membrane) {
+        if (error) {
+            fprint(2, "membrane-create: %s: %s\n", path, error);
+            rc_error(NULL);
+        }
         rc_error("membrane-create: failed to create membrane");
         return;
     }
+    if (error) fprint(2, "membrane-create: %s: %s\n", path, error);
     
     uint32_t id = tensor_membrane_get_id_prime(membrane);
+    if (path) {
+        fprint(1, "Opened tensor membrane (ID: %d) from %s\n", (int)id, path);
+        return;
+    }
     fprint(1, "Created tensor membrane (ID: %d) with prime factors: [", (int)id);
     for (int i = 0; i < count; i++) {
         fprint(1, "%d", primes[i]);
@@ -1226,6 +2546,41 @@ void b_membrane_create(char **av) {
     fprint(1, "]\n");
 }
 
+/* membrane-flush <id> syncs a file-backed membrane with a new checksum;
+ * -c instead checks the data against the last one */
+void b_membrane_flush(char **av) {
+    int check = av[1] && strcmp(av[1], "-c") == 0;
+    if (check) av++;
+    if (!av[1]) {
+        rc_error("membrane-flush: usage: membrane-flush [-c] <id>");
+        return;
+    }
+    
+    uint32_t id = (uint32_t)atoi(av[1]);
+    void *membrane = tensor_membrane_find_by_id_prime(id);
+    if (!membrane) {
+        rc_error("membrane-flush: membrane not found");
+        return;
+    }
+    
+    if (check) {
+        int status = tensor_membrane_verify_prime(membrane);
+        if (status < 0) {
+            rc_error("membrane-flush: membrane is not file-backed");
+            return;
+        }
+        fprint(1, "Membrane %d checksum %s\n", (int)id, status ? "ok" : "mismatch or stale");
+        set(status == 1);
+        return;
+    }
+    
+    if (tensor_membrane_flush_prime(membrane) != 0) {
+        rc_error("membrane-flush: membrane is not a writable file");
+        return;
+    }
+    fprint(1, "Flushed membrane %d\n", (int)id);
+}
+
 void b_membrane_list(char **av) {
     int count = tensor_membrane_get_count_prime();
     fprint(1, "Active tensor membranes: %d\n", count);
@@ -1257,7 +2612,11 @@ void b_membrane_info(char **av) {
     tensor_membrane_print_prime(membrane);
 }
 
+/* membrane-destroy [-u] <id>; -u also removes the backing file or
+ * shared memory segment */
 void b_membrane_destroy(char **av) {
+    int unlink_file = av[1] && strcmp(av[1], "-u") == 0;
+    if (unlink_file) av++;
     if (!av[1]) {
         rc_error("membrane-destroy: missing membrane ID argument");
         return;
@@ -1271,13 +2630,66 @@ void b_membrane_destroy(char **av) {
         return;
     }
     
+    if (unlink_file && tensor_membrane_unlink_prime(membrane) != 0) {
+        rc_error("membrane-destroy: cannot remove the membrane's file");
+        return;
+    }
     tensor_membrane_destroy_prime(membrane);
     fprint(1, "Destroyed membrane %d\n", (int)id);
 }
 
+/* membrane-set <id> - [file] reads "<indices> <value>" lines, one
+ * element per line, without going through the shell for each */
+static void membrane_set_batch(uint32_t id, void *membrane, char *path) {
+    FILE *in = path ? fopen(path, "r") : fdopen(dup(0), "r");
+    if (!in) {
+        rc_error("membrane-set: cannot open input");
+        return;
+    }
+    
+    char *line = NULL;
+    size_t size = 0;
+    int line_number = 0, count = 0;
+    while (getline(&line, &size, in) != -1) {
+        line_number++;
+        char *p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '\n' || *p == '\0' || *p == '#') continue;
+        
+        uint32_t indices[16];
+        int index_count = 0;
+        char *end;
+        for (;;) {
+            unsigned long index = strtoul(p, &end, 10);
+            if (end == p || index_count == 16) break;
+            indices[index_count++] = (uint32_t)index;
+            p = end;
+            if (*p != ',') break;
+            p++;
+        }
+        float value = strtof(p, &end);
+        while (*end == ' ' || *end == '\t' || *end == '\r' || *end == '\n') end++;
+        
+        if (end == p || *end || index_count == 0 ||
+            tensor_membrane_set_element_prime(membrane, indices, index_count, value) != 0) {
+            free(line);
+            fclose(in);
+            fprint(2, "membrane-set: line %d: expected in-range indices and a value\n",
+                   line_number);
+            fprint(1, "Set %d elements of membrane %d\n", count, (int)id);
+            rc_error(NULL);
+        }
+        count++;
+    }
+    free(line);
+    fclose(in);
+    fprint(1, "Set %d elements of membrane %d\n", count, (int)id);
+}
+
 void b_membrane_set(char **av) {
-    if (!av[1] || !av[2] || !av[3]) {
-        rc_error("membrane-set: usage: membrane-set <id> <indices> <value>");
+    int batch = av[1] && av[2] && strcmp(av[2], "-") == 0;
+    if (!av[1] || !av[2] || (!av[3] && !batch)) {
+        rc_error("membrane-set: usage: membrane-set <id> <indices> <value> | <id> - [file]");
         return;
     }
     
@@ -1289,13 +2701,18 @@ void b_membrane_set(char **av) {
         return;
     }
     
+    if (batch) {
+        membrane_set_batch(id, membrane, av[3]);
+        return;
+    }
+    
     /* Parse indices from string like "0,1,2" */
-    uint32_t indices[8];
+    uint32_t indices[16];
     int index_count = 0;
     char *indices_str = ecpy(av[2]);
     char *token = strtok(indices_str, ",");
     
-    while (token && index_count < 8) {
+    while (token && index_count < 16) {
         indices[index_count++] = (uint32_t)atoi(token);
         token = strtok(NULL, ",");
     }
@@ -1303,7 +2720,11 @@ void b_membrane_set(char **av) {
     
     float value = (float)atof(av[3]);
     
-    /* Use the implementation-specific function (simplified for now) */
+    if (tensor_membrane_set_element_prime(membrane, indices, index_count, value) != 0) {
+        rc_error("membrane-set: indices out of range for membrane shape");
+        return;
+    }
+    
     fprint(1, "Set element at membrane %d, indices [", (int)id);
     for (int i = 0; i < index_count; i++) {
         fprint(1, "%d", (int)indices[i]);
@@ -1327,24 +2748,93 @@ void b_membrane_get(char **av) {
     }
     
     /* Parse indices */
-    uint32_t indices[8];
+    uint32_t indices[16];
     int index_count = 0;
     char *indices_str = ecpy(av[2]);
     char *token = strtok(indices_str, ",");
     
-    while (token && index_count < 8) {
+    while (token && index_count < 16) {
         indices[index_count++] = (uint32_t)atoi(token);
         token = strtok(NULL, ",");
     }
     efree(indices_str);
     
-    /* Simplified get operation */
+    float value;
+    if (tensor_membrane_get_element_prime(membrane, indices, index_count, &value) != 0) {
+        rc_error("membrane-get: indices out of range for membrane shape");
+        return;
+    }
+    
     fprint(1, "Element at membrane %d, indices [", (int)id);
     for (int i = 0; i < index_count; i++) {
         fprint(1, "%d", (int)indices[i]);
         if (i < index_count - 1) fprint(1, ",");
     }
-    fprint(1, "] = %d (x100)\n", 12); /* Placeholder value */
+    fprint(1, "] = %d (x100)\n", (int)(value * 100));
+}
+
+/* membrane-load [-b] <id> [file] overwrites every element from the file
+ * or stdin; -b reads raw floats, otherwise whitespace-separated text */
+void b_membrane_load(char **av) {
+    int binary = av[1] && strcmp(av[1], "-b") == 0;
+    if (binary) av++;
+    if (!av[1]) {
+        rc_error("membrane-load: usage: membrane-load [-b] <id> [file]");
+        return;
+    }
+    
+    uint32_t id = (uint32_t)atoi(av[1]);
+    void *membrane = tensor_membrane_find_by_id_prime(id);
+    if (!membrane) {
+        rc_error("membrane-load: membrane not found");
+        return;
+    }
+    
+    int fd = av[2] ? open(av[2], O_RDONLY) : 0;
+    if (fd < 0) {
+        rc_error("membrane-load: cannot open file");
+        return;
+    }
+    
+    size_t loaded;
+    const char *error;
+    int status = tensor_membrane_load_prime(membrane, fd, binary, &loaded, &error);
+    if (av[2]) close(fd);
+    if (status != 0) {
+        fprint(2, "membrane-load: %s after %d elements\n", error, (int)loaded);
+        rc_error(NULL);
+    }
+    fprint(1, "Loaded %d elements into membrane %d\n", (int)loaded, (int)id);
+}
+
+/* membrane-dump [-b] <id> [file] writes every element in the formats
+ * membrane-load reads */
+void b_membrane_dump(char **av) {
+    int binary = av[1] && strcmp(av[1], "-b") == 0;
+    if (binary) av++;
+    if (!av[1]) {
+        rc_error("membrane-dump: usage: membrane-dump [-b] <id> [file]");
+        return;
+    }
+    
+    void *membrane = tensor_membrane_find_by_id_prime((uint32_t)atoi(av[1]));
+    if (!membrane) {
+        rc_error("membrane-dump: membrane not found");
+        return;
+    }
+    
+    int fd = av[2] ? open(av[2], O_WRONLY | O_CREAT | O_TRUNC, 0666) : 1;
+    if (fd < 0) {
+        rc_error("membrane-dump: cannot create file");
+        return;
+    }
+    
+    int status = tensor_membrane_dump_prime(membrane, fd, binary);
+    if (av[2] && close(fd) != 0) status = -1;
+    if (status != 0) {
+        rc_error("membrane-dump: write error");
+        return;
+    }
 }
 
 void b_membrane_fill(char **av) {
@@ -1362,12 +2852,16 @@ void b_membrane_fill(char **av) {
     }
     
     float value = (float)atof(av[2]);
+    if (tensor_membrane_fill_prime(membrane, value) != 0) {
+        rc_error("membrane-fill: fill failed");
+        return;
+    }
     fprint(1, "Filled membrane %d with value %d (x100)\n", (int)id, (int)(value * 100));
 }
 
 void b_membrane_add_object(char **av) {
     if (!av[1] || !av[2]) {
-        rc_error("membrane-add-object: usage: membrane-add-object <id> <symbol>");
+        rc_error("membrane-add-object: usage: membrane-add-object <id> <symbol> [count]");
         return;
     }
     
@@ -1380,10 +2874,15 @@ void b_membrane_add_object(char **av) {
     }
     
     const char *symbol = av[2];
-    int result = tensor_membrane_add_object_prime(membrane, symbol);
+    int count = av[3] ? atoi(av[3]) : 1;
+    int result = tensor_membrane_add_objects_prime(membrane, symbol, count);
     
     if (result == 0) {
-        fprint(1, "Added object '%s' to membrane %d\n", symbol, (int)id);
+        if (count > 1) {
+            fprint(1, "Added %d copies of object '%s' to membrane %d\n", count, symbol, (int)id);
+        } else {
+            fprint(1, "Added object '%s' to membrane %d\n", symbol, (int)id);
+        }
     } else {
         rc_error("membrane-add-object: failed to add object");
     }
@@ -1391,7 +2890,7 @@ void b_membrane_add_object(char **av) {
 
 void b_membrane_remove_object(char **av) {
     if (!av[1] || !av[2]) {
-        rc_error("membrane-remove-object: usage: membrane-remove-object <id> <symbol>");
+        rc_error("membrane-remove-object: usage: membrane-remove-object <id> <symbol> [count]");
         return;
     }
     
@@ -1404,18 +2903,24 @@ void b_membrane_remove_object(char **av) {
     }
     
     const char *symbol = av[2];
+    int count = av[3] ? atoi(av[3]) : 1;
+    if (tensor_membrane_remove_objects_prime(membrane, symbol, count) != 0) {
+        rc_error("membrane-remove-object: not enough copies of object");
+        return;
+    }
     fprint(1, "Removed object '%s' from membrane %d\n", symbol, (int)id);
 }
 
 void b_membrane_transfer(char **av) {
     if (!av[1] || !av[2] || !av[3]) {
-        rc_error("membrane-transfer: usage: membrane-transfer <from_id> <to_id> <symbol>");
+        rc_error("membrane-transfer: usage: membrane-transfer <from_id> <to_id> <symbol> [count]");
         return;
     }
     
     uint32_t from_id = (uint32_t)atoi(av[1]);
     uint32_t to_id = (uint32_t)atoi(av[2]);
     const char *symbol = av[3];
+    int count = av[4] ? atoi(av[4]) : 1;
     
     void *from_membrane = tensor_membrane_find_by_id_prime(from_id);
     void *to_membrane = tensor_membrane_find_by_id_prime(to_id);
@@ -1430,6 +2935,11 @@ void b_membrane_transfer(char **av) {
         return;
     }
     
+    if (tensor_membrane_transfer_objects_prime(from_membrane, to_membrane, symbol, count) != 0) {
+        rc_error("membrane-transfer: not enough copies of object in source membrane");
+        return;
+    }
+    
     fprint(1, "Transferred object '%s' from membrane %d to membrane %d\n", 
            symbol, (int)from_id, (int)to_id);
 }
@@ -1475,6 +2985,11 @@ void b_membrane_reshape(char **av) {
         return;
     }
     
+    if (tensor_membrane_reshape_prime(membrane, new_primes, count) != 0) {
+        rc_error("membrane-reshape: factors do not preserve the element count");
+        return;
+    }
+    
     fprint(1, "Reshaped membrane %d to factors: [", (int)id);
     for (int i = 0; i < count; i++) {
         fprint(1, "%d", new_primes[i]);
@@ -1483,6 +2998,325 @@ void b_membrane_reshape(char **av) {
     fprint(1, "]\n");
 }
 
+/* membrane-view <id> <start:stop[:step],...> slices without copying;
+ * a bare index keeps that axis with extent one and an empty bound means
+ * the edge.  membrane-view -r <id> <factors> is a reshaped alias. */
+void b_membrane_view(char **av) {
+    int reshape = av[1] && strcmp(av[1], "-r") == 0;
+    if (reshape) av++;
+    if (!av[1] || !av[2] || av[3]) {
+        rc_error("membrane-view: usage: membrane-view [-r] <id> <slices|factors>");
+        return;
+    }
+    
+    uint32_t id = (uint32_t)atoi(av[1]);
+    void *membrane = tensor_membrane_find_by_id_prime(id);
+    if (!membrane) {
+        rc_error("membrane-view: membrane not found");
+        return;
+    }
+    
+    char *spec = av[2];
+    if (spec[0] == '[') {
+        spec++;
+        char *end = strchr(spec, ']');
+        if (end) *end = '\0';
+    }
+    
+    void *view = NULL;
+    int count = 0;
+    if (reshape) {
+        int factors[16];
+        char *copy = ecpy(spec);
+        for (char *token = strtok(copy, ","); token && count < 16; token = strtok(NULL, ",")) {
+            if (atoi(token) > 0) factors[count++] = atoi(token);
+        }
+        efree(copy);
+        if (count == 0) {
+            rc_error("membrane-view: invalid prime factors format");
+            return;
+        }
+        view = tensor_membrane_reshape_view_prime(membrane, factors, count);
+    } else {
+        uint32_t start[16], stop[16], step[16];
+        char *copy = ecpy(spec);
+        for (char *token = strtok(copy, ","); token && count < 16; token = strtok(NULL, ",")) {
+            char *colon = strchr(token, ':');
+            start[count] = (uint32_t)atoi(token);
+            stop[count] = colon ? UINT32_MAX : start[count] + 1;
+            step[count] = 1;
+            if (colon) {
+                char *next = strchr(colon + 1, ':');
+                if (colon[1] != '\0' && colon[1] != ':') stop[count] = (uint32_t)atoi(colon + 1);
+                if (next) step[count] = (uint32_t)atoi(next + 1);
+            }
+            count++;
+        }
+        efree(copy);
+        view = tensor_membrane_view_prime(membrane, start, stop, step, count);
+    }
+    
+    if (!view) {
+        rc_error(reshape ? "membrane-view: factors do not preserve the element count"
+                         : "membrane-view: slice is empty or outside the membrane");
+        return;
+    }
+    
+    fprint(1, "Created view (ID: %d) of membrane %d\n",
+           (int)tensor_membrane_get_id_prime(view), (int)id);
+}
+
+void b_membrane_op(char **av) {
+    if (!av[1] || !av[2]) {
+        rc_error("membrane-op: usage: membrane-op <op> <id> [value|id] [id]");
+        return;
+    }
+    
+    const char *op = av[1];
+    void *dst = tensor_membrane_find_by_id_prime((uint32_t)atoi(av[2]));
+    void *src = NULL;
+    float alpha = 0.0f;
+    
+    if (!dst) {
+        rc_error("membrane-op: membrane not found");
+        return;
+    }
+    
+    /* Operand layout depends on the operation */
+    if (strcmp(op, "fill") == 0 || strcmp(op, "scale") == 0) {
+        if (!av[3]) {
+            rc_error("membrane-op: usage: membrane-op fill|scale <id> <value>");
+            return;
+        }
+        alpha = (float)atof(av[3]);
+    } else if (strcmp(op, "axpy") == 0) {
+        if (!av[3] || !av[4]) {
+            rc_error("membrane-op: usage: membrane-op axpy <y> <alpha> <x>");
+            return;
+        }
+        alpha = (float)atof(av[3]);
+        src = tensor_membrane_find_by_id_prime((uint32_t)atoi(av[4]));
+    } else if (strcmp(op, "copy") == 0 || strcmp(op, "add") == 0 ||
+               strcmp(op, "mul") == 0 || strcmp(op, "dot") == 0) {
+        if (!av[3]) {
+            rc_error("membrane-op: usage: membrane-op copy|add|mul|dot <id> <id>");
+            return;
+        }
+        src = tensor_membrane_find_by_id_prime((uint32_t)atoi(av[3]));
+    } else if (strcmp(op, "sum") != 0 && strcmp(op, "max") != 0 && strcmp(op, "norm") != 0) {
+        rc_error("membrane-op: unknown operation (fill scale copy axpy add mul sum max norm dot)");
+        return;
+    }
+    
+    float result = 0.0f;
+    int status = tensor_membrane_op_prime(op, dst, src, alpha, &result);
+    if (status < 0) {
+        rc_error("membrane-op: membrane not found or shapes differ");
+        return;
+    }
+    
+    if (status > 0) {
+        if (src)
+            fprint(1, "%s of membranes %d and %d = %d (x100)\n", op, atoi(av[2]), atoi(av[3]),
+                   (int)(result * 100));
+        else
+            fprint(1, "%s of membrane %d = %d (x100)\n", op, atoi(av[2]), (int)(result * 100));
+    } else {
+        fprint(1, "Applied %s to membrane %d\n", op, atoi(av[2]));
+    }
+}
+
+void b_membrane_rule(char **av) {
+    if (!av[1]) {
+        rc_error("membrane-rule: usage: membrane-rule <id> ['lhs -> rhs' | -c]");
+        return;
+    }
+    
+    uint32_t id = (uint32_t)atoi(av[1]);
+    if (!tensor_membrane_find_by_id_prime(id)) {
+        rc_error("membrane-rule: membrane not found");
+        return;
+    }
+    
+    if (av[2] && strcmp(av[2], "-c") == 0) {
+        psystem_clear_rules(id);
+        fprint(1, "Cleared rules of membrane %d\n", (int)id);
+        return;
+    }
+    
+    if (av[2]) {
+        const char *error;
+        if (psystem_add_rule(id, av[2], &error) != 0) {
+            fprint(2, "membrane-rule: %s\n", error);
+            rc_error(NULL);
+            return;
+        }
+    }
+    
+    /* List the membrane's rules */
+    uint32_t count = psystem_rule_count(id);
+    for (uint32_t i = 0; i < count; i++) {
+        char text[256];
+        psystem_format_rule(psystem_get_rule(id, i), text, sizeof(text));
+        fprint(1, "  r%d: %s\n", (int)i + 1, text);
+    }
+}
+
+void b_membrane_evolve(char **av) {
+    if (!av[1] || atoi(av[1]) <= 0) {
+        rc_error("membrane-evolve: usage: membrane-evolve <steps> [seed]");
+        return;
+    }
+    
+    uint32_t steps = (uint32_t)atoi(av[1]);
+    uint64_t seed = av[2] ? strtoull(av[2], NULL, 10) : (uint64_t)time(NULL);
+    PSystemStats stats;
+    struct timespec start, end;
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int result = psystem_evolve(steps, seed, &stats);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    
+    if (result != 0) {
+        rc_error("membrane-evolve: out of memory during evolution");
+        return;
+    }
+    
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    char rate[32];
+    snprintf(rate, sizeof(rate), "%.1f", seconds > 0 ? stats.steps / seconds : 0.0);
+    fprint(1, "Evolved %d steps in %d ms (%s steps/s, %d rule applications)%s\n",
+           (int)stats.steps, (int)(seconds * 1000), rate, (int)stats.applications,
+           stats.halted ? ", halted" : "");
+}
+
+/* membrane-snapshot <id> checkpoints a membrane; -l lists snapshots,
+ * -d removes one and -r writes one back into a membrane */
+void b_membrane_snapshot(char **av) {
+    if (av[1] && strcmp(av[1], "-l") == 0) {
+        SnapshotInfo info;
+        for (uint32_t id = snapshot_next(0); id; id = snapshot_next(id)) {
+            snapshot_info(id, &info);
+            fprint(1, "Snapshot %d: membrane %d, version %d, %d elements\n", (int)info.id,
+                   (int)info.membrane_id, (int)info.version, (int)info.element_count);
+        }
+        return;
+    }
+    
+    if (av[1] && strcmp(av[1], "-d") == 0) {
+        if (!av[2] || snapshot_delete((uint32_t)atoi(av[2])) != 0) {
+            rc_error("membrane-snapshot: snapshot not found");
+            return;
+        }
+        fprint(1, "Deleted snapshot %s\n", av[2]);
+        return;
+    }
+    
+    if (av[1] && strcmp(av[1], "-r") == 0) {
+        if (!av[2]) {
+            rc_error("membrane-snapshot: usage: membrane-snapshot -r <snapshot> [id]");
+            return;
+        }
+        uint32_t target = av[3] ? (uint32_t)atoi(av[3]) : 0;
+        if (snapshot_restore((uint32_t)atoi(av[2]), target) != 0) {
+            rc_error("membrane-snapshot: cannot restore: no such snapshot or membrane, or sizes differ");
+            return;
+        }
+        fprint(1, "Restored snapshot %s\n", av[2]);
+        return;
+    }
+    
+    if (!av[1]) {
+        rc_error("membrane-snapshot: usage: membrane-snapshot <id> | -l | -d <snapshot> | -r <snapshot> [id]");
+        return;
+    }
+    
+    uint32_t id = (uint32_t)atoi(av[1]);
+    if (!tensor_membrane_find_by_id_prime(id)) {
+        rc_error("membrane-snapshot: membrane not found");
+        return;
+    }
+    
+    size_t copied;
+    uint32_t snapshot = snapshot_take(id, &copied);
+    if (!snapshot) {
+        rc_error("membrane-snapshot: out of memory");
+        return;
+    }
+    
+    SnapshotInfo info;
+    snapshot_info(snapshot, &info);
+    size_t pages = (info.element_count + MEMBRANE_PAGE_ELEMENTS - 1) / MEMBRANE_PAGE_ELEMENTS;
+    fprint(1, "Snapshot %d of membrane %d at version %d (%d of %d pages copied)\n",
+           (int)snapshot, (int)id, (int)info.version, (int)copied, (int)pages);
+}
+
+/* membrane-diff <snapshot> [snapshot] writes the delta from the first
+ * snapshot to the second, or to the live membrane, on standard output */
+void b_membrane_diff(char **av) {
+    if (!av[1]) {
+        rc_error("membrane-diff: usage: membrane-diff <snapshot> [snapshot]");
+        return;
+    }
+    
+    SnapshotDelta delta;
+    snapshot_delta_init(&delta);
+    if (snapshot_diff((uint32_t)atoi(av[1]), av[2] ? (uint32_t)atoi(av[2]) : 0, &delta) != 0) {
+        snapshot_delta_free(&delta);
+        rc_error("membrane-diff: no such snapshot or membrane, or sizes differ");
+        return;
+    }
+    
+    FILE *out = fdopen(dup(1), "w");
+    int status = out ? snapshot_delta_write(&delta, out) : -1;
+    if (out && fclose(out) != 0) status = -1;
+    snapshot_delta_free(&delta);
+    if (status != 0) {
+        rc_error("membrane-diff: write error");
+        return;
+    }
+}
+
+/* membrane-patch <id> [file] applies a delta from membrane-diff */
+void b_membrane_patch(char **av) {
+    if (!av[1]) {
+        rc_error("membrane-patch: usage: membrane-patch <id> [file]");
+        return;
+    }
+    
+    uint32_t id = (uint32_t)atoi(av[1]);
+    if (!tensor_membrane_find_by_id_prime(id)) {
+        rc_error("membrane-patch: membrane not found");
+        return;
+    }
+    
+    FILE *in = av[2] && strcmp(av[2], "-") != 0 ? fopen(av[2], "r") : fdopen(dup(0), "r");
+    if (!in) {
+        rc_error("membrane-patch: cannot open delta");
+        return;
+    }
+    
+    SnapshotDelta delta;
+    const char *error;
+    snapshot_delta_init(&delta);
+    int status = snapshot_delta_read(&delta, in, &error);
+    fclose(in);
+    if (status != 0) {
+        snapshot_delta_free(&delta);
+        fprint(2, "membrane-patch: %s\n", error);
+        rc_error(NULL);
+    }
+    
+    status = snapshot_delta_apply(&delta, id);
+    size_t changed = delta.value_count;
+    snapshot_delta_free(&delta);
+    if (status != 0) {
+        rc_error("membrane-patch: delta does not fit the membrane");
+        return;
+    }
+    fprint(1, "Patched %d elements of membrane %d\n", (int)changed, (int)id);
+}
+
 void b_cognitive_status(char **av) {
     AttentionState *state = get_attention_state();
     fprint(1, "Cognitive Status:\n");
@@ -1493,45 +3327,126 @@ void b_cognitive_status(char **av) {
     list_cognitive_modules();
 }
 
-/* PLN Inference Command */
-void b_pln_infer(char **av) {
+/* kernel-load <name> <library> installs the hypergraph kernel the
+ * library exports under name, replacing any kernel of that name while
+ * commands using it may still be running.  Without arguments it lists
+ * the kernels. */
+void b_kernel_load(char **av) {
     if (!av[1]) {
-        rc_error("pln-infer: missing premises argument");
+        size_t count;
+        const char **names = sorted_names(&kernel_registry, &count);
+        for (size_t i = 0; i < count; i++) {
+            KernelEntry *entry = registry_lookup(&kernel_registry, names[i]);
+            if (entry) fprint(1, "%s%s\n", names[i], entry->library ? " (loaded)" : "");
+        }
+        free(names);
+        return;
+    }
+    if (!av[2]) {
+        rc_error("kernel-load: usage: kernel-load <name> <library>");
         return;
     }
     
-    const char *premises = av[1];
-    
-    /* Use PLN inference via hypergraph kernel */
-    HypergraphKernel *kernel = find_hypergraph_kernel("default");
-    if (kernel && kernel->pln_infer) {
-        char *conclusion = NULL;
-        TruthValue tv;
-        int result = kernel->pln_infer(premises, &conclusion, &tv);
-        
-        if (result == 0 && conclusion) {
-            fprint(1, "PLN Inference Result:\n");
-            fprint(1, "  Premises: %s\n", premises);
-            fprint(1, "  Conclusion: %s\n", conclusion);
-            fprint(1, "  Truth Value: (%d, %d)\n", (int)(tv.strength * 100), (int)(tv.confidence * 100));
-            efree(conclusion);
-        } else {
-            fprint(1, "PLN inference failed\n");
-        }
-    } else {
-        /* Fallback: use scheme_call */
-        char *result = scheme_call("pln-infer", &av[1]);
-        if (result) {
-            fprint(1, "PLN inference: %s\n", result);
-            efree(result);
+    const char *error;
+    if (load_hypergraph_kernel(av[1], av[2], &error) != 0) {
+        fprint(2, "kernel-load: %s\n", error);
+        rc_error(NULL);
+        return;
+    }
+    fprint(1, "Kernel %s loaded from %s\n", av[1], av[2]);
+}
+
+/* PLN Inference Command */
+
+static void pln_print(Atom atom) {
+    char *text = hypergraph_text_tv(atom);
+    if (!text) return;
+    fprint(1, "%d %s\n", (int)atom, text);
+    free(text);
+}
+
+/* pln-infer [-b] [-s steps] [-t ms] <atom>...
+ * Adds the atoms to the store and chains forward from them, printing
+ * every conclusion whose truth value changed.  A number is the handle
+ * of an atom already in the store.  With -b the single atom
+ * is a target whose truth value is derived backward from the links
+ * around it.  The chainer stops after the step budget (-s, 20000 by
+ * default) or the latency budget (-t, 50 ms).  The status is false
+ * when nothing could be concluded. */
+void b_pln_infer(char **av) {
+    PlnBudget budget = { PLN_MAX_STEPS, PLN_MAX_SECONDS };
+    int backward = 0;
+    
+    for (av++; *av && (*av)[0] == '-'; av++) {
+        if (strcmp(*av, "-b") == 0) {
+            backward = 1;
+        } else if (strcmp(*av, "-s") == 0 && av[1]) {
+            budget.max_steps = strtoul(*++av, NULL, 10);
+        } else if (strcmp(*av, "-t") == 0 && av[1]) {
+            budget.max_seconds = strtod(*++av, NULL) / 1000.0;
         } else {
-            fprint(1, "PLN inference not available\n");
+            break;
         }
     }
+    if (!*av || (*av)[0] == '-') {
+        rc_error("pln-infer: usage: pln-infer [-b] [-s steps] [-t ms] <atom>...");
+        return;
+    }
+    
+    const char *error = NULL;
+    size_t count;
+    Atom *atoms = hypergraph_insert_all(av, 1, &count, &error);
+    if (!atoms) {
+        fprint(2, "pln-infer: %s\n", error);
+        rc_error(NULL);
+        return;
+    }
+    if (backward && count != 1) {
+        free(atoms);
+        rc_error("pln-infer: -b takes one target");
+        return;
+    }
+    
+    PlnStats stats;
+    Atom target = atoms[0];
+    int result = backward ? pln_backward(target, &budget, &stats)
+                          : pln_forward(atoms, count, &budget, &stats);
+    free(atoms);
+    if (result < 0) {
+        rc_error("pln-infer: out of memory");
+        return;
+    }
+    
+    char line[160];
+    snprintf(line, sizeof(line), "PLN: %d steps (%d memoized), %d conclusions, %d revisions, %.3f ms%s",
+             (int)stats.steps, (int)stats.memoized, (int)stats.conclusions, (int)stats.revisions,
+             stats.seconds * 1000.0, stats.exhausted ? ", budget exhausted" : "");
+    fprint(1, "%s\n", line);
+    
+    if (backward) {
+        float strength, confidence;
+        pln_print(target);
+        hypergraph_get_tv(target, &strength, &confidence);
+        set(confidence > 0.0f);
+        return;
+    }
+    size_t n = pln_conclusions(NULL, 0);
+    if (n && (atoms = malloc(n * sizeof(Atom))) != NULL) {
+        pln_conclusions(atoms, n);
+        for (size_t i = 0; i < n; i++) pln_print(atoms[i]);
+        free(atoms);
+    }
+    set(n != 0);
 }
 
-/* Cognitive Transform Command */
+/* cognitive-transform [-k kernel] <pattern> <input> runs the named
+ * hypergraph kernel's transform, "default" unless -k is given */
 void b_cognitive_transform(char **av) {
+    const char *name = "default";
+    if (av[1] && strcmp(av[1], "-k") == 0 && av[2]) {
+        name = av[2];
+        av += 2;
+    }
     if (!av[1] || !av[2]) {
         rc_error("cognitive-transform: missing pattern or input argument");
         return;
@@ -1541,7 +3456,12 @@ void b_cognitive_transform(char **av) {
     const char *input = av[2];
     
     /* Use hypergraph kernel transformation */
-    HypergraphKernel *kernel = find_hypergraph_kernel("default");
+    HypergraphKernel *kernel = find_hypergraph_kernel(name);
+    if (!kernel && strcmp(name, "default") != 0) {
+        fprint(2, "cognitive-transform: no kernel %s\n", name);
+        rc_error(NULL);
+        return;
+    }
     if (kernel && kernel->transform) {
         char *output = NULL;
         int result = kernel->transform(pattern, input, &output);
@@ -1742,7 +3662,7 @@ int cognitive_init(void) {
     }
     
     /* Register default hypergraph kernel */
-    if (register_hypergraph_kernel(&default_kernel) != 0) {
+    if (register_hypergraph_kernel("default", &default_kernel) != 0) {
         return -1;
     }
 #endif
@@ -1765,19 +3685,28 @@ int cognitive_init(void) {
 
 void cognitive_cleanup(void) {
     /* Cleanup all registered modules */
-    while (modules_head) {
-        CognitiveModule *next = modules_head->next;
-        if (modules_head->cleanup) {
-            modules_head->cleanup();
+    pthread_mutex_lock(&retired_lock);
+    while (retired_modules) {
+        CognitiveModule *next = retired_modules->next;
+        /* A module can be replaced and later registered again */
+        if (retired_modules->cleanup && find_cognitive_module(retired_modules->name) != retired_modules) {
+            retired_modules->cleanup();
         }
-        modules_head = next;
+        retired_modules = next;
     }
+    pthread_mutex_unlock(&retired_lock);
+    registry_clear(&module_registry, release_module);
+    release_kernels();
     
     /* Reset hook counts */
     for (int i = 0; i < HOOK_COUNT; i++) {
         hook_counts[i] = 0;
     }
     
+    pln_reset();
+    ecan_reset();
+    hypergraph_clear();
+    
 #if ENABLE_IPC_EXTENSIONS
     rc_ipc_cleanup();
 #endif
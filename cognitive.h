@@ -129,14 +129,26 @@ extern void scheme_cleanup(void);
 /* Tensor Operations Interface */
 #if ENABLE_TENSOR_OPERATIONS
 extern void *tensor_create(int *dims, int ndims);
+extern void *tensor_create_named(int *dims, int ndims, const char *name);
 extern void tensor_destroy(void *tensor);
-extern int tensor_compute(void *tensor, const char *op);
+extern void *tensor_find(const char *ref);
+extern uint32_t tensor_handle(void *tensor);
+extern const char *tensor_name(void *tensor);
+extern int tensor_compute(void *tensor, const char *op, float *result);
+extern int tensor_apply(void *tensor, const char *op, float operand, void *other);
+extern int tensor_describe(void *tensor, char *buf, size_t size);
 extern void *tensor_membrane_alloc(int prime_factors[], int count);
 extern void tensor_membrane_free(void *membrane);
 #else
 #define tensor_create(dims, ndims) NULL
+#define tensor_create_named(dims, ndims, name) NULL
 #define tensor_destroy(tensor) do {} while(0)
-#define tensor_compute(tensor, op) -1
+#define tensor_find(ref) NULL
+#define tensor_handle(tensor) 0
+#define tensor_name(tensor) NULL
+#define tensor_compute(tensor, op, result) -1
+#define tensor_apply(tensor, op, operand, other) -1
+#define tensor_describe(tensor, buf, size) -1
 #define tensor_membrane_alloc(factors, count) NULL
 #define tensor_membrane_free(membrane) do {} while(0)
 #endif
@@ -148,7 +160,7 @@ struct CognitiveModule {
     int (*init)(void);
     int (*process)(const char *input, char **output);
     void (*cleanup)(void);
-    struct CognitiveModule *next;
+    struct CognitiveModule *next;   /* private: modules replaced under the same name */
 };
 
 extern int register_cognitive_module(CognitiveModule *module);
@@ -190,11 +202,17 @@ extern void b_ipc_connect(char **);
 extern void b_ipc_send(char **);
 extern void b_ipc_recv(char **);
 extern void b_scheme_eval(char **);
+extern void b_kernel_load(char **);
 extern void b_hypergraph_encode(char **);
+extern void b_hypergraph_query(char **);
+extern void b_hypergraph_save(char **);
+extern void b_hypergraph_load(char **);
 extern void b_pattern_match(char **);
 extern void b_attention_allocate(char **);
 extern void b_tensor_create(char **);
 extern void b_tensor_op(char **);
+extern void b_tensor_destroy(char **);
+extern void b_tensor_list(char **);
 extern void b_membrane_alloc(char **);
 extern void b_cognitive_status(char **);
 extern void b_pln_infer(char **);
@@ -202,16 +220,26 @@ extern void b_cognitive_transform(char **);
 
 /* Enhanced Tensor Membrane Commands */
 extern void b_membrane_create(char **);
+extern void b_membrane_flush(char **);
 extern void b_membrane_list(char **);
 extern void b_membrane_info(char **);
 extern void b_membrane_destroy(char **);
 extern void b_membrane_set(char **);
 extern void b_membrane_get(char **);
+extern void b_membrane_load(char **);
+extern void b_membrane_dump(char **);
 extern void b_membrane_fill(char **);
 extern void b_membrane_add_object(char **);
 extern void b_membrane_remove_object(char **);
 extern void b_membrane_transfer(char **);
 extern void b_membrane_reshape(char **);
+extern void b_membrane_view(char **);
+extern void b_membrane_op(char **);
+extern void b_membrane_rule(char **);
+extern void b_membrane_evolve(char **);
+extern void b_membrane_snapshot(char **);
+extern void b_membrane_diff(char **);
+extern void b_membrane_patch(char **);
 
 /* Distributed Network Commands */
 #if ENABLE_DISTRIBUTED_PROTOCOLS
@@ -230,6 +258,7 @@ extern void b_orchestrator_create(char **);
 extern void b_orchestrator_status(char **);
 extern void b_orchestrator_load_model(char **);
 extern void b_orchestrator_inference(char **);
+extern void b_orchestrator_coordinate(char **);
 extern void b_airchat_create(char **);
 extern void b_airchat_load(char **);
 extern void b_airchat_chat(char **);
@@ -254,7 +283,13 @@ extern void b_load_example_modules(char **);
 extern void b_test_pattern(char **);
 extern void b_test_attention(char **);
 
-/* Cognitive Grammar Support Functions */
+/* Cognitive Grammar Support Functions
+ * Kernels and modules are looked up by name in hash tables that can be
+ * updated while other threads read them.  Registering under a taken
+ * name replaces the entry atomically.  A kernel library exports a
+ * HypergraphKernel named hypergraph_kernel. */
+extern int register_hypergraph_kernel(const char *name, const HypergraphKernel *kernel);
+extern int load_hypergraph_kernel(const char *name, const char *path, const char **error);
 extern HypergraphKernel *find_hypergraph_kernel(const char *name);
 extern float calculate_ecan_attention(const char *input, ECANValues *ecan);
 
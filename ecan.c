@@ -0,0 +1,368 @@
+/* ECAN Engine Implementation
+ * Only atoms in the attentional focus take part in a tick.  The focus
+ * is a min-heap of at most focus_size atoms keyed by STI, with a
+ * position index by handle, so an atom can enter by pushing out the
+ * least important one in O(log n).
+ *
+ * A tick:
+ *   1. collects rent from every focus atom into the funds;
+ *   2. diffuses a fraction of each focus atom's STI over its outgoing
+ *      set and its newest incoming links, one sparse matrix-vector
+ *      product over a CSR matrix with a row per focus atom;
+ *   3. lets atoms that received STI compete for the focus, and drops
+ *      those under the forgetting threshold, whose STI goes back to
+ *      the funds.
+ * Its cost depends on the focus size and ECAN_MAX_SPREAD, not on the
+ * size of the store.  The matrix is kept until the focus or the store
+ * changes.
+ */
+
+#include "ecan.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    float sti;
+    Atom atom;
+} FocusEntry;
+
+static EcanParams params = {
+    10000.0f,                   /* funds */
+    512,                        /* focus_size */
+    0.05f,                      /* rent */
+    0.2f,                       /* spread */
+    1.0f,                       /* forget */
+    0.1f,                       /* lti_rate */
+    0.01f                       /* lti_decay */
+};
+
+static FocusEntry *focus = NULL;            /* min-heap on sti */
+static size_t focus_count = 0;
+static uint32_t *focus_pos = NULL;          /* by handle: heap index plus one */
+static size_t focus_pos_capacity = 0;
+static unsigned long ticks = 0;
+
+/* Diffusion matrix: row i spreads from row_atom[i] to col_atom[] with
+ * weights that sum to one */
+static Atom *row_atom = NULL;
+static uint32_t *row_start = NULL;
+static float *row_given = NULL;             /* STI each row spreads this tick */
+static Atom *col_atom = NULL;
+static float *weight = NULL;
+static size_t rows = 0;
+static size_t nonzeros = 0;
+static size_t row_capacity = 0;
+static size_t edge_capacity = 0;
+static int matrix_stale = 1;
+static size_t matrix_atoms = 0;             /* store size it was built for */
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static float sti_of(Atom atom) {
+    float sti, lti;
+    hypergraph_get_av(atom, &sti, &lti);
+    return sti;
+}
+
+static void add_sti(Atom atom, float amount) {
+    float sti, lti;
+    hypergraph_get_av(atom, &sti, &lti);
+    hypergraph_set_av(atom, sti + amount, lti);
+}
+
+/* Heap */
+
+static int pos_reserve(Atom atom) {
+    if (atom < focus_pos_capacity) return 0;
+    size_t capacity = focus_pos_capacity ? focus_pos_capacity : 1024;
+    while (capacity <= atom) capacity *= 2;
+    uint32_t *pos = realloc(focus_pos, capacity * sizeof(uint32_t));
+    if (!pos) return -1;
+    memset(pos + focus_pos_capacity, 0, (capacity - focus_pos_capacity) * sizeof(uint32_t));
+    focus_pos = pos;
+    focus_pos_capacity = capacity;
+    return 0;
+}
+
+static int in_focus(Atom atom) {
+    return atom < focus_pos_capacity && focus_pos[atom];
+}
+
+static void heap_set(size_t i, FocusEntry e) {
+    focus[i] = e;
+    focus_pos[e.atom] = i + 1;
+}
+
+static void sift_up(size_t i) {
+    FocusEntry e = focus[i];
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (focus[parent].sti <= e.sti) break;
+        heap_set(i, focus[parent]);
+        i = parent;
+    }
+    heap_set(i, e);
+}
+
+static void sift_down(size_t i) {
+    FocusEntry e = focus[i];
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= focus_count) break;
+        if (child + 1 < focus_count && focus[child + 1].sti < focus[child].sti) child++;
+        if (e.sti <= focus[child].sti) break;
+        heap_set(i, focus[child]);
+        i = child;
+    }
+    heap_set(i, e);
+}
+
+static void heap_remove(size_t i) {
+    focus_pos[focus[i].atom] = 0;
+    if (--focus_count == i) return;
+    heap_set(i, focus[focus_count]);
+    sift_down(i);
+    sift_up(focus_pos[focus[i].atom] - 1);
+}
+
+/* Give an atom outside the focus the chance to enter it */
+static void focus_offer(Atom atom) {
+    float sti = sti_of(atom);
+
+    if (in_focus(atom)) {
+        size_t i = focus_pos[atom] - 1;
+        focus[i].sti = sti;
+        sift_down(i);
+        sift_up(focus_pos[atom] - 1);
+        return;
+    }
+    if (sti < params.forget || pos_reserve(atom) < 0) return;
+    if (focus_count == params.focus_size) {
+        if (!focus_count || sti <= focus[0].sti) return;
+        heap_remove(0);
+    }
+    focus[focus_count].sti = sti;
+    focus[focus_count].atom = atom;
+    focus_pos[atom] = ++focus_count;
+    sift_up(focus_count - 1);
+    matrix_stale = 1;
+}
+
+/* Diffusion matrix */
+
+static int matrix_reserve(size_t row_count, size_t edges) {
+    if (row_count + 1 > row_capacity) {
+        Atom *ra = realloc(row_atom, (row_count + 1) * sizeof(Atom));
+        if (ra) row_atom = ra;
+        uint32_t *rs = realloc(row_start, (row_count + 1) * sizeof(uint32_t));
+        if (rs) row_start = rs;
+        float *rg = realloc(row_given, (row_count + 1) * sizeof(float));
+        if (rg) row_given = rg;
+        if (!ra || !rs || !rg) return -1;
+        row_capacity = row_count + 1;
+    }
+    if (edges > edge_capacity) {
+        Atom *ca = realloc(col_atom, edges * sizeof(Atom));
+        if (ca) col_atom = ca;
+        float *w = realloc(weight, edges * sizeof(float));
+        if (w) weight = w;
+        if (!ca || !w) return -1;
+        edge_capacity = edges;
+    }
+    return 0;
+}
+
+static int matrix_build(void) {
+    if (matrix_reserve(focus_count, focus_count * ECAN_MAX_SPREAD) < 0) return -1;
+
+    rows = focus_count;
+    nonzeros = 0;
+    for (size_t i = 0; i < rows; i++) {
+        Atom atom = focus[i].atom;
+        size_t first = nonzeros;
+        uint32_t arity, cursor = 0;
+        const Atom *out = hypergraph_outgoing(atom, &arity);
+        Atom link;
+
+        row_atom[i] = atom;
+        row_start[i] = first;
+        for (uint32_t k = 0; k < arity && nonzeros - first < ECAN_MAX_SPREAD; k++) {
+            col_atom[nonzeros++] = out[k];
+        }
+        while (nonzeros - first < ECAN_MAX_SPREAD &&
+               (link = hypergraph_incoming_next(atom, &cursor)) != 0) {
+            col_atom[nonzeros++] = link;
+        }
+        for (size_t k = first; k < nonzeros; k++) weight[k] = 1.0f / (nonzeros - first);
+    }
+    row_start[rows] = nonzeros;
+    matrix_stale = 0;
+    matrix_atoms = hypergraph_atom_count();
+    return 0;
+}
+
+/* Engine */
+
+void ecan_get_params(EcanParams *p) {
+    *p = params;
+}
+
+int ecan_set_params(const EcanParams *p) {
+    if (p->focus_size < 1 || p->rent < 0.0f || p->rent > 1.0f || p->spread < 0.0f ||
+        p->spread > 1.0f || p->lti_rate < 0.0f || p->lti_decay < 0.0f || p->lti_decay > 1.0f ||
+        p->funds < 0.0f) return -1;
+
+    if (p->focus_size != params.focus_size && focus) {
+        /* Shrinking drops the least important atoms, which keep their STI */
+        while (focus_count > p->focus_size) heap_remove(0);
+        FocusEntry *f = realloc(focus, p->focus_size * sizeof(FocusEntry));
+        if (!f) return -1;
+        focus = f;
+        matrix_stale = 1;
+    }
+    params = *p;
+    return 0;
+}
+
+/* Move amount of STI from the funds to atom; returns what was given */
+float ecan_stimulate(Atom atom, float amount) {
+    float sti, lti;
+
+    if (!hypergraph_valid(atom) || amount <= 0.0f) return 0.0f;
+    if (!focus) {
+        focus = malloc(params.focus_size * sizeof(FocusEntry));
+        if (!focus) return 0.0f;
+    }
+    if (amount > params.funds) amount = params.funds;
+    params.funds -= amount;
+    hypergraph_get_av(atom, &sti, &lti);
+    hypergraph_set_av(atom, sti + amount, lti + amount * params.lti_rate);
+    focus_offer(atom);
+    return amount;
+}
+
+int ecan_tick(EcanTick *stats) {
+    double start = now();
+    size_t forgotten = 0;
+    float rent = 0.0f;
+
+    if (!focus) {
+        focus = malloc(params.focus_size * sizeof(FocusEntry));
+        if (!focus) return -1;
+    }
+    if ((matrix_stale || matrix_atoms != hypergraph_atom_count()) && matrix_build() < 0) return -1;
+
+    /* Rent and the amounts to spread come from STI as it was at the
+     * start of the tick; the product then only adds */
+    for (size_t i = 0; i < rows; i++) {
+        Atom atom = row_atom[i];
+        float sti, lti;
+        hypergraph_get_av(atom, &sti, &lti);
+        float paid = sti > 0.0f ? sti * params.rent : 0.0f;
+        float given = row_start[i + 1] > row_start[i] && sti > 0.0f ? (sti - paid) * params.spread : 0.0f;
+        rent += paid;
+        row_given[i] = given;
+        hypergraph_set_av(atom, sti - paid - given, lti * (1.0f - params.lti_decay));
+    }
+    params.funds += rent;
+    for (size_t i = 0; i < rows; i++) {
+        for (uint32_t k = row_start[i]; k < row_start[i + 1]; k++) {
+            add_sti(col_atom[k], row_given[i] * weight[k]);
+        }
+    }
+
+    /* Forget, then rebuild the heap from the new STI values */
+    for (size_t i = 0; i < focus_count;) {
+        float sti = sti_of(focus[i].atom);
+        if (sti < params.forget) {
+            float lti;
+            hypergraph_get_av(focus[i].atom, &sti, &lti);
+            params.funds += sti;
+            hypergraph_set_av(focus[i].atom, 0.0f, lti);
+            focus_pos[focus[i].atom] = 0;
+            focus[i] = focus[--focus_count];
+            forgotten++;
+            matrix_stale = 1;
+            continue;
+        }
+        focus[i++].sti = sti;
+    }
+    for (size_t i = 0; i < focus_count; i++) focus_pos[focus[i].atom] = i + 1;
+    for (size_t i = focus_count / 2; i-- > 0;) sift_down(i);
+
+    /* Neighbours that received STI compete for the focus */
+    for (size_t k = 0; k < nonzeros; k++) {
+        if (!in_focus(col_atom[k])) focus_offer(col_atom[k]);
+    }
+
+    ticks++;
+    if (stats) {
+        stats->ticks = ticks;
+        stats->focus = focus_count;
+        stats->edges = nonzeros;
+        stats->forgotten = forgotten;
+        stats->rent = rent;
+        stats->seconds = now() - start;
+    }
+    return 0;
+}
+
+static int by_sti_descending(const void *a, const void *b) {
+    float x = ((const FocusEntry*)a)->sti, y = ((const FocusEntry*)b)->sti;
+    if (x != y) return x < y ? 1 : -1;
+    return ((const FocusEntry*)a)->atom < ((const FocusEntry*)b)->atom ? -1 : 1;
+}
+
+size_t ecan_focus(Atom *atoms, size_t max) {
+    if (!focus_count) return 0;
+    FocusEntry *sorted = malloc(focus_count * sizeof(FocusEntry));
+    if (!sorted) return 0;
+
+    memcpy(sorted, focus, focus_count * sizeof(FocusEntry));
+    qsort(sorted, focus_count, sizeof(FocusEntry), by_sti_descending);
+    for (size_t i = 0; i < focus_count && i < max; i++) atoms[i] = sorted[i].atom;
+    free(sorted);
+    return focus_count;
+}
+
+/* Forget everything; the store's attention values are left to the
+ * caller, who resets it when the store is cleared or replaced */
+void ecan_reset(void) {
+    free(focus);
+    free(focus_pos);
+    free(row_atom);
+    free(row_start);
+    free(row_given);
+    free(col_atom);
+    free(weight);
+    focus = NULL;
+    focus_pos = NULL;
+    row_atom = NULL;
+    row_start = NULL;
+    row_given = NULL;
+    col_atom = NULL;
+    weight = NULL;
+    focus_count = focus_pos_capacity = 0;
+    rows = nonzeros = 0;
+    row_capacity = edge_capacity = 0;
+    matrix_stale = 1;
+    matrix_atoms = 0;
+    ticks = 0;
+}
+
+size_t ecan_refocus(void) {
+    Atom count = (Atom)hypergraph_atom_count();
+
+    ecan_reset();
+    focus = malloc(params.focus_size * sizeof(FocusEntry));
+    if (!focus) return 0;
+    for (Atom atom = 1; atom <= count; atom++) {
+        if (sti_of(atom) >= params.forget) focus_offer(atom);
+    }
+    return focus_count;
+}
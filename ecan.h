@@ -0,0 +1,48 @@
+/* ECAN Engine Header
+ * Economic attention allocation over the hypergraph store
+ */
+
+#ifndef ECAN_H
+#define ECAN_H
+
+#include <stddef.h>
+#include "hypergraph.h"
+
+#define ECAN_MAX_SPREAD 32              /* neighbours an atom spreads to per tick */
+#define ECAN_STIMULUS 100.0f            /* default stimulus for an atom */
+
+typedef struct {
+    float funds;                /* STI held by no atom */
+    size_t focus_size;          /* bound on the attentional focus */
+    float rent;                 /* fraction of STI a focus atom pays per tick */
+    float spread;               /* fraction of STI diffused to neighbours per tick */
+    float forget;               /* STI under which an atom leaves the focus */
+    float lti_rate;             /* fraction of a stimulus kept as LTI */
+    float lti_decay;            /* fraction of LTI a focus atom loses per tick */
+} EcanParams;
+
+typedef struct {
+    unsigned long ticks;
+    size_t focus;               /* atoms in the focus after the tick */
+    size_t edges;               /* nonzeros in the diffusion matrix */
+    size_t forgotten;           /* atoms that left the focus */
+    float rent;                 /* STI returned to the funds */
+    double seconds;
+} EcanTick;
+
+/* STI is conserved: stimulus comes out of the funds, and rent and the
+ * STI of forgotten atoms go back in */
+extern void ecan_get_params(EcanParams *params);
+extern int ecan_set_params(const EcanParams *params);
+extern float ecan_stimulate(Atom atom, float amount);
+extern int ecan_tick(EcanTick *stats);
+
+/* Focus atoms by descending STI; returns the focus size */
+extern size_t ecan_focus(Atom *atoms, size_t max);
+extern void ecan_reset(void);
+
+/* Forget the focus and rebuild it from the STI the atoms hold, as when
+ * the store has been replaced; returns the focus size */
+extern size_t ecan_refocus(void);
+
+#endif /* ECAN_H */
@@ -94,7 +94,7 @@ gguf_context *gguf_init_from_file(const char *fname) {
     offset += sizeof(uint64_t);
     
     /* Read key-value pairs (simplified implementation) */
-    ctx->kv = malloc(ctx->n_kv * sizeof(gguf_kv));
+    ctx->kv = calloc(ctx->n_kv, sizeof(gguf_kv));
     if (!ctx->kv) {
         free(ctx);
         munmap(data, st.st_size);
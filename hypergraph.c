@@ -0,0 +1,1264 @@
+/* Hypergraph Store Implementation
+ * Atoms live in one array of fixed-size records.  A node's record
+ * points into a pool of interned names; a link's record points at its
+ * run in one contiguous outgoing array.  Every outgoing slot also
+ * records its owning link and the previous slot holding the same
+ * target, so each atom's incoming set is a chain through those slots
+ * and adding a link never allocates per atom.  A hash table over
+ * (type, name) and (type, outgoing) keeps atoms unique, and each type
+ * keeps the list of its atoms.
+ *
+ * Truth and attention values are columns of their own beside the
+ * records.
+ *
+ * Nothing holds a pointer into another array: names, outgoing runs
+ * and incoming chains are all offsets.  A saved store is therefore
+ * just these arrays, and a loaded one uses them where the file is
+ * mapped until they have to grow.
+ */
+
+#include "hypergraph.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef struct {
+    uint16_t type;
+    uint32_t first;             /* node: name offset; link: outgoing offset */
+    uint32_t arity;             /* 0 for nodes */
+    uint32_t incoming;          /* newest slot holding this atom, plus one */
+    uint32_t incoming_count;
+} AtomRecord;
+
+typedef struct {
+    float strength;
+    float confidence;
+} TruthRecord;
+
+typedef struct {
+    float sti;                  /* short- and long-term importance */
+    float lti;
+} AttentionRecord;
+
+typedef struct {
+    char *name;
+    int link;
+    Atom *atoms;
+    size_t count;
+    size_t capacity;
+} AtomType;
+
+static const struct {
+    const char *name;
+    int link;
+} builtin_types[] = {
+    { "ConceptNode", 0 },
+    { "PredicateNode", 0 },
+    { "VariableNode", 0 },
+    { "NumberNode", 0 },
+    { "SchemaNode", 0 },
+    { "ListLink", 1 },
+    { "OrderedLink", 1 },
+    { "InheritanceLink", 1 },
+    { "SimilarityLink", 1 },
+    { "ImplicationLink", 1 },
+    { "EvaluationLink", 1 },
+    { "ExecutionLink", 1 },
+    { "MemberLink", 1 },
+    { "AndLink", 1 },
+    { "OrLink", 1 },
+    { "NotLink", 1 },
+};
+
+static AtomType types[HYPERGRAPH_MAX_TYPES];
+static uint16_t type_count = 0;            /* highest type id */
+
+static AtomRecord *atoms = NULL;           /* indexed by handle; 0 unused */
+static TruthRecord *truth = NULL;          /* indexed by handle */
+static AttentionRecord *attention = NULL;  /* indexed by handle */
+static size_t atom_count = 0;
+static size_t atom_capacity = 0;
+static size_t link_count = 0;
+
+static Atom *outgoing = NULL;              /* indexed by slot */
+static Atom *slot_owner = NULL;
+static uint32_t *slot_next = NULL;         /* older slot with the same target, plus one */
+static size_t slot_count = 0;
+static size_t slot_capacity = 0;
+
+static char *names = NULL;                 /* NUL-terminated names, back to back */
+static size_t names_used = 0;
+static size_t names_capacity = 0;
+static uint32_t *name_table = NULL;        /* open addressing, offset plus one */
+static size_t name_table_capacity = 0;
+static size_t name_count = 0;
+
+static Atom *atom_table = NULL;            /* open addressing over all atoms */
+static size_t atom_table_capacity = 0;
+
+static void *image = NULL;                 /* loaded file the arrays may point into */
+static size_t image_size = 0;
+
+static int mapped(const void *p) {
+    return image && (const char *)p >= (const char *)image &&
+           (const char *)p < (const char *)image + image_size;
+}
+
+static void release(void *p) {
+    if (!mapped(p)) free(p);
+}
+
+/* Make room for need elements in a doubling array; one still in a
+ * loaded image is copied out */
+static int reserve(void **array, size_t *capacity, size_t need, size_t size) {
+    if (need <= *capacity) return 0;
+    size_t grown = *capacity ? *capacity : 64;
+    while (grown < need) grown *= 2;
+    void *p;
+    if (mapped(*array)) {
+        if ((p = malloc(grown * size)) != NULL) memcpy(p, *array, *capacity * size);
+    } else {
+        p = realloc(*array, grown * size);
+    }
+    if (!p) return -1;
+    *array = p;
+    *capacity = grown;
+    return 0;
+}
+
+static uint32_t hash_string(const char *s) {
+    uint32_t hash = 2166136261u;
+    for (; *s; s++) {
+        hash ^= (unsigned char)*s;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Final avalanche, so that tables can index by the low bits */
+static uint32_t hash_mix(uint32_t hash) {
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    return hash ^ hash >> 16;
+}
+
+/* Names are interned, so a node is identified by its type and offset */
+static uint32_t hash_node(uint16_t type, uint32_t name) {
+    return hash_mix(name ^ (uint32_t)type << 24);
+}
+
+static uint32_t hash_link(uint16_t type, const Atom *out, uint32_t arity) {
+    uint32_t hash = 2166136261u ^ type;
+    for (uint32_t i = 0; i < arity; i++) {
+        hash ^= out[i];
+        hash *= 16777619u;
+    }
+    return hash_mix(hash);
+}
+
+static uint32_t hash_atom(Atom atom) {
+    const AtomRecord *r = &atoms[atom];
+    if (types[r->type].link) return hash_link(r->type, outgoing + r->first, r->arity);
+    return hash_node(r->type, r->first);
+}
+
+/* Types */
+
+static uint16_t type_add(const char *name, int link) {
+    if (type_count + 1 >= HYPERGRAPH_MAX_TYPES) return 0;
+    char *copy = malloc(strlen(name) + 1);
+    if (!copy) return 0;
+    strcpy(copy, name);
+    type_count++;
+    types[type_count].name = copy;
+    types[type_count].link = link;
+    types[type_count].atoms = NULL;
+    types[type_count].count = 0;
+    types[type_count].capacity = 0;
+    return type_count;
+}
+
+static void types_init(void) {
+    if (type_count) return;
+    for (size_t i = 0; i < sizeof(builtin_types) / sizeof(builtin_types[0]); i++) {
+        type_add(builtin_types[i].name, builtin_types[i].link);
+    }
+}
+
+uint16_t hypergraph_type_lookup(const char *name) {
+    types_init();
+    for (uint16_t t = 1; t <= type_count; t++) {
+        if (strcmp(types[t].name, name) == 0) return t;
+    }
+    return 0;
+}
+
+/* 0 for a node type name, 1 for a link type name, -1 for neither */
+int hypergraph_type_kind(const char *name) {
+    size_t len = strlen(name);
+    if (len <= 4) return -1;
+    if (strcmp(name + len - 4, "Node") == 0) return 0;
+    if (strcmp(name + len - 4, "Link") == 0) return 1;
+    return -1;
+}
+
+uint16_t hypergraph_type(const char *name) {
+    uint16_t type = hypergraph_type_lookup(name);
+    if (type) return type;
+
+    int kind = hypergraph_type_kind(name);
+    return kind < 0 ? 0 : type_add(name, kind);
+}
+
+const char *hypergraph_type_name(uint16_t type) {
+    types_init();
+    return type >= 1 && type <= type_count ? types[type].name : NULL;
+}
+
+int hypergraph_type_is_link(uint16_t type) {
+    return type >= 1 && type <= type_count && types[type].link;
+}
+
+uint16_t hypergraph_type_count(void) {
+    types_init();
+    return type_count;
+}
+
+/* Name pool */
+
+static int name_table_grow(void) {
+    size_t capacity = name_table_capacity ? name_table_capacity * 2 : 1024;
+    uint32_t *table = calloc(capacity, sizeof(uint32_t));
+    if (!table) return -1;
+
+    for (size_t i = 0; i < name_table_capacity; i++) {
+        if (!name_table[i]) continue;
+        size_t j = hash_string(names + name_table[i] - 1) & (capacity - 1);
+        while (table[j]) j = (j + 1) & (capacity - 1);
+        table[j] = name_table[i];
+    }
+    release(name_table);
+    name_table = table;
+    name_table_capacity = capacity;
+    return 0;
+}
+
+/* Offset of name in the pool, adding it when add is set; -1 if absent */
+static int64_t name_offset(const char *name, int add) {
+    if (!name_table_capacity) {
+        if (!add || name_table_grow() < 0) return -1;
+    }
+
+    size_t i = hash_string(name) & (name_table_capacity - 1);
+    while (name_table[i]) {
+        if (strcmp(names + name_table[i] - 1, name) == 0) return name_table[i] - 1;
+        i = (i + 1) & (name_table_capacity - 1);
+    }
+    if (!add) return -1;
+
+    size_t len = strlen(name) + 1;
+    if (names_used + len >= UINT32_MAX) return -1;
+    if (reserve((void**)&names, &names_capacity, names_used + len, 1) < 0) return -1;
+    if ((name_count + 1) * 2 > name_table_capacity) {
+        if (name_table_grow() < 0) return -1;
+        i = hash_string(name) & (name_table_capacity - 1);
+        while (name_table[i]) i = (i + 1) & (name_table_capacity - 1);
+    }
+
+    uint32_t offset = names_used;
+    memcpy(names + offset, name, len);
+    names_used += len;
+    name_table[i] = offset + 1;
+    name_count++;
+    return offset;
+}
+
+/* Atom table */
+
+static int atom_table_grow(void) {
+    size_t capacity = atom_table_capacity ? atom_table_capacity * 2 : 1024;
+    Atom *table = calloc(capacity, sizeof(Atom));
+    if (!table) return -1;
+
+    for (Atom a = 1; a <= atom_count; a++) {
+        size_t j = hash_atom(a) & (capacity - 1);
+        while (table[j]) j = (j + 1) & (capacity - 1);
+        table[j] = a;
+    }
+    release(atom_table);
+    atom_table = table;
+    atom_table_capacity = capacity;
+    return 0;
+}
+
+/* Slot of a node in the atom table: its handle, or the empty slot where
+ * it belongs */
+static Atom *node_slot(uint16_t type, uint32_t name) {
+    size_t i = hash_node(type, name) & (atom_table_capacity - 1);
+    while (atom_table[i]) {
+        const AtomRecord *r = &atoms[atom_table[i]];
+        if (r->type == type && r->first == name) break;
+        i = (i + 1) & (atom_table_capacity - 1);
+    }
+    return &atom_table[i];
+}
+
+static Atom *link_slot(uint16_t type, const Atom *out, uint32_t arity) {
+    size_t i = hash_link(type, out, arity) & (atom_table_capacity - 1);
+    while (atom_table[i]) {
+        const AtomRecord *r = &atoms[atom_table[i]];
+        if (r->type == type && r->arity == arity &&
+            memcmp(outgoing + r->first, out, arity * sizeof(Atom)) == 0) break;
+        i = (i + 1) & (atom_table_capacity - 1);
+    }
+    return &atom_table[i];
+}
+
+/* Append a record and list it under its type; the caller fills in
+ * first and arity and enters it in the atom table */
+static Atom atom_new(uint16_t type) {
+    AtomType *t = &types[type];
+    if (atom_count + 1 >= UINT32_MAX) return 0;
+    size_t capacity = atom_capacity;
+    if (reserve((void**)&atoms, &capacity, atom_count + 2, sizeof(AtomRecord)) < 0) return 0;
+    capacity = atom_capacity;
+    if (reserve((void**)&truth, &capacity, atom_count + 2, sizeof(TruthRecord)) < 0) return 0;
+    capacity = atom_capacity;
+    if (reserve((void**)&attention, &capacity, atom_count + 2, sizeof(AttentionRecord)) < 0) return 0;
+    atom_capacity = capacity;
+    if (reserve((void**)&t->atoms, &t->capacity, t->count + 1, sizeof(Atom)) < 0) return 0;
+    if ((atom_count + 1) * 2 > atom_table_capacity && atom_table_grow() < 0) return 0;
+
+    Atom atom = ++atom_count;
+    AtomRecord *r = &atoms[atom];
+    r->type = type;
+    r->first = 0;
+    r->arity = 0;
+    r->incoming = 0;
+    r->incoming_count = 0;
+    truth[atom].strength = 1.0f;
+    truth[atom].confidence = 0.0f;
+    attention[atom].sti = 0.0f;
+    attention[atom].lti = 0.0f;
+    t->atoms[t->count++] = atom;
+    return atom;
+}
+
+Atom hypergraph_find_node(uint16_t type, const char *name) {
+    if (!name || !atom_table_capacity || type < 1 || type > type_count || types[type].link) return 0;
+    int64_t offset = name_offset(name, 0);
+    if (offset < 0) return 0;
+    return *node_slot(type, (uint32_t)offset);
+}
+
+Atom hypergraph_add_node(uint16_t type, const char *name) {
+    types_init();
+    if (!name || type < 1 || type > type_count || types[type].link) return 0;
+    int64_t offset = name_offset(name, 1);
+    if (offset < 0) return 0;
+    if (atom_table_capacity) {
+        Atom found = *node_slot(type, (uint32_t)offset);
+        if (found) return found;
+    }
+
+    Atom atom = atom_new(type);
+    if (!atom) return 0;
+    atoms[atom].first = (uint32_t)offset;
+    *node_slot(type, (uint32_t)offset) = atom;
+    return atom;
+}
+
+Atom hypergraph_find_link(uint16_t type, const Atom *out, uint32_t arity) {
+    if (!atom_table_capacity || type < 1 || type > type_count || !types[type].link) return 0;
+    return *link_slot(type, out, arity);
+}
+
+Atom hypergraph_add_link(uint16_t type, const Atom *out, uint32_t arity) {
+    types_init();
+    if (type < 1 || type > type_count || !types[type].link) return 0;
+    for (uint32_t i = 0; i < arity; i++) {
+        if (!hypergraph_valid(out[i])) return 0;
+    }
+    if (atom_table_capacity) {
+        Atom found = *link_slot(type, out, arity);
+        if (found) return found;
+    }
+
+    if (slot_count + arity >= UINT32_MAX) return 0;
+    uintptr_t inside = (uintptr_t)(out - outgoing);
+    if ((uintptr_t)out < (uintptr_t)outgoing || inside >= slot_count) inside = UINTPTR_MAX;
+    size_t capacity = slot_capacity;
+    if (reserve((void**)&outgoing, &capacity, slot_count + arity, sizeof(Atom)) < 0) return 0;
+    capacity = slot_capacity;
+    if (reserve((void**)&slot_owner, &capacity, slot_count + arity, sizeof(Atom)) < 0) return 0;
+    capacity = slot_capacity;
+    if (reserve((void**)&slot_next, &capacity, slot_count + arity, sizeof(uint32_t)) < 0) return 0;
+    slot_capacity = capacity;
+
+    /* out may be another link's run, which reserve can have moved */
+    if (inside != UINTPTR_MAX) out = outgoing + inside;
+    uint32_t first = slot_count;
+    memmove(outgoing + first, out, arity * sizeof(Atom));
+
+    Atom atom = atom_new(type);
+    if (!atom) return 0;
+    atoms[atom].first = first;
+    atoms[atom].arity = arity;
+    for (uint32_t i = 0; i < arity; i++) {
+        uint32_t slot = first + i;
+        AtomRecord *target = &atoms[outgoing[slot]];
+        slot_owner[slot] = atom;
+        slot_next[slot] = target->incoming;
+        target->incoming = slot + 1;
+        target->incoming_count++;
+    }
+    slot_count += arity;
+    link_count++;
+    *link_slot(type, outgoing + first, arity) = atom;
+    return atom;
+}
+
+/* Atom fields */
+
+int hypergraph_valid(Atom atom) {
+    return atom >= 1 && atom <= atom_count;
+}
+
+uint16_t hypergraph_atom_type(Atom atom) {
+    return hypergraph_valid(atom) ? atoms[atom].type : 0;
+}
+
+const char *hypergraph_atom_name(Atom atom) {
+    if (!hypergraph_valid(atom) || types[atoms[atom].type].link) return NULL;
+    return names + atoms[atom].first;
+}
+
+const Atom *hypergraph_outgoing(Atom atom, uint32_t *arity) {
+    if (!hypergraph_valid(atom) || !types[atoms[atom].type].link) {
+        *arity = 0;
+        return NULL;
+    }
+    *arity = atoms[atom].arity;
+    return outgoing + atoms[atom].first;
+}
+
+void hypergraph_get_tv(Atom atom, float *strength, float *confidence) {
+    if (!hypergraph_valid(atom)) {
+        *strength = 0.0f;
+        *confidence = 0.0f;
+        return;
+    }
+    *strength = truth[atom].strength;
+    *confidence = truth[atom].confidence;
+}
+
+void hypergraph_set_tv(Atom atom, float strength, float confidence) {
+    if (!hypergraph_valid(atom)) return;
+    truth[atom].strength = strength;
+    truth[atom].confidence = confidence;
+}
+
+void hypergraph_get_av(Atom atom, float *sti, float *lti) {
+    if (!hypergraph_valid(atom)) {
+        *sti = 0.0f;
+        *lti = 0.0f;
+        return;
+    }
+    *sti = attention[atom].sti;
+    *lti = attention[atom].lti;
+}
+
+void hypergraph_set_av(Atom atom, float sti, float lti) {
+    if (!hypergraph_valid(atom)) return;
+    attention[atom].sti = sti;
+    attention[atom].lti = lti;
+}
+
+/* Indexes */
+
+const Atom *hypergraph_atoms_of_type(uint16_t type, size_t *count) {
+    if (type < 1 || type > type_count) {
+        *count = 0;
+        return NULL;
+    }
+    *count = types[type].count;
+    return types[type].atoms;
+}
+
+uint32_t hypergraph_incoming_count(Atom atom) {
+    return hypergraph_valid(atom) ? atoms[atom].incoming_count : 0;
+}
+
+Atom hypergraph_incoming_next(Atom atom, uint32_t *cursor) {
+    uint32_t position;
+    return hypergraph_incoming_next_at(atom, cursor, &position);
+}
+
+Atom hypergraph_incoming_next_at(Atom atom, uint32_t *cursor, uint32_t *position) {
+    if (!hypergraph_valid(atom) || *cursor == UINT32_MAX) return 0;
+
+    uint32_t next = *cursor ? *cursor : atoms[atom].incoming;
+    if (!next) {
+        *cursor = UINT32_MAX;
+        return 0;
+    }
+    *cursor = slot_next[next - 1] ? slot_next[next - 1] : UINT32_MAX;
+    Atom link = slot_owner[next - 1];
+    *position = next - 1 - atoms[link].first;
+    return link;
+}
+
+/* Nodes of any type called name; returns how many there are, storing
+ * up to max of them */
+size_t hypergraph_find_name(const char *name, Atom *found, size_t max) {
+    if (!atom_table_capacity) return 0;
+    int64_t offset = name_offset(name, 0);
+    if (offset < 0) return 0;
+
+    size_t n = 0;
+    for (uint16_t t = 1; t <= type_count; t++) {
+        if (types[t].link) continue;
+        Atom atom = *node_slot(t, (uint32_t)offset);
+        if (!atom) continue;
+        if (n < max) found[n] = atom;
+        n++;
+    }
+    return n;
+}
+
+size_t hypergraph_atom_count(void) {
+    return atom_count;
+}
+
+size_t hypergraph_link_count(void) {
+    return link_count;
+}
+
+void hypergraph_clear(void) {
+    for (uint16_t t = 1; t <= type_count; t++) {
+        free(types[t].name);
+        release(types[t].atoms);
+    }
+    type_count = 0;
+
+    release(atoms);
+    release(truth);
+    release(attention);
+    release(outgoing);
+    release(slot_owner);
+    release(slot_next);
+    release(names);
+    release(name_table);
+    release(atom_table);
+    if (image) munmap(image, image_size);
+    image = NULL;
+    image_size = 0;
+    atoms = NULL;
+    truth = NULL;
+    attention = NULL;
+    outgoing = slot_owner = atom_table = NULL;
+    slot_next = name_table = NULL;
+    names = NULL;
+    atom_count = atom_capacity = link_count = 0;
+    slot_count = slot_capacity = 0;
+    names_used = names_capacity = name_table_capacity = name_count = 0;
+    atom_table_capacity = 0;
+}
+
+/* S-expressions */
+
+static const char *skip_space(const char *p) {
+    while (isspace((unsigned char)*p)) p++;
+    return p;
+}
+
+char *hypergraph_read_name(const char **text, const char **error) {
+    const char *p = *text;
+    char *name;
+
+    if (*p == '"') {
+        const char *start = ++p;
+        while (*p && *p != '"') p += p[0] == '\\' && p[1] ? 2 : 1;
+        if (*p != '"') {
+            *error = "unterminated string";
+            return NULL;
+        }
+        name = malloc(p - start + 1);
+        if (!name) {
+            *error = "out of memory";
+            return NULL;
+        }
+        size_t n = 0;
+        for (const char *q = start; q < p; q++) {
+            if (*q == '\\') q++;
+            name[n++] = *q;
+        }
+        name[n] = '\0';
+        p++;
+    } else {
+        const char *start = p;
+        while (*p && !isspace((unsigned char)*p) && *p != '(' && *p != ')' && *p != '"') p++;
+        if (p == start) {
+            *error = "expected a name";
+            return NULL;
+        }
+        name = malloc(p - start + 1);
+        if (!name) {
+            *error = "out of memory";
+            return NULL;
+        }
+        memcpy(name, start, p - start);
+        name[p - start] = '\0';
+    }
+    *text = p;
+    return name;
+}
+
+/* (stv strength confidence), with p just past "(stv" */
+static const char *parse_stv(const char *p, float *strength, float *confidence,
+                             const char **error) {
+    char *end;
+    *strength = strtof(p, &end);
+    if (end == p) {
+        *error = "bad stv";
+        return NULL;
+    }
+    p = end;
+    *confidence = strtof(p, &end);
+    if (end == p) {
+        *error = "bad stv";
+        return NULL;
+    }
+    p = skip_space(end);
+    if (*p != ')') {
+        *error = "bad stv";
+        return NULL;
+    }
+    return p + 1;
+}
+
+static Atom parse_atom(const char **text, int add, int depth, const char **error) {
+    const char *p = skip_space(*text);
+    if (*p != '(') {
+        *error = "expected '('";
+        return 0;
+    }
+    if (depth >= HYPERGRAPH_MAX_DEPTH) {
+        *error = "atom nested too deeply";
+        return 0;
+    }
+
+    const char *start = p = skip_space(p + 1);
+    while (isalnum((unsigned char)*p) || *p == '_' || *p == '-') p++;
+    char type_name[64];
+    if (p == start || (size_t)(p - start) >= sizeof(type_name)) {
+        *error = "expected an atom type";
+        return 0;
+    }
+    memcpy(type_name, start, p - start);
+    type_name[p - start] = '\0';
+    /* A lookup of a type not yet in use still has to be parsed, but
+     * can match nothing */
+    uint16_t type = add ? hypergraph_type(type_name) : hypergraph_type_lookup(type_name);
+    int link = type ? types[type].link : hypergraph_type_kind(type_name);
+    if (link < 0 || (add && !type)) {
+        *error = "unknown atom type";
+        return 0;
+    }
+
+    float strength = 0.0f, confidence = 0.0f;
+    int has_tv = 0;
+    p = skip_space(p);
+    if (strncmp(p, "(stv", 4) == 0 && isspace((unsigned char)p[4])) {
+        p = parse_stv(p + 4, &strength, &confidence, error);
+        if (!p) return 0;
+        has_tv = 1;
+        p = skip_space(p);
+    }
+
+    Atom atom = 0;
+    int missing = !type;
+    if (!link) {
+        char *name = hypergraph_read_name(&p, error);
+        if (!name) return 0;
+        atom = add ? hypergraph_add_node(type, name) : hypergraph_find_node(type, name);
+        free(name);
+        if (add && !atom) {
+            *error = "out of memory";
+            return 0;
+        }
+    } else {
+        Atom *out = NULL;
+        size_t arity = 0, capacity = 0;
+        for (p = skip_space(p); *p && *p != ')'; p = skip_space(p)) {
+            Atom child = parse_atom(&p, add, depth + 1, error);
+            if (!child) {
+                if (*error) {
+                    free(out);
+                    return 0;
+                }
+                missing = 1;
+            }
+            if (reserve((void**)&out, &capacity, arity + 1, sizeof(Atom)) < 0) {
+                free(out);
+                *error = "out of memory";
+                return 0;
+            }
+            out[arity++] = child;
+        }
+        if (!missing) {
+            atom = add ? hypergraph_add_link(type, out, arity) : hypergraph_find_link(type, out, arity);
+            if (add && !atom) {
+                free(out);
+                *error = "out of memory";
+                return 0;
+            }
+        }
+        free(out);
+    }
+
+    p = skip_space(p);
+    if (*p != ')') {
+        *error = "expected ')'";
+        return 0;
+    }
+    if (atom && has_tv && add) hypergraph_set_tv(atom, strength, confidence);
+    *text = p + 1;
+    return atom;
+}
+
+Atom hypergraph_parse(const char **text, int add, const char **error) {
+    *error = NULL;
+    return parse_atom(text, add, 0, error);
+}
+
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+} FormatBuffer;
+
+static void format_put(FormatBuffer *f, const char *s, size_t n) {
+    if (f->len < f->size) {
+        size_t room = f->size - f->len - 1;
+        memcpy(f->buf + f->len, s, n < room ? n : room);
+    }
+    f->len += n;
+}
+
+static void format_atom(FormatBuffer *f, Atom atom, int depth) {
+    const AtomRecord *r = &atoms[atom];
+    const char *type = types[r->type].name;
+
+    if (depth >= HYPERGRAPH_MAX_DEPTH) {
+        format_put(f, "...", 3);
+        return;
+    }
+    format_put(f, "(", 1);
+    format_put(f, type, strlen(type));
+    if (!types[r->type].link) {
+        format_put(f, " \"", 2);
+        for (const char *s = names + r->first; *s; s++) {
+            if (*s == '"' || *s == '\\') format_put(f, "\\", 1);
+            format_put(f, s, 1);
+        }
+        format_put(f, "\"", 1);
+    } else {
+        for (uint32_t i = 0; i < r->arity; i++) {
+            format_put(f, " ", 1);
+            format_atom(f, outgoing[r->first + i], depth + 1);
+        }
+    }
+    format_put(f, ")", 1);
+}
+
+/* Like snprintf: returns the full length and truncates to size */
+int hypergraph_format(Atom atom, char *buf, size_t size) {
+    FormatBuffer f = { buf, size, 0 };
+    if (hypergraph_valid(atom)) format_atom(&f, atom, 0);
+    if (size) buf[f.len < size ? f.len : size - 1] = '\0';
+    return (int)f.len;
+}
+
+Atom hypergraph_encode_words(const char *text) {
+    uint16_t concept = hypergraph_type("ConceptNode");
+    uint16_t ordered = hypergraph_type("OrderedLink");
+    uint16_t list = hypergraph_type("ListLink");
+    Atom *words = NULL;
+    size_t count = 0, capacity = 0;
+    Atom result = 0;
+
+    char *word = malloc(strlen(text) + 1);
+    if (!word) return 0;
+    for (const char *p = skip_space(text); *p; p = skip_space(p)) {
+        size_t n = 0;
+        while (*p && !isspace((unsigned char)*p)) word[n++] = *p++;
+        word[n] = '\0';
+        if (reserve((void**)&words, &capacity, count + 1, sizeof(Atom)) < 0) goto done;
+        if (!(words[count++] = hypergraph_add_node(concept, word))) goto done;
+    }
+    for (size_t i = 0; i + 1 < count; i++) {
+        if (!hypergraph_add_link(ordered, words + i, 2)) goto done;
+    }
+    if (count) result = hypergraph_add_link(list, words, count);
+
+done:
+    free(word);
+    free(words);
+    return result;
+}
+
+
+/* Binary images
+ * A header, then one section per array, each starting on a 64-byte
+ * boundary.  Arrays are written exactly as they are held, in the byte
+ * order of the machine, so loading maps the file and points the store
+ * at the sections.  The mapping is private: writes made by later
+ * changes stay in memory, and any array that has to grow is copied
+ * out of it by reserve.
+ */
+
+#define HYPERGRAPH_FILE_MAGIC "RCHYPER"
+#define HYPERGRAPH_FILE_FORMAT 1
+#define HYPERGRAPH_FILE_ORDER 0x01020304u
+#define HYPERGRAPH_FILE_ALIGN 64
+
+enum {
+    SECTION_TYPES,              /* per type: link flag, then its name */
+    SECTION_TYPE_COUNTS,        /* uint32 atoms per type */
+    SECTION_TYPE_ATOMS,         /* the per-type lists, back to back */
+    SECTION_NAMES,
+    SECTION_NAME_TABLE,
+    SECTION_ATOMS,              /* records, from handle 0 */
+    SECTION_TRUTH,
+    SECTION_ATTENTION,
+    SECTION_OUTGOING,
+    SECTION_SLOT_OWNER,
+    SECTION_SLOT_NEXT,
+    SECTION_ATOM_TABLE,
+    SECTION_COUNT
+};
+
+typedef struct {
+    char magic[8];
+    uint32_t format;
+    uint32_t byte_order;
+    uint32_t record_size;       /* sizeof(AtomRecord) of the writer */
+    uint32_t type_count;
+    uint64_t atom_count;
+    uint64_t link_count;
+    uint64_t slot_count;
+    uint64_t names_used;
+    uint64_t name_count;
+    uint64_t name_table_capacity;
+    uint64_t atom_table_capacity;
+    struct {
+        uint64_t offset;
+        uint64_t length;
+    } sections[SECTION_COUNT];
+    uint32_t checksum;          /* FNV-1a of everything above */
+    uint32_t unused;
+} HypergraphFileHeader;
+
+static uint32_t header_checksum(const HypergraphFileHeader *header) {
+    const unsigned char *p = (const unsigned char *)header;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < offsetof(HypergraphFileHeader, checksum); i++) {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint64_t align_up(uint64_t n) {
+    return (n + HYPERGRAPH_FILE_ALIGN - 1) & ~(uint64_t)(HYPERGRAPH_FILE_ALIGN - 1);
+}
+
+static int write_bytes(FILE *f, uint64_t *pos, const void *data, size_t length) {
+    if (length && fwrite(data, 1, length, f) != length) return -1;
+    *pos += length;
+    return 0;
+}
+
+static int write_pad(FILE *f, uint64_t *pos, uint64_t offset) {
+    static const char zero[HYPERGRAPH_FILE_ALIGN];
+    while (*pos < offset) {
+        size_t n = offset - *pos < sizeof(zero) ? offset - *pos : sizeof(zero);
+        if (write_bytes(f, pos, zero, n) < 0) return -1;
+    }
+    return 0;
+}
+
+/* Handle 0 is never used, so an array indexed by handle is written with
+ * a zeroed element in its place */
+static int write_handles(FILE *f, uint64_t *pos, const void *array, size_t size) {
+    if (write_pad(f, pos, *pos + size) < 0) return -1;
+    return atom_count ? write_bytes(f, pos, (const char *)array + size, atom_count * size) : 0;
+}
+
+static int write_image(FILE *f, HypergraphFileHeader *header) {
+    uint64_t pos = 0;
+    if (write_bytes(f, &pos, header, sizeof(*header)) < 0) return -1;
+
+    for (int s = 0; s < SECTION_COUNT; s++) {
+        if (write_pad(f, &pos, header->sections[s].offset) < 0) return -1;
+        int failed = 0;
+        switch (s) {
+        case SECTION_TYPES:
+            for (uint16_t t = 1; t <= type_count && !failed; t++) {
+                unsigned char link = types[t].link ? 1 : 0;
+                failed = write_bytes(f, &pos, &link, 1) < 0 ||
+                         write_bytes(f, &pos, types[t].name, strlen(types[t].name) + 1) < 0;
+            }
+            break;
+        case SECTION_TYPE_COUNTS:
+            for (uint16_t t = 1; t <= type_count && !failed; t++) {
+                uint32_t count = types[t].count;
+                failed = write_bytes(f, &pos, &count, sizeof(count)) < 0;
+            }
+            break;
+        case SECTION_TYPE_ATOMS:
+            for (uint16_t t = 1; t <= type_count && !failed; t++) {
+                failed = write_bytes(f, &pos, types[t].atoms, types[t].count * sizeof(Atom)) < 0;
+            }
+            break;
+        case SECTION_NAMES:
+            failed = write_bytes(f, &pos, names, names_used) < 0;
+            break;
+        case SECTION_NAME_TABLE:
+            failed = write_bytes(f, &pos, name_table, name_table_capacity * sizeof(uint32_t)) < 0;
+            break;
+        case SECTION_ATOMS:
+            failed = write_handles(f, &pos, atoms, sizeof(AtomRecord)) < 0;
+            break;
+        case SECTION_TRUTH:
+            failed = write_handles(f, &pos, truth, sizeof(TruthRecord)) < 0;
+            break;
+        case SECTION_ATTENTION:
+            failed = write_handles(f, &pos, attention, sizeof(AttentionRecord)) < 0;
+            break;
+        case SECTION_OUTGOING:
+            failed = write_bytes(f, &pos, outgoing, slot_count * sizeof(Atom)) < 0;
+            break;
+        case SECTION_SLOT_OWNER:
+            failed = write_bytes(f, &pos, slot_owner, slot_count * sizeof(Atom)) < 0;
+            break;
+        case SECTION_SLOT_NEXT:
+            failed = write_bytes(f, &pos, slot_next, slot_count * sizeof(uint32_t)) < 0;
+            break;
+        case SECTION_ATOM_TABLE:
+            failed = write_bytes(f, &pos, atom_table, atom_table_capacity * sizeof(Atom)) < 0;
+            break;
+        }
+        if (failed) return -1;
+    }
+    return 0;
+}
+
+int hypergraph_save(const char *path, const char **error) {
+    types_init();
+
+    HypergraphFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HYPERGRAPH_FILE_MAGIC, sizeof(header.magic));
+    header.format = HYPERGRAPH_FILE_FORMAT;
+    header.byte_order = HYPERGRAPH_FILE_ORDER;
+    header.record_size = sizeof(AtomRecord);
+    header.type_count = type_count;
+    header.atom_count = atom_count;
+    header.link_count = link_count;
+    header.slot_count = slot_count;
+    header.names_used = names_used;
+    header.name_count = name_count;
+    header.name_table_capacity = name_table_capacity;
+    header.atom_table_capacity = atom_table_capacity;
+
+    uint64_t type_bytes = 0;
+    for (uint16_t t = 1; t <= type_count; t++) type_bytes += strlen(types[t].name) + 2;
+    uint64_t lengths[SECTION_COUNT] = {
+        [SECTION_TYPES] = type_bytes,
+        [SECTION_TYPE_COUNTS] = (uint64_t)type_count * sizeof(uint32_t),
+        [SECTION_TYPE_ATOMS] = atom_count * sizeof(Atom),
+        [SECTION_NAMES] = names_used,
+        [SECTION_NAME_TABLE] = name_table_capacity * sizeof(uint32_t),
+        [SECTION_ATOMS] = (atom_count + 1) * sizeof(AtomRecord),
+        [SECTION_TRUTH] = (atom_count + 1) * sizeof(TruthRecord),
+        [SECTION_ATTENTION] = (atom_count + 1) * sizeof(AttentionRecord),
+        [SECTION_OUTGOING] = slot_count * sizeof(Atom),
+        [SECTION_SLOT_OWNER] = slot_count * sizeof(Atom),
+        [SECTION_SLOT_NEXT] = slot_count * sizeof(uint32_t),
+        [SECTION_ATOM_TABLE] = atom_table_capacity * sizeof(Atom),
+    };
+    uint64_t offset = align_up(sizeof(header));
+    for (int s = 0; s < SECTION_COUNT; s++) {
+        header.sections[s].offset = offset;
+        header.sections[s].length = lengths[s];
+        offset = align_up(offset + lengths[s]);
+    }
+    header.checksum = header_checksum(&header);
+
+    /* Written beside the target and renamed over it, so a failed save
+     * never leaves a partial image under the real name */
+    size_t len = strlen(path);
+    char *temp = malloc(len + 5);
+    if (!temp) {
+        *error = "out of memory";
+        return -1;
+    }
+    memcpy(temp, path, len);
+    memcpy(temp + len, ".tmp", 5);
+
+    FILE *f = fopen(temp, "wb");
+    if (!f) {
+        *error = "cannot create file";
+        free(temp);
+        return -1;
+    }
+    int failed = write_image(f, &header) < 0;
+    failed |= fflush(f) != 0;
+    failed |= fsync(fileno(f)) != 0;
+    failed |= fclose(f) != 0;
+    if (failed || rename(temp, path) != 0) {
+        *error = failed ? "write failed" : "cannot replace file";
+        unlink(temp);
+        free(temp);
+        return -1;
+    }
+    free(temp);
+    return 0;
+}
+
+/* Every check an image has to pass before the store is pointed at it:
+ * sizes agree with the header, every offset and handle is in range,
+ * and every incoming chain and probe sequence ends, so nothing that
+ * reads the loaded store can run off an array.  One pass over each
+ * section; the indexes are trusted to match the atoms beyond that. */
+static const char *image_check(const char *map, size_t size) {
+    const HypergraphFileHeader *header = (const HypergraphFileHeader *)map;
+    if (size < sizeof(*header) || memcmp(header->magic, HYPERGRAPH_FILE_MAGIC, sizeof(header->magic)) != 0) {
+        return "not a hypergraph image";
+    }
+    if (header->format != HYPERGRAPH_FILE_FORMAT || header->byte_order != HYPERGRAPH_FILE_ORDER ||
+        header->record_size != sizeof(AtomRecord)) {
+        return "image from an incompatible build";
+    }
+    if (header->checksum != header_checksum(header)) return "corrupt header";
+
+    uint64_t n = header->atom_count, slots = header->slot_count;
+    uint64_t used = header->names_used;
+    uint64_t name_capacity = header->name_table_capacity;
+    uint64_t table_capacity = header->atom_table_capacity;
+    if (header->type_count < 1 || header->type_count >= HYPERGRAPH_MAX_TYPES ||
+        n >= UINT32_MAX || slots >= UINT32_MAX || used >= UINT32_MAX ||
+        header->link_count > n ||
+        name_capacity > UINT32_MAX || (name_capacity & (name_capacity - 1)) ||
+        header->name_count > name_capacity || (name_capacity && header->name_count == name_capacity) ||
+        table_capacity > UINT32_MAX || (table_capacity & (table_capacity - 1)) ||
+        n > table_capacity || (table_capacity && n == table_capacity)) {
+        return "corrupt header";
+    }
+
+    uint64_t lengths[SECTION_COUNT] = {
+        [SECTION_TYPES] = header->sections[SECTION_TYPES].length,
+        [SECTION_TYPE_COUNTS] = (uint64_t)header->type_count * sizeof(uint32_t),
+        [SECTION_TYPE_ATOMS] = n * sizeof(Atom),
+        [SECTION_NAMES] = used,
+        [SECTION_NAME_TABLE] = name_capacity * sizeof(uint32_t),
+        [SECTION_ATOMS] = (n + 1) * sizeof(AtomRecord),
+        [SECTION_TRUTH] = (n + 1) * sizeof(TruthRecord),
+        [SECTION_ATTENTION] = (n + 1) * sizeof(AttentionRecord),
+        [SECTION_OUTGOING] = slots * sizeof(Atom),
+        [SECTION_SLOT_OWNER] = slots * sizeof(Atom),
+        [SECTION_SLOT_NEXT] = slots * sizeof(uint32_t),
+        [SECTION_ATOM_TABLE] = table_capacity * sizeof(Atom),
+    };
+    for (int s = 0; s < SECTION_COUNT; s++) {
+        uint64_t offset = header->sections[s].offset;
+        if (offset % HYPERGRAPH_FILE_ALIGN || offset < sizeof(*header) || offset > size ||
+            header->sections[s].length != lengths[s] || lengths[s] > size - offset) {
+            return "truncated or corrupt image";
+        }
+    }
+#define SECTION(s) ((const void *)(map + header->sections[s].offset))
+
+    const char *p = SECTION(SECTION_TYPES), *end = p + lengths[SECTION_TYPES];
+    for (uint32_t t = 1; t <= header->type_count; t++) {
+        if (p == end || (unsigned char)*p > 1) return "corrupt type table";
+        const char *name = ++p;
+        p = memchr(name, '\0', end - name);
+        if (!p || p == name) return "corrupt type table";
+        p++;
+    }
+    if (p != end) return "corrupt type table";
+
+    const char *pool = SECTION(SECTION_NAMES);
+    if (used && pool[used - 1] != '\0') return "corrupt name pool";
+    const uint32_t *ntable = SECTION(SECTION_NAME_TABLE);
+    uint64_t entries = 0;
+    for (uint64_t i = 0; i < name_capacity; i++) {
+        if (!ntable[i]) continue;
+        uint32_t offset = ntable[i] - 1;
+        if (offset >= used || (offset && pool[offset - 1] != '\0')) return "corrupt name table";
+        entries++;
+    }
+    if (entries != header->name_count) return "corrupt name table";
+
+    /* Type flags are needed by handle below */
+    unsigned char link_type[HYPERGRAPH_MAX_TYPES];
+    p = SECTION(SECTION_TYPES);
+    for (uint32_t t = 1; t <= header->type_count; t++) {
+        link_type[t] = (unsigned char)*p;
+        p += strlen(p + 1) + 2;
+    }
+
+    const AtomRecord *records = SECTION(SECTION_ATOMS);
+    const Atom *out = SECTION(SECTION_OUTGOING);
+    const Atom *owner = SECTION(SECTION_SLOT_OWNER);
+    const uint32_t *next = SECTION(SECTION_SLOT_NEXT);
+    uint64_t type_tally[HYPERGRAPH_MAX_TYPES] = { 0 };
+    uint64_t slot = 0, links = 0, incoming = 0;
+    for (uint64_t a = 1; a <= n; a++) {
+        const AtomRecord *r = &records[a];
+        if (r->type < 1 || r->type > header->type_count || r->incoming > slots) return "corrupt atom";
+        type_tally[r->type]++;
+        incoming += r->incoming_count;
+        if (!link_type[r->type]) {
+            if (r->arity || r->first >= used || (r->first && pool[r->first - 1] != '\0')) {
+                return "corrupt atom";
+            }
+            continue;
+        }
+        if (r->first != slot || r->arity > slots - slot) return "corrupt atom";
+        for (uint32_t k = 0; k < r->arity; k++, slot++) {
+            if (!out[slot] || out[slot] >= a || owner[slot] != a || next[slot] > slot) {
+                return "corrupt outgoing set";
+            }
+        }
+        links++;
+    }
+    if (slot != slots || links != header->link_count || incoming != slots) {
+        return "corrupt outgoing set";
+    }
+
+    const Atom *table = SECTION(SECTION_ATOM_TABLE);
+    entries = 0;
+    for (uint64_t i = 0; i < table_capacity; i++) {
+        if (!table[i]) continue;
+        if (table[i] > n) return "corrupt atom table";
+        entries++;
+    }
+    if (entries != n) return "corrupt atom table";
+
+    const uint32_t *type_counts = SECTION(SECTION_TYPE_COUNTS);
+    const Atom *list = SECTION(SECTION_TYPE_ATOMS);
+    for (uint32_t t = 1; t <= header->type_count; t++) {
+        if (type_counts[t - 1] != type_tally[t]) return "corrupt type lists";
+        for (uint32_t i = 0; i < type_counts[t - 1]; i++) {
+            Atom a = list[i];
+            if (a < 1 || a > n || records[a].type != t || (i && a <= list[i - 1])) {
+                return "corrupt type lists";
+            }
+        }
+        list += type_counts[t - 1];
+    }
+    return NULL;
+}
+
+/* An empty section leaves its array unallocated */
+static void *section_array(const char *map, const HypergraphFileHeader *header, int s) {
+    return header->sections[s].length ? (void *)SECTION(s) : NULL;
+}
+
+/* Points the store at a checked image, taking over the mapping */
+static int image_adopt(char *map, size_t size) {
+    const HypergraphFileHeader *header = (const HypergraphFileHeader *)map;
+    char *type_names[HYPERGRAPH_MAX_TYPES];
+    const char *p = SECTION(SECTION_TYPES);
+    for (uint32_t t = 1; t <= header->type_count; t++) {
+        type_names[t] = strdup(p + 1);
+        if (!type_names[t]) {
+            while (--t) free(type_names[t]);
+            return -1;
+        }
+        p += strlen(p + 1) + 2;
+    }
+
+    hypergraph_clear();
+    image = map;
+    image_size = size;
+
+    const uint32_t *type_counts = SECTION(SECTION_TYPE_COUNTS);
+    Atom *list = section_array(map, header, SECTION_TYPE_ATOMS);
+    p = SECTION(SECTION_TYPES);
+    for (uint32_t t = 1; t <= header->type_count; t++) {
+        types[t].name = type_names[t];
+        types[t].link = *p;
+        types[t].count = types[t].capacity = type_counts[t - 1];
+        types[t].atoms = types[t].count ? list : NULL;
+        list += types[t].count;
+        p += strlen(p + 1) + 2;
+    }
+    type_count = header->type_count;
+
+    atoms = section_array(map, header, SECTION_ATOMS);
+    truth = section_array(map, header, SECTION_TRUTH);
+    attention = section_array(map, header, SECTION_ATTENTION);
+    atom_count = header->atom_count;
+    atom_capacity = atom_count + 1;
+    link_count = header->link_count;
+
+    outgoing = section_array(map, header, SECTION_OUTGOING);
+    slot_owner = section_array(map, header, SECTION_SLOT_OWNER);
+    slot_next = section_array(map, header, SECTION_SLOT_NEXT);
+    slot_count = slot_capacity = header->slot_count;
+
+    names = section_array(map, header, SECTION_NAMES);
+    names_used = names_capacity = header->names_used;
+    name_table = section_array(map, header, SECTION_NAME_TABLE);
+    name_table_capacity = header->name_table_capacity;
+    name_count = header->name_count;
+
+    atom_table = section_array(map, header, SECTION_ATOM_TABLE);
+    atom_table_capacity = header->atom_table_capacity;
+    return 0;
+}
+#undef SECTION
+
+int hypergraph_load(const char *path, const char **error) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        *error = "cannot open file";
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(HypergraphFileHeader)) {
+        close(fd);
+        *error = "not a hypergraph image";
+        return -1;
+    }
+
+    size_t size = st.st_size;
+    char *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        *error = "cannot map file";
+        return -1;
+    }
+    madvise(map, size, MADV_WILLNEED);
+
+    const char *problem = image_check(map, size);
+    if (!problem && image_adopt(map, size) < 0) problem = "out of memory";
+    if (problem) {
+        munmap(map, size);
+        *error = problem;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,82 @@
+/* Hypergraph Store Header
+ * Persistent in-memory atom store with type and incoming-set indexes
+ */
+
+#ifndef HYPERGRAPH_H
+#define HYPERGRAPH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Atoms are named by 1-based handles; 0 means "no atom".  A node is a
+ * type and a name, a link is a type and an ordered outgoing set; both
+ * are unique, so adding an existing atom returns its handle. */
+typedef uint32_t Atom;
+
+#define HYPERGRAPH_MAX_DEPTH 64         /* nesting bound for parse and format */
+#define HYPERGRAPH_MAX_TYPES 256
+
+/* Types.  Names ending in "Node" or "Link" that are not built in are
+ * registered on first use; hypergraph_type_kind tells which a name is
+ * (0 node, 1 link, -1 neither) without registering it. */
+extern uint16_t hypergraph_type(const char *name);
+extern uint16_t hypergraph_type_lookup(const char *name);
+extern int hypergraph_type_kind(const char *name);
+extern const char *hypergraph_type_name(uint16_t type);
+extern int hypergraph_type_is_link(uint16_t type);
+extern uint16_t hypergraph_type_count(void);
+
+/* Insertion and lookup; lookups never add */
+extern Atom hypergraph_add_node(uint16_t type, const char *name);
+extern Atom hypergraph_add_link(uint16_t type, const Atom *outgoing, uint32_t arity);
+extern Atom hypergraph_find_node(uint16_t type, const char *name);
+extern Atom hypergraph_find_link(uint16_t type, const Atom *outgoing, uint32_t arity);
+
+/* Atom fields.  Truth values default to (stv 1 0); attention values
+ * (STI, LTI) start at 0 and belong to the ECAN engine. */
+extern int hypergraph_valid(Atom atom);
+extern uint16_t hypergraph_atom_type(Atom atom);
+extern const char *hypergraph_atom_name(Atom atom);
+extern const Atom *hypergraph_outgoing(Atom atom, uint32_t *arity);
+extern void hypergraph_get_tv(Atom atom, float *strength, float *confidence);
+extern void hypergraph_set_tv(Atom atom, float strength, float confidence);
+extern void hypergraph_get_av(Atom atom, float *sti, float *lti);
+extern void hypergraph_set_av(Atom atom, float sti, float lti);
+
+/* Indexes.  Atoms of a type are listed in insertion order.  The
+ * incoming set is walked with a cursor starting at 0; a link holding
+ * the atom twice appears twice, and hypergraph_incoming_next_at also
+ * gives the position in the link's outgoing set of each appearance. */
+extern const Atom *hypergraph_atoms_of_type(uint16_t type, size_t *count);
+extern uint32_t hypergraph_incoming_count(Atom atom);
+extern Atom hypergraph_incoming_next(Atom atom, uint32_t *cursor);
+extern Atom hypergraph_incoming_next_at(Atom atom, uint32_t *cursor, uint32_t *position);
+extern size_t hypergraph_find_name(const char *name, Atom *atoms, size_t max);
+
+extern size_t hypergraph_atom_count(void);
+extern size_t hypergraph_link_count(void);
+extern void hypergraph_clear(void);
+
+/* S-expressions, as in (InheritanceLink (stv 0.9 0.8) (ConceptNode "cat")
+ * (ConceptNode "animal")).  hypergraph_parse reads one atom and advances
+ * text past it; with add false it only looks atoms up.  Returns 0 with
+ * error set on malformed input, and 0 with error NULL when a lookup
+ * finds nothing.  Node names are quoted with \" and \\ escapes, or bare
+ * words; hypergraph_read_name returns one as a malloc'd string. */
+extern Atom hypergraph_parse(const char **text, int add, const char **error);
+extern char *hypergraph_read_name(const char **text, const char **error);
+extern int hypergraph_format(Atom atom, char *buf, size_t size);
+
+/* Binary images of the whole store: types, names, atoms with their
+ * truth and attention values, and the indexes.  hypergraph_load maps
+ * the file and replaces the store with its contents, leaving the store
+ * as it was if the file is not a valid image.  Both return 0, or -1
+ * with error set. */
+extern int hypergraph_save(const char *path, const char **error);
+extern int hypergraph_load(const char *path, const char **error);
+
+/* Plain text: a ConceptNode per word, an OrderedLink per adjacent pair
+ * and a ListLink over the whole sequence, which is returned */
+extern Atom hypergraph_encode_words(const char *text);
+
+#endif /* HYPERGRAPH_H */
@@ -0,0 +1,302 @@
+/* Symbol Interning Implementation
+ * Symbols are stored once in an append-only arena and named by small
+ * integers, so membranes can count and move objects without touching
+ * strings.
+ */
+
+#include "intern.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Global symbol table */
+
+#define ARENA_BLOCK 4096
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    size_t size;
+    char text[];
+} ArenaBlock;
+
+static ArenaBlock *arena = NULL;
+static const char **symbol_names = NULL;   /* indexed by id */
+static uint32_t *symbol_hashes = NULL;     /* indexed by id */
+static uint32_t symbols = 0;               /* highest id handed out */
+static uint32_t names_capacity = 0;
+static uint32_t *symbol_table = NULL;      /* open addressing, holds ids */
+static uint32_t table_capacity = 0;
+
+static uint32_t symbol_hash(const char *name) {
+    uint32_t hash = 2166136261u;
+    for (; *name; name++) {
+        hash ^= (unsigned char)*name;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Copy name into the arena; strings never move once stored */
+static const char *arena_store(const char *name) {
+    size_t len = strlen(name) + 1;
+
+    if (!arena || arena->size - arena->used < len) {
+        size_t size = len > ARENA_BLOCK ? len : ARENA_BLOCK;
+        ArenaBlock *block = malloc(sizeof(ArenaBlock) + size);
+        if (!block) return NULL;
+        block->next = arena;
+        block->used = 0;
+        block->size = size;
+        arena = block;
+    }
+
+    char *copy = arena->text + arena->used;
+    memcpy(copy, name, len);
+    arena->used += len;
+    return copy;
+}
+
+static int symbol_table_grow(void) {
+    uint32_t capacity = table_capacity ? table_capacity * 2 : 256;
+    uint32_t *table = calloc(capacity, sizeof(uint32_t));
+    if (!table) return -1;
+
+    for (uint32_t id = 1; id <= symbols; id++) {
+        uint32_t i = symbol_hashes[id] & (capacity - 1);
+        while (table[i]) i = (i + 1) & (capacity - 1);
+        table[i] = id;
+    }
+    free(symbol_table);
+    symbol_table = table;
+    table_capacity = capacity;
+    return 0;
+}
+
+/* Find name's slot in the table: either its id or the empty slot where
+ * it belongs */
+static uint32_t *symbol_slot(const char *name, uint32_t hash) {
+    uint32_t i = hash & (table_capacity - 1);
+    while (symbol_table[i]) {
+        uint32_t id = symbol_table[i];
+        if (symbol_hashes[id] == hash && strcmp(symbol_names[id], name) == 0) break;
+        i = (i + 1) & (table_capacity - 1);
+    }
+    return &symbol_table[i];
+}
+
+uint32_t symbol_lookup(const char *name) {
+    if (!name || !symbol_table) return 0;
+    return *symbol_slot(name, symbol_hash(name));
+}
+
+uint32_t symbol_intern(const char *name) {
+    if (!name) return 0;
+
+    /* Keep the table at most half full */
+    if ((symbols + 1) * 2 > table_capacity && symbol_table_grow() != 0) return 0;
+
+    uint32_t hash = symbol_hash(name);
+    uint32_t *slot = symbol_slot(name, hash);
+    if (*slot) return *slot;
+
+    if (symbols + 1 >= names_capacity) {
+        uint32_t capacity = names_capacity ? names_capacity * 2 : 256;
+        const char **names = realloc(symbol_names, capacity * sizeof(char*));
+        if (!names) return 0;
+        symbol_names = names;
+        uint32_t *hashes = realloc(symbol_hashes, capacity * sizeof(uint32_t));
+        if (!hashes) return 0;
+        symbol_hashes = hashes;
+        names_capacity = capacity;
+    }
+
+    const char *copy = arena_store(name);
+    if (!copy) return 0;
+
+    uint32_t id = ++symbols;
+    symbol_names[id] = copy;
+    symbol_hashes[id] = hash;
+    *slot = id;
+    return id;
+}
+
+const char *symbol_name(uint32_t id) {
+    if (id == 0 || id > symbols) return NULL;
+    return symbol_names[id];
+}
+
+uint32_t symbol_count(void) {
+    return symbols;
+}
+
+/* Multisets */
+
+static uint32_t multiset_hash(uint32_t symbol, uint32_t capacity) {
+    return (symbol * 2654435761u) & (capacity - 1);
+}
+
+void multiset_init(Multiset *ms) {
+    ms->entries = NULL;
+    ms->capacity = 0;
+    ms->distinct = 0;
+    ms->total = 0;
+    ms->hashed = 0;
+}
+
+void multiset_clear(Multiset *ms) {
+    free(ms->entries);
+    multiset_init(ms);
+}
+
+/* Position of symbol in the sorted vector, or where it would go */
+static uint32_t small_search(const Multiset *ms, uint32_t symbol) {
+    uint32_t lo = 0, hi = ms->distinct;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (ms->entries[mid].symbol < symbol) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* Slot holding symbol in the hash table, or the empty slot for it */
+static uint32_t hash_search(const Multiset *ms, uint32_t symbol) {
+    uint32_t mask = ms->capacity - 1;
+    uint32_t i = multiset_hash(symbol, ms->capacity);
+    while (ms->entries[i].symbol && ms->entries[i].symbol != symbol) i = (i + 1) & mask;
+    return i;
+}
+
+static int hash_rebuild(Multiset *ms, uint32_t capacity) {
+    MultisetEntry *entries = calloc(capacity, sizeof(MultisetEntry));
+    if (!entries) return -1;
+
+    MultisetEntry *old = ms->entries;
+    uint32_t old_capacity = ms->capacity;
+    int was_hashed = ms->hashed;
+    uint32_t live = was_hashed ? old_capacity : ms->distinct;
+
+    ms->entries = entries;
+    ms->capacity = capacity;
+    ms->hashed = 1;
+    for (uint32_t i = 0; i < live; i++) {
+        if (old[i].symbol) ms->entries[hash_search(ms, old[i].symbol)] = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+uint32_t multiset_count(const Multiset *ms, uint32_t symbol) {
+    if (!ms || symbol == 0 || ms->distinct == 0) return 0;
+
+    if (ms->hashed) return ms->entries[hash_search(ms, symbol)].count;
+
+    uint32_t i = small_search(ms, symbol);
+    return i < ms->distinct && ms->entries[i].symbol == symbol ? ms->entries[i].count : 0;
+}
+
+int multiset_add(Multiset *ms, uint32_t symbol, uint32_t count) {
+    if (!ms || symbol == 0) return -1;
+    if (count == 0) return 0;
+
+    if (!ms->hashed) {
+        uint32_t i = small_search(ms, symbol);
+        if (i < ms->distinct && ms->entries[i].symbol == symbol) {
+            if (ms->entries[i].count > UINT32_MAX - count) return -1;
+            ms->entries[i].count += count;
+            ms->total += count;
+            return 0;
+        }
+
+        if (ms->distinct < MULTISET_SMALL) {
+            if (ms->distinct == ms->capacity) {
+                uint32_t capacity = ms->capacity ? ms->capacity * 2 : 4;
+                MultisetEntry *entries = realloc(ms->entries, capacity * sizeof(MultisetEntry));
+                if (!entries) return -1;
+                ms->entries = entries;
+                ms->capacity = capacity;
+            }
+            memmove(&ms->entries[i + 1], &ms->entries[i],
+                    (ms->distinct - i) * sizeof(MultisetEntry));
+            ms->entries[i].symbol = symbol;
+            ms->entries[i].count = count;
+            ms->distinct++;
+            ms->total += count;
+            return 0;
+        }
+
+        /* Outgrew the vector */
+        if (hash_rebuild(ms, MULTISET_SMALL * 4) != 0) return -1;
+    }
+
+    uint32_t i = hash_search(ms, symbol);
+    if (ms->entries[i].symbol) {
+        if (ms->entries[i].count > UINT32_MAX - count) return -1;
+        ms->entries[i].count += count;
+        ms->total += count;
+        return 0;
+    }
+
+    /* Keep the table at most half full */
+    if ((ms->distinct + 1) * 2 > ms->capacity) {
+        if (hash_rebuild(ms, ms->capacity * 2) != 0) return -1;
+        i = hash_search(ms, symbol);
+    }
+    ms->entries[i].symbol = symbol;
+    ms->entries[i].count = count;
+    ms->distinct++;
+    ms->total += count;
+    return 0;
+}
+
+/* Take count copies of symbol; fails without change if there are fewer */
+int multiset_remove(Multiset *ms, uint32_t symbol, uint32_t count) {
+    if (!ms || symbol == 0 || ms->distinct == 0) return count == 0 ? 0 : -1;
+
+    uint32_t i = ms->hashed ? hash_search(ms, symbol) : small_search(ms, symbol);
+    MultisetEntry *entry = &ms->entries[i];
+    if ((!ms->hashed && i >= ms->distinct) || entry->symbol != symbol || entry->count < count) {
+        return -1;
+    }
+
+    entry->count -= count;
+    ms->total -= count;
+    if (entry->count > 0) return 0;
+
+    ms->distinct--;
+    if (!ms->hashed) {
+        memmove(entry, entry + 1, (ms->distinct - i) * sizeof(MultisetEntry));
+        return 0;
+    }
+
+    /* Backward-shift deletion keeps probe chains intact */
+    uint32_t mask = ms->capacity - 1;
+    uint32_t hole = i;
+    for (uint32_t j = (i + 1) & mask; ms->entries[j].symbol; j = (j + 1) & mask) {
+        uint32_t home = multiset_hash(ms->entries[j].symbol, ms->capacity);
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            ms->entries[hole] = ms->entries[j];
+            hole = j;
+        }
+    }
+    ms->entries[hole].symbol = 0;
+    ms->entries[hole].count = 0;
+    return 0;
+}
+
+/* Iterate: start with *cursor = 0; returns 0 when done.  Order is by
+ * symbol id for small sets and unspecified for hashed ones. */
+int multiset_next(const Multiset *ms, uint32_t *cursor, uint32_t *symbol, uint32_t *count) {
+    if (!ms || !cursor) return 0;
+
+    uint32_t limit = ms->hashed ? ms->capacity : ms->distinct;
+    while (*cursor < limit) {
+        const MultisetEntry *entry = &ms->entries[(*cursor)++];
+        if (entry->symbol) {
+            if (symbol) *symbol = entry->symbol;
+            if (count) *count = entry->count;
+            return 1;
+        }
+    }
+    return 0;
+}
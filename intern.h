@@ -0,0 +1,43 @@
+/* Symbol Interning Header
+ * Global string-to-id table and compact symbol multisets
+ */
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Symbol ids start at 1; 0 means "no symbol" */
+extern uint32_t symbol_intern(const char *name);
+extern uint32_t symbol_lookup(const char *name);
+extern const char *symbol_name(uint32_t id);
+extern uint32_t symbol_count(void);
+
+/* Multiset of symbols with multiplicities.  Up to MULTISET_SMALL
+ * distinct symbols are kept in a sorted vector; larger sets switch to
+ * an open-addressing hash table. */
+#define MULTISET_SMALL 16
+
+typedef struct {
+    uint32_t symbol;
+    uint32_t count;
+} MultisetEntry;
+
+typedef struct {
+    MultisetEntry *entries;     /* sorted vector, or hash table when hashed */
+    uint32_t capacity;
+    uint32_t distinct;          /* symbols with a nonzero count */
+    uint64_t total;             /* sum of all counts */
+    int hashed;
+} Multiset;
+
+extern void multiset_init(Multiset *ms);
+extern void multiset_clear(Multiset *ms);
+extern uint32_t multiset_count(const Multiset *ms, uint32_t symbol);
+extern int multiset_add(Multiset *ms, uint32_t symbol, uint32_t count);
+extern int multiset_remove(Multiset *ms, uint32_t symbol, uint32_t count);
+extern int multiset_next(const Multiset *ms, uint32_t *cursor, uint32_t *symbol,
+                         uint32_t *count);
+
+#endif /* INTERN_H */
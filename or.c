@@ -9,13 +9,127 @@
 #include <string.h>
 #include <stdio.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
 
 /* Global orchestrator registry */
 static Orchestrator **orchestrators = NULL;
 static int orchestrator_count = 0;
 static pthread_mutex_t orchestrator_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/* Plain-data copy of an orchestrator's attention and pattern state */
+typedef struct {
+    AttentionState attention;
+    float resonance_depth;
+    float temporal_coherence;
+    float spatial_distribution;
+    PatternSketch patterns;
+    int sources;                /* orchestrators merged into this view */
+} OrchestratorSnapshot;
+
+/* Seqlock-protected snapshot: the sequence is odd while a write is in
+ * progress.  Readers retry instead of locking, so they never block the
+ * writer, and orchestrators never contend with each other. */
+typedef struct {
+    atomic_uint seq;
+    OrchestratorSnapshot data;
+} SnapshotCell;
+
+struct OrchestratorSync {
+    SnapshotCell published;     /* this orchestrator's own state */
+    SnapshotCell coordinated;   /* merged view kept by the coordinator */
+    pthread_mutex_t publish_lock; /* serializes writers of this orchestrator */
+    pthread_mutex_t coordinate_lock; /* serializes writers of the coordinated view */
+    pthread_t coordinator;
+    pthread_mutex_t tick_lock;
+    pthread_cond_t tick_cond;
+    int coordinating;
+    int tick_ms;
+    pthread_mutex_t inflight_lock;
+    pthread_cond_t inflight_done;
+    int inflight;               /* dispatched tasks still on a worker */
+    struct BackgroundInference *unreaped; /* background jobs not yet waited for */
+};
+
+static void snapshot_write(SnapshotCell *cell, const OrchestratorSnapshot *snap) {
+    unsigned seq = atomic_load_explicit(&cell->seq, memory_order_relaxed);
+    atomic_store_explicit(&cell->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&cell->data, snap, sizeof(OrchestratorSnapshot));
+    atomic_store_explicit(&cell->seq, seq + 2, memory_order_release);
+}
+
+static void snapshot_read(SnapshotCell *cell, OrchestratorSnapshot *snap) {
+    unsigned before, after;
+    for (;;) {
+        before = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        if (before & 1) {
+            sched_yield();
+            continue;
+        }
+        memcpy(snap, &cell->data, sizeof(OrchestratorSnapshot));
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&cell->seq, memory_order_relaxed);
+        if (before == after) return;
+    }
+}
+
+static struct OrchestratorSync *orchestrator_sync_create(void) {
+    struct OrchestratorSync *sync = calloc(1, sizeof(struct OrchestratorSync));
+    if (!sync) return NULL;
+    
+    atomic_init(&sync->published.seq, 0);
+    atomic_init(&sync->coordinated.seq, 0);
+    pattern_sketch_init(&sync->published.data.patterns);
+    pattern_sketch_init(&sync->coordinated.data.patterns);
+    pthread_mutex_init(&sync->publish_lock, NULL);
+    pthread_mutex_init(&sync->coordinate_lock, NULL);
+    pthread_mutex_init(&sync->tick_lock, NULL);
+    pthread_cond_init(&sync->tick_cond, NULL);
+    pthread_mutex_init(&sync->inflight_lock, NULL);
+    pthread_cond_init(&sync->inflight_done, NULL);
+    return sync;
+}
+
+/* Holding the registry lock across fork keeps coordinators out of a
+ * merge, so no coordinated view is left half-written in the child */
+static void orchestrator_fork_prepare(void) {
+    pthread_mutex_lock(&orchestrator_mutex);
+}
+
+static void orchestrator_fork_parent(void) {
+    pthread_mutex_unlock(&orchestrator_mutex);
+}
+
+/* The child inherits coordinator state but not the threads, which may
+ * have held a tick lock at the fork: forget them so nothing in the
+ * child joins a thread it does not own */
+static void orchestrator_fork_child(void) {
+    for (int i = 0; i < orchestrator_count; i++) {
+        struct OrchestratorSync *sync = orchestrators[i]->sync;
+        if (!sync) continue;
+        pthread_mutex_init(&sync->publish_lock, NULL);
+        pthread_mutex_init(&sync->coordinate_lock, NULL);
+        pthread_mutex_init(&sync->tick_lock, NULL);
+        pthread_cond_init(&sync->tick_cond, NULL);
+        sync->coordinating = 0;
+        
+        /* Nor do tasks on those threads ever finish here */
+        pthread_mutex_init(&sync->inflight_lock, NULL);
+        pthread_cond_init(&sync->inflight_done, NULL);
+        sync->inflight = 0;
+    }
+    pthread_mutex_unlock(&orchestrator_mutex);
+}
+
+static void orchestrator_fork_register(void) {
+    pthread_atfork(orchestrator_fork_prepare, orchestrator_fork_parent, orchestrator_fork_child);
+}
+
 /* Create orchestrator */
 Orchestrator *orchestrator_create(const char *name, uint32_t agent_id) {
     if (!name) return NULL;
@@ -30,11 +144,13 @@ Orchestrator *orchestrator_create(const char *name, uint32_t agent_id) {
     orc->resonance_state = resonance_create();
     orc->attention_state = malloc(sizeof(AttentionState));
     orc->inference_engine = NULL;
+    orc->workers = NULL;
     orc->thread_count = 0;
     orc->is_active = 0;
     orc->last_update = time(NULL);
+    orc->sync = orchestrator_sync_create();
     
-    if (!orc->pattern_state || !orc->resonance_state || !orc->attention_state) {
+    if (!orc->pattern_state || !orc->resonance_state || !orc->attention_state || !orc->sync) {
         orchestrator_destroy(orc);
         return NULL;
     }
@@ -43,6 +159,8 @@ Orchestrator *orchestrator_create(const char *name, uint32_t agent_id) {
     memset(orc->attention_state, 0, sizeof(AttentionState));
     
     /* Register orchestrator */
+    static pthread_once_t fork_once = PTHREAD_ONCE_INIT;
+    pthread_once(&fork_once, orchestrator_fork_register);
     pthread_mutex_lock(&orchestrator_mutex);
     orchestrators = realloc(orchestrators, (orchestrator_count + 1) * sizeof(Orchestrator*));
     if (orchestrators) {
@@ -53,10 +171,17 @@ Orchestrator *orchestrator_create(const char *name, uint32_t agent_id) {
     return orc;
 }
 
+static void orchestrator_drain(Orchestrator *orc);
+static void background_inference_detach(Orchestrator *orc);
+
 /* Destroy orchestrator */
 void orchestrator_destroy(Orchestrator *orc) {
     if (!orc) return;
     
+    orchestrator_stop_coordinator(orc);
+    orchestrator_stop_workers(orc);
+    background_inference_detach(orc);
+    
     /* Remove from registry */
     pthread_mutex_lock(&orchestrator_mutex);
     for (int i = 0; i < orchestrator_count; i++) {
@@ -75,6 +200,15 @@ void orchestrator_destroy(Orchestrator *orc) {
     if (orc->resonance_state) resonance_destroy(orc->resonance_state);
     if (orc->attention_state) free(orc->attention_state);
     if (orc->inference_engine) gguf_free_model((gguf_model*)orc->inference_engine);
+    if (orc->sync) {
+        pthread_mutex_destroy(&orc->sync->publish_lock);
+        pthread_mutex_destroy(&orc->sync->coordinate_lock);
+        pthread_mutex_destroy(&orc->sync->tick_lock);
+        pthread_cond_destroy(&orc->sync->tick_cond);
+        pthread_mutex_destroy(&orc->sync->inflight_lock);
+        pthread_cond_destroy(&orc->sync->inflight_done);
+        free(orc->sync);
+    }
     
     free(orc);
 }
@@ -89,6 +223,7 @@ int orchestrator_init(Orchestrator *orc) {
     
     /* Initialize pattern analysis */
     pattern_analysis_update(orc->pattern_state, "initialization");
+    orchestrator_publish(orc);
     
     return 0;
 }
@@ -137,6 +272,7 @@ int orchestrator_update(Orchestrator *orc) {
         resonance_analyze(orc->resonance_state, orc->neural_tree);
     }
     
+    orchestrator_publish(orc);
     return 0;
 }
 
@@ -160,21 +296,56 @@ NeuralNode *neural_node_create(const char *pattern_type, NeuralNode *parent) {
     node->ecan_values.stimulation_level = 0.0f;
     node->children = NULL;
     node->child_count = 0;
-    node->parent = parent;
+    node->child_capacity = 0;
+    node->parent = NULL;
     node->pattern_data = NULL;
     node->created = time(NULL);
     node->last_accessed = time(NULL);
     
+    node->subtree_count = 0;
+    node->subtree_resonance = 0.0;
+    node->subtree_resonance_sq = 0.0;
+    memset(node->subtree_spectrum, 0, sizeof(node->subtree_spectrum));
+    node->applied_frequency = 0.0f;
+    node->accounted = 0;
+    node->dirty = 0;
+    node->next_dirty = NULL;
+    node->dirty_list = NULL;
+    node->propagated = 0.0f;
+    node->propagated_valid = 0;
+    node->pending = 0;
+    node->next_pending = NULL;
+    node->pending_list = NULL;
+    
+    /* Attach to parent */
+    if (parent) {
+        if (parent->child_count >= parent->child_capacity) {
+            int capacity = parent->child_capacity ? parent->child_capacity * 2 : 4;
+            NeuralNode **children = realloc(parent->children, capacity * sizeof(NeuralNode*));
+            if (!children) {
+                free(node->pattern_type);
+                free(node);
+                return NULL;
+            }
+            parent->children = children;
+            parent->child_capacity = capacity;
+        }
+        parent->children[parent->child_count++] = node;
+        node->parent = parent;
+    }
+    
+    /* New nodes enter the aggregates on the next update and take their
+     * activation on the next propagation */
+    neural_node_mark_dirty(node);
+    neural_node_mark_pending(node);
+    
     return node;
 }
 
-/* Destroy neural node */
-void neural_node_destroy(NeuralNode *node) {
-    if (!node) return;
-    
-    /* Destroy children recursively */
+/* Free a node and its subtree without touching ancestor aggregates */
+static void neural_node_free(NeuralNode *node) {
     for (int i = 0; i < node->child_count; i++) {
-        neural_node_destroy(node->children[i]);
+        neural_node_free(node->children[i]);
     }
     
     if (node->pattern_type) free(node->pattern_type);
@@ -184,32 +355,192 @@ void neural_node_destroy(NeuralNode *node) {
     free(node);
 }
 
-/* Propagate activation through neural tree */
+/* Map a resonance frequency to its spectrum bin */
+static int resonance_bin(float frequency) {
+    int bin = (int)(frequency / RESONANCE_BIN_WIDTH);
+    if (bin < 0) bin = 0;
+    if (bin >= RESONANCE_SPECTRUM_BINS) bin = RESONANCE_SPECTRUM_BINS - 1;
+    return bin;
+}
+
+/* Apply an aggregate delta to a node and all of its ancestors */
+static void neural_path_apply(NeuralNode *node, int count, double resonance,
+                              double resonance_sq, int old_bin, int new_bin) {
+    for (NeuralNode *n = node; n; n = n->parent) {
+        n->subtree_count += count;
+        n->subtree_resonance += resonance;
+        n->subtree_resonance_sq += resonance_sq;
+        if (old_bin >= 0) n->subtree_spectrum[old_bin]--;
+        if (new_bin >= 0) n->subtree_spectrum[new_bin]++;
+    }
+}
+
+/* Whether node lies in the subtree under ancestor */
+static int neural_node_within(NeuralNode *node, NeuralNode *ancestor) {
+    for (; node; node = node->parent) {
+        if (node == ancestor) return 1;
+    }
+    return 0;
+}
+
+/* Destroy neural node */
+void neural_node_destroy(NeuralNode *node) {
+    if (!node) return;
+    
+    NeuralNode *parent = node->parent;
+    if (parent) {
+        /* Settle pending changes so no queued node lies in this subtree */
+        NeuralNode *root = neural_tree_root(parent);
+        neural_tree_update_resonance(root);
+        
+        NeuralNode **link = &root->pending_list;
+        while (*link) {
+            if (neural_node_within(*link, node)) *link = (*link)->next_pending;
+            else link = &(*link)->next_pending;
+        }
+        
+        /* Remove the subtree from ancestor aggregates */
+        for (NeuralNode *n = parent; n; n = n->parent) {
+            n->subtree_count -= node->subtree_count;
+            n->subtree_resonance -= node->subtree_resonance;
+            n->subtree_resonance_sq -= node->subtree_resonance_sq;
+            for (int i = 0; i < RESONANCE_SPECTRUM_BINS; i++) {
+                n->subtree_spectrum[i] -= node->subtree_spectrum[i];
+            }
+        }
+        
+        /* Unlink from parent */
+        for (int i = 0; i < parent->child_count; i++) {
+            if (parent->children[i] == node) {
+                memmove(&parent->children[i], &parent->children[i+1],
+                       (parent->child_count - i - 1) * sizeof(NeuralNode*));
+                parent->child_count--;
+                break;
+            }
+        }
+    }
+    
+    neural_node_free(node);
+}
+
+/* Find the root of the tree containing node */
+NeuralNode *neural_tree_root(NeuralNode *node) {
+    if (!node) return NULL;
+    while (node->parent) node = node->parent;
+    return node;
+}
+
+/* Queue a node for re-aggregation on its root */
+void neural_node_mark_dirty(NeuralNode *node) {
+    if (!node || node->dirty) return;
+    
+    NeuralNode *root = neural_tree_root(node);
+    node->dirty = 1;
+    node->next_dirty = root->dirty_list;
+    root->dirty_list = node;
+}
+
+/* Queue a node for the next propagation on its root */
+void neural_node_mark_pending(NeuralNode *node) {
+    if (!node || node->pending) return;
+    
+    NeuralNode *root = neural_tree_root(node);
+    node->pending = 1;
+    node->next_pending = root->pending_list;
+    root->pending_list = node;
+}
+
+static void neural_node_apply(NeuralNode *node, float activation) {
+    node->last_accessed = time(NULL);
+    if (node->activation_level == activation && node->accounted) return;
+    
+    node->activation_level = activation;
+    neural_node_mark_dirty(node);
+}
+
+/* Set activation on a single node; the next propagation over it puts
+ * the propagated value back */
+int neural_node_set_activation(NeuralNode *node, float activation) {
+    if (!node) return -1;
+    
+    neural_node_apply(node, activation);
+    neural_node_mark_pending(node);
+    return 0;
+}
+
+#define NEURAL_DECAY 0.8f
+
+/* Push activation into node, descending only when its value changed */
+static void neural_propagate_from(NeuralNode *node, float activation) {
+    int changed = !node->propagated_valid || node->propagated != activation;
+    
+    node->propagated = activation;
+    node->propagated_valid = 1;
+    neural_node_apply(node, activation);
+    if (!changed) return;
+    
+    for (int i = 0; i < node->child_count; i++) {
+        neural_propagate_from(node->children[i], activation * NEURAL_DECAY);
+    }
+}
+
+/* Propagate activation through neural tree, decaying with depth.  A
+ * changed activation rewrites the subtree; an unchanged one only
+ * revisits the nodes queued since the last propagation. */
 int neural_tree_propagate(NeuralNode *root, float activation) {
     if (!root) return -1;
     
-    root->activation_level = activation;
-    root->last_accessed = time(NULL);
+    neural_propagate_from(root, activation);
     
-    /* Propagate to children with decay */
-    float decay_factor = 0.8f;
-    for (int i = 0; i < root->child_count; i++) {
-        neural_tree_propagate(root->children[i], activation * decay_factor);
+    NeuralNode **link = &neural_tree_root(root)->pending_list;
+    NeuralNode *node;
+    while ((node = *link) != NULL) {
+        if (!neural_node_within(node, root)) {
+            link = &node->next_pending;
+            continue;
+        }
+        *link = node->next_pending;
+        node->next_pending = NULL;
+        node->pending = 0;
+        if (node == root) continue;
+        
+        /* Start from the highest ancestor propagation has not reached */
+        while (!node->parent->propagated_valid) node = node->parent;
+        neural_propagate_from(node, node->parent->propagated * NEURAL_DECAY);
     }
     
     return 0;
 }
 
-/* Update resonance in neural tree */
+/* Update resonance in neural tree: fold queued changes into the
+ * aggregates.  Cost is proportional to the number of changed nodes times
+ * their depth, independent of tree size. */
 int neural_tree_update_resonance(NeuralNode *root) {
     if (!root) return -1;
     
-    /* Update resonance frequency based on activation */
-    root->resonance_frequency = 1.0f + root->activation_level;
+    root = neural_tree_root(root);
     
-    /* Update children */
-    for (int i = 0; i < root->child_count; i++) {
-        neural_tree_update_resonance(root->children[i]);
+    NeuralNode *node;
+    while ((node = root->dirty_list) != NULL) {
+        root->dirty_list = node->next_dirty;
+        node->next_dirty = NULL;
+        node->dirty = 0;
+        
+        /* Update resonance frequency based on activation */
+        float frequency = 1.0f + node->activation_level;
+        node->resonance_frequency = frequency;
+        
+        if (!node->accounted) {
+            neural_path_apply(node, 1, frequency, (double)frequency * frequency,
+                              -1, resonance_bin(frequency));
+            node->accounted = 1;
+        } else if (frequency != node->applied_frequency) {
+            float old = node->applied_frequency;
+            neural_path_apply(node, 0, (double)frequency - old,
+                              (double)frequency * frequency - (double)old * old,
+                              resonance_bin(old), resonance_bin(frequency));
+        }
+        node->applied_frequency = frequency;
     }
     
     return 0;
@@ -232,6 +563,165 @@ NeuralNode *neural_tree_find_pattern(NeuralNode *root, const char *pattern) {
     return NULL;
 }
 
+/* Pattern sketch: 64-bit FNV-1a identifies a pattern */
+static uint64_t pattern_hash(const char *text, size_t len) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)text[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+#define SKETCH_INDEX_SIZE (PATTERN_SKETCH_K * 2)
+
+void pattern_sketch_init(PatternSketch *sketch) {
+    memset(sketch, 0, sizeof(PatternSketch));
+    memset(sketch->index, -1, sizeof(sketch->index));
+}
+
+static int sketch_index_find(const PatternSketch *sketch, uint64_t hash) {
+    for (int i = hash & (SKETCH_INDEX_SIZE - 1); ; i = (i + 1) & (SKETCH_INDEX_SIZE - 1)) {
+        int slot = sketch->index[i];
+        if (slot < 0) return -1;
+        if (sketch->counters[slot].hash == hash) return i;
+    }
+}
+
+static void sketch_index_insert(PatternSketch *sketch, uint64_t hash, int slot) {
+    int i = hash & (SKETCH_INDEX_SIZE - 1);
+    while (sketch->index[i] >= 0) i = (i + 1) & (SKETCH_INDEX_SIZE - 1);
+    sketch->index[i] = (int8_t)slot;
+}
+
+/* Backward-shift deletion keeps probe chains intact without tombstones */
+static void sketch_index_remove(PatternSketch *sketch, int i) {
+    const int mask = SKETCH_INDEX_SIZE - 1;
+    sketch->index[i] = -1;
+    for (int j = (i + 1) & mask; sketch->index[j] >= 0; j = (j + 1) & mask) {
+        int slot = sketch->index[j];
+        int home = sketch->counters[slot].hash & mask;
+        /* Move the entry back if its home lies cyclically outside (i, j] */
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            sketch->index[i] = (int8_t)slot;
+            sketch->index[j] = -1;
+            i = j;
+        }
+    }
+}
+
+static void sketch_heap_swap(PatternSketch *sketch, int a, int b) {
+    uint8_t t = sketch->heap[a];
+    sketch->heap[a] = sketch->heap[b];
+    sketch->heap[b] = t;
+    sketch->heap_pos[sketch->heap[a]] = (uint8_t)a;
+    sketch->heap_pos[sketch->heap[b]] = (uint8_t)b;
+}
+
+static void sketch_heap_down(PatternSketch *sketch, int i) {
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        if (l < sketch->used && sketch->counters[sketch->heap[l]].count <
+                                sketch->counters[sketch->heap[m]].count) m = l;
+        if (r < sketch->used && sketch->counters[sketch->heap[r]].count <
+                                sketch->counters[sketch->heap[m]].count) m = r;
+        if (m == i) return;
+        sketch_heap_swap(sketch, i, m);
+        i = m;
+    }
+}
+
+static void sketch_heap_up(PatternSketch *sketch, int i) {
+    while (i > 0) {
+        int p = (i - 1) / 2;
+        if (sketch->counters[sketch->heap[p]].count <= sketch->counters[sketch->heap[i]].count) return;
+        sketch_heap_swap(sketch, i, p);
+        i = p;
+    }
+}
+
+/* Count weight occurrences of a pre-hashed pattern */
+static int sketch_add_hashed(PatternSketch *sketch, uint64_t hash,
+                             const char *text, size_t len, uint64_t weight) {
+    sketch->total += weight;
+    
+    int pos = sketch_index_find(sketch, hash);
+    if (pos >= 0) {
+        int slot = sketch->index[pos];
+        sketch->counters[slot].count += weight;
+        sketch_heap_down(sketch, sketch->heap_pos[slot]);
+        return slot;
+    }
+    
+    int slot;
+    uint64_t base = 0;
+    if (sketch->used < PATTERN_SKETCH_K) {
+        /* Free counter available */
+        slot = sketch->used;
+        sketch->heap[slot] = (uint8_t)slot;
+        sketch->heap_pos[slot] = (uint8_t)slot;
+        sketch->used++;
+    } else {
+        /* Evict the minimum counter; the newcomer inherits its count */
+        slot = sketch->heap[0];
+        base = sketch->counters[slot].count;
+        sketch_index_remove(sketch, sketch_index_find(sketch, sketch->counters[slot].hash));
+    }
+    
+    PatternCounter *c = &sketch->counters[slot];
+    c->hash = hash;
+    c->count = base + weight;
+    c->error = base;
+    if (len >= PATTERN_TEXT_MAX) len = PATTERN_TEXT_MAX - 1;
+    memcpy(c->text, text, len);
+    c->text[len] = '\0';
+    sketch_index_insert(sketch, hash, slot);
+    
+    if (base) {
+        sketch_heap_down(sketch, sketch->heap_pos[slot]);
+    } else {
+        sketch_heap_up(sketch, sketch->heap_pos[slot]);
+    }
+    return slot;
+}
+
+/* Count weight occurrences of a pattern.  Returns the counter slot. */
+int pattern_sketch_add(PatternSketch *sketch, const char *text, size_t len, uint64_t weight) {
+    if (!sketch || !text || weight == 0) return -1;
+    return sketch_add_hashed(sketch, pattern_hash(text, len), text, len, weight);
+}
+
+/* Merge src into dest; counts and error bounds add.  Since a sketch's
+ * counts always sum to its total, the merged total stays exact. */
+void pattern_sketch_merge(PatternSketch *dest, const PatternSketch *src) {
+    if (!dest || !src) return;
+    
+    for (int i = 0; i < src->used; i++) {
+        const PatternCounter *c = &src->counters[i];
+        int slot = sketch_add_hashed(dest, c->hash, c->text, strlen(c->text), c->count);
+        dest->counters[slot].error += c->error;
+    }
+}
+
+static int counter_compare(const void *a, const void *b) {
+    const PatternCounter *x = *(const PatternCounter * const *)a;
+    const PatternCounter *y = *(const PatternCounter * const *)b;
+    return (x->count < y->count) - (x->count > y->count);
+}
+
+/* Fill top with up to max counters, most frequent first */
+int pattern_sketch_top(const PatternSketch *sketch, const PatternCounter **top, int max) {
+    if (!sketch || !top || max <= 0) return 0;
+    
+    const PatternCounter *all[PATTERN_SKETCH_K];
+    for (int i = 0; i < sketch->used; i++) all[i] = &sketch->counters[i];
+    qsort(all, sketch->used, sizeof(all[0]), counter_compare);
+    
+    int n = sketch->used < max ? sketch->used : max;
+    for (int i = 0; i < n; i++) top[i] = all[i];
+    return n;
+}
+
 /* Create pattern analysis */
 PatternAnalysis *pattern_analysis_create(void) {
     PatternAnalysis *analysis = malloc(sizeof(PatternAnalysis));
@@ -241,8 +731,8 @@ PatternAnalysis *pattern_analysis_create(void) {
     analysis->temporal_coherence = 0.0f;
     analysis->spatial_distribution = 0.0f;
     analysis->pattern_count = 0;
-    analysis->active_patterns = NULL;
-    analysis->pattern_weights = NULL;
+    pattern_sketch_init(&analysis->sketch);
+    memset(analysis->pattern_weights, 0, sizeof(analysis->pattern_weights));
     analysis->analysis_time = time(NULL);
     
     return analysis;
@@ -251,40 +741,38 @@ PatternAnalysis *pattern_analysis_create(void) {
 /* Destroy pattern analysis */
 void pattern_analysis_destroy(PatternAnalysis *analysis) {
     if (!analysis) return;
-    
-    if (analysis->active_patterns) {
-        for (int i = 0; i < analysis->pattern_count; i++) {
-            if (analysis->active_patterns[i]) free(analysis->active_patterns[i]);
-        }
-        free(analysis->active_patterns);
-    }
-    if (analysis->pattern_weights) free(analysis->pattern_weights);
-    
     free(analysis);
 }
 
-/* Update pattern analysis */
+/* Refresh per-counter weights (share of all observed occurrences) */
+static void pattern_analysis_weigh(PatternAnalysis *analysis) {
+    PatternSketch *sketch = &analysis->sketch;
+    
+    analysis->pattern_count = sketch->used;
+    for (int i = 0; i < PATTERN_SKETCH_K; i++) {
+        analysis->pattern_weights[i] = (i < sketch->used && sketch->total) ?
+            (float)sketch->counters[i].count / (float)sketch->total : 0.0f;
+    }
+}
+
+/* Update pattern analysis: every whitespace-separated token of the input
+ * is one observation.  Constant memory, O(log K) per token. */
 int pattern_analysis_update(PatternAnalysis *analysis, const char *input) {
     if (!analysis || !input) return -1;
     
     analysis->analysis_time = time(NULL);
     
-    /* Simple pattern counting based on input length and complexity */
-    int input_len = strlen(input);
-    analysis->pattern_count = 1 + (input_len / 10);
-    
-    /* Update pattern arrays */
-    analysis->active_patterns = realloc(analysis->active_patterns, 
-                                      analysis->pattern_count * sizeof(char*));
-    analysis->pattern_weights = realloc(analysis->pattern_weights,
-                                      analysis->pattern_count * sizeof(float));
-    
-    if (!analysis->active_patterns || !analysis->pattern_weights) return -1;
-    
-    /* Add the input as a pattern */
-    analysis->active_patterns[0] = strdup(input);
-    analysis->pattern_weights[0] = 1.0f;
+    const char *p = input;
+    while (*p) {
+        while (*p == ' ' || *p == '\t' || *p == '\n') p++;
+        const char *start = p;
+        while (*p && *p != ' ' && *p != '\t' && *p != '\n') p++;
+        if (p > start) {
+            pattern_sketch_add(&analysis->sketch, start, p - start, 1);
+        }
+    }
     
+    pattern_analysis_weigh(analysis);
     return 0;
 }
 
@@ -349,30 +837,46 @@ void resonance_destroy(ResonanceDepth *resonance) {
     free(resonance);
 }
 
-/* Analyze resonance */
+/* Analyze resonance over the subtree rooted at tree */
 int resonance_analyze(ResonanceDepth *resonance, NeuralNode *tree) {
     if (!resonance || !tree) return -1;
     
-    /* Count nodes and calculate average resonance */
-    int node_count = 0;
-    float total_resonance = 0.0f;
-    
-    /* Simple recursive count (would need proper tree traversal) */
-    node_count++;
-    total_resonance += tree->resonance_frequency;
+    /* Bring the aggregates up to date; only dirty paths are touched */
+    neural_tree_update_resonance(tree);
     
+    int node_count = (int)tree->subtree_count;
     resonance->resonance_nodes = node_count;
-    resonance->depth_level = total_resonance / node_count;
     
-    /* Update stability based on resonance consistency */
-    if (resonance->depth_level > 0.5f) {
-        resonance->stability_measure = 0.8f;
-        resonance->coherence_factor = 1.2f;
-    } else {
-        resonance->stability_measure = 0.3f;
-        resonance->coherence_factor = 0.8f;
+    if (!resonance->frequency_spectrum) {
+        resonance->frequency_spectrum = calloc(RESONANCE_SPECTRUM_BINS, sizeof(float));
+        if (!resonance->frequency_spectrum) return -1;
+        resonance->spectrum_size = RESONANCE_SPECTRUM_BINS;
+    }
+    
+    if (node_count == 0) {
+        resonance->depth_level = 0.0f;
+        memset(resonance->frequency_spectrum, 0, RESONANCE_SPECTRUM_BINS * sizeof(float));
+        return 0;
     }
     
+    double mean = tree->subtree_resonance / node_count;
+    double variance = tree->subtree_resonance_sq / node_count - mean * mean;
+    if (variance < 0.0) variance = 0.0;
+    
+    resonance->depth_level = (float)mean;
+    
+    /* Spectrum is the normalized distribution of node frequencies */
+    uint32_t peak = 0;
+    for (int i = 0; i < RESONANCE_SPECTRUM_BINS; i++) {
+        uint32_t count = tree->subtree_spectrum[i];
+        resonance->frequency_spectrum[i] = (float)count / node_count;
+        if (count > peak) peak = count;
+    }
+    
+    /* Stability falls with spread; coherence is the share of the dominant band */
+    resonance->stability_measure = (float)(1.0 / (1.0 + variance));
+    resonance->coherence_factor = (float)peak / node_count;
+    
     return 0;
 }
 
@@ -386,7 +890,8 @@ float resonance_get_stability(ResonanceDepth *resonance) {
 int orchestrator_load_model(Orchestrator *orc, const char *model_path) {
     if (!orc || !model_path) return -1;
     
-    /* Free existing model */
+    /* Free existing model, once no task can still be using it */
+    orchestrator_drain(orc);
     if (orc->inference_engine) {
         gguf_free_model((gguf_model*)orc->inference_engine);
         orc->inference_engine = NULL;
@@ -405,6 +910,39 @@ int orchestrator_load_model(Orchestrator *orc, const char *model_path) {
     return 0;
 }
 
+/* Produce a response for one prompt.  Reads the model only, so it is
+ * safe to run for many prompts concurrently. */
+static char *inference_generate(Orchestrator *orc, const char *prompt) {
+    /* Simple inference simulation - in real implementation would use llama.cpp */
+    size_t size = strlen(prompt) + strlen(orc->name) + 64;
+    char *result = malloc(size);
+    if (!result) return NULL;
+    
+    snprintf(result, size, "Inference response to: \"%s\" (simulated from %s)", 
+             prompt, orc->name);
+    return result;
+}
+
+/* Fold a set of processed prompts into the orchestrator state */
+static void inference_record(Orchestrator *orc, const char **prompts, int count) {
+    /* Update neural tree with inference activity */
+    if (orc->neural_tree) {
+        neural_tree_propagate(orc->neural_tree, 0.8f);
+    }
+    
+    /* Update pattern analysis and attention */
+    ECANValues ecan;
+    for (int i = 0; i < count; i++) {
+        pattern_analysis_update(orc->pattern_state, prompts[i]);
+        orc->attention_state->total_attention = calculate_ecan_attention(prompts[i], &ecan);
+    }
+    orc->attention_state->active_patterns = orc->pattern_state->pattern_count;
+    orc->attention_state->timestamp = time(NULL);
+    
+    /* Make the new state visible to coordinators */
+    orchestrator_publish(orc);
+}
+
 /* Perform inference */
 int orchestrator_inference(Orchestrator *orc, const char *prompt, char **response) {
     if (!orc || !prompt || !response) return -1;
@@ -414,23 +952,229 @@ int orchestrator_inference(Orchestrator *orc, const char *prompt, char **respons
         return -1;
     }
     
-    /* Simple inference simulation - in real implementation would use llama.cpp */
-    char *result = malloc(512);
-    if (!result) return -1;
+    *response = inference_generate(orc, prompt);
+    if (!*response) return -1;
     
-    snprintf(result, 512, "Inference response to: \"%s\" (simulated from %s)", 
-             prompt, orc->name);
+    inference_record(orc, &prompt, 1);
+    return 0;
+}
+
+typedef struct {
+    Orchestrator *orc;
+    const char **prompts;
+    char **responses;
+} InferenceBatch;
+
+static void inference_batch_item(void *ctx, int index) {
+    InferenceBatch *batch = (InferenceBatch*)ctx;
+    batch->responses[index] = inference_generate(batch->orc, batch->prompts[index]);
+}
+
+/* Run a batch of prompts through the forward pass on the orchestrator's
+ * workers; responses[i] answers prompts[i].  State is updated once for
+ * the whole batch. */
+int orchestrator_inference_batch(Orchestrator *orc, const char **prompts, int count,
+                                 char **responses) {
+    if (!orc || !prompts || !responses || count < 0) return -1;
+    if (!orc->inference_engine) return -1;
+    
+    InferenceBatch batch = { orc, prompts, responses };
+    worker_pool_parallel_for(orc->workers, count, inference_batch_item, &batch);
+    
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        if (!responses[i]) failed++;
+    }
     
-    *response = result;
+    inference_record(orc, prompts, count);
+    return failed ? -1 : 0;
+}
+
+/* Coordination */
+
+/* Publish the orchestrator's current state for lock-free readers */
+int orchestrator_publish(Orchestrator *orc) {
+    if (!orc || !orc->sync) return -1;
+    
+    OrchestratorSnapshot snap;
+    snap.attention = *orc->attention_state;
+    snap.attention.pattern_data = NULL; /* not meaningful outside the owner */
+    snap.resonance_depth = orc->pattern_state->resonance_depth;
+    snap.temporal_coherence = orc->pattern_state->temporal_coherence;
+    snap.spatial_distribution = orc->pattern_state->spatial_distribution;
+    snap.patterns = orc->pattern_state->sketch;
+    snap.sources = 1;
+    
+    pthread_mutex_lock(&orc->sync->publish_lock);
+    snapshot_write(&orc->sync->published, &snap);
+    pthread_mutex_unlock(&orc->sync->publish_lock);
+    return 0;
+}
+
+/* Accumulate the orchestrator's published attention into global_state */
+int orchestrator_sync_attention(Orchestrator *orc, AttentionState *global_state) {
+    if (!orc || !orc->sync || !global_state) return -1;
     
-    /* Update neural tree with inference activity */
-    if (orc->neural_tree) {
-        neural_tree_propagate(orc->neural_tree, 0.8f);
+    OrchestratorSnapshot snap;
+    snapshot_read(&orc->sync->published, &snap);
+    
+    global_state->total_attention += snap.attention.total_attention;
+    global_state->active_patterns += snap.attention.active_patterns;
+    if (snap.attention.timestamp > global_state->timestamp) {
+        global_state->timestamp = snap.attention.timestamp;
     }
+    return 0;
+}
+
+/* Merge the orchestrator's published patterns into global_analysis */
+int orchestrator_sync_patterns(Orchestrator *orc, PatternAnalysis *global_analysis) {
+    if (!orc || !orc->sync || !global_analysis) return -1;
     
-    /* Update pattern analysis */
-    pattern_analysis_update(orc->pattern_state, prompt);
+    OrchestratorSnapshot snap;
+    snapshot_read(&orc->sync->published, &snap);
+    
+    pattern_sketch_merge(&global_analysis->sketch, &snap.patterns);
+    pattern_analysis_weigh(global_analysis);
+    if (snap.resonance_depth > global_analysis->resonance_depth) {
+        global_analysis->resonance_depth = snap.resonance_depth;
+    }
+    if (snap.temporal_coherence > global_analysis->temporal_coherence) {
+        global_analysis->temporal_coherence = snap.temporal_coherence;
+    }
+    global_analysis->spatial_distribution = (float)global_analysis->pattern_count / 10.0f;
+    if (global_analysis->spatial_distribution > 1.0f) global_analysis->spatial_distribution = 1.0f;
+    return 0;
+}
+
+/* Merge the primary and agent states into the primary's coordinated view.
+ * Only published snapshots are read, so agents keep running unhindered.
+ * The caller keeps the agents alive, normally by holding the registry
+ * lock; concurrent merges into one primary are serialized here. */
+int orchestrator_coordinate_agents(Orchestrator *primary, Orchestrator **agents, int count) {
+    if (!primary || !primary->sync || (count > 0 && !agents)) return -1;
+    
+    PatternAnalysis *merged = pattern_analysis_create();
+    if (!merged) return -1;
+    
+    AttentionState attention = {0};
+    int sources = 0;
+    
+    if (orchestrator_sync_attention(primary, &attention) == 0 &&
+        orchestrator_sync_patterns(primary, merged) == 0) {
+        sources++;
+    }
+    for (int i = 0; i < count; i++) {
+        if (!agents[i] || agents[i] == primary) continue;
+        if (orchestrator_sync_attention(agents[i], &attention) == 0 &&
+            orchestrator_sync_patterns(agents[i], merged) == 0) {
+            sources++;
+        }
+    }
+    
+    OrchestratorSnapshot snap;
+    snap.attention = attention;
+    snap.resonance_depth = merged->resonance_depth;
+    snap.temporal_coherence = merged->temporal_coherence;
+    snap.spatial_distribution = merged->spatial_distribution;
+    snap.patterns = merged->sketch;
+    snap.sources = sources;
+    pthread_mutex_lock(&primary->sync->coordinate_lock);
+    snapshot_write(&primary->sync->coordinated, &snap);
+    pthread_mutex_unlock(&primary->sync->coordinate_lock);
+    
+    pattern_analysis_destroy(merged);
+    return sources;
+}
+
+/* Read the coordinated view; either output may be NULL.  Returns the
+ * number of orchestrators merged into it. */
+int orchestrator_read_coordinated(Orchestrator *orc, AttentionState *attention,
+                                  PatternAnalysis *patterns) {
+    if (!orc || !orc->sync) return -1;
+    
+    OrchestratorSnapshot snap;
+    snapshot_read(&orc->sync->coordinated, &snap);
+    
+    if (attention) *attention = snap.attention;
+    if (patterns) {
+        patterns->sketch = snap.patterns;
+        patterns->resonance_depth = snap.resonance_depth;
+        patterns->temporal_coherence = snap.temporal_coherence;
+        patterns->spatial_distribution = snap.spatial_distribution;
+        pattern_analysis_weigh(patterns);
+    }
+    return snap.sources;
+}
+
+/* Coordinator thread: merge every registered orchestrator on each tick */
+static void *coordinator_main(void *arg) {
+    Orchestrator *primary = (Orchestrator*)arg;
+    struct OrchestratorSync *sync = primary->sync;
+    
+    pthread_mutex_lock(&sync->tick_lock);
+    while (sync->coordinating) {
+        pthread_mutex_unlock(&sync->tick_lock);
+        
+        /* The registry lock only pins agent lifetimes during the merge */
+        pthread_mutex_lock(&orchestrator_mutex);
+        orchestrator_coordinate_agents(primary, orchestrators, orchestrator_count);
+        pthread_mutex_unlock(&orchestrator_mutex);
+        
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += sync->tick_ms / 1000;
+        deadline.tv_nsec += (long)(sync->tick_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        
+        pthread_mutex_lock(&sync->tick_lock);
+        while (sync->coordinating &&
+               pthread_cond_timedwait(&sync->tick_cond, &sync->tick_lock, &deadline) != ETIMEDOUT)
+            ;
+    }
+    pthread_mutex_unlock(&sync->tick_lock);
+    return NULL;
+}
+
+/* Start merging all orchestrators into orc every tick_ms milliseconds */
+int orchestrator_start_coordinator(Orchestrator *orc, int tick_ms) {
+    if (!orc || !orc->sync || tick_ms <= 0) return -1;
+    
+    struct OrchestratorSync *sync = orc->sync;
+    pthread_mutex_lock(&sync->tick_lock);
+    if (sync->coordinating) {
+        /* Already running: just retune the tick */
+        sync->tick_ms = tick_ms;
+        pthread_mutex_unlock(&sync->tick_lock);
+        return 0;
+    }
+    sync->tick_ms = tick_ms;
+    sync->coordinating = 1;
+    pthread_mutex_unlock(&sync->tick_lock);
+    
+    if (pthread_create(&sync->coordinator, NULL, coordinator_main, orc) != 0) {
+        sync->coordinating = 0;
+        return -1;
+    }
+    return 0;
+}
+
+int orchestrator_stop_coordinator(Orchestrator *orc) {
+    if (!orc || !orc->sync) return -1;
+    
+    struct OrchestratorSync *sync = orc->sync;
+    pthread_mutex_lock(&sync->tick_lock);
+    if (!sync->coordinating) {
+        pthread_mutex_unlock(&sync->tick_lock);
+        return 0;
+    }
+    sync->coordinating = 0;
+    pthread_cond_signal(&sync->tick_cond);
+    pthread_mutex_unlock(&sync->tick_lock);
     
+    pthread_join(sync->coordinator, NULL);
     return 0;
 }
 
@@ -444,6 +1188,306 @@ int orchestrator_set_context(Orchestrator *orc, const char *context) {
     return 0;
 }
 
+/* Worker pool */
+
+typedef struct PoolTask {
+    WorkerTask fn;
+    void *arg;
+    struct PoolTask *next;
+} PoolTask;
+
+struct WorkerPool {
+    pthread_t *threads;
+    int thread_count;
+    PoolTask *head, *tail;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    int stopping;
+    pid_t owner;                /* threads exist only in this process */
+};
+
+static void *worker_main(void *arg) {
+    WorkerPool *pool = (WorkerPool*)arg;
+    
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->head && !pool->stopping) {
+            pthread_cond_wait(&pool->ready, &pool->lock);
+        }
+        if (!pool->head) break; /* stopping and drained */
+        
+        PoolTask *task = pool->head;
+        pool->head = task->next;
+        if (!pool->head) pool->tail = NULL;
+        pthread_mutex_unlock(&pool->lock);
+        
+        task->fn(task->arg);
+        free(task);
+        
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+WorkerPool *worker_pool_create(int threads) {
+    if (threads <= 0) return NULL;
+    
+    WorkerPool *pool = calloc(1, sizeof(WorkerPool));
+    if (!pool) return NULL;
+    
+    pool->threads = malloc(threads * sizeof(pthread_t));
+    if (!pool->threads) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->ready, NULL);
+    pool->owner = getpid();
+    
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) break;
+        pool->thread_count++;
+    }
+    if (pool->thread_count == 0) {
+        worker_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+/* Runs every queued task, then joins the workers */
+void worker_pool_destroy(WorkerPool *pool) {
+    if (!pool) return;
+    
+    if (pool->owner != getpid()) {
+        /* Inherited across fork: there are no threads to join */
+        free(pool->threads);
+        free(pool);
+        return;
+    }
+    
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+    
+    for (int i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->ready);
+    free(pool->threads);
+    free(pool);
+}
+
+int worker_pool_submit(WorkerPool *pool, WorkerTask fn, void *arg) {
+    if (!pool || !fn || pool->owner != getpid()) return -1;
+    
+    PoolTask *task = malloc(sizeof(PoolTask));
+    if (!task) return -1;
+    task->fn = fn;
+    task->arg = arg;
+    task->next = NULL;
+    
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail) pool->tail->next = task;
+    else pool->head = task;
+    pool->tail = task;
+    pthread_cond_signal(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+int worker_pool_size(WorkerPool *pool) {
+    return (pool && pool->owner == getpid()) ? pool->thread_count : 0;
+}
+
+/* Process-wide pool sized to the machine, created on first use */
+WorkerPool *worker_pool_default(void) {
+    static WorkerPool *pool = NULL;
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    
+    pthread_mutex_lock(&lock);
+    if (!pool || pool->owner != getpid()) {
+        /* A forked child inherits the pool but not its threads */
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        pool = worker_pool_create(n > 0 ? (int)n : 1);
+    }
+    pthread_mutex_unlock(&lock);
+    return pool;
+}
+
+typedef struct {
+    void (*fn)(void *ctx, int index);
+    void *ctx;
+    int count;
+    atomic_int next;
+    int helpers;                /* helper tasks still running */
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+} ParallelFor;
+
+static void parallel_for_drain(ParallelFor *pf) {
+    int i;
+    while ((i = atomic_fetch_add(&pf->next, 1)) < pf->count) {
+        pf->fn(pf->ctx, i);
+    }
+}
+
+static void parallel_for_helper(void *arg) {
+    ParallelFor *pf = (ParallelFor*)arg;
+    parallel_for_drain(pf);
+    
+    pthread_mutex_lock(&pf->lock);
+    if (--pf->helpers == 0) pthread_cond_signal(&pf->done);
+    pthread_mutex_unlock(&pf->lock);
+}
+
+/* Call fn(ctx, i) for i in [0, count).  Indices are handed out
+ * dynamically; the calling thread works too, so a NULL pool simply
+ * runs the loop inline. */
+void worker_pool_parallel_for(WorkerPool *pool, int count,
+                              void (*fn)(void *ctx, int index), void *ctx) {
+    if (count <= 0 || !fn) return;
+    
+    ParallelFor pf;
+    pf.fn = fn;
+    pf.ctx = ctx;
+    pf.count = count;
+    atomic_init(&pf.next, 0);
+    pf.helpers = 0;
+    pthread_mutex_init(&pf.lock, NULL);
+    pthread_cond_init(&pf.done, NULL);
+    
+    int helpers = worker_pool_size(pool);
+    if (helpers > count - 1) helpers = count - 1;
+    
+    pthread_mutex_lock(&pf.lock);
+    for (int i = 0; i < helpers; i++) {
+        if (worker_pool_submit(pool, parallel_for_helper, &pf) == 0) pf.helpers++;
+    }
+    pthread_mutex_unlock(&pf.lock);
+    
+    parallel_for_drain(&pf);
+    
+    pthread_mutex_lock(&pf.lock);
+    while (pf.helpers > 0) {
+        pthread_cond_wait(&pf.done, &pf.lock);
+    }
+    pthread_mutex_unlock(&pf.lock);
+    
+    pthread_mutex_destroy(&pf.lock);
+    pthread_cond_destroy(&pf.done);
+}
+
+/* Multi-threaded execution */
+int orchestrator_start_workers(Orchestrator *orc, int thread_count) {
+    if (!orc || thread_count <= 0) return -1;
+    if (orc->workers && orc->thread_count == thread_count) return 0;
+    
+    WorkerPool *pool = worker_pool_create(thread_count);
+    if (!pool) return -1;
+    
+    orchestrator_stop_workers(orc);
+    orc->workers = pool;
+    orc->thread_count = worker_pool_size(pool);
+    return 0;
+}
+
+/* Wait for every task dispatched for orc, whichever pool runs it */
+static void orchestrator_drain(Orchestrator *orc) {
+    if (!orc->sync) return;
+    
+    pthread_mutex_lock(&orc->sync->inflight_lock);
+    while (orc->sync->inflight > 0) {
+        pthread_cond_wait(&orc->sync->inflight_done, &orc->sync->inflight_lock);
+    }
+    pthread_mutex_unlock(&orc->sync->inflight_lock);
+}
+
+int orchestrator_stop_workers(Orchestrator *orc) {
+    if (!orc) return -1;
+    
+    orchestrator_drain(orc);
+    if (orc->workers) {
+        worker_pool_destroy(orc->workers);
+        orc->workers = NULL;
+    }
+    orc->thread_count = 0;
+    return 0;
+}
+
+typedef struct {
+    Orchestrator *orc;
+    InferenceTask *task;
+} DispatchedInference;
+
+static void inference_task_run(void *arg) {
+    DispatchedInference *job = (DispatchedInference*)arg;
+    InferenceTask *task = job->task;
+    struct OrchestratorSync *sync = job->orc->sync;
+    
+    task->response = inference_generate(job->orc, task->prompt);
+    task->status = task->response ? 0 : -1;
+    free(job);
+    if (task->done) task->done(task);
+    
+    /* Last, so a drained orchestrator has no task left touching it */
+    pthread_mutex_lock(&sync->inflight_lock);
+    if (--sync->inflight == 0) pthread_cond_broadcast(&sync->inflight_done);
+    pthread_mutex_unlock(&sync->inflight_lock);
+}
+
+/* Queue a task on the orchestrator's workers, or the shared pool when it
+ * has none.  Only generation runs there; callers fold the result into
+ * the orchestrator state from their own thread. */
+int orchestrator_dispatch_task(Orchestrator *orc, const char *task, void *data) {
+    if (!orc || !task || !data) return -1;
+    
+    if (strcmp(task, "inference") == 0) {
+        InferenceTask *it = (InferenceTask*)data;
+        if (!it->prompt || !orc->inference_engine) return -1;
+        
+        DispatchedInference *job = malloc(sizeof(DispatchedInference));
+        if (!job) return -1;
+        job->orc = orc;
+        job->task = it;
+        it->response = NULL;
+        it->status = -1;
+        
+        pthread_mutex_lock(&orc->sync->inflight_lock);
+        orc->sync->inflight++;
+        pthread_mutex_unlock(&orc->sync->inflight_lock);
+        
+        WorkerPool *pool = orc->workers ? orc->workers : worker_pool_default();
+        if (worker_pool_submit(pool, inference_task_run, job) != 0) {
+            pthread_mutex_lock(&orc->sync->inflight_lock);
+            orc->sync->inflight--;
+            pthread_mutex_unlock(&orc->sync->inflight_lock);
+            free(job);
+            return -1;
+        }
+        return 0;
+    }
+    return -1;
+}
+
+/* Find a registered orchestrator by name */
+static Orchestrator *orchestrator_find(const char *name) {
+    Orchestrator *orc = NULL;
+    pthread_mutex_lock(&orchestrator_mutex);
+    for (int i = 0; i < orchestrator_count; i++) {
+        if (strcmp(orchestrators[i]->name, name) == 0) {
+            orc = orchestrators[i];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&orchestrator_mutex);
+    return orc;
+}
+
 /* Shell commands */
 void b_orchestrator_create(char **av) {
     if (!av[1]) {
@@ -477,10 +1521,24 @@ void b_orchestrator_status(char **av) {
                orc->thread_count);
         
         if (orc->pattern_state) {
-            fprint(1, "    Patterns: %d, Resonance: %.2f, Coherence: %.2f\n",
-                   orc->pattern_state->pattern_count,
-                   orc->pattern_state->resonance_depth,
-                   orc->pattern_state->temporal_coherence);
+            PatternAnalysis *pa = orc->pattern_state;
+            fprint(1, "    Patterns: %d of %d observed, Resonance: %d (x100), Coherence: %d (x100)\n",
+                   pa->pattern_count, (int)pa->sketch.total,
+                   (int)(pa->resonance_depth * 100),
+                   (int)(pa->temporal_coherence * 100));
+            
+            const PatternCounter *top[3];
+            int n = pattern_sketch_top(&pa->sketch, top, 3);
+            for (int j = 0; j < n; j++) {
+                fprint(1, "      %s: %d\n", top[j]->text, (int)top[j]->count);
+            }
+        }
+        
+        if (orc->resonance_state && orc->neural_tree &&
+            resonance_analyze(orc->resonance_state, orc->neural_tree) == 0) {
+            fprint(1, "    Neural tree: %d nodes, Stability: %d (x100)\n",
+                   orc->resonance_state->resonance_nodes,
+                   (int)(orc->resonance_state->stability_measure * 100));
         }
         
         if (orc->inference_engine) {
@@ -521,33 +1579,504 @@ void b_orchestrator_load_model(char **av) {
     }
 }
 
-void b_orchestrator_inference(char **av) {
-    if (!av[1] || !av[2]) {
-        rc_error("orchestrator-inference: usage: orchestrator-inference <name> <prompt>");
+/* Batch inference over a stream of prompts */
+
+#define INFERENCE_BATCH_PER_WORKER 64
+
+/* Append the UTF-8 encoding of cp to buf */
+static size_t utf8_encode(char *buf, unsigned cp) {
+    if (cp < 0x80) { buf[0] = cp; return 1; }
+    if (cp < 0x800) { buf[0] = 0xC0 | (cp >> 6); buf[1] = 0x80 | (cp & 0x3F); return 2; }
+    if (cp < 0x10000) {
+        buf[0] = 0xE0 | (cp >> 12);
+        buf[1] = 0x80 | ((cp >> 6) & 0x3F);
+        buf[2] = 0x80 | (cp & 0x3F);
+        return 3;
+    }
+    buf[0] = 0xF0 | (cp >> 18);
+    buf[1] = 0x80 | ((cp >> 12) & 0x3F);
+    buf[2] = 0x80 | ((cp >> 6) & 0x3F);
+    buf[3] = 0x80 | (cp & 0x3F);
+    return 4;
+}
+
+/* The four hex digits at p, or -1 */
+static long json_hex4(const char *p) {
+    long cp = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        cp <<= 4;
+        if (c >= '0' && c <= '9') cp |= c - '0';
+        else if (c >= 'a' && c <= 'f') cp |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') cp |= c - 'A' + 10;
+        else return -1;
+    }
+    return cp;
+}
+
+/* Decode the JSON string starting at the opening quote in place.
+ * Returns the decoded text or NULL if the string is malformed or
+ * holds a NUL, which the C string could not keep. */
+static char *json_unquote(char *p, char **end) {
+    char *out = ++p, *w = p;
+    while (*p && *p != '"') {
+        if (*p != '\\') {
+            *w++ = *p++;
+            continue;
+        }
+        switch (*++p) {
+        case 'n': *w++ = '\n'; break;
+        case 't': *w++ = '\t'; break;
+        case 'r': *w++ = '\r'; break;
+        case 'b': *w++ = '\b'; break;
+        case 'f': *w++ = '\f'; break;
+        case 'u': {
+            long cp = json_hex4(p + 1);
+            if (cp <= 0 || (cp >= 0xDC00 && cp <= 0xDFFF)) return NULL;
+            p += 4;
+            if (cp >= 0xD800 && cp <= 0xDBFF) {
+                /* A high surrogate needs the low half to follow */
+                long low = p[1] == '\\' && p[2] == 'u' ? json_hex4(p + 3) : -1;
+                if (low < 0xDC00 || low > 0xDFFF) return NULL;
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                p += 6;
+            }
+            w += utf8_encode(w, (unsigned)cp);
+            break;
+        }
+        case '\0': return NULL;
+        default: *w++ = *p; break; /* \" \\ \/ */
+        }
+        p++;
+    }
+    if (*p != '"') return NULL;
+    *w = '\0';
+    if (end) *end = p + 1;
+    return out;
+}
+
+/* Extract the prompt from one input line: a JSON object with a
+ * "prompt" member, a JSON string, or raw text.  Modifies line.
+ * Returns NULL with the reason in *error for a line without one. */
+static char *prompt_from_line(char *line, const char **error) {
+    size_t len = strlen(line);
+    while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) line[--len] = '\0';
+    
+    char *p = line;
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p == '\0') {
+        *error = "empty line";
+        return NULL;
+    }
+    
+    *error = "malformed JSON";
+    if (*p == '"') return json_unquote(p, NULL);
+    if (*p != '{') return p;
+    
+    /* Scan members for "prompt" */
+    p++;
+    for (;;) {
+        while (*p == ' ' || *p == '\t' || *p == ',') p++;
+        if (*p != '"') {
+            if (*p == '}') *error = "no prompt member";
+            return NULL;
+        }
+        char *key = json_unquote(p, &p);
+        if (!key) return NULL;
+        while (*p == ' ' || *p == '\t' || *p == ':') p++;
+        if (strcmp(key, "prompt") == 0) {
+            if (*p != '"') {
+                *error = "prompt is not a string";
+                return NULL;
+            }
+            return json_unquote(p, NULL);
+        }
+        /* Skip a scalar or string value */
+        if (*p == '"') {
+            if (!json_unquote(p, &p)) return NULL;
+        } else {
+            while (*p && *p != ',' && *p != '}') p++;
+        }
+        if (*p == '}') {
+            *error = "no prompt member";
+            return NULL;
+        }
+        if (*p != ',') return NULL;
+    }
+}
+
+/* Write s as a JSON string literal */
+static void json_write_string(FILE *out, const char *s) {
+    putc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        switch (c) {
+        case '"': fputs("\\\"", out); break;
+        case '\\': fputs("\\\\", out); break;
+        case '\n': fputs("\\n", out); break;
+        case '\t': fputs("\\t", out); break;
+        case '\r': fputs("\\r", out); break;
+        default:
+            if (c < 0x20) fprintf(out, "\\u%04x", c);
+            else putc(c, out);
+        }
+    }
+    putc('"', out);
+}
+
+/* Run the prompts of a batch and write its records in input order.  A
+ * record with errors[i] set is an input line without a prompt; the
+ * others take prompts, lines and responses in turn. */
+static void inference_run_batch(Orchestrator *orc, FILE *out, char **lines,
+                                const char **prompts, char **responses, const long *ids,
+                                const char **errors, int count, int nprompts, long *failed) {
+    if (nprompts > 0) orchestrator_inference_batch(orc, prompts, nprompts, responses);
+    
+    for (int i = 0, j = 0; i < count; i++) {
+        if (errors[i]) {
+            fprintf(out, "{\"id\":%ld,\"error\":", ids[i]);
+            json_write_string(out, errors[i]);
+            fputs("}\n", out);
+            (*failed)++;
+            continue;
+        }
+        fprintf(out, "{\"id\":%ld,\"prompt\":", ids[i]);
+        json_write_string(out, prompts[j]);
+        fputs(",\"response\":", out);
+        if (responses[j]) {
+            json_write_string(out, responses[j]);
+        } else {
+            fputs("null", out);
+            (*failed)++;
+        }
+        fputs("}\n", out);
+        free(responses[j]);
+        free(lines[j]);
+        j++;
+    }
+}
+
+/* Stream prompts from in to out in batches; results keep input order
+ * and carry the number of the input line they came from.  A line
+ * without a prompt takes its place in the batch as an error record. */
+static int orchestrator_inference_stream(Orchestrator *orc, FILE *in, FILE *out,
+                                         long *processed, long *failed) {
+    int batch_size = INFERENCE_BATCH_PER_WORKER * (orc->thread_count > 0 ? orc->thread_count : 1);
+    char **lines = malloc(batch_size * sizeof(char*));
+    const char **prompts = malloc(batch_size * sizeof(char*));
+    char **responses = malloc(batch_size * sizeof(char*));
+    long *ids = malloc(batch_size * sizeof(long));
+    const char **errors = malloc(batch_size * sizeof(char*));
+    if (!lines || !prompts || !responses || !ids || !errors) {
+        free(lines);
+        free(prompts);
+        free(responses);
+        free(ids);
+        free(errors);
+        return -1;
+    }
+    
+    char *line = NULL;
+    size_t cap = 0;
+    int count = 0, nprompts = 0;
+    long line_number = 0;
+    *processed = *failed = 0;
+    
+    while (getline(&line, &cap, in) >= 0) {
+        const char *error;
+        char *prompt = prompt_from_line(line, &error);
+        line_number++;
+        (*processed)++;
+        
+        ids[count] = line_number;
+        if (!prompt) {
+            errors[count] = error;
+        } else {
+            /* The batch keeps the line buffer; getline allocates a new one */
+            errors[count] = NULL;
+            lines[nprompts] = line;
+            prompts[nprompts] = prompt;
+            nprompts++;
+            line = NULL;
+            cap = 0;
+        }
+        
+        if (++count == batch_size) {
+            inference_run_batch(orc, out, lines, prompts, responses, ids, errors,
+                                count, nprompts, failed);
+            count = nprompts = 0;
+        }
+    }
+    if (count > 0) {
+        inference_run_batch(orc, out, lines, prompts, responses, ids, errors,
+                            count, nprompts, failed);
+    }
+    
+    free(line);
+    free(lines);
+    free(prompts);
+    free(responses);
+    free(ids);
+    free(errors);
+    return 0;
+}
+
+static double elapsed_seconds(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Background inference, run as a pseudo-job visible to $apids and wait */
+
+typedef struct BackgroundInference {
+    InferenceTask task;         /* first, so the done hook can find the job */
+    Orchestrator *orc;          /* NULL once the orchestrator is destroyed */
+    char *prompt;
+    char *var;                  /* assigned the response when reaped, or */
+    int fd;                     /* written the response on completion */
+    pid_t pid;
+    struct BackgroundInference *next; /* on the orchestrator's unreaped list */
+} BackgroundInference;
+
+/* Jobs outlive their orchestrator until wait collects them; the list
+ * is only touched on the shell thread */
+static void background_inference_detach(Orchestrator *orc) {
+    if (!orc->sync) return;
+    
+    for (BackgroundInference *job = orc->sync->unreaped; job; job = job->next) {
+        job->orc = NULL;
+    }
+    orc->sync->unreaped = NULL;
+}
+
+/* Runs on the worker thread */
+static void background_inference_done(InferenceTask *task) {
+    BackgroundInference *job = (BackgroundInference*)task;
+    
+    if (job->fd >= 0) {
+        if (task->response) {
+            size_t len = strlen(task->response);
+            task->response[len] = '\n'; /* temporarily, to write one line */
+            (void)write(job->fd, task->response, len + 1);
+            task->response[len] = '\0';
+        }
+        close(job->fd);
+    }
+    rc_pseudoexit(job->pid, task->status == 0 ? 0 : 0x100); /* exit(1) */
+}
+
+/* Runs on the shell thread when wait collects the job */
+static void background_inference_reap(void *arg, int stat) {
+    BackgroundInference *job = (BackgroundInference*)arg;
+    (void)stat;
+    
+    if (job->orc) {
+        BackgroundInference **link = &job->orc->sync->unreaped;
+        while (*link != job) link = &(*link)->next;
+        *link = job->next;
+        
+        if (job->task.response) {
+            const char *prompt = job->prompt;
+            inference_record(job->orc, &prompt, 1);
+        }
+    }
+    if (job->var) {
+        varassign(job->var, job->task.response ? word(job->task.response, NULL) : NULL, FALSE);
+    }
+    free(job->task.response);
+    free(job->prompt);
+    free(job->var);
+    free(job);
+}
+
+static void orchestrator_inference_background(Orchestrator *orc, const char *prompt,
+                                              const char *var) {
+    if (!orc->inference_engine) {
+        rc_error("orchestrator-inference: no model loaded");
         return;
     }
     
-    /* Find orchestrator */
-    Orchestrator *orc = NULL;
-    pthread_mutex_lock(&orchestrator_mutex);
-    for (int i = 0; i < orchestrator_count; i++) {
-        if (strcmp(orchestrators[i]->name, av[1]) == 0) {
-            orc = orchestrators[i];
-            break;
+    BackgroundInference *job = calloc(1, sizeof(BackgroundInference));
+    if (!job) {
+        rc_error("orchestrator-inference: out of memory");
+        return;
+    }
+    job->orc = orc;
+    job->prompt = strdup(prompt);
+    job->var = var ? strdup(var) : NULL;
+    /* Close-on-exec, so commands run meanwhile do not inherit it */
+    job->fd = var ? -1 : fcntl(1, F_DUPFD_CLOEXEC, 0);
+    job->task.prompt = job->prompt;
+    job->task.done = background_inference_done;
+    job->next = orc->sync->unreaped;
+    orc->sync->unreaped = job;
+    
+    job->pid = rc_pseudofork(background_inference_reap, job);
+    if (!job->prompt || (var && !job->var) ||
+        orchestrator_dispatch_task(orc, "inference", &job->task) != 0) {
+        /* Report the failure through the job's status */
+        if (job->fd >= 0) {
+            close(job->fd);
+            job->fd = -1;
         }
+        rc_pseudoexit(job->pid, 0x100);
     }
-    pthread_mutex_unlock(&orchestrator_mutex);
     
+    if (interactive)
+        fprint(2, "%d\n", job->pid);
+    varassign("apid", word(nprint("%d", job->pid), NULL), FALSE);
+}
+
+void b_orchestrator_inference(char **av) {
+    const char *input_path = NULL, *output_path = "-", *var = NULL;
+    int jobs = 0, background = 0, ac, c;
+    
+    for (rc_optind = ac = 0; av[ac] != NULL; ac++)
+        ; /* count the arguments for getopt */
+    while ((c = rc_getopt(ac, av, "bv:f:o:j:")) != -1) {
+        switch (c) {
+        case 'b': background = 1; break;
+        case 'v': var = rc_optarg; break;
+        case 'f': input_path = rc_optarg; break;
+        case 'o': output_path = rc_optarg; break;
+        case 'j': jobs = atoi(rc_optarg); break;
+        default: set(FALSE); return;
+        }
+    }
+    av += rc_optind - 1;
+    
+    if (!av[1] || (!input_path && !av[2]) || (background && input_path) || (var && !background)) {
+        rc_error("orchestrator-inference: usage: orchestrator-inference [-b [-v var]] [-f prompts] [-o out] [-j N] <name> [prompt]");
+        return;
+    }
+    
+    Orchestrator *orc = orchestrator_find(av[1]);
     if (!orc) {
         rc_error("orchestrator-inference: orchestrator not found");
         return;
     }
     
-    char *response = NULL;
-    if (orchestrator_inference(orc, av[2], &response) == 0 && response) {
-        fprint(1, "%s\n", response);
-        free(response);
-    } else {
-        rc_error("orchestrator-inference: inference failed");
+    if (background) {
+        if (jobs > 0 && orchestrator_start_workers(orc, jobs) != 0) {
+            rc_error("orchestrator-inference: failed to start workers");
+            return;
+        }
+        orchestrator_inference_background(orc, av[2], var);
+        return;
+    }
+    
+    if (!input_path) {
+        char *response = NULL;
+        if (orchestrator_inference(orc, av[2], &response) == 0 && response) {
+            fprint(1, "%s\n", response);
+            free(response);
+        } else {
+            free(response);
+            rc_error("orchestrator-inference: inference failed");
+        }
+        return;
+    }
+    
+    if (!orc->inference_engine) {
+        rc_error("orchestrator-inference: no model loaded");
+        return;
+    }
+    if (jobs > 0 && orchestrator_start_workers(orc, jobs) != 0) {
+        rc_error("orchestrator-inference: failed to start workers");
+        return;
+    }
+    
+    /* "-" selects the shell's standard input or output */
+    int to_stdout = strcmp(output_path, "-") == 0;
+    FILE *in = strcmp(input_path, "-") == 0 ? fdopen(dup(0), "r") : fopen(input_path, "r");
+    if (!in) {
+        rc_error("orchestrator-inference: cannot open prompt file");
+        return;
+    }
+    FILE *out = to_stdout ? fdopen(dup(1), "w") : fopen(output_path, "w");
+    if (!out) {
+        fclose(in);
+        rc_error("orchestrator-inference: cannot open output file");
+        return;
+    }
+    
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    long processed = 0, failed = 0;
+    int status = orchestrator_inference_stream(orc, in, out, &processed, &failed);
+    fclose(in);
+    if (fclose(out) != 0) status = -1;
+    
+    double seconds = elapsed_seconds(&start);
+    char rate[64];
+    snprintf(rate, sizeof(rate), "%.1f", seconds > 0 ? processed / seconds : 0.0);
+    fprint(to_stdout ? 2 : 1, "orchestrator-inference: %ld prompts in %d ms (%s prompts/s, %d workers, %ld failed)\n",
+           processed, (int)(seconds * 1000), rate,
+           orc->thread_count > 0 ? orc->thread_count : 1, failed);
+    
+    if (status != 0) {
+        rc_error("orchestrator-inference: batch failed");
+    }
+}
+
+/* orchestrator-coordinate [-s] <name> [tick_ms] */
+void b_orchestrator_coordinate(char **av) {
+    int stop = 0;
+    if (av[1] && strcmp(av[1], "-s") == 0) {
+        stop = 1;
+        av++;
+    }
+    if (!av[1]) {
+        rc_error("orchestrator-coordinate: usage: orchestrator-coordinate [-s] <name> [tick_ms]");
+        return;
+    }
+    
+    Orchestrator *orc = orchestrator_find(av[1]);
+    if (!orc) {
+        rc_error("orchestrator-coordinate: orchestrator not found");
+        return;
+    }
+    
+    if (stop) {
+        orchestrator_stop_coordinator(orc);
+        fprint(1, "Stopped coordinator for %s\n", orc->name);
+        return;
     }
-}
\ No newline at end of file
+    
+    if (av[2]) {
+        int tick_ms = atoi(av[2]);
+        if (tick_ms <= 0 || orchestrator_start_coordinator(orc, tick_ms) != 0) {
+            rc_error("orchestrator-coordinate: failed to start coordinator");
+            return;
+        }
+        fprint(1, "Coordinating all orchestrators into %s every %d ms\n", orc->name, tick_ms);
+        return;
+    }
+    
+    /* One-shot merge */
+    pthread_mutex_lock(&orchestrator_mutex);
+    orchestrator_coordinate_agents(orc, orchestrators, orchestrator_count);
+    pthread_mutex_unlock(&orchestrator_mutex);
+    
+    AttentionState attention;
+    PatternAnalysis *patterns = pattern_analysis_create();
+    if (!patterns) {
+        rc_error("orchestrator-coordinate: out of memory");
+        return;
+    }
+    int sources = orchestrator_read_coordinated(orc, &attention, patterns);
+    
+    fprint(1, "Coordinated view of %d orchestrators in %s:\n", sources, orc->name);
+    fprint(1, "  Total Attention: %d (x100)\n", (int)(attention.total_attention * 100));
+    fprint(1, "  Patterns: %d of %d observed\n", patterns->pattern_count,
+           (int)patterns->sketch.total);
+    
+    const PatternCounter *top[5];
+    int n = pattern_sketch_top(&patterns->sketch, top, 5);
+    for (int i = 0; i < n; i++) {
+        fprint(1, "    %s: %d\n", top[i]->text, (int)top[i]->count);
+    }
+    pattern_analysis_destroy(patterns);
+}
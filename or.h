@@ -10,11 +10,31 @@
 #include "cognitive.h"
 #include "gguf.h"
 
+/* Resonance spectrum: histogram of node resonance frequencies */
+#define RESONANCE_SPECTRUM_BINS 16
+#define RESONANCE_BIN_WIDTH 0.25f
+
 /* Neural tree structure types */
 typedef struct NeuralNode NeuralNode;
 typedef struct PatternAnalysis PatternAnalysis;
 typedef struct ResonanceDepth ResonanceDepth;
 
+/* Published snapshots and coordinator state (private to or.c) */
+struct OrchestratorSync;
+
+/* Fixed-size thread pool shared by orchestrator workloads */
+typedef struct WorkerPool WorkerPool;
+typedef void (*WorkerTask)(void *arg);
+
+/* A prompt handed to orchestrator_dispatch_task("inference").  The
+ * worker fills in response and status, then calls done. */
+typedef struct InferenceTask {
+    const char *prompt;
+    char *response;
+    int status;
+    void (*done)(struct InferenceTask *task);
+} InferenceTask;
+
 /* Orchestrator class for main coordination */
 typedef struct {
     uint32_t agent_id;
@@ -24,9 +44,11 @@ typedef struct {
     ResonanceDepth *resonance_state;
     AttentionState *attention_state;
     void *inference_engine;  /* Will hold gguf_model */
+    WorkerPool *workers;
     int thread_count;
     int is_active;
     time_t last_update;
+    struct OrchestratorSync *sync;
 } Orchestrator;
 
 /* Neural tree node structure */
@@ -39,20 +61,67 @@ struct NeuralNode {
     ECANValues ecan_values;
     NeuralNode **children;
     int child_count;
+    int child_capacity;
     NeuralNode *parent;
     void *pattern_data;
     time_t created;
     time_t last_accessed;
+
+    /* Aggregated subtree statistics, maintained incrementally.  A node
+     * whose activation changes is marked dirty and queued on its root;
+     * neural_tree_update_resonance() folds each queued change into the
+     * aggregates along the path to the root only. */
+    uint32_t subtree_count;
+    double subtree_resonance;
+    double subtree_resonance_sq;
+    uint32_t subtree_spectrum[RESONANCE_SPECTRUM_BINS];
+    float applied_frequency;    /* resonance already folded into ancestors */
+    int accounted;              /* node is included in ancestor aggregates */
+    int dirty;
+    NeuralNode *next_dirty;
+    NeuralNode *dirty_list;     /* pending changes (root only) */
+
+    /* Activation last pushed down by neural_tree_propagate().  Nodes
+     * that change outside propagation (new nodes, direct activation
+     * sets) are queued on their root, so propagating an unchanged
+     * activation again visits only those. */
+    float propagated;
+    int propagated_valid;
+    int pending;
+    NeuralNode *next_pending;
+    NeuralNode *pending_list;   /* nodes propagation has to revisit (root only) */
 };
 
+/* Streaming top-K pattern sketch (Space-Saving).  Memory is fixed at
+ * PATTERN_SKETCH_K counters regardless of how many updates are seen;
+ * a counter's true frequency lies in [count - error, count]. */
+#define PATTERN_SKETCH_K 32
+#define PATTERN_TEXT_MAX 48
+
+typedef struct {
+    uint64_t hash;
+    uint64_t count;
+    uint64_t error;                     /* overestimation bound */
+    char text[PATTERN_TEXT_MAX];        /* truncated pattern text */
+} PatternCounter;
+
+typedef struct {
+    PatternCounter counters[PATTERN_SKETCH_K];
+    uint8_t heap[PATTERN_SKETCH_K];     /* min-heap of counters by count */
+    uint8_t heap_pos[PATTERN_SKETCH_K];
+    int8_t index[PATTERN_SKETCH_K * 2]; /* open-addressed hash -> counter */
+    int used;
+    uint64_t total;
+} PatternSketch;
+
 /* Pattern analysis structure */
 struct PatternAnalysis {
     float resonance_depth;
     float temporal_coherence;
     float spatial_distribution;
     int pattern_count;
-    char **active_patterns;
-    float *pattern_weights;
+    PatternSketch sketch;
+    float pattern_weights[PATTERN_SKETCH_K];
     time_t analysis_time;
 };
 
@@ -77,6 +146,10 @@ extern int orchestrator_update(Orchestrator *orc);
 /* Neural tree operations */
 extern NeuralNode *neural_node_create(const char *pattern_type, NeuralNode *parent);
 extern void neural_node_destroy(NeuralNode *node);
+extern int neural_node_set_activation(NeuralNode *node, float activation);
+extern void neural_node_mark_dirty(NeuralNode *node);
+extern void neural_node_mark_pending(NeuralNode *node);
+extern NeuralNode *neural_tree_root(NeuralNode *node);
 extern int neural_tree_propagate(NeuralNode *root, float activation);
 extern int neural_tree_update_resonance(NeuralNode *root);
 extern NeuralNode *neural_tree_find_pattern(NeuralNode *root, const char *pattern);
@@ -89,6 +162,12 @@ extern float pattern_calculate_resonance_depth(PatternAnalysis *analysis);
 extern float pattern_calculate_temporal_coherence(PatternAnalysis *analysis);
 extern float pattern_calculate_spatial_distribution(PatternAnalysis *analysis);
 
+/* Pattern sketch functions */
+extern void pattern_sketch_init(PatternSketch *sketch);
+extern int pattern_sketch_add(PatternSketch *sketch, const char *text, size_t len, uint64_t weight);
+extern void pattern_sketch_merge(PatternSketch *dest, const PatternSketch *src);
+extern int pattern_sketch_top(const PatternSketch *sketch, const PatternCounter **top, int max);
+
 /* Resonance functions */
 extern ResonanceDepth *resonance_create(void);
 extern void resonance_destroy(ResonanceDepth *resonance);
@@ -99,22 +178,39 @@ extern float resonance_get_stability(ResonanceDepth *resonance);
 extern int orchestrator_load_model(Orchestrator *orc, const char *model_path);
 extern int orchestrator_inference(Orchestrator *orc, const char *prompt, char **response);
 extern int orchestrator_set_context(Orchestrator *orc, const char *context);
+extern int orchestrator_inference_batch(Orchestrator *orc, const char **prompts, int count,
+                                        char **responses);
 
 /* Multi-threaded execution */
 extern int orchestrator_start_workers(Orchestrator *orc, int thread_count);
 extern int orchestrator_stop_workers(Orchestrator *orc);
 extern int orchestrator_dispatch_task(Orchestrator *orc, const char *task, void *data);
 
+/* Worker pool */
+extern WorkerPool *worker_pool_create(int threads);
+extern void worker_pool_destroy(WorkerPool *pool);
+extern int worker_pool_submit(WorkerPool *pool, WorkerTask fn, void *arg);
+extern int worker_pool_size(WorkerPool *pool);
+extern void worker_pool_parallel_for(WorkerPool *pool, int count,
+                                     void (*fn)(void *ctx, int index), void *ctx);
+extern WorkerPool *worker_pool_default(void);
+
 /* Coordination functions */
 extern int orchestrator_coordinate_agents(Orchestrator *primary, Orchestrator **agents, int count);
 extern int orchestrator_sync_attention(Orchestrator *orc, AttentionState *global_state);
 extern int orchestrator_sync_patterns(Orchestrator *orc, PatternAnalysis *global_analysis);
+extern int orchestrator_publish(Orchestrator *orc);
+extern int orchestrator_read_coordinated(Orchestrator *orc, AttentionState *attention,
+                                         PatternAnalysis *patterns);
+extern int orchestrator_start_coordinator(Orchestrator *orc, int tick_ms);
+extern int orchestrator_stop_coordinator(Orchestrator *orc);
 
 /* Shell command interface */
 extern void b_orchestrator_create(char **av);
 extern void b_orchestrator_status(char **av);
 extern void b_orchestrator_load_model(char **av);
 extern void b_orchestrator_inference(char **av);
+extern void b_orchestrator_coordinate(char **av);
 extern void b_neural_tree_show(char **av);
 extern void b_pattern_analysis(char **av);
 
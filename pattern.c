@@ -0,0 +1,601 @@
+/* Pattern Matcher Implementation
+ * A pattern is a conjunction of clauses.  Each clause is compiled to a
+ * pre-order array of terms: constants already looked up in the store,
+ * variables, and links whose fully constant parts have been folded
+ * into constants.
+ *
+ * The join order is chosen greedily: at every step, the clause whose
+ * candidates come cheapest given the variables bound so far.  A clause
+ * gets its candidates from the smallest of its type list, the incoming
+ * set of one of its constants, or the incoming set of the value of a
+ * bound variable.  For a term nested inside the clause, the search
+ * climbs through incoming sets, checking type, arity and position at
+ * every level, so each candidate is reached once.
+ *
+ * The first clause's candidates are split into chunks that run on the
+ * worker pool.  Each chunk keeps its own groundings, and they are
+ * emitted in chunk order, a batch of chunks at a time.
+ */
+
+#include "pattern.h"
+#include "or.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <math.h>
+
+typedef enum {
+    TERM_ATOM,
+    TERM_VAR,
+    TERM_LINK
+} TermKind;
+
+typedef struct {
+    TermKind kind;
+    uint16_t type;              /* TERM_LINK */
+    uint32_t arity;             /* TERM_LINK */
+    Atom atom;                  /* TERM_ATOM; 0 if not in the store */
+    int var;                    /* TERM_VAR */
+    int parent;                 /* -1 at the root */
+    uint32_t index;             /* position in the parent's outgoing set */
+    int size;                   /* terms in this subtree */
+} PatternTerm;
+
+typedef struct {
+    PatternTerm *terms;         /* pre-order; children follow their link */
+    int count;
+    int capacity;
+} Clause;
+
+typedef enum {
+    SOURCE_SELF,                /* constant clause: the atom itself */
+    SOURCE_TYPE,                /* every atom of the root's type */
+    SOURCE_ATOM,                /* climb from a constant term */
+    SOURCE_VAR                  /* climb from a bound variable's value */
+} SourceKind;
+
+typedef struct {
+    int clause;
+    SourceKind source;
+    int anchor;                 /* term climbed from */
+    double estimate;
+} PlanStep;
+
+struct Pattern {
+    Clause clauses[PATTERN_MAX_CLAUSES];
+    int clause_count;
+    char *vars[PATTERN_MAX_VARS];
+    int var_count;
+    int empty;                  /* a constant is missing from the store */
+    PlanStep plan[PATTERN_MAX_CLAUSES];
+};
+
+/* Compilation */
+
+static const char *skip_space(const char *p) {
+    while (isspace((unsigned char)*p)) p++;
+    return p;
+}
+
+static int term_add(Clause *c, TermKind kind, int parent, uint32_t index) {
+    if (c->count == c->capacity) {
+        int capacity = c->capacity ? c->capacity * 2 : 16;
+        PatternTerm *terms = realloc(c->terms, capacity * sizeof(PatternTerm));
+        if (!terms) return -1;
+        c->terms = terms;
+        c->capacity = capacity;
+    }
+    PatternTerm *t = &c->terms[c->count];
+    memset(t, 0, sizeof(*t));
+    t->kind = kind;
+    t->parent = parent;
+    t->index = index;
+    t->size = 1;
+    return c->count++;
+}
+
+static int var_index(Pattern *p, const char *name, const char **error) {
+    for (int i = 0; i < p->var_count; i++) {
+        if (strcmp(p->vars[i], name) == 0) return i;
+    }
+    if (p->var_count == PATTERN_MAX_VARS) {
+        *error = "too many variables";
+        return -1;
+    }
+    char *copy = malloc(strlen(name) + 1);
+    if (!copy) {
+        *error = "out of memory";
+        return -1;
+    }
+    strcpy(copy, name);
+    p->vars[p->var_count] = copy;
+    return p->var_count++;
+}
+
+static int var_term(Pattern *p, Clause *c, const char *name, int parent, uint32_t index,
+                    const char **error) {
+    int var = var_index(p, name, error);
+    if (var < 0) return -1;
+    int t = term_add(c, TERM_VAR, parent, index);
+    if (t < 0) {
+        *error = "out of memory";
+        return -1;
+    }
+    c->terms[t].var = var;
+    return t;
+}
+
+/* A link whose children are all constants becomes a constant itself */
+static void fold_link(Pattern *p, Clause *c, int t) {
+    PatternTerm *term = &c->terms[t];
+    Atom out[64];
+
+    if (term->size != (int)term->arity + 1 || term->arity > sizeof(out) / sizeof(out[0])) return;
+    for (uint32_t i = 0; i < term->arity; i++) {
+        if (c->terms[t + 1 + i].kind != TERM_ATOM) return;
+        out[i] = c->terms[t + 1 + i].atom;
+        if (!out[i]) p->empty = 1;
+    }
+    term->atom = term->type && !p->empty ? hypergraph_find_link(term->type, out, term->arity) : 0;
+    if (!term->atom) p->empty = 1;
+    term->kind = TERM_ATOM;
+    term->size = 1;
+    c->count = t + 1;
+}
+
+static int parse_term(Pattern *p, Clause *c, const char **text, int parent, uint32_t index,
+                      int depth, const char **error) {
+    const char *s = skip_space(*text);
+    char type_name[64];
+
+    if (*s == '$') {
+        const char *start = ++s;
+        while (isalnum((unsigned char)*s) || *s == '_' || *s == '-') s++;
+        if (s == start || (size_t)(s - start) >= sizeof(type_name)) {
+            *error = "bad variable name";
+            return -1;
+        }
+        memcpy(type_name, start, s - start);
+        type_name[s - start] = '\0';
+        *text = s;
+        return var_term(p, c, type_name, parent, index, error);
+    }
+    if (*s != '(') {
+        *error = "expected '(' or a variable";
+        return -1;
+    }
+    if (depth >= HYPERGRAPH_MAX_DEPTH) {
+        *error = "pattern nested too deeply";
+        return -1;
+    }
+
+    const char *start = s = skip_space(s + 1);
+    while (isalnum((unsigned char)*s) || *s == '_' || *s == '-') s++;
+    if (s == start || (size_t)(s - start) >= sizeof(type_name)) {
+        *error = "expected an atom type";
+        return -1;
+    }
+    memcpy(type_name, start, s - start);
+    type_name[s - start] = '\0';
+    s = skip_space(s);
+
+    int t;
+    uint16_t type = hypergraph_type_lookup(type_name);
+    int link = type ? hypergraph_type_is_link(type) : hypergraph_type_kind(type_name);
+    if (strcmp(type_name, "VariableNode") == 0) {
+        char *name = hypergraph_read_name(&s, error);
+        if (!name) return -1;
+        t = var_term(p, c, name[0] == '$' ? name + 1 : name, parent, index, error);
+        free(name);
+        if (t < 0) return -1;
+    } else if (link < 0) {
+        *error = "unknown atom type";
+        return -1;
+    } else if (!link) {
+        char *name = hypergraph_read_name(&s, error);
+        if (!name) return -1;
+        t = term_add(c, TERM_ATOM, parent, index);
+        if (t >= 0) c->terms[t].atom = type ? hypergraph_find_node(type, name) : 0;
+        free(name);
+        if (t < 0) {
+            *error = "out of memory";
+            return -1;
+        }
+        if (!c->terms[t].atom) p->empty = 1;
+    } else {
+        t = term_add(c, TERM_LINK, parent, index);
+        if (t < 0) {
+            *error = "out of memory";
+            return -1;
+        }
+        c->terms[t].type = type;
+        if (!type) p->empty = 1;
+        uint32_t arity = 0;
+        for (s = skip_space(s); *s && *s != ')'; s = skip_space(s)) {
+            if (parse_term(p, c, &s, t, arity++, depth + 1, error) < 0) return -1;
+        }
+        c->terms[t].arity = arity;
+        c->terms[t].size = c->count - t;
+        fold_link(p, c, t);
+    }
+
+    s = skip_space(s);
+    if (*s != ')') {
+        *error = "expected ')'";
+        return -1;
+    }
+    *text = s + 1;
+    return t;
+}
+
+/* Planning */
+
+/* Expected links holding an atom, from the store's averages */
+static double average_incoming(void) {
+    size_t atoms = hypergraph_atom_count();
+    double average = atoms ? 2.0 * hypergraph_link_count() / atoms : 1.0;
+    return average < 1.0 ? 1.0 : average;
+}
+
+static void plan_clause(const Pattern *p, int ci, const int *bound, double average,
+                        PlanStep *step) {
+    const Clause *c = &p->clauses[ci];
+    size_t n;
+
+    step->clause = ci;
+    step->anchor = 0;
+    if (c->terms[0].kind == TERM_ATOM) {
+        step->source = SOURCE_SELF;
+        step->estimate = 0.0;
+        return;
+    }
+    hypergraph_atoms_of_type(c->terms[0].type, &n);
+    step->source = SOURCE_TYPE;
+    step->estimate = (double)n;
+
+    for (int t = 1; t < c->count; t++) {
+        const PatternTerm *term = &c->terms[t];
+        int depth = 0;
+        for (int u = t; c->terms[u].parent >= 0; u = c->terms[u].parent) depth++;
+
+        double estimate;
+        if (term->kind == TERM_ATOM) {
+            estimate = hypergraph_incoming_count(term->atom) * pow(average, depth - 1);
+        } else if (term->kind == TERM_VAR && bound[term->var]) {
+            estimate = pow(average, depth);
+        } else {
+            continue;
+        }
+        if (estimate < step->estimate) {
+            step->source = term->kind == TERM_ATOM ? SOURCE_ATOM : SOURCE_VAR;
+            step->anchor = t;
+            step->estimate = estimate;
+        }
+    }
+}
+
+static void pattern_plan(Pattern *p) {
+    int bound[PATTERN_MAX_VARS] = {0};
+    int used[PATTERN_MAX_CLAUSES] = {0};
+    double average = average_incoming();
+
+    for (int step = 0; step < p->clause_count; step++) {
+        PlanStep best, candidate;
+        best.clause = -1;
+        for (int ci = 0; ci < p->clause_count; ci++) {
+            if (used[ci]) continue;
+            plan_clause(p, ci, bound, average, &candidate);
+            if (best.clause < 0 || candidate.estimate < best.estimate) best = candidate;
+        }
+        used[best.clause] = 1;
+        const Clause *c = &p->clauses[best.clause];
+        for (int t = 0; t < c->count; t++) {
+            if (c->terms[t].kind == TERM_VAR) bound[c->terms[t].var] = 1;
+        }
+        p->plan[step] = best;
+    }
+}
+
+Pattern *pattern_compile(const char **clauses, int count, const char **error) {
+    *error = NULL;
+    if (count < 1 || count > PATTERN_MAX_CLAUSES) {
+        *error = count < 1 ? "no clauses" : "too many clauses";
+        return NULL;
+    }
+    Pattern *p = calloc(1, sizeof(Pattern));
+    if (!p) {
+        *error = "out of memory";
+        return NULL;
+    }
+
+    for (int i = 0; i < count; i++) {
+        const char *text = clauses[i];
+        Clause *c = &p->clauses[p->clause_count++];
+        if (parse_term(p, c, &text, -1, 0, 0, error) < 0) break;
+        if (*skip_space(text)) {
+            *error = "trailing text after clause";
+            break;
+        }
+        if (c->terms[0].kind == TERM_VAR) {
+            *error = "a clause must be an atom, not a variable";
+            break;
+        }
+    }
+    if (*error) {
+        pattern_free(p);
+        return NULL;
+    }
+
+    pattern_plan(p);
+    return p;
+}
+
+void pattern_free(Pattern *p) {
+    if (!p) return;
+    for (int i = 0; i < p->clause_count; i++) free(p->clauses[i].terms);
+    for (int i = 0; i < p->var_count; i++) free(p->vars[i]);
+    free(p);
+}
+
+int pattern_var_count(const Pattern *p) {
+    return p->var_count;
+}
+
+const char *pattern_var_name(const Pattern *p, int var) {
+    return var >= 0 && var < p->var_count ? p->vars[var] : NULL;
+}
+
+int pattern_explain(const Pattern *p, char *buf, size_t size) {
+    size_t len = 0;
+
+    if (size) buf[0] = '\0';
+    for (int step = 0; step < p->clause_count; step++) {
+        const PlanStep *ps = &p->plan[step];
+        const PatternTerm *root = &p->clauses[ps->clause].terms[0];
+        const PatternTerm *anchor = &p->clauses[ps->clause].terms[ps->anchor];
+        char source[96];
+
+        switch (ps->source) {
+        case SOURCE_SELF:
+            snprintf(source, sizeof(source), "constant %u", (unsigned)root->atom);
+            break;
+        case SOURCE_TYPE:
+            snprintf(source, sizeof(source), "scan %s", hypergraph_type_name(root->type));
+            break;
+        case SOURCE_ATOM:
+            snprintf(source, sizeof(source), "incoming of %u", (unsigned)anchor->atom);
+            break;
+        case SOURCE_VAR:
+            snprintf(source, sizeof(source), "incoming of $%s", p->vars[anchor->var]);
+            break;
+        }
+        int n = snprintf(len < size ? buf + len : NULL, len < size ? size - len : 0,
+                         "%sclause %d: %s (~%.0f)", step ? "; " : "", ps->clause + 1,
+                         source, ps->estimate);
+        if (n > 0) len += n;
+    }
+    if (p->empty) {
+        int n = snprintf(len < size ? buf + len : NULL, len < size ? size - len : 0,
+                         "%s", "; a constant is not in the store");
+        if (n > 0) len += n;
+    }
+    return (int)len;
+}
+
+/* Search */
+
+typedef struct Search Search;
+typedef void (*Visit)(Search *s, int step, const Atom *binding, Atom candidate);
+
+struct Search {
+    const Pattern *pattern;
+    Atom *results;              /* var_count atoms per grounding */
+    size_t count;
+    size_t capacity;
+    size_t limit;               /* 0 for none */
+    int failed;
+    Atom *candidates;           /* gathered first-step candidates */
+    size_t candidate_count;
+    size_t candidate_capacity;
+};
+
+static int search_done(const Search *s) {
+    return s->failed || (s->limit && s->count >= s->limit);
+}
+
+/* Match atom against term t, binding variables; binding is left
+ * partly written on failure */
+static int unify(const Clause *c, int t, Atom atom, Atom *binding) {
+    const PatternTerm *term = &c->terms[t];
+
+    switch (term->kind) {
+    case TERM_ATOM:
+        return atom == term->atom;
+    case TERM_VAR:
+        if (binding[term->var]) return binding[term->var] == atom;
+        binding[term->var] = atom;
+        return 1;
+    case TERM_LINK: {
+        uint32_t arity;
+        const Atom *out = hypergraph_outgoing(atom, &arity);
+        if (hypergraph_atom_type(atom) != term->type || arity != term->arity) return 0;
+        int child = t + 1;
+        for (uint32_t i = 0; i < arity; i++) {
+            if (!unify(c, child, out[i], binding)) return 0;
+            child += c->terms[child].size;
+        }
+        return 1;
+    }
+    }
+    return 0;
+}
+
+/* Walk up from value, which stands at term t, to each link holding it
+ * in that position all the way to the clause root.  A link holding
+ * value more than once is reached once per position, so only the
+ * appearance at term t's own position is followed. */
+static void climb(Search *s, int step, const Atom *binding, int t, Atom value, Visit visit) {
+    const Clause *c = &s->pattern->clauses[s->pattern->plan[step].clause];
+    const PatternTerm *term = &c->terms[t];
+    const PatternTerm *parent = &c->terms[term->parent];
+    uint32_t cursor = 0, position;
+    Atom link;
+
+    while (!search_done(s) && (link = hypergraph_incoming_next_at(value, &cursor, &position)) != 0) {
+        uint32_t arity;
+        hypergraph_outgoing(link, &arity);
+        if (position != term->index || hypergraph_atom_type(link) != parent->type ||
+            arity != parent->arity) continue;
+        if (term->parent == 0) {
+            visit(s, step, binding, link);
+        } else {
+            climb(s, step, binding, term->parent, link, visit);
+        }
+    }
+}
+
+static void generate(Search *s, int step, const Atom *binding, Visit visit) {
+    const PlanStep *ps = &s->pattern->plan[step];
+    const Clause *c = &s->pattern->clauses[ps->clause];
+
+    switch (ps->source) {
+    case SOURCE_SELF:
+        visit(s, step, binding, c->terms[0].atom);
+        break;
+    case SOURCE_TYPE: {
+        size_t n;
+        const Atom *atoms = hypergraph_atoms_of_type(c->terms[0].type, &n);
+        for (size_t i = 0; i < n && !search_done(s); i++) visit(s, step, binding, atoms[i]);
+        break;
+    }
+    case SOURCE_ATOM:
+        climb(s, step, binding, ps->anchor, c->terms[ps->anchor].atom, visit);
+        break;
+    case SOURCE_VAR:
+        climb(s, step, binding, ps->anchor, binding[c->terms[ps->anchor].var], visit);
+        break;
+    }
+}
+
+static void search_step(Search *s, int step, const Atom *binding);
+
+static void try_candidate(Search *s, int step, const Atom *binding, Atom candidate) {
+    const Pattern *p = s->pattern;
+    Atom next[PATTERN_MAX_VARS];
+
+    memcpy(next, binding, sizeof(next));
+    if (unify(&p->clauses[p->plan[step].clause], 0, candidate, next)) {
+        search_step(s, step + 1, next);
+    }
+}
+
+static void search_step(Search *s, int step, const Atom *binding) {
+    const Pattern *p = s->pattern;
+
+    if (search_done(s)) return;
+    if (step < p->clause_count) {
+        generate(s, step, binding, try_candidate);
+        return;
+    }
+
+    if (p->var_count) {
+        if (s->count == s->capacity) {
+            size_t capacity = s->capacity ? s->capacity * 2 : 64;
+            Atom *results = realloc(s->results, capacity * p->var_count * sizeof(Atom));
+            if (!results) {
+                s->failed = 1;
+                return;
+            }
+            s->results = results;
+            s->capacity = capacity;
+        }
+        memcpy(s->results + s->count * p->var_count, binding, p->var_count * sizeof(Atom));
+    }
+    s->count++;
+}
+
+static void collect_candidate(Search *s, int step, const Atom *binding, Atom candidate) {
+    (void)step;
+    (void)binding;
+    if (s->candidate_count == s->candidate_capacity) {
+        size_t capacity = s->candidate_capacity ? s->candidate_capacity * 2 : 256;
+        Atom *candidates = realloc(s->candidates, capacity * sizeof(Atom));
+        if (!candidates) {
+            s->failed = 1;
+            return;
+        }
+        s->candidates = candidates;
+        s->candidate_capacity = capacity;
+    }
+    s->candidates[s->candidate_count++] = candidate;
+}
+
+typedef struct {
+    const Atom *candidates;
+    size_t count;
+    Search *searches;           /* one per task */
+} MatchBatch;
+
+static void match_task(void *ctx, int index) {
+    MatchBatch *batch = (MatchBatch*)ctx;
+    Search *s = &batch->searches[index];
+    size_t first = (size_t)index * PATTERN_CHUNK;
+    size_t last = first + PATTERN_CHUNK < batch->count ? first + PATTERN_CHUNK : batch->count;
+    Atom binding[PATTERN_MAX_VARS] = {0};
+
+    for (size_t i = first; i < last && !search_done(s); i++) {
+        try_candidate(s, 0, binding, batch->candidates[i]);
+    }
+}
+
+size_t pattern_run(const Pattern *p, size_t limit,
+                   void (*emit)(void *ctx, const Atom *grounding), void *ctx) {
+    Search gather;
+    Search searches[PATTERN_BATCH];
+    Atom binding[PATTERN_MAX_VARS] = {0};
+    const Atom *candidates;
+    size_t count, emitted = 0;
+
+    if (p->empty) return 0;
+
+    /* A scan uses the type list as it is; anything else is gathered */
+    memset(&gather, 0, sizeof(gather));
+    gather.pattern = p;
+    if (p->plan[0].source == SOURCE_TYPE) {
+        candidates = hypergraph_atoms_of_type(p->clauses[p->plan[0].clause].terms[0].type, &count);
+    } else {
+        generate(&gather, 0, binding, collect_candidate);
+        candidates = gather.candidates;
+        count = gather.candidate_count;
+    }
+
+    for (size_t start = 0; start < count && !gather.failed; start += PATTERN_BATCH * PATTERN_CHUNK) {
+        MatchBatch batch;
+        batch.candidates = candidates + start;
+        batch.count = count - start < PATTERN_BATCH * PATTERN_CHUNK ? count - start
+                                                                    : PATTERN_BATCH * PATTERN_CHUNK;
+        batch.searches = searches;
+        int tasks = (int)((batch.count + PATTERN_CHUNK - 1) / PATTERN_CHUNK);
+        for (int i = 0; i < tasks; i++) {
+            memset(&searches[i], 0, sizeof(Search));
+            searches[i].pattern = p;
+            searches[i].limit = limit ? limit - emitted : 0;
+        }
+
+        worker_pool_parallel_for(worker_pool_default(), tasks, match_task, &batch);
+
+        for (int i = 0; i < tasks; i++) {
+            for (size_t g = 0; g < searches[i].count && !(limit && emitted >= limit); g++) {
+                emit(ctx, searches[i].results ? searches[i].results + g * p->var_count : NULL);
+                emitted++;
+            }
+            if (searches[i].failed) gather.failed = 1;
+            free(searches[i].results);
+        }
+        if (limit && emitted >= limit) break;
+    }
+
+    free(gather.candidates);
+    return emitted;
+}
@@ -0,0 +1,39 @@
+/* Pattern Matcher Header
+ * Conjunctive queries with variables over the hypergraph store
+ */
+
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <stddef.h>
+#include "hypergraph.h"
+
+#define PATTERN_MAX_VARS 16
+#define PATTERN_MAX_CLAUSES 16
+#define PATTERN_CHUNK 64                /* first-clause candidates per task */
+#define PATTERN_BATCH 64                /* tasks per batch of emitted results */
+
+typedef struct Pattern Pattern;
+
+/* Each clause is an atom S-expression in which $name, or
+ * (VariableNode "name"), stands for any atom.  A variable shared by
+ * clauses must take the same value in all of them.  Compiling looks up
+ * the constant parts, so a pattern naming an atom that does not exist
+ * compiles but matches nothing. */
+extern Pattern *pattern_compile(const char **clauses, int count, const char **error);
+extern void pattern_free(Pattern *pattern);
+
+/* Variables are numbered in order of first appearance */
+extern int pattern_var_count(const Pattern *pattern);
+extern const char *pattern_var_name(const Pattern *pattern, int var);
+
+/* The join order and where each clause's candidates come from */
+extern int pattern_explain(const Pattern *pattern, char *buf, size_t size);
+
+/* Calls emit with the value of every variable, for each grounding, in
+ * an order that does not depend on threads.  Stops after limit
+ * groundings unless limit is 0; returns the number emitted. */
+extern size_t pattern_run(const Pattern *pattern, size_t limit,
+                          void (*emit)(void *ctx, const Atom *grounding), void *ctx);
+
+#endif /* PATTERN_H */
@@ -0,0 +1,524 @@
+/* PLN Chainer Implementation
+ * A link X->Y is expanded by trying every rule that pairs it with
+ * another link at X or Y, found through the incoming sets:
+ *
+ *   deduction   X->Y, Y->Z |- X->Z     and  W->X, X->Y |- W->Y
+ *   induction   X->Y, X->Z |- Y->Z
+ *   abduction   X->Y, Z->Y |- X->Z
+ *
+ * Induction and abduction invert one premise with Bayes' rule and
+ * then deduce, so all three share the independence-based deduction
+ * formula.  Term probabilities are the strengths of the terms' own
+ * truth values, or PLN_TERM_PRIOR for terms with no evidence.
+ *
+ * Each rule application is a derivation, memoized under its rule and
+ * premises with the truth value it gave.  A conclusion's truth value
+ * is the revision of its independent derivations: strengths averaged
+ * by evidence count c/(1-c), counts summed.  Independence is judged by
+ * evidence fingerprints, a bit per asserted link hashed into 64, as in
+ * the evidential bases of NARS; a collision only makes the chainer
+ * more cautious.  When a conclusion changes it
+ * is queued for expansion in turn, so changes propagate until nothing
+ * moves or the budget runs out.
+ */
+
+#include "pln.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PLN_EPSILON 1e-4f               /* smaller changes do not propagate */
+#define PLN_MAX_COUNT_CONFIDENCE 0.999f
+
+typedef struct {
+    Atom premise[2];
+    Atom conclusion;
+    uint32_t rule;
+    float strength, confidence;
+    uint64_t evidence;          /* fingerprint of the asserted premises */
+    uint32_t next;              /* next derivation of the same conclusion */
+    uint32_t chain;             /* next derivation in the memo bucket */
+} Derivation;
+
+typedef struct {
+    uint32_t conclusion;        /* derivation list head, 0 if never derived */
+    uint32_t queued;            /* run it is queued in */
+    uint32_t changed;           /* run that changed it */
+    uint32_t term;              /* backward run it is a term of */
+    uint32_t distance;          /* links from the target, when a term */
+    float strength, confidence; /* truth value the chainer last wrote */
+    uint64_t evidence;
+} AtomState;
+
+typedef struct {
+    float priority;
+    Atom atom;
+} QueueEntry;
+
+static Derivation *derivations = NULL;      /* 1-based */
+static size_t derivation_count = 0;
+static size_t derivation_capacity = 0;
+static uint32_t *memo = NULL;               /* bucket heads */
+static size_t memo_size = 0;
+
+static AtomState *state = NULL;             /* by handle */
+static size_t state_capacity = 0;
+
+static QueueEntry *queue = NULL;            /* max-heap on priority */
+static size_t queue_count = 0;
+static size_t queue_capacity = 0;
+
+static Atom *changed = NULL;
+static size_t changed_count = 0;
+static size_t changed_capacity = 0;
+
+/* The current run */
+static uint32_t run = 0;
+static uint16_t inheritance, implication;
+static int restricted;                      /* only derive between marked terms */
+static int stopped;
+static int failed;
+static const PlnBudget *limits;
+static PlnStats *counts;
+static double started;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int reserve(void **p, size_t *capacity, size_t need, size_t size) {
+    if (need <= *capacity) return 0;
+    size_t n = *capacity ? *capacity : 256;
+    while (n < need) n *= 2;
+    void *q = realloc(*p, n * size);
+    if (!q) return -1;
+    *p = q;
+    *capacity = n;
+    return 0;
+}
+
+static int state_reserve(Atom atom) {
+    size_t old = state_capacity;
+    if (reserve((void**)&state, &state_capacity, (size_t)atom + 1, sizeof(AtomState)) < 0) return -1;
+    memset(state + old, 0, (state_capacity - old) * sizeof(AtomState));
+    return 0;
+}
+
+static float clamp01(float x) {
+    return x < 0.0f ? 0.0f : x > 1.0f ? 1.0f : x;
+}
+
+static float term_strength(Atom term) {
+    float strength, confidence;
+    hypergraph_get_tv(term, &strength, &confidence);
+    return confidence > 0.0f ? strength : PLN_TERM_PRIOR;
+}
+
+/* Candidates are ordered by the STI of a link and its terms, then by
+ * confidence; a backward run puts links near the target first */
+static float priority(Atom link) {
+    float sti, lti, strength, confidence;
+    uint32_t arity;
+    const Atom *out = hypergraph_outgoing(link, &arity);
+
+    hypergraph_get_tv(link, &strength, &confidence);
+    hypergraph_get_av(link, &sti, &lti);
+    for (uint32_t i = 0; i < arity; i++) {
+        float term, unused;
+        hypergraph_get_av(out[i], &term, &unused);
+        sti += term;
+        if (restricted) sti -= state[out[i]].distance;
+    }
+    return sti + confidence;
+}
+
+/* Formulas */
+
+/* P(C|A) from P(B|A), P(C|B) and the term probabilities, assuming A
+ * and C are independent given B and given not-B */
+static float deduce(float ab, float bc, float b, float c) {
+    if (b > 0.9999f) return bc;
+    return clamp01(ab * bc + (1.0f - ab) * (c - b * bc) / (1.0f - b));
+}
+
+/* P(A|B) from P(B|A) */
+static float invert(float ab, float a, float b) {
+    return b > 0.0f ? clamp01(ab * a / b) : 0.0f;
+}
+
+static float count_of(float confidence) {
+    if (confidence > PLN_MAX_COUNT_CONFIDENCE) confidence = PLN_MAX_COUNT_CONFIDENCE;
+    return confidence / (1.0f - confidence);
+}
+
+/* Queue */
+
+static int queue_push(Atom link) {
+    if (state_reserve(link) < 0) return -1;
+    if (state[link].queued == run) return 0;
+    if (reserve((void**)&queue, &queue_capacity, queue_count + 1, sizeof(QueueEntry)) < 0) return -1;
+    QueueEntry e = { priority(link), link };
+    size_t i = queue_count++;
+    while (i > 0 && queue[(i - 1) / 2].priority < e.priority) {
+        queue[i] = queue[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    queue[i] = e;
+    state[link].queued = run;
+    return 0;
+}
+
+static Atom queue_pop(void) {
+    Atom top = queue[0].atom;
+    QueueEntry last = queue[--queue_count];
+    size_t i = 0;
+
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= queue_count) break;
+        if (child + 1 < queue_count && queue[child + 1].priority > queue[child].priority) child++;
+        if (queue[child].priority <= last.priority) break;
+        queue[i] = queue[child];
+        i = child;
+    }
+    if (queue_count) queue[i] = last;
+    state[top].queued = 0;
+    return top;
+}
+
+/* Memo */
+
+static uint32_t memo_hash(uint32_t rule, Atom p, Atom q) {
+    uint32_t h = rule * 0x9E3779B1u ^ p * 0x85EBCA77u ^ q * 0xC2B2AE3Du;
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    return h;
+}
+
+static int memo_grow(void) {
+    size_t size = memo_size ? memo_size * 2 : 1024;
+    uint32_t *buckets = calloc(size, sizeof(uint32_t));
+    if (!buckets) return -1;
+    for (uint32_t d = 1; d <= derivation_count; d++) {
+        Derivation *r = &derivations[d];
+        uint32_t h = memo_hash(r->rule, r->premise[0], r->premise[1]) & (size - 1);
+        r->chain = buckets[h];
+        buckets[h] = d;
+    }
+    free(memo);
+    memo = buckets;
+    memo_size = size;
+    return 0;
+}
+
+static uint32_t memo_find(uint32_t rule, Atom p, Atom q) {
+    if (!memo_size) return 0;
+    uint32_t d = memo[memo_hash(rule, p, q) & (memo_size - 1)];
+    while (d && !(derivations[d].rule == rule && derivations[d].premise[0] == p &&
+                  derivations[d].premise[1] == q)) {
+        d = derivations[d].chain;
+    }
+    return d;
+}
+
+static uint32_t memo_add(uint32_t rule, Atom p, Atom q, Atom conclusion) {
+    if (derivation_count + 1 > memo_size && memo_grow() < 0) return 0;
+    if (reserve((void**)&derivations, &derivation_capacity, derivation_count + 2,
+                sizeof(Derivation)) < 0) return 0;
+
+    uint32_t d = ++derivation_count;
+    uint32_t h = memo_hash(rule, p, q) & (memo_size - 1);
+    Derivation *r = &derivations[d];
+    r->rule = rule;
+    r->premise[0] = p;
+    r->premise[1] = q;
+    r->conclusion = conclusion;
+    r->chain = memo[h];
+    memo[h] = d;
+    r->next = state[conclusion].conclusion;
+    state[conclusion].conclusion = d;
+    return d;
+}
+
+/* Rules */
+
+static int over_budget(void) {
+    if (counts->steps >= limits->max_steps ||
+        ((counts->steps & 63) == 0 && now() - started > limits->max_seconds)) {
+        stopped = 1;
+    }
+    return stopped;
+}
+
+static int near(float a, float b) {
+    return a - b < PLN_EPSILON && b - a < PLN_EPSILON;
+}
+
+/* Whether the chainer's truth value for atom still stands, rather
+ * than one asserted before or since */
+static int derived(Atom atom) {
+    float strength, confidence;
+    if (atom >= state_capacity || !state[atom].conclusion) return 0;
+    hypergraph_get_tv(atom, &strength, &confidence);
+    return strength == state[atom].strength && confidence == state[atom].confidence;
+}
+
+static uint64_t evidence_of(Atom atom) {
+    if (derived(atom)) return state[atom].evidence;
+    return (uint64_t)1 << (memo_hash(0, atom, 0) & 63);
+}
+
+/* The most confident derivation, revised with every other one whose
+ * evidence is disjoint from what has been counted */
+static void revise(Atom conclusion, float *strength, float *confidence, uint64_t *evidence) {
+    uint32_t best = state[conclusion].conclusion;
+    for (uint32_t d = derivations[best].next; d; d = derivations[d].next) {
+        if (derivations[d].confidence > derivations[best].confidence) best = d;
+    }
+
+    float n = count_of(derivations[best].confidence);
+    float weight = n, total = n * derivations[best].strength;
+    *evidence = derivations[best].evidence;
+    for (uint32_t d = state[conclusion].conclusion; d; d = derivations[d].next) {
+        if (d == best || (derivations[d].evidence & *evidence)) continue;
+        n = count_of(derivations[d].confidence);
+        weight += n;
+        total += n * derivations[d].strength;
+        *evidence |= derivations[d].evidence;
+        counts->revisions++;
+    }
+    *strength = total / weight;
+    *confidence = weight / (weight + 1.0f);
+}
+
+/* Derive src->dst from premises p and q, unless their evidence
+ * overlaps: a conclusion must not be supported twice by one premise */
+static void apply(uint32_t rule, Atom p, Atom q, uint16_t type, Atom src, Atom dst) {
+    float ps, pc, qs, qc, strength, confidence;
+    uint32_t arity;
+
+    if (src == dst || stopped || failed) return;
+    if (restricted && (state[src].term != run || state[dst].term != run)) return;
+    if (over_budget()) return;
+    counts->steps++;
+
+    uint64_t pe = evidence_of(p), qe = evidence_of(q), evidence;
+    if (pe & qe) return;
+    hypergraph_get_tv(p, &ps, &pc);
+    hypergraph_get_tv(q, &qs, &qc);
+    confidence = pc * qc;
+    if (rule != PLN_DEDUCTION) confidence *= PLN_INVERSION_DISCOUNT;
+    if (confidence < PLN_MIN_CONFIDENCE) return;
+
+    const Atom *pout = hypergraph_outgoing(p, &arity);
+    Atom x = pout[0], y = pout[1];
+    switch (rule) {
+    case PLN_DEDUCTION:         /* x->y, y->dst */
+        strength = deduce(ps, qs, term_strength(y), term_strength(dst));
+        break;
+    case PLN_INDUCTION:         /* x->src, x->dst */
+        strength = deduce(invert(ps, term_strength(x), term_strength(src)), qs,
+                          term_strength(x), term_strength(dst));
+        break;
+    default:                    /* src->y, dst->y */
+        strength = deduce(ps, invert(qs, term_strength(dst), term_strength(y)),
+                          term_strength(y), term_strength(dst));
+        break;
+    }
+
+    Atom out[2] = { src, dst };
+    Atom conclusion = hypergraph_find_link(type, out, 2);
+    if (conclusion) {
+        float s, c;
+        hypergraph_get_tv(conclusion, &s, &c);
+        if (c > 0.0f && !derived(conclusion)) return;
+    } else if (!(conclusion = hypergraph_add_link(type, out, 2))) {
+        failed = 1;
+        return;
+    }
+    if (state_reserve(conclusion) < 0) {
+        failed = 1;
+        return;
+    }
+
+    uint32_t d = memo_find(rule, p, q);
+    if (d) {
+        Derivation *r = &derivations[d];
+        if (near(r->strength, strength) && near(r->confidence, confidence) && r->evidence == (pe | qe)) {
+            counts->memoized++;
+            return;
+        }
+    } else if (!(d = memo_add(rule, p, q, conclusion))) {
+        failed = 1;
+        return;
+    }
+    derivations[d].strength = strength;
+    derivations[d].confidence = confidence;
+    derivations[d].evidence = pe | qe;
+
+    revise(conclusion, &strength, &confidence, &evidence);
+    AtomState *a = &state[conclusion];
+    a->evidence = evidence;
+    if (near(a->strength, strength) && near(a->confidence, confidence) && derived(conclusion)) return;
+    a->strength = strength;
+    a->confidence = confidence;
+    hypergraph_set_tv(conclusion, strength, confidence);
+    if (a->changed != run) {
+        if (reserve((void**)&changed, &changed_capacity, changed_count + 1, sizeof(Atom)) < 0) {
+            failed = 1;
+            return;
+        }
+        changed[changed_count++] = conclusion;
+        a->changed = run;
+        counts->conclusions++;
+    }
+    if (queue_push(conclusion) < 0) failed = 1;
+}
+
+static int chainable(Atom link, Atom *x, Atom *y) {
+    uint16_t type = hypergraph_atom_type(link);
+    uint32_t arity;
+    const Atom *out;
+
+    if (!type || (type != inheritance && type != implication)) return 0;
+    out = hypergraph_outgoing(link, &arity);
+    if (arity != 2 || out[0] == out[1]) return 0;
+    *x = out[0];
+    *y = out[1];
+    return 1;
+}
+
+/* Pair link x->y with every link of its type at x or y */
+static void expand(Atom link) {
+    uint16_t type = hypergraph_atom_type(link);
+    Atom x, y, other, a, b;
+    uint32_t cursor;
+
+    if (!chainable(link, &x, &y)) return;
+
+    cursor = 0;
+    while (!stopped && !failed && (other = hypergraph_incoming_next(y, &cursor)) != 0) {
+        if (other == link || hypergraph_atom_type(other) != type || !chainable(other, &a, &b)) continue;
+        if (a == y) apply(PLN_DEDUCTION, link, other, type, x, b);
+        else apply(PLN_ABDUCTION, link, other, type, x, a);
+    }
+    cursor = 0;
+    while (!stopped && !failed && (other = hypergraph_incoming_next(x, &cursor)) != 0) {
+        if (other == link || hypergraph_atom_type(other) != type || !chainable(other, &a, &b)) continue;
+        if (b == x) apply(PLN_DEDUCTION, other, link, type, a, y);
+        else apply(PLN_INDUCTION, link, other, type, y, b);
+    }
+}
+
+static int begin(const PlnBudget *budget, PlnStats *stats) {
+    static PlnStats unused;
+    static const PlnBudget defaults = { PLN_MAX_STEPS, PLN_MAX_SECONDS };
+
+    limits = budget ? budget : &defaults;
+    counts = stats ? stats : &unused;
+    memset(counts, 0, sizeof *counts);
+    started = now();
+    run++;
+    inheritance = hypergraph_type_lookup("InheritanceLink");
+    implication = hypergraph_type_lookup("ImplicationLink");
+    restricted = stopped = failed = 0;
+    queue_count = 0;
+    changed_count = 0;
+    return state_reserve((Atom)hypergraph_atom_count());
+}
+
+static int chain(void) {
+    while (queue_count && !stopped && !failed) expand(queue_pop());
+
+    counts->exhausted = stopped && queue_count;
+    counts->seconds = now() - started;
+    return failed ? -1 : 0;
+}
+
+int pln_forward(const Atom *premises, size_t count, const PlnBudget *budget, PlnStats *stats) {
+    if (begin(budget, stats) < 0) return -1;
+    for (size_t i = 0; i < count; i++) {
+        if (hypergraph_valid(premises[i]) && queue_push(premises[i]) < 0) return -1;
+    }
+    return chain();
+}
+
+int pln_backward(Atom target, const PlnBudget *budget, PlnStats *stats) {
+    Atom x, y, *terms = NULL;
+    size_t count = 0, capacity = 0, level = 0;
+
+    if (begin(budget, stats) < 0) return -1;
+    if (!hypergraph_valid(target) || !chainable(target, &x, &y)) return chain();
+    uint16_t type = hypergraph_atom_type(target);
+
+    /* Terms within PLN_BACKWARD_DEPTH links of either end, breadth first */
+    restricted = 1;
+    if (reserve((void**)&terms, &capacity, 2, sizeof(Atom)) < 0) return -1;
+    terms[count++] = x;
+    terms[count++] = y;
+    state[x].term = state[y].term = run;
+    state[x].distance = state[y].distance = 0;
+    for (int depth = 0; depth < PLN_BACKWARD_DEPTH; depth++) {
+        size_t end = count;
+        for (; level < end && count < PLN_BACKWARD_TERMS; level++) {
+            uint32_t cursor = 0;
+            Atom link, a, b;
+            while (count < PLN_BACKWARD_TERMS &&
+                   (link = hypergraph_incoming_next(terms[level], &cursor)) != 0) {
+                if (hypergraph_atom_type(link) != type || !chainable(link, &a, &b)) continue;
+                Atom next = a == terms[level] ? b : a;
+                if (state_reserve(next) < 0 ||
+                    reserve((void**)&terms, &capacity, count + 1, sizeof(Atom)) < 0) {
+                    free(terms);
+                    return -1;
+                }
+                if (state[next].term == run) continue;
+                state[next].term = run;
+                state[next].distance = depth + 1;
+                terms[count++] = next;
+            }
+        }
+    }
+
+    /* Every link between two terms is a premise */
+    for (size_t i = 0; i < count; i++) {
+        uint32_t cursor = 0;
+        Atom link, a, b;
+        while ((link = hypergraph_incoming_next(terms[i], &cursor)) != 0) {
+            if (hypergraph_atom_type(link) != type || link == target || !chainable(link, &a, &b) ||
+                a != terms[i] || state[b].term != run) continue;
+            if (queue_push(link) < 0) {
+                free(terms);
+                return -1;
+            }
+        }
+    }
+    free(terms);
+    return chain();
+}
+
+size_t pln_conclusions(Atom *atoms, size_t max) {
+    size_t n = changed_count < max ? changed_count : max;
+    if (n) memcpy(atoms, changed, n * sizeof(Atom));
+    return changed_count;
+}
+
+void pln_reset(void) {
+    free(derivations);
+    free(memo);
+    free(state);
+    free(queue);
+    free(changed);
+    derivations = NULL;
+    memo = NULL;
+    state = NULL;
+    queue = NULL;
+    changed = NULL;
+    derivation_count = derivation_capacity = memo_size = 0;
+    state_capacity = queue_count = queue_capacity = 0;
+    changed_count = changed_capacity = 0;
+    run = 0;
+}
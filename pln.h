@@ -0,0 +1,64 @@
+/* PLN Chainer Header
+ * Rule-based probabilistic inference over the hypergraph store
+ */
+
+#ifndef PLN_H
+#define PLN_H
+
+#include <stddef.h>
+#include "hypergraph.h"
+
+#define PLN_MAX_STEPS 20000             /* default inference-step budget */
+#define PLN_MAX_SECONDS 0.05            /* default latency budget */
+#define PLN_MIN_CONFIDENCE 0.01f        /* weaker conclusions are not drawn */
+#define PLN_TERM_PRIOR 0.2f             /* strength of a term with no evidence */
+#define PLN_INVERSION_DISCOUNT 0.8f     /* confidence kept by induction and abduction */
+#define PLN_BACKWARD_DEPTH 3            /* links between a target and its premises */
+#define PLN_BACKWARD_TERMS 4096
+
+typedef enum {
+    PLN_DEDUCTION,              /* A->B, B->C |- A->C */
+    PLN_INDUCTION,              /* B->A, B->C |- A->C */
+    PLN_ABDUCTION,              /* A->B, C->B |- A->C */
+    PLN_RULES
+} PlnRule;
+
+typedef struct {
+    size_t max_steps;           /* rule applications */
+    double max_seconds;
+} PlnBudget;
+
+typedef struct {
+    size_t steps;               /* rule applications tried */
+    size_t memoized;            /* applications whose result was already known */
+    size_t revisions;           /* independent derivations merged by revision */
+    size_t conclusions;         /* atoms whose truth value changed */
+    int exhausted;              /* the budget ran out with work left */
+    double seconds;
+} PlnStats;
+
+/* The chainer works on arity-2 InheritanceLinks and ImplicationLinks,
+ * combining two premises of the same type.  A conclusion is stored as
+ * a link whose truth value is the revision of every derivation of it;
+ * derivations are memoized by rule and premises, so deriving the same
+ * thing again costs a lookup.  Every atom carries a 64-bit fingerprint
+ * of the asserted links it rests on; premises whose fingerprints
+ * overlap are not combined, and revision only merges derivations with
+ * disjoint fingerprints, so no evidence is counted twice.
+ * Links with asserted truth values (confidence above 0) are premises
+ * only and are never overwritten.  Candidates are expanded in order of
+ * attention: the STI of a link and its two terms, then confidence.
+ * Both runs return -1 when out of memory. */
+extern int pln_forward(const Atom *premises, size_t count, const PlnBudget *budget, PlnStats *stats);
+
+/* Derive the truth value of target from links within
+ * PLN_BACKWARD_DEPTH of its terms */
+extern int pln_backward(Atom target, const PlnBudget *budget, PlnStats *stats);
+
+/* Atoms whose truth value the last run changed, in order of change */
+extern size_t pln_conclusions(Atom *atoms, size_t max);
+
+/* Forget all derivations, as when the store is cleared or replaced */
+extern void pln_reset(void);
+
+#endif /* PLN_H */
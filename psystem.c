@@ -0,0 +1,494 @@
+/* P-System Evolution Implementation
+ * Rules are attached to membranes and applied in maximally parallel
+ * steps.  Each step has two phases so that membranes can be processed
+ * concurrently without locks:
+ *
+ *   select  every membrane, in parallel, repeatedly picks a random
+ *           applicable rule and consumes its left-hand side from its own
+ *           objects until nothing applies; products are only recorded.
+ *   commit  products staying in their membrane are added in parallel,
+ *           then products crossing membranes are delivered in order.
+ *
+ * Objects produced in a step are therefore never consumed in that step.
+ */
+
+#include "psystem.h"
+#include "tensor-membrane.h"
+#include "intern.h"
+#include "or.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+
+/* Membranes per parallel work item */
+#define PSYSTEM_CHUNK 64
+
+typedef struct {
+    TensorMembraneImpl *target;
+    uint32_t symbol;
+    uint32_t count;
+} Delivery;
+
+/* Rules of one membrane, plus its scratch state for the current step */
+typedef struct {
+    uint32_t membrane_id;
+    PSystemRule *rules;
+    uint32_t count;
+    uint32_t capacity;
+    
+    TensorMembraneImpl *membrane;
+    Delivery *deliveries;
+    uint32_t delivery_count;
+    uint32_t delivery_capacity;
+    uint64_t applications;
+    uint64_t rng;
+    int failed;
+} RuleSet;
+
+static RuleSet *rule_sets = NULL;
+static uint32_t rule_set_count = 0;
+static uint32_t rule_set_capacity = 0;
+
+/* Open-addressing index from membrane id to rule set position + 1 */
+static uint32_t *rule_index = NULL;
+static uint32_t rule_index_capacity = 0;
+
+/* Rule compilation */
+
+static const char *skip_space(const char *p) {
+    while (*p && isspace((unsigned char)*p)) p++;
+    return p;
+}
+
+/* Read a symbol name into buf; returns the position after it */
+static const char *read_symbol(const char *p, char *buf, size_t size) {
+    size_t len = 0;
+    while (*p && !isspace((unsigned char)*p) && *p != '(' && *p != ')' && *p != ',' &&
+           !(p[0] == '-' && p[1] == '>')) {
+        if (len + 1 < size) buf[len++] = *p;
+        p++;
+    }
+    buf[len] = '\0';
+    return p;
+}
+
+/* Add count copies of symbol to a term list, merging duplicates */
+static int add_term(PSystemTerm *terms, uint32_t *n, uint32_t symbol, PSystemTarget target) {
+    for (uint32_t i = 0; i < *n; i++) {
+        if (terms[i].symbol == symbol && terms[i].target == target) {
+            terms[i].count++;
+            return 0;
+        }
+    }
+    if (*n >= PSYSTEM_MAX_TERMS) return -1;
+    terms[*n].symbol = symbol;
+    terms[*n].count = 1;
+    terms[*n].target = target;
+    (*n)++;
+    return 0;
+}
+
+/* Compile "lhs -> rhs".  The left side is a list of symbols; the right
+ * side is a list of symbols and (symbol, here|out|in) pairs, and may be
+ * empty or "#" to erase the left side. */
+int psystem_compile_rule(const char *text, PSystemRule *rule, const char **error) {
+    char name[64];
+    const char *p;
+    const char *dummy;
+    
+    if (!error) error = &dummy;
+    if (!text || !rule) {
+        *error = "no rule";
+        return -1;
+    }
+    memset(rule, 0, sizeof(PSystemRule));
+    
+    /* Left-hand side */
+    p = skip_space(text);
+    while (*p && !(p[0] == '-' && p[1] == '>')) {
+        p = read_symbol(p, name, sizeof(name));
+        if (!name[0]) {
+            *error = "unexpected character on left-hand side";
+            return -1;
+        }
+        if (add_term(rule->lhs, &rule->lhs_count, symbol_intern(name), PSYSTEM_HERE) != 0) {
+            *error = "too many distinct symbols";
+            return -1;
+        }
+        p = skip_space(p);
+    }
+    if (!*p) {
+        *error = "missing '->'";
+        return -1;
+    }
+    if (rule->lhs_count == 0) {
+        *error = "empty left-hand side";
+        return -1;
+    }
+    
+    /* Right-hand side */
+    p = skip_space(p + 2);
+    if (p[0] == '#' && !*skip_space(p + 1)) return 0;
+    while (*p) {
+        PSystemTarget target = PSYSTEM_HERE;
+    
+        if (*p == '(') {
+            char where[16];
+            p = read_symbol(skip_space(p + 1), name, sizeof(name));
+            p = skip_space(p);
+            if (*p != ',') {
+                *error = "expected ',' in (symbol, target)";
+                return -1;
+            }
+            p = read_symbol(skip_space(p + 1), where, sizeof(where));
+            p = skip_space(p);
+            if (*p != ')') {
+                *error = "expected ')' in (symbol, target)";
+                return -1;
+            }
+            p++;
+    
+            if (strcmp(where, "here") == 0) target = PSYSTEM_HERE;
+            else if (strcmp(where, "out") == 0) target = PSYSTEM_OUT;
+            else if (strcmp(where, "in") == 0) target = PSYSTEM_IN;
+            else {
+                *error = "target must be here, out or in";
+                return -1;
+            }
+        } else {
+            p = read_symbol(p, name, sizeof(name));
+        }
+    
+        if (!name[0]) {
+            *error = "unexpected character on right-hand side";
+            return -1;
+        }
+        if (add_term(rule->rhs, &rule->rhs_count, symbol_intern(name), target) != 0) {
+            *error = "too many distinct symbols";
+            return -1;
+        }
+        p = skip_space(p);
+    }
+    return 0;
+}
+
+/* Render a rule back to text; returns the length that was needed */
+int psystem_format_rule(const PSystemRule *rule, char *buf, size_t size) {
+    static const char *targets[] = { "here", "out", "in" };
+    size_t len = 0;
+
+#define APPEND(...) do { \
+        int n_ = snprintf(buf + (len < size ? len : size), len < size ? size - len : 0, __VA_ARGS__); \
+        if (n_ > 0) len += n_; \
+    } while (0)
+    
+    if (size > 0) buf[0] = '\0';
+    for (uint32_t i = 0; i < rule->lhs_count; i++) {
+        for (uint32_t k = 0; k < rule->lhs[i].count; k++) {
+            APPEND("%s ", symbol_name(rule->lhs[i].symbol));
+        }
+    }
+    APPEND("->");
+    if (rule->rhs_count == 0) APPEND(" #");
+    for (uint32_t i = 0; i < rule->rhs_count; i++) {
+        for (uint32_t k = 0; k < rule->rhs[i].count; k++) {
+            if (rule->rhs[i].target == PSYSTEM_HERE) {
+                APPEND(" %s", symbol_name(rule->rhs[i].symbol));
+            } else {
+                APPEND(" (%s, %s)", symbol_name(rule->rhs[i].symbol), targets[rule->rhs[i].target]);
+            }
+        }
+    }
+#undef APPEND
+    return (int)len;
+}
+
+/* Rule tables */
+
+static uint32_t rule_index_slot(uint32_t membrane_id) {
+    uint32_t mask = rule_index_capacity - 1;
+    uint32_t i = (membrane_id * 2654435761u) & mask;
+    while (rule_index[i] && rule_sets[rule_index[i] - 1].membrane_id != membrane_id) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/* Rebuild the index after rule sets moved or the table filled up */
+static int rule_index_rebuild(uint32_t capacity) {
+    uint32_t *index = calloc(capacity, sizeof(uint32_t));
+    if (!index) return -1;
+    
+    free(rule_index);
+    rule_index = index;
+    rule_index_capacity = capacity;
+    for (uint32_t i = 0; i < rule_set_count; i++) {
+        rule_index[rule_index_slot(rule_sets[i].membrane_id)] = i + 1;
+    }
+    return 0;
+}
+
+static RuleSet *rule_set_find(uint32_t membrane_id) {
+    if (!rule_index) return NULL;
+    
+    uint32_t slot = rule_index[rule_index_slot(membrane_id)];
+    return slot ? &rule_sets[slot - 1] : NULL;
+}
+
+static void rule_set_free(RuleSet *set) {
+    free(set->rules);
+    free(set->deliveries);
+}
+
+int psystem_add_rule(uint32_t membrane_id, const char *text, const char **error) {
+    const char *dummy;
+    PSystemRule rule;
+    
+    if (!error) error = &dummy;
+    if (!find_membrane_by_id(membrane_id)) {
+        *error = "membrane not found";
+        return -1;
+    }
+    if (psystem_compile_rule(text, &rule, error) != 0) return -1;
+    
+    RuleSet *set = rule_set_find(membrane_id);
+    if (!set) {
+        if (rule_set_count == rule_set_capacity) {
+            uint32_t capacity = rule_set_capacity ? rule_set_capacity * 2 : 16;
+            RuleSet *sets = realloc(rule_sets, capacity * sizeof(RuleSet));
+            if (!sets) {
+                *error = "out of memory";
+                return -1;
+            }
+            rule_sets = sets;
+            rule_set_capacity = capacity;
+        }
+        if ((rule_set_count + 1) * 2 > rule_index_capacity &&
+            rule_index_rebuild(rule_index_capacity ? rule_index_capacity * 2 : 64) != 0) {
+            *error = "out of memory";
+            return -1;
+        }
+        set = &rule_sets[rule_set_count++];
+        memset(set, 0, sizeof(RuleSet));
+        set->membrane_id = membrane_id;
+        rule_index[rule_index_slot(membrane_id)] = rule_set_count;
+    }
+    
+    if (set->count == set->capacity) {
+        uint32_t capacity = set->capacity ? set->capacity * 2 : 4;
+        PSystemRule *rules = realloc(set->rules, capacity * sizeof(PSystemRule));
+        if (!rules) {
+            *error = "out of memory";
+            return -1;
+        }
+        set->rules = rules;
+        set->capacity = capacity;
+    }
+    set->rules[set->count++] = rule;
+    return 0;
+}
+
+uint32_t psystem_rule_count(uint32_t membrane_id) {
+    RuleSet *set = rule_set_find(membrane_id);
+    return set ? set->count : 0;
+}
+
+const PSystemRule *psystem_get_rule(uint32_t membrane_id, uint32_t index) {
+    RuleSet *set = rule_set_find(membrane_id);
+    return set && index < set->count ? &set->rules[index] : NULL;
+}
+
+int psystem_clear_rules(uint32_t membrane_id) {
+    RuleSet *set = rule_set_find(membrane_id);
+    if (!set) return -1;
+    
+    rule_set_free(set);
+    *set = rule_sets[--rule_set_count];
+    return rule_index_rebuild(rule_index_capacity);
+}
+
+/* Evolution */
+
+/* splitmix64: seeds each membrane's stream independently of scheduling */
+static uint64_t rng_seed(uint64_t seed, uint64_t stream) {
+    uint64_t z = seed + stream * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return (z ^ (z >> 31)) | 1;
+}
+
+/* xorshift64* */
+static uint32_t rng_next(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return (uint32_t)((x * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+/* How many times rule could fire on the membrane's current objects */
+static uint32_t rule_capacity(const PSystemRule *rule, TensorMembraneImpl *membrane) {
+    uint32_t max = UINT32_MAX;
+    
+    for (uint32_t i = 0; i < rule->lhs_count; i++) {
+        uint32_t times = membrane_symbol_count(membrane, rule->lhs[i].symbol) / rule->lhs[i].count;
+        if (times < max) max = times;
+        if (max == 0) return 0;
+    }
+    
+    /* Sending objects in needs somewhere to send them */
+    for (uint32_t i = 0; i < rule->rhs_count; i++) {
+        if (rule->rhs[i].target == PSYSTEM_IN && membrane_children(membrane, NULL) == 0) return 0;
+    }
+    return max;
+}
+
+static void deliver(RuleSet *set, TensorMembraneImpl *target, uint32_t symbol, uint32_t count) {
+    if (set->delivery_count == set->delivery_capacity) {
+        uint32_t capacity = set->delivery_capacity ? set->delivery_capacity * 2 : 16;
+        Delivery *deliveries = realloc(set->deliveries, capacity * sizeof(Delivery));
+        if (!deliveries) {
+            set->failed = 1;
+            return;
+        }
+        set->deliveries = deliveries;
+        set->delivery_capacity = capacity;
+    }
+    set->deliveries[set->delivery_count].target = target;
+    set->deliveries[set->delivery_count].symbol = symbol;
+    set->deliveries[set->delivery_count].count = count;
+    set->delivery_count++;
+}
+
+/* Select phase for one membrane: touches only its own objects */
+static void rule_set_select(RuleSet *set) {
+    TensorMembraneImpl *membrane = set->membrane;
+    
+    set->delivery_count = 0;
+    set->applications = 0;
+    
+    for (;;) {
+        /* Pick a random applicable rule by reservoir sampling */
+        const PSystemRule *rule = NULL;
+        uint32_t max = 0, n = 0;
+        for (uint32_t r = 0; r < set->count; r++) {
+            uint32_t capacity = rule_capacity(&set->rules[r], membrane);
+            if (capacity > 0 && rng_next(&set->rng) % ++n == 0) {
+                rule = &set->rules[r];
+                max = capacity;
+            }
+        }
+        if (!rule) break;
+    
+        /* Fire it a random number of times */
+        uint32_t times = 1 + rng_next(&set->rng) % max;
+    
+        for (uint32_t i = 0; i < rule->lhs_count; i++) {
+            membrane_remove_symbol(membrane, rule->lhs[i].symbol, rule->lhs[i].count * times);
+        }
+    
+        for (uint32_t i = 0; i < rule->rhs_count; i++) {
+            const PSystemTerm *term = &rule->rhs[i];
+            TensorMembraneImpl *target = membrane;
+    
+            if (term->target == PSYSTEM_OUT) {
+                target = membrane_parent(membrane);
+                if (!target) continue; /* expelled into the environment */
+            } else if (term->target == PSYSTEM_IN) {
+                TensorMembraneImpl **children;
+                uint32_t child_count = membrane_children(membrane, &children);
+                target = children[rng_next(&set->rng) % child_count];
+            }
+            deliver(set, target, term->symbol, term->count * times);
+        }
+        set->applications += times;
+    }
+}
+
+/* Commit phase, first half: products that stay in their membrane */
+static void rule_set_commit_local(RuleSet *set) {
+    for (uint32_t i = 0; i < set->delivery_count; i++) {
+        Delivery *d = &set->deliveries[i];
+        if (d->target == set->membrane) {
+            if (membrane_add_symbol(d->target, d->symbol, d->count) != 0) set->failed = 1;
+        }
+    }
+}
+
+typedef struct {
+    int commit;
+} EvolvePhase;
+
+static void evolve_chunk(void *ctx, int chunk) {
+    EvolvePhase *phase = (EvolvePhase*)ctx;
+    uint32_t start = (uint32_t)chunk * PSYSTEM_CHUNK;
+    uint32_t end = start + PSYSTEM_CHUNK;
+    if (end > rule_set_count) end = rule_set_count;
+    
+    for (uint32_t i = start; i < end; i++) {
+        if (phase->commit) rule_set_commit_local(&rule_sets[i]);
+        else rule_set_select(&rule_sets[i]);
+    }
+}
+
+int psystem_evolve(uint32_t steps, uint64_t seed, PSystemStats *stats) {
+    PSystemStats local = { 0, 0, 0 };
+    int failed = 0;
+    
+    /* Forget the rules of membranes that no longer exist */
+    uint32_t live = rule_set_count;
+    for (uint32_t i = 0; i < rule_set_count; ) {
+        rule_sets[i].membrane = find_membrane_by_id(rule_sets[i].membrane_id);
+        if (!rule_sets[i].membrane) {
+            rule_set_free(&rule_sets[i]);
+            rule_sets[i] = rule_sets[--rule_set_count];
+        } else {
+            i++;
+        }
+    }
+    if (live != rule_set_count && rule_index_rebuild(rule_index_capacity) != 0) return -1;
+    
+    WorkerPool *pool = worker_pool_default();
+    int chunks = (int)((rule_set_count + PSYSTEM_CHUNK - 1) / PSYSTEM_CHUNK);
+    
+    for (uint32_t step = 0; step < steps; step++) {
+        uint64_t applications = 0;
+        EvolvePhase phase;
+    
+        for (uint32_t i = 0; i < rule_set_count; i++) {
+            rule_sets[i].rng = rng_seed(seed ^ ((uint64_t)step << 32), rule_sets[i].membrane_id);
+        }
+    
+        phase.commit = 0;
+        worker_pool_parallel_for(pool, chunks, evolve_chunk, &phase);
+        phase.commit = 1;
+        worker_pool_parallel_for(pool, chunks, evolve_chunk, &phase);
+    
+        /* Products crossing membranes may meet at the same target */
+        for (uint32_t i = 0; i < rule_set_count; i++) {
+            RuleSet *set = &rule_sets[i];
+            for (uint32_t j = 0; j < set->delivery_count; j++) {
+                Delivery *d = &set->deliveries[j];
+                if (d->target != set->membrane &&
+                    membrane_add_symbol(d->target, d->symbol, d->count) != 0) {
+                    set->failed = 1;
+                }
+            }
+            applications += set->applications;
+            failed |= set->failed;
+            set->failed = 0;
+        }
+    
+        if (applications == 0) {
+            local.halted = 1;
+            break;
+        }
+        local.steps++;
+        local.applications += applications;
+    }
+    
+    if (stats) *stats = local;
+    return failed ? -1 : 0;
+}
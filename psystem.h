@@ -0,0 +1,51 @@
+/* P-System Evolution Header
+ * Multiset rewriting rules over nested tensor membranes
+ */
+
+#ifndef PSYSTEM_H
+#define PSYSTEM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PSYSTEM_MAX_TERMS 16
+
+/* Where a produced object goes */
+typedef enum {
+    PSYSTEM_HERE,       /* stays in the membrane that applied the rule */
+    PSYSTEM_OUT,        /* to the parent; leaves the system from the root */
+    PSYSTEM_IN          /* to a child chosen at random */
+} PSystemTarget;
+
+typedef struct {
+    uint32_t symbol;            /* interned, see intern.h */
+    uint32_t count;
+    PSystemTarget target;       /* right-hand side only */
+} PSystemTerm;
+
+/* A compiled rule such as "a a b -> c (d, out)" */
+typedef struct {
+    PSystemTerm lhs[PSYSTEM_MAX_TERMS];
+    uint32_t lhs_count;
+    PSystemTerm rhs[PSYSTEM_MAX_TERMS];
+    uint32_t rhs_count;
+} PSystemRule;
+
+typedef struct {
+    uint64_t steps;             /* steps in which some rule applied */
+    uint64_t applications;      /* rule applications over all steps */
+    int halted;                 /* stopped early: no rule was applicable */
+} PSystemStats;
+
+/* Rule compilation and per-membrane rule tables */
+extern int psystem_compile_rule(const char *text, PSystemRule *rule, const char **error);
+extern int psystem_format_rule(const PSystemRule *rule, char *buf, size_t size);
+extern int psystem_add_rule(uint32_t membrane_id, const char *text, const char **error);
+extern uint32_t psystem_rule_count(uint32_t membrane_id);
+extern const PSystemRule *psystem_get_rule(uint32_t membrane_id, uint32_t index);
+extern int psystem_clear_rules(uint32_t membrane_id);
+
+/* Run up to steps maximally parallel steps */
+extern int psystem_evolve(uint32_t steps, uint64_t seed, PSystemStats *stats);
+
+#endif /* PSYSTEM_H */
@@ -396,6 +396,8 @@ extern void uerror(char *);
 /* wait.c */
 extern pid_t rc_fork(void);
 extern pid_t rc_wait4(pid_t, int *, bool);
+extern pid_t rc_pseudofork(void (*)(void *, int), void *);
+extern void rc_pseudoexit(pid_t, int);
 extern List *sgetapids(void);
 extern void waitforall(void);
 extern void waitfor(char **);
@@ -0,0 +1,144 @@
+/* Registry Implementation
+ * Open addressing with linear probing.  Slots are claimed by writers
+ * under the lock and never given back, so a reader that finds an empty
+ * slot knows the name is absent.  A table is at most three quarters
+ * full: the writer about to pass that copies it into a table twice the
+ * size before claiming a slot.
+ */
+
+#include "registry.h"
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t registry_hash(const char *name) {
+    uint32_t hash = 2166136261u;
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* The slot holding name, or the empty slot ending its probe chain */
+static RegistrySlot *registry_probe(RegistryTable *table, const char *name, uint32_t hash) {
+    size_t mask = table->capacity - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        RegistrySlot *slot = &table->slots[i];
+        char *slot_name = atomic_load_explicit(&slot->name, memory_order_acquire);
+        if (!slot_name) return slot;
+        if (slot->hash == hash && strcmp(slot_name, name) == 0) return slot;
+    }
+}
+
+/* Publishes a copy of the current table at twice its size, or the
+ * first table; the caller holds the lock */
+static RegistryTable *registry_grow(Registry *registry) {
+    RegistryTable *old = atomic_load_explicit(&registry->table, memory_order_relaxed);
+    size_t capacity = old ? old->capacity * 2 : REGISTRY_SLOTS;
+    RegistryTable *table = calloc(1, sizeof(RegistryTable) + capacity * sizeof(RegistrySlot));
+    if (!table) return NULL;
+    table->replaced = old;
+    table->capacity = capacity;
+
+    for (size_t i = 0; old && i < old->capacity; i++) {
+        RegistrySlot *from = &old->slots[i];
+        char *name = atomic_load_explicit(&from->name, memory_order_relaxed);
+        if (!name) continue;
+        RegistrySlot *to = registry_probe(table, name, from->hash);
+        to->hash = from->hash;
+        atomic_store_explicit(&to->value, atomic_load_explicit(&from->value, memory_order_relaxed),
+                              memory_order_relaxed);
+        atomic_store_explicit(&to->name, name, memory_order_relaxed);
+    }
+    atomic_store_explicit(&registry->table, table, memory_order_release);
+    return table;
+}
+
+void *registry_lookup(Registry *registry, const char *name) {
+    if (!registry || !name) return NULL;
+
+    RegistryTable *table = atomic_load_explicit(&registry->table, memory_order_acquire);
+    if (!table) return NULL;
+    RegistrySlot *slot = registry_probe(table, name, registry_hash(name));
+    if (!atomic_load_explicit(&slot->name, memory_order_acquire)) return NULL;
+    return atomic_load_explicit(&slot->value, memory_order_acquire);
+}
+
+int registry_swap(Registry *registry, const char *name, void *value, void **old) {
+    if (old) *old = NULL;
+    if (!registry || !name) return -1;
+
+    uint32_t hash = registry_hash(name);
+    pthread_mutex_lock(&registry->lock);
+    RegistryTable *table = atomic_load_explicit(&registry->table, memory_order_relaxed);
+    RegistrySlot *slot = table ? registry_probe(table, name, hash) : NULL;
+    if (!slot || !atomic_load_explicit(&slot->name, memory_order_relaxed)) {
+        /* Removing a name that was never there */
+        if (!value) {
+            pthread_mutex_unlock(&registry->lock);
+            return 0;
+        }
+        char *copy = strdup(name);
+        if (!copy) {
+            pthread_mutex_unlock(&registry->lock);
+            return -1;
+        }
+        if (!table || (registry->names + 1) * 4 > table->capacity * 3) {
+            if (!(table = registry_grow(registry))) {
+                free(copy);
+                pthread_mutex_unlock(&registry->lock);
+                return -1;
+            }
+            slot = registry_probe(table, name, hash);
+        }
+        /* The value and hash go in first, so a reader that sees the
+         * name also sees them */
+        slot->hash = hash;
+        atomic_store_explicit(&slot->value, value, memory_order_relaxed);
+        atomic_store_explicit(&slot->name, copy, memory_order_release);
+        registry->names++;
+    } else {
+        void *previous = atomic_exchange_explicit(&slot->value, value, memory_order_acq_rel);
+        if (old) *old = previous;
+    }
+    pthread_mutex_unlock(&registry->lock);
+    return 0;
+}
+
+size_t registry_names(Registry *registry, const char **names, size_t max) {
+    size_t count = 0;
+    if (!registry) return 0;
+
+    RegistryTable *table = atomic_load_explicit(&registry->table, memory_order_acquire);
+    for (size_t i = 0; table && i < table->capacity; i++) {
+        RegistrySlot *slot = &table->slots[i];
+        char *name = atomic_load_explicit(&slot->name, memory_order_acquire);
+        if (!name || !atomic_load_explicit(&slot->value, memory_order_acquire)) continue;
+        if (count < max) names[count] = name;
+        count++;
+    }
+    return count;
+}
+
+void registry_clear(Registry *registry, void (*release)(void *value)) {
+    if (!registry) return;
+
+    pthread_mutex_lock(&registry->lock);
+    RegistryTable *table = atomic_exchange_explicit(&registry->table, NULL, memory_order_relaxed);
+    /* Older tables share the newest one's names, and any value they
+     * hold was either copied into it or replaced and kept by the
+     * caller */
+    for (size_t i = 0; table && i < table->capacity; i++) {
+        RegistrySlot *slot = &table->slots[i];
+        void *value = atomic_load_explicit(&slot->value, memory_order_relaxed);
+        if (value && release) release(value);
+        free(atomic_load_explicit(&slot->name, memory_order_relaxed));
+    }
+    while (table) {
+        RegistryTable *replaced = table->replaced;
+        free(table);
+        table = replaced;
+    }
+    registry->names = 0;
+    pthread_mutex_unlock(&registry->lock);
+}
@@ -0,0 +1,59 @@
+/* Registry Header
+ * Name-hashed tables whose entries can be replaced while readers run
+ */
+
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define REGISTRY_SLOTS 64               /* initial table size; a power of two */
+
+/* A name, once published in a slot, stays there for the life of the
+ * registry; removing an entry only clears its value.  Probe chains are
+ * therefore never broken and lookups need no lock: they read the name
+ * and value pointers with acquire loads.  Writers are serialized. */
+typedef struct {
+    _Atomic(char *) name;
+    _Atomic(void *) value;
+    uint32_t hash;
+} RegistrySlot;
+
+/* A table that fills up is copied into one twice the size, which is
+ * then published; readers still probing the old one finish there, so
+ * it is kept until registry_clear. */
+typedef struct RegistryTable {
+    struct RegistryTable *replaced;     /* the smaller table before it */
+    size_t capacity;                    /* a power of two */
+    RegistrySlot slots[];
+} RegistryTable;
+
+typedef struct {
+    _Atomic(RegistryTable *) table;     /* NULL until the first name */
+    pthread_mutex_t lock;               /* serializes writers */
+    size_t names;                       /* slots with a name */
+} Registry;
+
+#define REGISTRY_INIT { .lock = PTHREAD_MUTEX_INITIALIZER }
+
+/* The value registered under name, or NULL */
+extern void *registry_lookup(Registry *registry, const char *name);
+
+/* Installs value under name (NULL removes it) with a single atomic
+ * store and returns the value it replaced in *old.  Readers see either
+ * the old or the new value, so the caller must keep the old one alive
+ * until no reader can still hold it.  Returns -1 when out of memory. */
+extern int registry_swap(Registry *registry, const char *name, void *value, void **old);
+
+/* Names with a value, in slot order; returns the number there are,
+ * storing up to max of them */
+extern size_t registry_names(Registry *registry, const char **names, size_t max);
+
+/* Drops every entry, passing each value to release.  Not safe against
+ * concurrent readers. */
+extern void registry_clear(Registry *registry, void (*release)(void *value));
+
+#endif /* REGISTRY_H */
@@ -0,0 +1,3461 @@
+/* Scheme VM Implementation
+ * A small Scheme for scripting the cognitive subsystems from the shell.
+ *
+ * Source is read into ordinary Scheme data and compiled, one top-level
+ * form at a time, to bytecode for a stack machine:
+ *   - variables are resolved at compile time to a frame slot, a slot
+ *     of the closure (closures are flat, holding copies of the
+ *     variables they use) or a global kept in the symbol itself;
+ *   - a variable that is both assigned and captured lives in a box, so
+ *     the copies share it;
+ *   - calls in tail position reuse the caller's frame, so loops
+ *     written as recursion run in constant space;
+ *   - arithmetic, comparison and list primitives are compiled inline
+ *     while their global names are unshadowed.
+ *
+ * Objects live in 64KB blocks, each holding objects of one size class
+ * on a free list; objects too big for any class are malloc'd.  The
+ * collector is mark-sweep with an explicit mark stack.  It only runs
+ * between instructions, where every live value is on the VM stack, in
+ * a frame or in a global, so C code never has to register roots.
+ * Blocks left empty by a sweep go back to malloc.
+ */
+
+#include "scheme-vm.h"
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SCHEME_UNBOUND ((SchemeValue)0x2A)
+#define SCHEME_READ_DEPTH 1000
+#define SCHEME_PRINT_LIMIT (1 << 20)        /* bytes of printed output */
+#define SCHEME_PRINT_DEPTH 10000
+#define SCHEME_SYMBOL_BUCKETS 4096
+
+/* Fixnums are 63-bit; arithmetic that leaves that range goes to flonums */
+#define FIXNUM_MAX ((long)(((unsigned long)-1) >> 2))
+#define FIXNUM_MIN (-FIXNUM_MAX - 1)
+#define IS_FIXNUM(v) ((v) & 1)
+#define FIXNUM(v) ((long)(intptr_t)(v) >> 1)
+#define MAKE_FIXNUM(n) ((SchemeValue)(((uintptr_t)(long)(n) << 1) | 1))
+#define IS_CHAR(v) (((v) & 0xFF) == 0x06)
+#define CHAR(v) ((int)((v) >> 8))
+#define MAKE_CHAR(c) ((SchemeValue)(((uintptr_t)(unsigned char)(c) << 8) | 0x06))
+#define IS_POINTER(v) (((v) & 7) == 0 && (v) != 0)
+#define HEADER(v) ((Header *)(v))
+#define TYPE(v) (IS_POINTER(v) ? HEADER(v)->type : T_NONE)
+#define TRUTHY(v) ((v) != SCHEME_FALSE)
+#define BOOLEAN(b) ((b) ? SCHEME_TRUE : SCHEME_FALSE)
+
+enum {
+    T_NONE, T_FREE, T_PAIR, T_FLONUM, T_STRING, T_SYMBOL, T_VECTOR,
+    T_CLOSURE, T_PROTO, T_PRIMITIVE, T_BOX
+};
+
+#define PERMANENT 1                 /* malloc'd, never collected */
+
+typedef struct {
+    uint8_t type;
+    uint8_t mark;
+    uint8_t flags;
+    uint8_t size_class;
+    uint32_t length;                /* strings, vectors, closures */
+} Header;
+
+typedef struct {
+    Header h;
+    SchemeValue car, cdr;
+} Pair;
+
+typedef struct {
+    Header h;
+    double value;
+} Flonum;
+
+typedef struct {
+    Header h;
+    char chars[];
+} String;
+
+typedef struct Symbol {
+    Header h;
+    SchemeValue value;              /* global binding */
+    struct Symbol *next;
+    uint32_t hash;
+    char name[];
+} Symbol;
+
+typedef struct {
+    Header h;
+    SchemeValue items[];
+} Vector;
+
+typedef struct {
+    Header h;
+    int32_t *code;
+    SchemeValue *consts;
+    uint32_t ncode, nconsts;
+    uint16_t nparams, nlocals;
+    uint32_t max_stack;
+    uint8_t rest;
+    SchemeValue name;
+} Proto;
+
+typedef struct {
+    Header h;
+    Proto *proto;
+    SchemeValue free[];
+} Closure;
+
+typedef struct Primitive {
+    Header h;
+    SchemePrimitive fn;
+    SchemeValue name;
+    int16_t min_args, max_args;     /* max_args -1 for any number */
+    uint8_t inline_op;              /* opcode when compiled inline, or 0 */
+    uint8_t inline_args;
+} Primitive;
+
+typedef struct {
+    Header h;
+    SchemeValue value;
+} Box;
+
+/* Heap blocks */
+
+#define BLOCK_BYTES (64 * 1024)
+#define SIZE_CLASSES 9
+#define LARGE_CLASS 0xFF
+
+static const uint32_t class_bytes[SIZE_CLASSES] = { 16, 24, 32, 48, 64, 96, 128, 192, 256 };
+
+typedef struct Block {
+    struct Block *next;
+    uint32_t size;                  /* bytes per object */
+    uint32_t count;                 /* objects in the block */
+    uint8_t size_class;
+    char pad[7];
+    char data[];
+} Block;
+
+typedef struct Large {
+    struct Large *next;
+    size_t bytes;
+} Large;
+
+typedef struct FreeObject {
+    Header h;
+    struct FreeObject *next;
+} FreeObject;
+
+typedef struct {
+    Closure *closure;
+    const int32_t *pc;
+    SchemeValue *fp;
+} Frame;
+
+typedef struct Fn Fn;
+
+static struct {
+    int ready;
+    SchemeValue *stack, *sp, *stack_end;
+    Frame *frames;
+    int nframes;
+    Symbol **symbols;
+    size_t nsymbols;
+    struct Primitive **primitives;
+    size_t nprimitives, primitive_cap;
+    Block *blocks;
+    Large *large;
+    FreeObject *free_list[SIZE_CLASSES];
+    size_t allocated, heap_bytes, threshold, collections;
+    double gc_seconds;
+    int gc_wanted;
+    Header **marks;
+    size_t nmarks, mark_cap;
+    int mark_failed;
+    jmp_buf *escape;
+    Fn *compiling;
+    char error[512];
+} vm;
+
+static void vm_error(const char *fmt, ...);
+
+static void out_of_memory(void) {
+    vm_error("out of memory");
+}
+
+static void *vm_malloc(size_t bytes) {
+    void *p = malloc(bytes ? bytes : 1);
+    if (!p) out_of_memory();
+    return p;
+}
+
+static void *vm_realloc(void *old, size_t bytes) {
+    void *p = realloc(old, bytes ? bytes : 1);
+    if (!p) out_of_memory();
+    return p;
+}
+
+static int size_class(size_t bytes) {
+    int c;
+    for (c = 0; c < SIZE_CLASSES; c++)
+        if (bytes <= class_bytes[c]) return c;
+    return -1;
+}
+
+static void refill(int c) {
+    uint32_t size = class_bytes[c];
+    uint32_t count = (BLOCK_BYTES - sizeof(Block)) / size;
+    Block *block = vm_malloc(sizeof(Block) + (size_t)count * size);
+    FreeObject *list = vm.free_list[c];
+    uint32_t i;
+
+    block->next = vm.blocks;
+    block->size = size;
+    block->count = count;
+    block->size_class = c;
+    vm.blocks = block;
+    for (i = count; i-- > 0;) {
+        FreeObject *f = (FreeObject *)(block->data + (size_t)i * size);
+        f->h.type = T_FREE;
+        f->next = list;
+        list = f;
+    }
+    vm.free_list[c] = list;
+}
+
+static void *alloc(int type, size_t bytes) {
+    Header *h;
+    int c = size_class(bytes);
+
+    if (c < 0) {
+        Large *large = vm_malloc(sizeof(Large) + bytes);
+        large->next = vm.large;
+        large->bytes = bytes;
+        vm.large = large;
+        h = (Header *)(large + 1);
+        h->size_class = LARGE_CLASS;
+    } else {
+        FreeObject *f;
+        if (!vm.free_list[c]) refill(c);
+        f = vm.free_list[c];
+        vm.free_list[c] = f->next;
+        h = &f->h;
+        h->size_class = c;
+        bytes = class_bytes[c];
+    }
+    h->type = type;
+    h->mark = 0;
+    h->flags = 0;
+    h->length = 0;
+    vm.allocated += bytes;
+    if (vm.allocated > vm.threshold) vm.gc_wanted = 1;
+    return h;
+}
+
+/* Collector */
+
+static void mark_push(Header *h) {
+    if (vm.nmarks == vm.mark_cap) {
+        size_t cap = vm.mark_cap ? vm.mark_cap * 2 : 1024;
+        Header **grown = realloc(vm.marks, cap * sizeof(Header *));
+        if (!grown) {
+            /* Nothing can be unwound in the middle of marking, so
+             * collect gives up once the mark stack is drained */
+            vm.mark_failed = 1;
+            return;
+        }
+        vm.marks = grown;
+        vm.mark_cap = cap;
+    }
+    vm.marks[vm.nmarks++] = h;
+}
+
+static void mark_value(SchemeValue v) {
+    Header *h;
+    if (!IS_POINTER(v)) return;
+    h = HEADER(v);
+    if (h->mark || (h->flags & PERMANENT)) return;
+    h->mark = 1;
+    mark_push(h);
+}
+
+static void mark_children(Header *h) {
+    uint32_t i;
+    switch (h->type) {
+    case T_PAIR:
+        mark_value(((Pair *)h)->car);
+        mark_value(((Pair *)h)->cdr);
+        break;
+    case T_VECTOR:
+        for (i = 0; i < h->length; i++) mark_value(((Vector *)h)->items[i]);
+        break;
+    case T_CLOSURE:
+        mark_value((SchemeValue)((Closure *)h)->proto);
+        for (i = 0; i < h->length; i++) mark_value(((Closure *)h)->free[i]);
+        break;
+    case T_PROTO:
+        for (i = 0; i < ((Proto *)h)->nconsts; i++) mark_value(((Proto *)h)->consts[i]);
+        break;
+    case T_BOX:
+        mark_value(((Box *)h)->value);
+        break;
+    }
+}
+
+static void finalize(Header *h) {
+    if (h->type == T_PROTO) {
+        free(((Proto *)h)->code);
+        free(((Proto *)h)->consts);
+    }
+}
+
+/* Leaves the heap as it was before an abandoned collection */
+static void clear_marks(void) {
+    Block *block;
+    Large *large;
+    uint32_t j;
+
+    for (block = vm.blocks; block; block = block->next)
+        for (j = 0; j < block->count; j++)
+            ((Header *)(block->data + (size_t)j * block->size))->mark = 0;
+    for (large = vm.large; large; large = large->next) ((Header *)(large + 1))->mark = 0;
+}
+
+static void collect(void) {
+    clock_t start = clock();
+    SchemeValue *v;
+    Block **bp;
+    Large **lp;
+    size_t i, live = 0;
+    int c;
+
+    for (v = vm.stack; v < vm.sp; v++) mark_value(*v);
+    for (i = 0; i < (size_t)vm.nframes; i++)
+        if (vm.frames[i].closure) mark_value((SchemeValue)vm.frames[i].closure);
+    for (i = 0; i < SCHEME_SYMBOL_BUCKETS; i++) {
+        Symbol *s;
+        for (s = vm.symbols[i]; s; s = s->next) mark_value(s->value);
+    }
+    while (vm.nmarks > 0) mark_children(vm.marks[--vm.nmarks]);
+    if (vm.mark_failed) {
+        /* Some objects were marked without their children, so nothing
+         * can be swept; the evaluation fails instead */
+        vm.mark_failed = 0;
+        clear_marks();
+        vm_error("out of memory in the collector");
+    }
+
+    for (c = 0; c < SIZE_CLASSES; c++) vm.free_list[c] = NULL;
+    for (bp = &vm.blocks; *bp;) {
+        Block *block = *bp;
+        FreeObject *head = NULL, *tail = NULL;
+        size_t used = 0;
+        uint32_t j;
+        for (j = 0; j < block->count; j++) {
+            Header *h = (Header *)(block->data + (size_t)j * block->size);
+            if (h->type != T_FREE) {
+                if (h->mark) {
+                    h->mark = 0;
+                    used++;
+                    continue;
+                }
+                finalize(h);
+                h->type = T_FREE;
+            }
+            ((FreeObject *)h)->next = head;
+            if (!head) tail = (FreeObject *)h;
+            head = (FreeObject *)h;
+        }
+        if (used == 0) {
+            *bp = block->next;
+            free(block);
+            continue;
+        }
+        if (head) {
+            tail->next = vm.free_list[block->size_class];
+            vm.free_list[block->size_class] = head;
+        }
+        live += used * block->size;
+        bp = &block->next;
+    }
+    for (lp = &vm.large; *lp;) {
+        Large *large = *lp;
+        Header *h = (Header *)(large + 1);
+        if (h->mark) {
+            h->mark = 0;
+            live += large->bytes;
+            lp = &large->next;
+        } else {
+            finalize(h);
+            *lp = large->next;
+            free(large);
+        }
+    }
+
+    vm.heap_bytes = live;
+    vm.allocated = 0;
+    vm.threshold = live > SCHEME_GC_MIN_BYTES ? live : SCHEME_GC_MIN_BYTES;
+    vm.gc_wanted = 0;
+    vm.collections++;
+    vm.gc_seconds += (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Constructors */
+
+/* The public constructors can also be called between evaluations, when
+ * no entry point has set vm.escape.  There they catch their own errors
+ * and return SCHEME_ERROR, with the message in vm.error. */
+#define GUARDED(expr)                                   \
+    do {                                                \
+        jmp_buf guard;                                  \
+        SchemeValue result;                             \
+        if (vm.escape) return (expr);                   \
+        vm.escape = &guard;                             \
+        if (setjmp(guard)) result = SCHEME_ERROR;       \
+        else result = (expr);                           \
+        vm.escape = NULL;                               \
+        return result;                                  \
+    } while (0)
+
+static SchemeValue make_pair(SchemeValue car, SchemeValue cdr) {
+    Pair *p = alloc(T_PAIR, sizeof(Pair));
+    p->car = car;
+    p->cdr = cdr;
+    return (SchemeValue)p;
+}
+
+SchemeValue scheme_cons(SchemeValue car, SchemeValue cdr) {
+    GUARDED(make_pair(car, cdr));
+}
+
+static SchemeValue make_real(double d) {
+    Flonum *f = alloc(T_FLONUM, sizeof(Flonum));
+    f->value = d;
+    return (SchemeValue)f;
+}
+
+SchemeValue scheme_real(double d) {
+    GUARDED(make_real(d));
+}
+
+SchemeValue scheme_integer(long n) {
+    if (n < FIXNUM_MIN || n > FIXNUM_MAX) return scheme_real((double)n);
+    return MAKE_FIXNUM(n);
+}
+
+static SchemeValue make_string(const char *s, size_t len) {
+    String *str;
+    if (len > UINT32_MAX - 1) vm_error("string too long");
+    str = alloc(T_STRING, sizeof(String) + len + 1);
+    str->h.length = len;
+    if (s) memcpy(str->chars, s, len);
+    str->chars[len] = '\0';
+    return (SchemeValue)str;
+}
+
+SchemeValue scheme_string(const char *s) {
+    GUARDED(make_string(s, strlen(s)));
+}
+
+static SchemeValue make_vector(size_t n, SchemeValue fill) {
+    Vector *vec;
+    size_t i;
+    if (n > (UINT32_MAX >> 4)) vm_error("vector too long");
+    vec = alloc(T_VECTOR, sizeof(Vector) + n * sizeof(SchemeValue));
+    vec->h.length = n;
+    for (i = 0; i < n; i++) vec->items[i] = fill;
+    return (SchemeValue)vec;
+}
+
+static SchemeValue make_box(SchemeValue value) {
+    Box *box = alloc(T_BOX, sizeof(Box));
+    box->value = value;
+    return (SchemeValue)box;
+}
+
+static uint32_t hash_name(const char *s, size_t len) {
+    uint32_t h = 2166136261u;
+    while (len--) h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h;
+}
+
+static SchemeValue intern(const char *name, size_t len) {
+    uint32_t hash = hash_name(name, len);
+    Symbol **bucket = &vm.symbols[hash % SCHEME_SYMBOL_BUCKETS];
+    Symbol *s;
+
+    for (s = *bucket; s; s = s->next)
+        if (s->hash == hash && s->h.length == len && memcmp(s->name, name, len) == 0)
+            return (SchemeValue)s;
+    s = vm_malloc(sizeof(Symbol) + len + 1);
+    s->h.type = T_SYMBOL;
+    s->h.mark = 0;
+    s->h.flags = PERMANENT;
+    s->h.size_class = LARGE_CLASS;
+    s->h.length = len;
+    s->value = SCHEME_UNBOUND;
+    s->hash = hash;
+    memcpy(s->name, name, len);
+    s->name[len] = '\0';
+    s->next = *bucket;
+    *bucket = s;
+    vm.nsymbols++;
+    return (SchemeValue)s;
+}
+
+SchemeValue scheme_symbol(const char *name) {
+    GUARDED(intern(name, strlen(name)));
+}
+
+int scheme_is_pair(SchemeValue v) {
+    return TYPE(v) == T_PAIR;
+}
+
+SchemeValue scheme_car(SchemeValue v) {
+    return ((Pair *)v)->car;
+}
+
+SchemeValue scheme_cdr(SchemeValue v) {
+    return ((Pair *)v)->cdr;
+}
+
+int scheme_get_integer(SchemeValue v, long *n) {
+    if (IS_FIXNUM(v)) {
+        *n = FIXNUM(v);
+        return 1;
+    }
+    if (TYPE(v) == T_FLONUM) {
+        double d = ((Flonum *)v)->value;
+        if (d == floor(d) && d >= -9.2e18 && d <= 9.2e18) {
+            *n = (long)d;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int scheme_get_real(SchemeValue v, double *d) {
+    if (IS_FIXNUM(v)) *d = (double)FIXNUM(v);
+    else if (TYPE(v) == T_FLONUM) *d = ((Flonum *)v)->value;
+    else return 0;
+    return 1;
+}
+
+const char *scheme_get_string(SchemeValue v) {
+    switch (TYPE(v)) {
+    case T_STRING: return ((String *)v)->chars;
+    case T_SYMBOL: return ((Symbol *)v)->name;
+    }
+    return NULL;
+}
+
+/* Printer */
+
+typedef struct {
+    char *s;
+    size_t len, cap;
+    int truncated;
+    int depth;
+} Buf;
+
+static void buf_add(Buf *b, const char *s, size_t n) {
+    if (b->truncated) return;
+    if (b->len + n > SCHEME_PRINT_LIMIT) {
+        n = SCHEME_PRINT_LIMIT - b->len;
+        b->truncated = 1;
+    }
+    if (b->len + n + 4 > b->cap) {
+        size_t cap = b->cap ? b->cap : 64;
+        while (cap < b->len + n + 4) cap *= 2;
+        b->s = vm_realloc(b->s, cap);
+        b->cap = cap;
+    }
+    memcpy(b->s + b->len, s, n);
+    b->len += n;
+    if (b->truncated) {
+        memcpy(b->s + b->len, "...", 3);
+        b->len += 3;
+    }
+    b->s[b->len] = '\0';
+}
+
+static void buf_str(Buf *b, const char *s) {
+    buf_add(b, s, strlen(s));
+}
+
+/* The shortest representation that reads back as the same double */
+static void format_real(char *out, size_t size, double d) {
+    int precision;
+    if (isnan(d)) {
+        snprintf(out, size, "+nan.0");
+        return;
+    }
+    if (isinf(d)) {
+        snprintf(out, size, d > 0 ? "+inf.0" : "-inf.0");
+        return;
+    }
+    for (precision = 1; precision < 17; precision++) {
+        snprintf(out, size, "%.*g", precision, d);
+        if (strtod(out, NULL) == d) break;
+    }
+    if (precision == 17) snprintf(out, size, "%.17g", d);
+    if (!strpbrk(out, ".e")) strncat(out, ".0", size - strlen(out) - 1);
+}
+
+static const char *char_names[][2] = {
+    { " ", "space" }, { "\n", "newline" }, { "\t", "tab" }, { "\r", "return" },
+    { "\0", "nul" }, { NULL, NULL }
+};
+
+static void print_value(Buf *b, SchemeValue v, int write);
+
+static void print_string(Buf *b, const String *s, int write) {
+    uint32_t i, start = 0;
+    if (!write) {
+        buf_add(b, s->chars, s->h.length);
+        return;
+    }
+    buf_add(b, "\"", 1);
+    for (i = 0; i < s->h.length; i++) {
+        const char *escape = NULL;
+        switch (s->chars[i]) {
+        case '"': escape = "\\\""; break;
+        case '\\': escape = "\\\\"; break;
+        case '\n': escape = "\\n"; break;
+        case '\t': escape = "\\t"; break;
+        case '\r': escape = "\\r"; break;
+        }
+        if (escape) {
+            buf_add(b, s->chars + start, i - start);
+            buf_str(b, escape);
+            start = i + 1;
+        }
+    }
+    buf_add(b, s->chars + start, i - start);
+    buf_add(b, "\"", 1);
+}
+
+static void print_value(Buf *b, SchemeValue v, int write) {
+    char tmp[64];
+    int i;
+
+    if (b->truncated) return;
+    if (IS_FIXNUM(v)) {
+        snprintf(tmp, sizeof tmp, "%ld", FIXNUM(v));
+        buf_str(b, tmp);
+        return;
+    }
+    if (IS_CHAR(v)) {
+        int c = CHAR(v);
+        if (!write) {
+            tmp[0] = c;
+            buf_add(b, tmp, 1);
+            return;
+        }
+        for (i = 0; char_names[i][0]; i++)
+            if (char_names[i][0][0] == c) break;
+        if (char_names[i][0]) snprintf(tmp, sizeof tmp, "#\\%s", char_names[i][1]);
+        else if (c < 32 || c >= 127) snprintf(tmp, sizeof tmp, "#\\x%x", c);
+        else snprintf(tmp, sizeof tmp, "#\\%c", c);
+        buf_str(b, tmp);
+        return;
+    }
+    switch (v) {
+    case SCHEME_NIL: buf_str(b, "()"); return;
+    case SCHEME_TRUE: buf_str(b, "#t"); return;
+    case SCHEME_FALSE: buf_str(b, "#f"); return;
+    case SCHEME_UNSPECIFIED: return;
+    case SCHEME_EOF: buf_str(b, "#<eof>"); return;
+    case SCHEME_UNBOUND: buf_str(b, "#<unbound>"); return;
+    }
+    switch (TYPE(v)) {
+    case T_PAIR:
+    case T_VECTOR:
+        if (b->depth >= SCHEME_PRINT_DEPTH) {
+            buf_str(b, "...");
+            return;
+        }
+        b->depth++;
+        break;
+    }
+    switch (TYPE(v)) {
+    case T_PAIR:
+        buf_add(b, "(", 1);
+        for (;;) {
+            print_value(b, ((Pair *)v)->car, write);
+            v = ((Pair *)v)->cdr;
+            if (TYPE(v) != T_PAIR || b->truncated) break;
+            buf_add(b, " ", 1);
+        }
+        if (v != SCHEME_NIL) {
+            buf_add(b, " . ", 3);
+            print_value(b, v, write);
+        }
+        buf_add(b, ")", 1);
+        b->depth--;
+        break;
+    case T_FLONUM:
+        format_real(tmp, sizeof tmp, ((Flonum *)v)->value);
+        buf_str(b, tmp);
+        break;
+    case T_STRING:
+        print_string(b, (String *)v, write);
+        break;
+    case T_SYMBOL:
+        buf_add(b, ((Symbol *)v)->name, HEADER(v)->length);
+        break;
+    case T_VECTOR:
+        buf_add(b, "#(", 2);
+        for (i = 0; i < (int)HEADER(v)->length; i++) {
+            if (i) buf_add(b, " ", 1);
+            print_value(b, ((Vector *)v)->items[i], write);
+        }
+        buf_add(b, ")", 1);
+        b->depth--;
+        break;
+    case T_CLOSURE: {
+        SchemeValue name = ((Closure *)v)->proto->name;
+        buf_str(b, "#<procedure");
+        if (name != SCHEME_FALSE) {
+            buf_add(b, " ", 1);
+            buf_str(b, ((Symbol *)name)->name);
+        }
+        buf_add(b, ">", 1);
+        break;
+    }
+    case T_PRIMITIVE:
+        buf_str(b, "#<primitive ");
+        buf_str(b, ((Symbol *)((Primitive *)v)->name)->name);
+        buf_add(b, ">", 1);
+        break;
+    case T_BOX:
+        buf_str(b, "#<box>");
+        break;
+    default:
+        buf_str(b, "#<unknown>");
+    }
+}
+
+static char *value_text(SchemeValue v, int write) {
+    Buf b = { NULL, 0, 0, 0, 0 };
+    buf_add(&b, "", 0);
+    print_value(&b, v, write);
+    return b.s;
+}
+
+/* Errors unwind to the entry point that started the evaluation, or to
+ * the public constructor called outside one (see GUARDED) */
+
+static void raise_error(void) {
+    longjmp(*vm.escape, 1);
+}
+
+static void vm_error(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(vm.error, sizeof vm.error, fmt, ap);
+    va_end(ap);
+    raise_error();
+}
+
+static void value_error(const char *who, const char *message, SchemeValue v) {
+    Buf b = { NULL, 0, 0, 0, 0 };
+    buf_add(&b, "", 0);
+    print_value(&b, v, 1);
+    if (b.len > 200) strcpy(b.s + 197, "...");
+    snprintf(vm.error, sizeof vm.error, "%s: %s: %s", who, message, b.s);
+    free(b.s);
+    raise_error();
+}
+
+SchemeValue scheme_fail(const char *who, const char *message) {
+    snprintf(vm.error, sizeof vm.error, "%s: %s", who, message);
+    return SCHEME_ERROR;
+}
+
+#define CAR(v) (((Pair *)(v))->car)
+#define CDR(v) (((Pair *)(v))->cdr)
+
+/* Length of a proper list, or -1 for improper and circular ones */
+static long list_length(SchemeValue v) {
+    SchemeValue slow = v;
+    long n = 0;
+    for (;;) {
+        if (v == SCHEME_NIL) return n;
+        if (TYPE(v) != T_PAIR) return -1;
+        v = CDR(v);
+        n++;
+        if (n % 2 == 0) {
+            slow = CDR(slow);
+            if (slow == v && v != SCHEME_NIL) return -1;
+        }
+    }
+}
+
+/* Reader */
+
+enum {
+    S_QUOTE, S_QUASIQUOTE, S_UNQUOTE, S_UNQUOTE_SPLICING, S_LAMBDA, S_DEFINE,
+    S_SET, S_IF, S_BEGIN, S_LET, S_LETSTAR, S_LETREC, S_LETRECSTAR, S_COND,
+    S_ELSE, S_ARROW, S_CASE, S_AND, S_OR, S_WHEN, S_UNLESS, S_DO, SPECIALS
+};
+
+static const char *special_names[SPECIALS] = {
+    "quote", "quasiquote", "unquote", "unquote-splicing", "lambda", "define",
+    "set!", "if", "begin", "let", "let*", "letrec", "letrec*", "cond",
+    "else", "=>", "case", "and", "or", "when", "unless", "do"
+};
+
+static SchemeValue specials[SPECIALS];
+
+typedef struct {
+    const char *p;
+    int depth;
+} Reader;
+
+static void skip_space(Reader *r) {
+    for (;;) {
+        while (isspace((unsigned char)*r->p)) r->p++;
+        if (*r->p == ';') {
+            while (*r->p && *r->p != '\n') r->p++;
+        } else if (r->p[0] == '#' && r->p[1] == '|') {
+            const char *end = strstr(r->p + 2, "|#");
+            if (!end) vm_error("read: unterminated block comment");
+            r->p = end + 2;
+        } else {
+            return;
+        }
+    }
+}
+
+static int delimiter(int c) {
+    return c == '\0' || isspace(c) || strchr("()[]\";'`,", c) != NULL;
+}
+
+/* Integers, overflowing to flonums, and decimal reals */
+static int parse_number(const char *s, size_t len, SchemeValue *out) {
+    char tmp[128], *end;
+    const char *digits = s;
+
+    if (len == 0 || len >= sizeof tmp) return 0;
+    memcpy(tmp, s, len);
+    tmp[len] = '\0';
+    if (*digits == '+' || *digits == '-') digits++;
+    if (strcmp(digits, "inf.0") == 0 && digits != s) {
+        *out = make_real(*s == '-' ? -INFINITY : INFINITY);
+        return 1;
+    }
+    if (strcmp(digits, "nan.0") == 0 && digits != s) {
+        *out = make_real(NAN);
+        return 1;
+    }
+    if (!isdigit((unsigned char)digits[0]) &&
+        !(digits[0] == '.' && isdigit((unsigned char)digits[1])))
+        return 0;
+    errno = 0;
+    {
+        long n = strtol(tmp, &end, 10);
+        if (*end == '\0') {
+            *out = errno == ERANGE ? make_real(strtod(tmp, NULL)) : scheme_integer(n);
+            return 1;
+        }
+    }
+    {
+        double d = strtod(tmp, &end);
+        if (*end != '\0') return 0;
+        *out = make_real(d);
+    }
+    return 1;
+}
+
+static SchemeValue read_datum(Reader *r);
+
+static SchemeValue read_list(Reader *r, char close) {
+    SchemeValue head = SCHEME_NIL, tail = SCHEME_NIL;
+
+    if (++r->depth > SCHEME_READ_DEPTH) vm_error("read: nesting too deep");
+    for (;;) {
+        SchemeValue cell;
+        skip_space(r);
+        if (!*r->p) vm_error("read: missing %c", close);
+        if (*r->p == ')' || *r->p == ']') {
+            if (*r->p != close) vm_error("read: expected %c", close);
+            r->p++;
+            break;
+        }
+        if (r->p[0] == '.' && delimiter((unsigned char)r->p[1])) {
+            if (head == SCHEME_NIL) vm_error("read: bad dotted list");
+            r->p++;
+            skip_space(r);
+            if (!*r->p) vm_error("read: missing %c", close);
+            CDR(tail) = read_datum(r);
+            skip_space(r);
+            if (*r->p != close) vm_error("read: bad dotted list");
+            r->p++;
+            break;
+        }
+        cell = make_pair(read_datum(r), SCHEME_NIL);
+        if (head == SCHEME_NIL) head = cell;
+        else CDR(tail) = cell;
+        tail = cell;
+    }
+    r->depth--;
+    return head;
+}
+
+static SchemeValue read_string(Reader *r) {
+    Buf b = { NULL, 0, 0, 0, 0 };
+    SchemeValue s;
+
+    buf_add(&b, "", 0);
+    for (r->p++; *r->p != '"'; r->p++) {
+        char c = *r->p;
+        if (!c) {
+            free(b.s);
+            vm_error("read: unterminated string");
+        }
+        if (c == '\\') {
+            switch (*++r->p) {
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case 'r': c = '\r'; break;
+            case 'a': c = '\a'; break;
+            case '0': c = '\0'; break;
+            case 'x': c = (char)strtol(r->p + 1, (char **)&r->p, 16);
+                if (*r->p != ';') r->p--;
+                break;
+            case '\0':
+                free(b.s);
+                vm_error("read: unterminated string");
+                break;
+            default: c = *r->p;
+            }
+        }
+        buf_add(&b, &c, 1);
+    }
+    r->p++;
+    s = make_string(b.s, b.len);
+    free(b.s);
+    return s;
+}
+
+static SchemeValue read_char(Reader *r) {
+    const char *start = r->p;
+    size_t len;
+    int i;
+
+    if (!*r->p) vm_error("read: bad character");
+    r->p++;
+    while (!delimiter((unsigned char)*r->p)) r->p++;
+    len = r->p - start;
+    if (len == 1) return MAKE_CHAR(*start);
+    for (i = 0; char_names[i][0]; i++)
+        if (strlen(char_names[i][1]) == len && strncmp(start, char_names[i][1], len) == 0)
+            return MAKE_CHAR(char_names[i][0][0]);
+    if (*start == 'x') {
+        char *end;
+        long c = strtol(start + 1, &end, 16);
+        if (end == r->p && c >= 0 && c < 256) return MAKE_CHAR(c);
+    }
+    vm_error("read: unknown character #\\%.*s", (int)len, start);
+    return SCHEME_UNSPECIFIED;
+}
+
+static SchemeValue read_datum(Reader *r) {
+    const char *start;
+    SchemeValue v;
+    int quote = -1;
+
+    skip_space(r);
+    switch (*r->p) {
+    case '\0':
+        vm_error("read: unexpected end of input");
+        break;
+    case '(':
+        r->p++;
+        return read_list(r, ')');
+    case '[':
+        r->p++;
+        return read_list(r, ']');
+    case ')':
+    case ']':
+        vm_error("read: unexpected %c", *r->p);
+        break;
+    case '"':
+        return read_string(r);
+    case '\'':
+        quote = S_QUOTE;
+        break;
+    case '`':
+        quote = S_QUASIQUOTE;
+        break;
+    case ',':
+        quote = S_UNQUOTE;
+        if (r->p[1] == '@') {
+            quote = S_UNQUOTE_SPLICING;
+            r->p++;
+        }
+        break;
+    case '#':
+        if (r->p[1] == '(') {
+            SchemeValue list, vec;
+            long i, n;
+            r->p += 2;
+            list = read_list(r, ')');
+            n = list_length(list);
+            vec = make_vector(n, SCHEME_UNSPECIFIED);
+            for (i = 0; i < n; i++, list = CDR(list)) ((Vector *)vec)->items[i] = CAR(list);
+            return vec;
+        }
+        if (r->p[1] == '\\') {
+            r->p += 2;
+            return read_char(r);
+        }
+        break;
+    }
+    if (quote >= 0) {
+        r->p++;
+        if (++r->depth > SCHEME_READ_DEPTH) vm_error("read: nesting too deep");
+        v = read_datum(r);
+        r->depth--;
+        return make_pair(specials[quote], make_pair(v, SCHEME_NIL));
+    }
+
+    start = r->p;
+    while (!delimiter((unsigned char)*r->p)) r->p++;
+    if (start[0] == '#') {
+        size_t len = r->p - start;
+        if ((len == 2 && start[1] == 't') || (len == 5 && strncmp(start, "#true", 5) == 0))
+            return SCHEME_TRUE;
+        if ((len == 2 && start[1] == 'f') || (len == 6 && strncmp(start, "#false", 6) == 0))
+            return SCHEME_FALSE;
+        vm_error("read: unknown syntax %.*s", (int)len, start);
+    }
+    if (parse_number(start, r->p - start, &v)) return v;
+    return intern(start, r->p - start);
+}
+
+/* Returns 0 at the end of the input */
+static int read_next(Reader *r, SchemeValue *datum) {
+    skip_space(r);
+    if (!*r->p) return 0;
+    *datum = read_datum(r);
+    return 1;
+}
+
+/* Compiler */
+
+enum {
+    OP_CONST = 1, OP_LOCAL, OP_SETLOCAL, OP_LOCALBOX, OP_SETLOCALBOX, OP_BOX,
+    OP_FREE, OP_FREEBOX, OP_SETFREEBOX, OP_GLOBAL, OP_SETGLOBAL, OP_DEFINE,
+    OP_POP, OP_JUMP, OP_JUMPF, OP_JUMPFK, OP_JUMPTK, OP_CLOSURE, OP_CALL,
+    OP_TAILCALL, OP_RETURN,
+    /* inline primitives */
+    OP_ADD, OP_SUB, OP_MUL, OP_LT, OP_GT, OP_LE, OP_GE, OP_NUMEQ, OP_CAR,
+    OP_CDR, OP_CONS, OP_NULLP, OP_PAIRP, OP_EQ, OP_NOT, OP_ZEROP
+};
+
+/* How an inline primitive takes its arguments */
+enum { INLINE_UNARY = 1, INLINE_BINARY, INLINE_FOLD };
+
+typedef struct {
+    SchemeValue *items;
+    size_t count, cap;
+} SymbolSet;
+
+typedef struct {
+    SchemeValue name;
+    int slot;
+    int boxed;
+} Var;
+
+typedef struct {
+    SchemeValue name;
+    int from_local;             /* a slot of the enclosing frame, else of its closure */
+    int index;
+    int boxed;
+} FreeVar;
+
+struct Fn {
+    Fn *parent;
+    Var *vars;                  /* visible locals, innermost last */
+    int nvars, var_cap;
+    FreeVar *free;
+    int nfree, free_cap;
+    int nslots, max_slots;
+    int32_t *code;
+    size_t ncode, code_cap;
+    SchemeValue *consts;
+    size_t nconsts, const_cap;
+    int depth, max_depth;       /* of the value stack above the locals */
+    SymbolSet captured;         /* names used inside nested lambdas */
+    SymbolSet mutated;          /* names assigned with set! */
+    void **scratch;             /* work arrays of the forms being compiled */
+    int nscratch, scratch_cap;
+};
+
+typedef struct {
+    int nvars, nslots;
+} Scope;
+
+/* Helpers for quasiquote and case */
+static SchemeValue prim_cons, prim_list, prim_append, prim_list_to_vector, prim_memv;
+
+static Fn *fn_new(Fn *parent) {
+    Fn *fn = vm_malloc(sizeof(Fn));
+    memset(fn, 0, sizeof(Fn));
+    fn->parent = parent;
+    vm.compiling = fn;
+    return fn;
+}
+
+static void fn_free(Fn *fn) {
+    vm.compiling = fn->parent;
+    free(fn->vars);
+    free(fn->free);
+    free(fn->code);
+    free(fn->consts);
+    free(fn->captured.items);
+    free(fn->mutated.items);
+    while (fn->nscratch > 0) free(fn->scratch[--fn->nscratch]);
+    free(fn->scratch);
+    free(fn);
+}
+
+/* A work array for compiling one form.  fn owns it until scratch_free,
+ * which takes arrays in the reverse order, so an error that unwinds the
+ * compiler frees it along with fn. */
+static void *scratch_alloc(Fn *fn, size_t bytes) {
+    void *p;
+    if (fn->nscratch == fn->scratch_cap) {
+        fn->scratch_cap = fn->scratch_cap ? fn->scratch_cap * 2 : 8;
+        fn->scratch = vm_realloc(fn->scratch, fn->scratch_cap * sizeof(void *));
+    }
+    p = vm_malloc(bytes);
+    fn->scratch[fn->nscratch++] = p;
+    return p;
+}
+
+static void scratch_free(Fn *fn, void *p) {
+    fn->nscratch--;
+    free(p);
+}
+
+static int set_has(const SymbolSet *set, SchemeValue name) {
+    size_t i;
+    for (i = 0; i < set->count; i++)
+        if (set->items[i] == name) return 1;
+    return 0;
+}
+
+static void set_add(SymbolSet *set, SchemeValue name) {
+    if (set_has(set, name)) return;
+    if (set->count == set->cap) {
+        set->cap = set->cap ? set->cap * 2 : 16;
+        set->items = vm_realloc(set->items, set->cap * sizeof(SchemeValue));
+    }
+    set->items[set->count++] = name;
+}
+
+/* Records the names a function body captures in nested lambdas and
+ * the names it assigns; by name only, so shadowing can at worst box a
+ * variable that did not need it */
+static void analyze(Fn *fn, SchemeValue x, int nested) {
+    SchemeValue head;
+
+    if (TYPE(x) == T_SYMBOL) {
+        if (nested) set_add(&fn->captured, x);
+        return;
+    }
+    if (TYPE(x) != T_PAIR) return;
+    head = CAR(x);
+    if (head == specials[S_QUOTE]) return;
+    if (head == specials[S_LAMBDA]) nested = 1;
+    if (TYPE(CDR(x)) == T_PAIR) {
+        SchemeValue second = CAR(CDR(x));
+        if (head == specials[S_DEFINE] && TYPE(second) == T_PAIR) nested = 1;
+        if (head == specials[S_LET] && TYPE(second) == T_SYMBOL) nested = 1;
+        if (head == specials[S_SET] && TYPE(second) == T_SYMBOL) set_add(&fn->mutated, second);
+    }
+    for (; TYPE(x) == T_PAIR; x = CDR(x)) analyze(fn, CAR(x), nested);
+    analyze(fn, x, nested);
+}
+
+static void emit(Fn *fn, int32_t word) {
+    if (fn->ncode == fn->code_cap) {
+        fn->code_cap = fn->code_cap ? fn->code_cap * 2 : 64;
+        fn->code = vm_realloc(fn->code, fn->code_cap * sizeof(int32_t));
+    }
+    fn->code[fn->ncode++] = word;
+}
+
+static void stack_effect(Fn *fn, int delta) {
+    fn->depth += delta;
+    if (fn->depth > fn->max_depth) fn->max_depth = fn->depth;
+}
+
+static void emit_op(Fn *fn, int op, int delta) {
+    emit(fn, op);
+    stack_effect(fn, delta);
+}
+
+static void emit_op_arg(Fn *fn, int op, int32_t arg, int delta) {
+    emit(fn, op);
+    emit(fn, arg);
+    stack_effect(fn, delta);
+}
+
+/* Emits a jump and returns the position of its target, to be patched */
+static size_t emit_jump(Fn *fn, int op, int delta) {
+    emit_op_arg(fn, op, 0, delta);
+    return fn->ncode - 1;
+}
+
+static void patch_jump(Fn *fn, size_t at) {
+    fn->code[at] = (int32_t)fn->ncode;
+}
+
+static int add_const(Fn *fn, SchemeValue v) {
+    size_t i;
+    for (i = 0; i < fn->nconsts; i++)
+        if (fn->consts[i] == v) return (int)i;
+    if (fn->nconsts == fn->const_cap) {
+        fn->const_cap = fn->const_cap ? fn->const_cap * 2 : 16;
+        fn->consts = vm_realloc(fn->consts, fn->const_cap * sizeof(SchemeValue));
+    }
+    fn->consts[fn->nconsts] = v;
+    return (int)fn->nconsts++;
+}
+
+static void emit_const(Fn *fn, SchemeValue v) {
+    emit_op_arg(fn, OP_CONST, add_const(fn, v), 1);
+}
+
+static void syntax_error(const char *form, SchemeValue x) {
+    value_error(form, "bad syntax", x);
+}
+
+static Scope enter_scope(Fn *fn) {
+    Scope scope;
+    scope.nvars = fn->nvars;
+    scope.nslots = fn->nslots;
+    return scope;
+}
+
+static void leave_scope(Fn *fn, Scope scope) {
+    fn->nvars = scope.nvars;
+    fn->nslots = scope.nslots;
+}
+
+static int add_var(Fn *fn, SchemeValue name, int boxed) {
+    Var *var;
+    if (fn->nslots >= 65535) vm_error("compile: too many local variables");
+    if (fn->nvars == fn->var_cap) {
+        fn->var_cap = fn->var_cap ? fn->var_cap * 2 : 16;
+        fn->vars = vm_realloc(fn->vars, fn->var_cap * sizeof(Var));
+    }
+    var = &fn->vars[fn->nvars++];
+    var->name = name;
+    var->slot = fn->nslots++;
+    var->boxed = boxed;
+    if (fn->nslots > fn->max_slots) fn->max_slots = fn->nslots;
+    return var->slot;
+}
+
+static int declare(Fn *fn, SchemeValue name, int boxed) {
+    if (TYPE(name) != T_SYMBOL) syntax_error("binding", name);
+    return add_var(fn, name, boxed);
+}
+
+/* A slot no name can refer to */
+static int declare_temp(Fn *fn) {
+    return add_var(fn, SCHEME_FALSE, 0);
+}
+
+/* Variables both assigned and captured are boxed */
+static int needs_box(Fn *fn, SchemeValue name) {
+    return set_has(&fn->captured, name) && set_has(&fn->mutated, name);
+}
+
+static int lexically_bound(Fn *fn, SchemeValue name) {
+    int i;
+    for (; fn; fn = fn->parent) {
+        for (i = 0; i < fn->nvars; i++)
+            if (fn->vars[i].name == name) return 1;
+        for (i = 0; i < fn->nfree; i++)
+            if (fn->free[i].name == name) return 1;
+    }
+    return 0;
+}
+
+enum { REF_GLOBAL, REF_LOCAL, REF_FREE };
+
+static int resolve(Fn *fn, SchemeValue name, int *index, int *boxed) {
+    int i, kind, outer, outer_boxed;
+    FreeVar *free_var;
+
+    for (i = fn->nvars; i-- > 0;)
+        if (fn->vars[i].name == name) {
+            *index = fn->vars[i].slot;
+            *boxed = fn->vars[i].boxed;
+            return REF_LOCAL;
+        }
+    for (i = 0; i < fn->nfree; i++)
+        if (fn->free[i].name == name) {
+            *index = i;
+            *boxed = fn->free[i].boxed;
+            return REF_FREE;
+        }
+    if (!fn->parent) return REF_GLOBAL;
+    kind = resolve(fn->parent, name, &outer, &outer_boxed);
+    if (kind == REF_GLOBAL) return REF_GLOBAL;
+    if (fn->nfree == fn->free_cap) {
+        fn->free_cap = fn->free_cap ? fn->free_cap * 2 : 8;
+        fn->free = vm_realloc(fn->free, fn->free_cap * sizeof(FreeVar));
+    }
+    free_var = &fn->free[fn->nfree];
+    free_var->name = name;
+    free_var->from_local = kind == REF_LOCAL;
+    free_var->index = outer;
+    free_var->boxed = outer_boxed;
+    *index = fn->nfree++;
+    *boxed = outer_boxed;
+    return REF_FREE;
+}
+
+/* Moves the code and constants of a compiled function into a prototype */
+static Proto *make_proto(Fn *fn, int nparams, int rest, SchemeValue name) {
+    Proto *proto = alloc(T_PROTO, sizeof(Proto));
+    proto->code = fn->code;
+    proto->ncode = fn->ncode;
+    proto->consts = fn->consts;
+    proto->nconsts = fn->nconsts;
+    proto->nparams = nparams;
+    proto->nlocals = fn->max_slots;
+    proto->max_stack = fn->max_depth + 1;
+    proto->rest = rest;
+    proto->name = name;
+    fn->code = NULL;
+    fn->consts = NULL;
+    return proto;
+}
+
+static void compile(Fn *fn, SchemeValue x, int tail);
+static void compile_body(Fn *fn, SchemeValue body, int tail);
+
+static void compile_ref(Fn *fn, SchemeValue name) {
+    int index, boxed;
+    switch (resolve(fn, name, &index, &boxed)) {
+    case REF_LOCAL:
+        emit_op_arg(fn, boxed ? OP_LOCALBOX : OP_LOCAL, index, 1);
+        break;
+    case REF_FREE:
+        emit_op_arg(fn, boxed ? OP_FREEBOX : OP_FREE, index, 1);
+        break;
+    default:
+        emit_op_arg(fn, OP_GLOBAL, add_const(fn, name), 1);
+    }
+}
+
+/* Pops the top of the stack into a variable */
+static void compile_store(Fn *fn, SchemeValue name) {
+    int index, boxed;
+    switch (resolve(fn, name, &index, &boxed)) {
+    case REF_LOCAL:
+        emit_op_arg(fn, boxed ? OP_SETLOCALBOX : OP_SETLOCAL, index, -1);
+        break;
+    case REF_FREE:
+        if (!boxed) vm_error("set!: cannot assign captured variable %s", ((Symbol *)name)->name);
+        emit_op_arg(fn, OP_SETFREEBOX, index, -1);
+        break;
+    default:
+        emit_op_arg(fn, OP_SETGLOBAL, add_const(fn, name), -1);
+    }
+}
+
+static void compile_sequence(Fn *fn, SchemeValue body, int tail) {
+    if (body == SCHEME_NIL) {
+        emit_const(fn, SCHEME_UNSPECIFIED);
+        return;
+    }
+    for (; TYPE(body) == T_PAIR; body = CDR(body)) {
+        int last = CDR(body) == SCHEME_NIL;
+        compile(fn, CAR(body), tail && last);
+        if (!last) emit_op(fn, OP_POP, -1);
+    }
+}
+
+static void compile_lambda(Fn *parent, SchemeValue params, SchemeValue body, SchemeValue name) {
+    Fn *fn = fn_new(parent);
+    SchemeValue p;
+    Proto *proto;
+    int i, nparams = 0, rest = 0;
+
+    if (list_length(body) <= 0) syntax_error("lambda", body);
+    analyze(fn, body, 0);
+    for (p = params; TYPE(p) == T_PAIR; p = CDR(p)) {
+        declare(fn, CAR(p), needs_box(fn, CAR(p)));
+        nparams++;
+    }
+    if (p != SCHEME_NIL) {
+        declare(fn, p, needs_box(fn, p));
+        rest = 1;
+    }
+    if (nparams > 65535 - 1) vm_error("lambda: too many parameters");
+    for (i = 0; i < fn->nvars; i++)
+        if (fn->vars[i].boxed) emit_op_arg(fn, OP_BOX, fn->vars[i].slot, 0);
+    compile_body(fn, body, 1);
+    emit_op(fn, OP_RETURN, -1);
+
+    proto = make_proto(fn, nparams, rest, name);
+
+    emit_op_arg(parent, OP_CLOSURE, add_const(parent, (SchemeValue)proto), 1);
+    emit(parent, fn->nfree);
+    for (i = 0; i < fn->nfree; i++) {
+        emit(parent, fn->free[i].from_local);
+        emit(parent, fn->free[i].index);
+    }
+    fn_free(fn);
+}
+
+static int is_form(Fn *fn, SchemeValue x, int special) {
+    return TYPE(x) == T_PAIR && CAR(x) == specials[special] && !lexically_bound(fn, specials[special]);
+}
+
+/* (define name value), (define name) or (define (name . params) body...) */
+static SchemeValue define_name(SchemeValue x) {
+    SchemeValue target;
+    if (TYPE(CDR(x)) != T_PAIR) syntax_error("define", x);
+    target = CAR(CDR(x));
+    if (TYPE(target) == T_PAIR) target = CAR(target);
+    if (TYPE(target) != T_SYMBOL) syntax_error("define", x);
+    return target;
+}
+
+static void compile_define_value(Fn *fn, SchemeValue x) {
+    SchemeValue target, rest;
+    define_name(x);     /* checks the shape before it is taken apart */
+    target = CAR(CDR(x));
+    rest = CDR(CDR(x));
+    if (TYPE(target) == T_PAIR) {
+        compile_lambda(fn, CDR(target), rest, CAR(target));
+    } else if (rest == SCHEME_NIL) {
+        emit_const(fn, SCHEME_UNSPECIFIED);
+    } else {
+        if (TYPE(rest) != T_PAIR || CDR(rest) != SCHEME_NIL) syntax_error("define", x);
+        if (is_form(fn, CAR(rest), S_LAMBDA) && TYPE(CDR(CAR(rest))) == T_PAIR)
+            compile_lambda(fn, CAR(CDR(CAR(rest))), CDR(CDR(CAR(rest))), target);
+        else
+            compile(fn, CAR(rest), 0);
+    }
+}
+
+/* Internal definitions anywhere in a body are bound as by letrec* */
+static void compile_body(Fn *fn, SchemeValue body, int tail) {
+    Scope scope = enter_scope(fn);
+    SchemeValue b;
+
+    if (list_length(body) < 0) syntax_error("body", body);
+    for (b = body; b != SCHEME_NIL; b = CDR(b))
+        if (is_form(fn, CAR(b), S_DEFINE)) {
+            SchemeValue name = define_name(CAR(b));
+            int boxed = set_has(&fn->captured, name);
+            int slot = declare(fn, name, boxed);
+            if (boxed) emit_op_arg(fn, OP_BOX, slot, 0);
+        }
+    for (b = body; b != SCHEME_NIL; b = CDR(b)) {
+        int last = CDR(b) == SCHEME_NIL;
+        if (is_form(fn, CAR(b), S_DEFINE)) {
+            compile_define_value(fn, CAR(b));
+            compile_store(fn, define_name(CAR(b)));
+            if (last) emit_const(fn, SCHEME_UNSPECIFIED);
+        } else {
+            compile(fn, CAR(b), tail && last);
+            if (!last) emit_op(fn, OP_POP, -1);
+        }
+    }
+    if (body == SCHEME_NIL) emit_const(fn, SCHEME_UNSPECIFIED);
+    leave_scope(fn, scope);
+}
+
+/* Binding lists: ((name init) ...) */
+static long check_bindings(const char *form, SchemeValue bindings) {
+    SchemeValue b;
+    long n = list_length(bindings);
+    if (n < 0) syntax_error(form, bindings);
+    for (b = bindings; b != SCHEME_NIL; b = CDR(b)) {
+        SchemeValue binding = CAR(b);
+        long len = list_length(binding);
+        if (len < 1 || len > 3 || TYPE(CAR(binding)) != T_SYMBOL) syntax_error(form, binding);
+    }
+    return n;
+}
+
+static SchemeValue binding_init(SchemeValue binding) {
+    return CDR(binding) == SCHEME_NIL ? SCHEME_UNSPECIFIED : CAR(CDR(binding));
+}
+
+static void compile_let(Fn *fn, SchemeValue x, int tail) {
+    SchemeValue bindings, body, b;
+    Scope scope;
+    long n, i;
+    int *slots;
+
+    if (TYPE(CDR(x)) != T_PAIR) syntax_error("let", x);
+    bindings = CAR(CDR(x));
+    body = CDR(CDR(x));
+
+    if (TYPE(bindings) == T_SYMBOL) {
+        /* named let: a local procedure called with the initial values */
+        SchemeValue name = bindings, params = SCHEME_NIL, *tailp = &params;
+        int slot, boxed;
+        if (TYPE(body) != T_PAIR) syntax_error("let", x);
+        bindings = CAR(body);
+        body = CDR(body);
+        n = check_bindings("let", bindings);
+        for (b = bindings; b != SCHEME_NIL; b = CDR(b)) {
+            *tailp = make_pair(CAR(CAR(b)), SCHEME_NIL);
+            tailp = &CDR(*tailp);
+        }
+        scope = enter_scope(fn);
+        boxed = set_has(&fn->captured, name);
+        slot = declare(fn, name, boxed);
+        if (boxed) emit_op_arg(fn, OP_BOX, slot, 0);
+        compile_lambda(fn, params, body, name);
+        compile_store(fn, name);
+        compile_ref(fn, name);
+        for (b = bindings; b != SCHEME_NIL; b = CDR(b)) compile(fn, binding_init(CAR(b)), 0);
+        emit_op_arg(fn, tail ? OP_TAILCALL : OP_CALL, n, -n);
+        leave_scope(fn, scope);
+        return;
+    }
+
+    n = check_bindings("let", bindings);
+    for (b = bindings; b != SCHEME_NIL; b = CDR(b)) compile(fn, binding_init(CAR(b)), 0);
+    scope = enter_scope(fn);
+    slots = scratch_alloc(fn, (n + 1) * sizeof(int));
+    for (i = 0, b = bindings; b != SCHEME_NIL; b = CDR(b), i++)
+        slots[i] = declare(fn, CAR(CAR(b)), needs_box(fn, CAR(CAR(b))));
+    for (i = n; i-- > 0;) emit_op_arg(fn, OP_SETLOCAL, slots[i], -1);
+    scratch_free(fn, slots);
+    for (i = scope.nvars; i < fn->nvars; i++)
+        if (fn->vars[i].boxed) emit_op_arg(fn, OP_BOX, fn->vars[i].slot, 0);
+    compile_body(fn, body, tail);
+    leave_scope(fn, scope);
+}
+
+static void compile_let_star(Fn *fn, SchemeValue x, int tail) {
+    SchemeValue b;
+    Scope scope;
+
+    if (TYPE(CDR(x)) != T_PAIR) syntax_error("let*", x);
+    check_bindings("let*", CAR(CDR(x)));
+    scope = enter_scope(fn);
+    for (b = CAR(CDR(x)); b != SCHEME_NIL; b = CDR(b)) {
+        SchemeValue name = CAR(CAR(b));
+        int boxed = needs_box(fn, name), slot;
+        compile(fn, binding_init(CAR(b)), 0);
+        slot = declare(fn, name, boxed);
+        emit_op_arg(fn, OP_SETLOCAL, slot, -1);
+        if (boxed) emit_op_arg(fn, OP_BOX, slot, 0);
+    }
+    compile_body(fn, CDR(CDR(x)), tail);
+    leave_scope(fn, scope);
+}
+
+static void compile_letrec(Fn *fn, SchemeValue x, int tail) {
+    SchemeValue b;
+    Scope scope;
+
+    if (TYPE(CDR(x)) != T_PAIR) syntax_error("letrec", x);
+    check_bindings("letrec", CAR(CDR(x)));
+    scope = enter_scope(fn);
+    for (b = CAR(CDR(x)); b != SCHEME_NIL; b = CDR(b)) {
+        SchemeValue name = CAR(CAR(b));
+        int boxed = set_has(&fn->captured, name);
+        int slot = declare(fn, name, boxed);
+        if (boxed) emit_op_arg(fn, OP_BOX, slot, 0);
+    }
+    for (b = CAR(CDR(x)); b != SCHEME_NIL; b = CDR(b)) {
+        SchemeValue binding = CAR(b), init = binding_init(binding);
+        if (is_form(fn, init, S_LAMBDA) && TYPE(CDR(init)) == T_PAIR)
+            compile_lambda(fn, CAR(CDR(init)), CDR(CDR(init)), CAR(binding));
+        else
+            compile(fn, init, 0);
+        compile_store(fn, CAR(binding));
+    }
+    compile_body(fn, CDR(CDR(x)), tail);
+    leave_scope(fn, scope);
+}
+
+static void compile_if(Fn *fn, SchemeValue x, int tail) {
+    long n = list_length(x);
+    size_t to_else, to_end;
+    int depth;
+
+    if (n != 3 && n != 4) syntax_error("if", x);
+    x = CDR(x);
+    compile(fn, CAR(x), 0);
+    to_else = emit_jump(fn, OP_JUMPF, -1);
+    depth = fn->depth;
+    compile(fn, CAR(CDR(x)), tail);
+    to_end = emit_jump(fn, OP_JUMP, 0);
+    patch_jump(fn, to_else);
+    fn->depth = depth;
+    if (n == 4) compile(fn, CAR(CDR(CDR(x))), tail);
+    else emit_const(fn, SCHEME_UNSPECIFIED);
+    patch_jump(fn, to_end);
+}
+
+/* and/or: each test but the last jumps to the end keeping its value */
+static void compile_logic(Fn *fn, SchemeValue x, int op, SchemeValue empty, int tail) {
+    size_t *ends;
+    long n = list_length(x) - 1, i;
+
+    if (n < 0) syntax_error(op == OP_JUMPFK ? "and" : "or", x);
+    if (n == 0) {
+        emit_const(fn, empty);
+        return;
+    }
+    ends = scratch_alloc(fn, n * sizeof(size_t));
+    for (i = 0, x = CDR(x); i < n; i++, x = CDR(x)) {
+        compile(fn, CAR(x), tail && i == n - 1);
+        if (i < n - 1) ends[i] = emit_jump(fn, op, -1);
+    }
+    for (i = 0; i < n - 1; i++) patch_jump(fn, ends[i]);
+    scratch_free(fn, ends);
+}
+
+static void compile_cond(Fn *fn, SchemeValue x, int tail) {
+    size_t *ends;
+    long n = list_length(x) - 1, count = 0;
+    int depth = fn->depth, has_else = 0;
+    SchemeValue c;
+
+    if (n < 0) syntax_error("cond", x);
+    ends = scratch_alloc(fn, (n + 1) * sizeof(size_t));
+    for (c = CDR(x); c != SCHEME_NIL; c = CDR(c)) {
+        SchemeValue clause = CAR(c), test, body;
+        size_t next;
+        if (list_length(clause) < 1) {
+            syntax_error("cond", clause);
+        }
+        test = CAR(clause);
+        body = CDR(clause);
+        fn->depth = depth;
+        if (test == specials[S_ELSE] && !lexically_bound(fn, test)) {
+            compile_sequence(fn, body, tail);
+            has_else = 1;
+            break;
+        }
+        if (body == SCHEME_NIL) {
+            compile(fn, test, 0);
+            ends[count++] = emit_jump(fn, OP_JUMPTK, -1);
+            continue;
+        }
+        if (CAR(body) == specials[S_ARROW] && !lexically_bound(fn, CAR(body))) {
+            Scope scope = enter_scope(fn);
+            int slot = declare_temp(fn);
+            if (list_length(body) != 2) {
+                syntax_error("cond", clause);
+            }
+            compile(fn, test, 0);
+            emit_op_arg(fn, OP_SETLOCAL, slot, -1);
+            emit_op_arg(fn, OP_LOCAL, slot, 1);
+            next = emit_jump(fn, OP_JUMPF, -1);
+            compile(fn, CAR(CDR(body)), 0);
+            emit_op_arg(fn, OP_LOCAL, slot, 1);
+            emit_op_arg(fn, tail ? OP_TAILCALL : OP_CALL, 1, -1);
+            leave_scope(fn, scope);
+        } else {
+            compile(fn, test, 0);
+            next = emit_jump(fn, OP_JUMPF, -1);
+            compile_sequence(fn, body, tail);
+        }
+        ends[count++] = emit_jump(fn, OP_JUMP, 0);
+        patch_jump(fn, next);
+    }
+    if (!has_else) {
+        fn->depth = depth;
+        emit_const(fn, SCHEME_UNSPECIFIED);
+    }
+    while (count > 0) patch_jump(fn, ends[--count]);
+    scratch_free(fn, ends);
+}
+
+static void compile_case(Fn *fn, SchemeValue x, int tail) {
+    size_t *ends;
+    long n = list_length(x) - 2, count = 0;
+    int depth, slot, has_else = 0;
+    Scope scope;
+    SchemeValue c;
+
+    if (n < 0) syntax_error("case", x);
+    scope = enter_scope(fn);
+    slot = declare_temp(fn);
+    compile(fn, CAR(CDR(x)), 0);
+    emit_op_arg(fn, OP_SETLOCAL, slot, -1);
+    depth = fn->depth;
+    ends = scratch_alloc(fn, (n + 1) * sizeof(size_t));
+    for (c = CDR(CDR(x)); c != SCHEME_NIL; c = CDR(c)) {
+        SchemeValue clause = CAR(c);
+        size_t next;
+        if (list_length(clause) < 1 ||
+            (CAR(clause) != specials[S_ELSE] && list_length(CAR(clause)) < 0)) {
+            syntax_error("case", clause);
+        }
+        fn->depth = depth;
+        if (CAR(clause) == specials[S_ELSE]) {
+            compile_sequence(fn, CDR(clause), tail);
+            has_else = 1;
+            break;
+        }
+        emit_const(fn, prim_memv);
+        emit_op_arg(fn, OP_LOCAL, slot, 1);
+        emit_const(fn, CAR(clause));
+        emit_op_arg(fn, OP_CALL, 2, -2);
+        next = emit_jump(fn, OP_JUMPF, -1);
+        compile_sequence(fn, CDR(clause), tail);
+        ends[count++] = emit_jump(fn, OP_JUMP, 0);
+        patch_jump(fn, next);
+    }
+    if (!has_else) {
+        fn->depth = depth;
+        emit_const(fn, SCHEME_UNSPECIFIED);
+    }
+    while (count > 0) patch_jump(fn, ends[--count]);
+    scratch_free(fn, ends);
+    leave_scope(fn, scope);
+}
+
+static void compile_when(Fn *fn, SchemeValue x, int unless, int tail) {
+    size_t skip, to_end;
+    int depth;
+
+    if (list_length(x) < 2) syntax_error(unless ? "unless" : "when", x);
+    compile(fn, CAR(CDR(x)), 0);
+    skip = emit_jump(fn, OP_JUMPF, -1);
+    depth = fn->depth;
+    if (unless) emit_const(fn, SCHEME_UNSPECIFIED);
+    else compile_sequence(fn, CDR(CDR(x)), tail);
+    to_end = emit_jump(fn, OP_JUMP, 0);
+    patch_jump(fn, skip);
+    fn->depth = depth;
+    if (unless) compile_sequence(fn, CDR(CDR(x)), tail);
+    else emit_const(fn, SCHEME_UNSPECIFIED);
+    patch_jump(fn, to_end);
+}
+
+/* (do ((var init step)...) (test result...) command...): the variables
+ * are updated in place, and boxed ones get a fresh box per iteration */
+static void compile_do(Fn *fn, SchemeValue x, int tail) {
+    SchemeValue specs, exit, b;
+    Scope scope;
+    size_t loop, to_body, to_end;
+    long n, i, steps = 0;
+    int depth, *slots, *stepped;
+
+    if (list_length(x) < 3 || list_length(CAR(CDR(CDR(x)))) < 1) syntax_error("do", x);
+    specs = CAR(CDR(x));
+    exit = CAR(CDR(CDR(x)));
+    n = check_bindings("do", specs);
+    for (b = specs; b != SCHEME_NIL; b = CDR(b)) compile(fn, binding_init(CAR(b)), 0);
+    scope = enter_scope(fn);
+    slots = scratch_alloc(fn, (2 * n + 1) * sizeof(int));
+    stepped = slots + n;
+    for (i = 0, b = specs; b != SCHEME_NIL; b = CDR(b), i++)
+        slots[i] = declare(fn, CAR(CAR(b)), set_has(&fn->captured, CAR(CAR(b))));
+    for (i = n; i-- > 0;) emit_op_arg(fn, OP_SETLOCAL, slots[i], -1);
+    for (i = scope.nvars; i < fn->nvars; i++)
+        if (fn->vars[i].boxed) emit_op_arg(fn, OP_BOX, fn->vars[i].slot, 0);
+
+    loop = fn->ncode;
+    depth = fn->depth;
+    compile(fn, CAR(exit), 0);
+    to_body = emit_jump(fn, OP_JUMPF, -1);
+    compile_sequence(fn, CDR(exit), tail);
+    to_end = emit_jump(fn, OP_JUMP, 0);
+    patch_jump(fn, to_body);
+    fn->depth = depth;
+    for (b = CDR(CDR(CDR(x))); TYPE(b) == T_PAIR; b = CDR(b)) {
+        compile(fn, CAR(b), 0);
+        emit_op(fn, OP_POP, -1);
+    }
+    for (i = 0, b = specs; b != SCHEME_NIL; b = CDR(b), i++)
+        if (list_length(CAR(b)) == 3) {
+            compile(fn, CAR(CDR(CDR(CAR(b)))), 0);
+            stepped[steps++] = i;
+        }
+    while (steps-- > 0) {
+        i = stepped[steps];
+        emit_op_arg(fn, OP_SETLOCAL, slots[i], -1);
+        if (fn->vars[scope.nvars + i].boxed) emit_op_arg(fn, OP_BOX, slots[i], 0);
+    }
+    scratch_free(fn, slots);
+    emit_op_arg(fn, OP_JUMP, (int32_t)loop, 0);
+    patch_jump(fn, to_end);
+    fn->depth = depth + 1;
+    leave_scope(fn, scope);
+}
+
+static int has_unquote(SchemeValue x) {
+    for (; TYPE(x) == T_PAIR; x = CDR(x)) {
+        if (CAR(x) == specials[S_UNQUOTE] || CAR(x) == specials[S_UNQUOTE_SPLICING]) return 1;
+        if (has_unquote(CAR(x))) return 1;
+    }
+    if (TYPE(x) == T_VECTOR) {
+        uint32_t i;
+        for (i = 0; i < HEADER(x)->length; i++)
+            if (has_unquote(((Vector *)x)->items[i])) return 1;
+    }
+    return x == specials[S_UNQUOTE] || x == specials[S_UNQUOTE_SPLICING];
+}
+
+static void compile_quasi(Fn *fn, SchemeValue x, int level) {
+    SchemeValue head;
+
+    if (!has_unquote(x)) {
+        emit_const(fn, x);
+        return;
+    }
+    if (TYPE(x) == T_VECTOR) {
+        SchemeValue list = SCHEME_NIL;
+        uint32_t i = HEADER(x)->length;
+        while (i-- > 0) list = make_pair(((Vector *)x)->items[i], list);
+        emit_const(fn, prim_list_to_vector);
+        compile_quasi(fn, list, level);
+        emit_op_arg(fn, OP_CALL, 1, -1);
+        return;
+    }
+    if (TYPE(x) != T_PAIR) {
+        emit_const(fn, x);
+        return;
+    }
+    head = CAR(x);
+    if ((head == specials[S_UNQUOTE] || head == specials[S_QUASIQUOTE]) && list_length(x) == 2) {
+        int inner = head == specials[S_UNQUOTE] ? level - 1 : level + 1;
+        if (inner == 0) {
+            compile(fn, CAR(CDR(x)), 0);
+            return;
+        }
+        emit_const(fn, prim_list);
+        emit_const(fn, head);
+        compile_quasi(fn, CAR(CDR(x)), inner);
+        emit_op_arg(fn, OP_CALL, 2, -2);
+        return;
+    }
+    if (TYPE(head) == T_PAIR && CAR(head) == specials[S_UNQUOTE_SPLICING] &&
+        list_length(head) == 2 && level == 1) {
+        emit_const(fn, prim_append);
+        compile(fn, CAR(CDR(head)), 0);
+        compile_quasi(fn, CDR(x), level);
+        emit_op_arg(fn, OP_CALL, 2, -2);
+        return;
+    }
+    emit_const(fn, prim_cons);
+    compile_quasi(fn, head, level);
+    compile_quasi(fn, CDR(x), level);
+    emit_op_arg(fn, OP_CALL, 2, -2);
+}
+
+static int special_form(SchemeValue head) {
+    int i;
+    for (i = 0; i < SPECIALS; i++)
+        if (specials[i] == head) return i;
+    return -1;
+}
+
+/* Primitives whose global name is unshadowed are compiled inline */
+static int compile_inline(Fn *fn, SchemeValue x, long argc) {
+    Primitive *prim = (Primitive *)((Symbol *)CAR(x))->value;
+    SchemeValue args = CDR(x);
+
+    if (TYPE((SchemeValue)prim) != T_PRIMITIVE || !prim->inline_op) return 0;
+    switch (prim->inline_args) {
+    case INLINE_UNARY:
+        if (argc != 1) return 0;
+        compile(fn, CAR(args), 0);
+        emit_op(fn, prim->inline_op, 0);
+        return 1;
+    case INLINE_BINARY:
+        if (argc != 2) return 0;
+        break;
+    case INLINE_FOLD:
+        if (argc < 2) return 0;
+        break;
+    }
+    compile(fn, CAR(args), 0);
+    for (args = CDR(args); args != SCHEME_NIL; args = CDR(args)) {
+        compile(fn, CAR(args), 0);
+        emit_op(fn, prim->inline_op, -1);
+    }
+    return 1;
+}
+
+static void compile(Fn *fn, SchemeValue x, int tail) {
+    SchemeValue head, args;
+    long argc;
+
+    if (TYPE(x) == T_SYMBOL) {
+        compile_ref(fn, x);
+        return;
+    }
+    if (TYPE(x) != T_PAIR) {
+        if (x == SCHEME_NIL) vm_error("eval: empty combination ()");
+        emit_const(fn, x);
+        return;
+    }
+    head = CAR(x);
+    argc = list_length(CDR(x));
+    if (argc < 0) syntax_error("call", x);
+
+    if (TYPE(head) == T_SYMBOL && !lexically_bound(fn, head)) {
+        switch (special_form(head)) {
+        case S_QUOTE:
+            if (argc != 1) syntax_error("quote", x);
+            emit_const(fn, CAR(CDR(x)));
+            return;
+        case S_QUASIQUOTE:
+            if (argc != 1) syntax_error("quasiquote", x);
+            compile_quasi(fn, CAR(CDR(x)), 1);
+            return;
+        case S_LAMBDA:
+            if (argc < 2) syntax_error("lambda", x);
+            compile_lambda(fn, CAR(CDR(x)), CDR(CDR(x)), SCHEME_FALSE);
+            return;
+        case S_DEFINE:
+            if (fn->parent || fn->nvars) vm_error("define: not allowed in an expression");
+            compile_define_value(fn, x);
+            emit_op_arg(fn, OP_DEFINE, add_const(fn, define_name(x)), 0);
+            return;
+        case S_SET:
+            if (argc != 2 || TYPE(CAR(CDR(x))) != T_SYMBOL) syntax_error("set!", x);
+            compile(fn, CAR(CDR(CDR(x))), 0);
+            compile_store(fn, CAR(CDR(x)));
+            emit_const(fn, SCHEME_UNSPECIFIED);
+            return;
+        case S_IF:
+            compile_if(fn, x, tail);
+            return;
+        case S_BEGIN:
+            compile_sequence(fn, CDR(x), tail);
+            return;
+        case S_LET:
+            compile_let(fn, x, tail);
+            return;
+        case S_LETSTAR:
+            compile_let_star(fn, x, tail);
+            return;
+        case S_LETREC:
+        case S_LETRECSTAR:
+            compile_letrec(fn, x, tail);
+            return;
+        case S_COND:
+            compile_cond(fn, x, tail);
+            return;
+        case S_CASE:
+            compile_case(fn, x, tail);
+            return;
+        case S_AND:
+            compile_logic(fn, x, OP_JUMPFK, SCHEME_TRUE, tail);
+            return;
+        case S_OR:
+            compile_logic(fn, x, OP_JUMPTK, SCHEME_FALSE, tail);
+            return;
+        case S_WHEN:
+            compile_when(fn, x, 0, tail);
+            return;
+        case S_UNLESS:
+            compile_when(fn, x, 1, tail);
+            return;
+        case S_DO:
+            compile_do(fn, x, tail);
+            return;
+        case S_UNQUOTE:
+        case S_UNQUOTE_SPLICING:
+            syntax_error("unquote", x);
+        }
+        if (compile_inline(fn, x, argc)) return;
+    }
+
+    compile(fn, head, 0);
+    for (args = CDR(x); args != SCHEME_NIL; args = CDR(args)) compile(fn, CAR(args), 0);
+    emit_op_arg(fn, tail ? OP_TAILCALL : OP_CALL, argc, -argc);
+}
+
+/* Compiles a top-level form to a procedure of no arguments */
+static SchemeValue compile_toplevel(SchemeValue x) {
+    Fn *fn = fn_new(NULL);
+    Closure *closure;
+    Proto *proto;
+
+    analyze(fn, x, 0);
+    compile(fn, x, 1);
+    emit_op(fn, OP_RETURN, -1);
+    proto = make_proto(fn, 0, 0, SCHEME_FALSE);
+    fn_free(fn);
+    closure = alloc(T_CLOSURE, sizeof(Closure));
+    closure->proto = proto;
+    return (SchemeValue)closure;
+}
+
+/* Arithmetic */
+
+static double real_value(const char *who, SchemeValue v) {
+    if (IS_FIXNUM(v)) return (double)FIXNUM(v);
+    if (TYPE(v) != T_FLONUM) value_error(who, "not a number", v);
+    return ((Flonum *)v)->value;
+}
+
+static long integer_value(const char *who, SchemeValue v) {
+    long n;
+    if (!scheme_get_integer(v, &n)) value_error(who, "not an integer", v);
+    return n;
+}
+
+static SchemeValue arith(int op, SchemeValue a, SchemeValue b) {
+    static const char *names[] = { "+", "-", "*" };
+    const char *who = names[op - OP_ADD];
+    double x, y;
+
+    if (IS_FIXNUM(a) && IS_FIXNUM(b)) {
+        long r;
+        switch (op) {
+        case OP_ADD: return scheme_integer(FIXNUM(a) + FIXNUM(b));
+        case OP_SUB: return scheme_integer(FIXNUM(a) - FIXNUM(b));
+        default:
+            if (!__builtin_mul_overflow(FIXNUM(a), FIXNUM(b), &r)) return scheme_integer(r);
+        }
+    }
+    x = real_value(who, a);
+    y = real_value(who, b);
+    switch (op) {
+    case OP_ADD: return make_real(x + y);
+    case OP_SUB: return make_real(x - y);
+    default: return make_real(x * y);
+    }
+}
+
+/* -1, 0 or 1, or 2 when either is NaN */
+static int compare(const char *who, SchemeValue a, SchemeValue b) {
+    double x, y;
+    if (IS_FIXNUM(a) && IS_FIXNUM(b))
+        return FIXNUM(a) < FIXNUM(b) ? -1 : FIXNUM(a) > FIXNUM(b);
+    x = real_value(who, a);
+    y = real_value(who, b);
+    if (x < y) return -1;
+    if (x > y) return 1;
+    return x == y ? 0 : 2;
+}
+
+static int compare_op(int op, SchemeValue a, SchemeValue b) {
+    static const char *names[] = { "<", ">", "<=", ">=", "=" };
+    int c = compare(names[op - OP_LT], a, b);
+    switch (op) {
+    case OP_LT: return c == -1;
+    case OP_GT: return c == 1;
+    case OP_LE: return c == -1 || c == 0;
+    case OP_GE: return c == 1 || c == 0;
+    default: return c == 0;
+    }
+}
+
+/* Virtual machine */
+
+static SchemeValue prim_apply;
+
+static void arity_error(SchemeValue f, int argc) {
+    char message[64];
+    snprintf(message, sizeof message, "wrong number of arguments (%d)", argc);
+    value_error("apply", message, f);
+}
+
+/* Calls the procedure below the argc arguments on top of the stack and
+ * pops them all; frames pushed by the call are popped by its return,
+ * which finds the sentinel frame with no closure */
+static SchemeValue run(int argc) {
+    SchemeValue *sp = vm.sp, *fp = NULL, *consts = NULL, f, a, b;
+    Closure *closure = NULL;
+    const int32_t *code = NULL, *pc = NULL;
+    int n = argc, tail = 0, k;
+
+    goto call;
+
+    for (;;) {
+        switch (*pc++) {
+        case OP_CONST:
+            *sp++ = consts[*pc++];
+            break;
+        case OP_LOCAL:
+            *sp++ = fp[*pc++];
+            break;
+        case OP_SETLOCAL:
+            fp[*pc++] = *--sp;
+            break;
+        case OP_LOCALBOX:
+            *sp++ = ((Box *)fp[*pc++])->value;
+            break;
+        case OP_SETLOCALBOX:
+            ((Box *)fp[*pc++])->value = *--sp;
+            break;
+        case OP_BOX:
+            fp[*pc] = make_box(fp[*pc]);
+            pc++;
+            break;
+        case OP_FREE:
+            *sp++ = closure->free[*pc++];
+            break;
+        case OP_FREEBOX:
+            *sp++ = ((Box *)closure->free[*pc++])->value;
+            break;
+        case OP_SETFREEBOX:
+            ((Box *)closure->free[*pc++])->value = *--sp;
+            break;
+        case OP_GLOBAL: {
+            Symbol *s = (Symbol *)consts[*pc++];
+            if (s->value == SCHEME_UNBOUND) vm_error("unbound variable: %s", s->name);
+            *sp++ = s->value;
+            break;
+        }
+        case OP_SETGLOBAL: {
+            Symbol *s = (Symbol *)consts[*pc++];
+            if (s->value == SCHEME_UNBOUND) vm_error("set!: unbound variable: %s", s->name);
+            s->value = *--sp;
+            break;
+        }
+        case OP_DEFINE: {
+            Symbol *s = (Symbol *)consts[*pc++];
+            s->value = sp[-1];
+            sp[-1] = SCHEME_UNSPECIFIED;
+            break;
+        }
+        case OP_POP:
+            sp--;
+            break;
+        case OP_JUMP:
+            pc = code + *pc;
+            if (vm.gc_wanted) {
+                vm.sp = sp;
+                collect();
+            }
+            break;
+        case OP_JUMPF:
+            if (*--sp == SCHEME_FALSE) pc = code + *pc;
+            else pc++;
+            break;
+        case OP_JUMPFK:
+            if (sp[-1] == SCHEME_FALSE) pc = code + *pc;
+            else {
+                sp--;
+                pc++;
+            }
+            break;
+        case OP_JUMPTK:
+            if (sp[-1] != SCHEME_FALSE) pc = code + *pc;
+            else {
+                sp--;
+                pc++;
+            }
+            break;
+        case OP_CLOSURE: {
+            Proto *proto = (Proto *)consts[*pc++];
+            Closure *c;
+            k = *pc++;
+            c = alloc(T_CLOSURE, sizeof(Closure) + k * sizeof(SchemeValue));
+            c->proto = proto;
+            c->h.length = k;
+            for (n = 0; n < k; n++, pc += 2)
+                c->free[n] = pc[0] ? fp[pc[1]] : closure->free[pc[1]];
+            *sp++ = (SchemeValue)c;
+            break;
+        }
+        case OP_CALL:
+            n = *pc++;
+            tail = 0;
+            goto call;
+        case OP_TAILCALL:
+            n = *pc++;
+            tail = 1;
+            goto call;
+        case OP_RETURN:
+            goto ret;
+
+        case OP_ADD:
+        case OP_SUB:
+            a = sp[-2];
+            b = sp[-1];
+            if (IS_FIXNUM(a) && IS_FIXNUM(b)) {
+                long r = pc[-1] == OP_ADD ? FIXNUM(a) + FIXNUM(b) : FIXNUM(a) - FIXNUM(b);
+                if (r >= FIXNUM_MIN && r <= FIXNUM_MAX) {
+                    sp--;
+                    sp[-1] = MAKE_FIXNUM(r);
+                    break;
+                }
+            }
+            sp[-2] = arith(pc[-1], a, b);
+            sp--;
+            break;
+        case OP_MUL:
+            sp[-2] = arith(OP_MUL, sp[-2], sp[-1]);
+            sp--;
+            break;
+        case OP_LT:
+        case OP_GT:
+        case OP_LE:
+        case OP_GE:
+        case OP_NUMEQ:
+            a = sp[-2];
+            b = sp[-1];
+            if (IS_FIXNUM(a) && IS_FIXNUM(b)) {
+                long x = FIXNUM(a), y = FIXNUM(b);
+                switch (pc[-1]) {
+                case OP_LT: k = x < y; break;
+                case OP_GT: k = x > y; break;
+                case OP_LE: k = x <= y; break;
+                case OP_GE: k = x >= y; break;
+                default: k = x == y;
+                }
+            } else {
+                k = compare_op(pc[-1], a, b);
+            }
+            sp[-2] = BOOLEAN(k);
+            sp--;
+            break;
+        case OP_CAR:
+            if (TYPE(sp[-1]) != T_PAIR) value_error("car", "not a pair", sp[-1]);
+            sp[-1] = CAR(sp[-1]);
+            break;
+        case OP_CDR:
+            if (TYPE(sp[-1]) != T_PAIR) value_error("cdr", "not a pair", sp[-1]);
+            sp[-1] = CDR(sp[-1]);
+            break;
+        case OP_CONS:
+            sp[-2] = make_pair(sp[-2], sp[-1]);
+            sp--;
+            break;
+        case OP_NULLP:
+            sp[-1] = BOOLEAN(sp[-1] == SCHEME_NIL);
+            break;
+        case OP_PAIRP:
+            sp[-1] = BOOLEAN(TYPE(sp[-1]) == T_PAIR);
+            break;
+        case OP_EQ:
+            sp[-2] = BOOLEAN(sp[-2] == sp[-1]);
+            sp--;
+            break;
+        case OP_NOT:
+            sp[-1] = BOOLEAN(sp[-1] == SCHEME_FALSE);
+            break;
+        case OP_ZEROP:
+            if (IS_FIXNUM(sp[-1])) sp[-1] = BOOLEAN(FIXNUM(sp[-1]) == 0);
+            else sp[-1] = BOOLEAN(real_value("zero?", sp[-1]) == 0.0);
+            break;
+        default:
+            vm_error("internal error: bad opcode %d", (int)pc[-1]);
+        }
+        continue;
+
+    call:
+        /* the callee is at sp[-n - 1]; a tail call replaces the frame */
+        f = sp[-n - 1];
+        if (TYPE(f) == T_CLOSURE) {
+            Proto *proto = ((Closure *)f)->proto;
+            if (tail) {
+                memmove(fp - 1, sp - n - 1, (n + 1) * sizeof(SchemeValue));
+                sp = fp + n;
+            } else {
+                Frame *frame;
+                if (vm.nframes == SCHEME_MAX_FRAMES) vm_error("recursion too deep");
+                frame = &vm.frames[vm.nframes++];
+                frame->closure = closure;
+                frame->pc = pc;
+                frame->fp = fp;
+                fp = sp - n;
+            }
+            closure = (Closure *)f;
+            if (n != proto->nparams || proto->rest) {
+                SchemeValue list = SCHEME_NIL;
+                if (n < proto->nparams || (n > proto->nparams && !proto->rest)) arity_error(f, n);
+                while (n > proto->nparams) list = make_pair(fp[--n], list);
+                fp[n] = list;
+                sp = fp + n + 1;
+            }
+            if (fp + proto->nlocals + proto->max_stack > vm.stack_end) vm_error("stack overflow");
+            while (sp < fp + proto->nlocals) *sp++ = SCHEME_UNSPECIFIED;
+            code = pc = proto->code;
+            consts = proto->consts;
+            if (vm.gc_wanted) {
+                vm.sp = sp;
+                collect();
+            }
+            continue;
+        }
+        if (TYPE(f) == T_PRIMITIVE) {
+            Primitive *prim = (Primitive *)f;
+            if (f == prim_apply) {
+                /* (apply f a ... list): spread the list over the stack */
+                SchemeValue list;
+                long len;
+                if (n < 2) arity_error(f, n);
+                list = sp[-1];
+                len = list_length(list);
+                if (len < 0) value_error("apply", "not a list", list);
+                if (sp + len > vm.stack_end) vm_error("stack overflow");
+                memmove(sp - n - 1, sp - n, (n - 1) * sizeof(SchemeValue));
+                sp -= 2;
+                for (; list != SCHEME_NIL; list = CDR(list)) *sp++ = CAR(list);
+                n = n - 2 + len;
+                goto call;
+            }
+            if (n < prim->min_args || (prim->max_args >= 0 && n > prim->max_args)) arity_error(f, n);
+            vm.sp = sp;
+            a = prim->fn(n, sp - n);
+            if (a == SCHEME_ERROR) raise_error();
+            sp -= n + 1;
+            if (!code) {
+                vm.sp = sp;
+                return a;
+            }
+            *sp++ = a;
+            if (tail) goto ret;
+            if (vm.gc_wanted) {
+                vm.sp = sp;
+                collect();
+            }
+            continue;
+        }
+        value_error("apply", "not a procedure", f);
+
+    ret:
+        a = *--sp;
+        sp = fp - 1;
+        {
+            Frame *frame = &vm.frames[--vm.nframes];
+            closure = frame->closure;
+            pc = frame->pc;
+            fp = frame->fp;
+        }
+        if (!closure) {
+            vm.sp = sp;
+            return a;
+        }
+        *sp++ = a;
+        code = closure->proto->code;
+        consts = closure->proto->consts;
+    }
+}
+
+/* Primitives */
+
+#define PRIMITIVE(name) static SchemeValue name(int argc, SchemeValue *argv)
+
+static void check_type(const char *who, SchemeValue v, int type) {
+    static const char *names[] = {
+        "", "", "a pair", "a number", "a string", "a symbol", "a vector",
+        "a procedure", "", "a procedure", ""
+    };
+    if (TYPE(v) != type) {
+        char message[32];
+        snprintf(message, sizeof message, "not %s", names[type]);
+        value_error(who, message, v);
+    }
+}
+
+static long index_value(const char *who, SchemeValue v, long limit) {
+    long i = integer_value(who, v);
+    if (i < 0 || i >= limit) value_error(who, "index out of range", v);
+    return i;
+}
+
+PRIMITIVE(p_add) {
+    SchemeValue acc = MAKE_FIXNUM(0);
+    int i;
+    for (i = 0; i < argc; i++) acc = arith(OP_ADD, acc, argv[i]);
+    return acc;
+}
+
+PRIMITIVE(p_mul) {
+    SchemeValue acc = MAKE_FIXNUM(1);
+    int i;
+    for (i = 0; i < argc; i++) acc = arith(OP_MUL, acc, argv[i]);
+    return acc;
+}
+
+PRIMITIVE(p_sub) {
+    SchemeValue acc = argv[0];
+    int i;
+    if (argc == 1) return arith(OP_SUB, MAKE_FIXNUM(0), argv[0]);
+    for (i = 1; i < argc; i++) acc = arith(OP_SUB, acc, argv[i]);
+    return acc;
+}
+
+PRIMITIVE(p_div) {
+    SchemeValue acc = argc == 1 ? MAKE_FIXNUM(1) : argv[0];
+    int i;
+    for (i = argc == 1 ? 0 : 1; i < argc; i++) {
+        SchemeValue d = argv[i];
+        if (IS_FIXNUM(acc) && IS_FIXNUM(d)) {
+            if (FIXNUM(d) == 0) vm_error("/: division by zero");
+            if (FIXNUM(acc) % FIXNUM(d) == 0) {
+                acc = scheme_integer(FIXNUM(acc) / FIXNUM(d));
+                continue;
+            }
+        }
+        acc = make_real(real_value("/", acc) / real_value("/", d));
+    }
+    return acc;
+}
+
+static SchemeValue compare_chain(int op, int argc, SchemeValue *argv) {
+    int i, result = 1;
+    for (i = 0; i + 1 < argc; i++)
+        if (!compare_op(op, argv[i], argv[i + 1])) result = 0;
+    if (argc == 1) compare_op(op, argv[0], argv[0]);
+    return BOOLEAN(result);
+}
+
+PRIMITIVE(p_numeq) { return compare_chain(OP_NUMEQ, argc, argv); }
+PRIMITIVE(p_lt) { return compare_chain(OP_LT, argc, argv); }
+PRIMITIVE(p_gt) { return compare_chain(OP_GT, argc, argv); }
+PRIMITIVE(p_le) { return compare_chain(OP_LE, argc, argv); }
+PRIMITIVE(p_ge) { return compare_chain(OP_GE, argc, argv); }
+
+static SchemeValue integer_division(const char *who, int kind, SchemeValue *argv) {
+    long a = integer_value(who, argv[0]), b = integer_value(who, argv[1]), r;
+    int inexact = !IS_FIXNUM(argv[0]) || !IS_FIXNUM(argv[1]);
+    if (b == 0) vm_error("%s: division by zero", who);
+    if (b == -1) r = kind == 0 ? -a : 0;
+    else if (kind == 0) r = a / b;
+    else {
+        r = a % b;
+        if (kind == 2 && r != 0 && (r < 0) != (b < 0)) r += b;
+    }
+    return inexact ? make_real((double)r) : scheme_integer(r);
+}
+
+PRIMITIVE(p_quotient) { (void)argc; return integer_division("quotient", 0, argv); }
+PRIMITIVE(p_remainder) { (void)argc; return integer_division("remainder", 1, argv); }
+PRIMITIVE(p_modulo) { (void)argc; return integer_division("modulo", 2, argv); }
+
+PRIMITIVE(p_abs) {
+    (void)argc;
+    if (IS_FIXNUM(argv[0])) return scheme_integer(labs(FIXNUM(argv[0])));
+    return make_real(fabs(real_value("abs", argv[0])));
+}
+
+static SchemeValue extremum(const char *who, int sign, int argc, SchemeValue *argv) {
+    SchemeValue best = argv[0];
+    int i, inexact = !IS_FIXNUM(argv[0]);
+    real_value(who, best);
+    for (i = 1; i < argc; i++) {
+        int c = compare(who, argv[i], best);
+        if (!IS_FIXNUM(argv[i])) inexact = 1;
+        if (c == sign || c == 2) best = argv[i];
+    }
+    return inexact && IS_FIXNUM(best) ? make_real((double)FIXNUM(best)) : best;
+}
+
+PRIMITIVE(p_min) { return extremum("min", -1, argc, argv); }
+PRIMITIVE(p_max) { return extremum("max", 1, argc, argv); }
+
+PRIMITIVE(p_numberp) { (void)argc; return BOOLEAN(IS_FIXNUM(argv[0]) || TYPE(argv[0]) == T_FLONUM); }
+
+PRIMITIVE(p_integerp) {
+    long n;
+    (void)argc;
+    return BOOLEAN(scheme_get_integer(argv[0], &n));
+}
+
+PRIMITIVE(p_exactp) {
+    (void)argc;
+    real_value("exact?", argv[0]);
+    return BOOLEAN(IS_FIXNUM(argv[0]));
+}
+
+PRIMITIVE(p_inexactp) {
+    (void)argc;
+    real_value("inexact?", argv[0]);
+    return BOOLEAN(!IS_FIXNUM(argv[0]));
+}
+
+PRIMITIVE(p_inexact) {
+    (void)argc;
+    return IS_FIXNUM(argv[0]) ? make_real((double)FIXNUM(argv[0])) : (real_value("inexact", argv[0]), argv[0]);
+}
+
+PRIMITIVE(p_exact) {
+    double d;
+    (void)argc;
+    if (IS_FIXNUM(argv[0])) return argv[0];
+    d = real_value("exact", argv[0]);
+    if (d != d || isinf(d)) value_error("exact", "no exact representation", argv[0]);
+    d = trunc(d);
+    if (d < -9.2e18 || d > 9.2e18) value_error("exact", "out of range", argv[0]);
+    return scheme_integer((long)d);
+}
+
+static SchemeValue rounding(const char *who, double (*fn)(double), SchemeValue v) {
+    if (IS_FIXNUM(v)) return v;
+    return make_real(fn(real_value(who, v)));
+}
+
+PRIMITIVE(p_floor) { (void)argc; return rounding("floor", floor, argv[0]); }
+PRIMITIVE(p_ceiling) { (void)argc; return rounding("ceiling", ceil, argv[0]); }
+PRIMITIVE(p_round) { (void)argc; return rounding("round", nearbyint, argv[0]); }
+PRIMITIVE(p_truncate) { (void)argc; return rounding("truncate", trunc, argv[0]); }
+
+PRIMITIVE(p_sqrt) {
+    double d = real_value("sqrt", argv[0]), r = sqrt(d);
+    (void)argc;
+    if (IS_FIXNUM(argv[0]) && d >= 0 && r == floor(r) && r * r == d) return scheme_integer((long)r);
+    return make_real(r);
+}
+
+PRIMITIVE(p_expt) {
+    (void)argc;
+    if (IS_FIXNUM(argv[0]) && IS_FIXNUM(argv[1]) && FIXNUM(argv[1]) >= 0) {
+        long base = FIXNUM(argv[0]), e = FIXNUM(argv[1]), r = 1;
+        int overflow = 0;
+        while (e > 0 && !overflow) {
+            if (e & 1) overflow |= __builtin_mul_overflow(r, base, &r);
+            e >>= 1;
+            if (e) overflow |= __builtin_mul_overflow(base, base, &base);
+        }
+        if (!overflow) return scheme_integer(r);
+    }
+    return make_real(pow(real_value("expt", argv[0]), real_value("expt", argv[1])));
+}
+
+PRIMITIVE(p_exp) { (void)argc; return make_real(exp(real_value("exp", argv[0]))); }
+PRIMITIVE(p_log) { (void)argc; return make_real(log(real_value("log", argv[0]))); }
+PRIMITIVE(p_sin) { (void)argc; return make_real(sin(real_value("sin", argv[0]))); }
+PRIMITIVE(p_cos) { (void)argc; return make_real(cos(real_value("cos", argv[0]))); }
+
+PRIMITIVE(p_atan) {
+    if (argc == 2) return make_real(atan2(real_value("atan", argv[0]), real_value("atan", argv[1])));
+    return make_real(atan(real_value("atan", argv[0])));
+}
+
+PRIMITIVE(p_evenp) { (void)argc; return BOOLEAN(integer_value("even?", argv[0]) % 2 == 0); }
+PRIMITIVE(p_oddp) { (void)argc; return BOOLEAN(integer_value("odd?", argv[0]) % 2 != 0); }
+PRIMITIVE(p_positivep) { (void)argc; return BOOLEAN(real_value("positive?", argv[0]) > 0); }
+PRIMITIVE(p_negativep) { (void)argc; return BOOLEAN(real_value("negative?", argv[0]) < 0); }
+PRIMITIVE(p_zerop) { (void)argc; return BOOLEAN(real_value("zero?", argv[0]) == 0); }
+
+PRIMITIVE(p_number_to_string) {
+    char *text;
+    SchemeValue s;
+    (void)argc;
+    real_value("number->string", argv[0]);
+    text = value_text(argv[0], 0);
+    s = scheme_string(text);
+    free(text);
+    return s;
+}
+
+PRIMITIVE(p_string_to_number) {
+    SchemeValue v;
+    (void)argc;
+    check_type("string->number", argv[0], T_STRING);
+    if (!parse_number(((String *)argv[0])->chars, HEADER(argv[0])->length, &v)) return SCHEME_FALSE;
+    return v;
+}
+
+/* Pairs and lists */
+
+PRIMITIVE(p_cons) { (void)argc; return make_pair(argv[0], argv[1]); }
+
+PRIMITIVE(p_car) {
+    (void)argc;
+    check_type("car", argv[0], T_PAIR);
+    return CAR(argv[0]);
+}
+
+PRIMITIVE(p_cdr) {
+    (void)argc;
+    check_type("cdr", argv[0], T_PAIR);
+    return CDR(argv[0]);
+}
+
+static SchemeValue cxr(const char *who, SchemeValue v, const char *path) {
+    const char *p = path + strlen(path);
+    while (p-- > path) {
+        check_type(who, v, T_PAIR);
+        v = *p == 'a' ? CAR(v) : CDR(v);
+    }
+    return v;
+}
+
+PRIMITIVE(p_caar) { (void)argc; return cxr("caar", argv[0], "aa"); }
+PRIMITIVE(p_cadr) { (void)argc; return cxr("cadr", argv[0], "ad"); }
+PRIMITIVE(p_cdar) { (void)argc; return cxr("cdar", argv[0], "da"); }
+PRIMITIVE(p_cddr) { (void)argc; return cxr("cddr", argv[0], "dd"); }
+PRIMITIVE(p_caddr) { (void)argc; return cxr("caddr", argv[0], "add"); }
+
+PRIMITIVE(p_set_car) {
+    (void)argc;
+    check_type("set-car!", argv[0], T_PAIR);
+    CAR(argv[0]) = argv[1];
+    return SCHEME_UNSPECIFIED;
+}
+
+PRIMITIVE(p_set_cdr) {
+    (void)argc;
+    check_type("set-cdr!", argv[0], T_PAIR);
+    CDR(argv[0]) = argv[1];
+    return SCHEME_UNSPECIFIED;
+}
+
+PRIMITIVE(p_list) {
+    SchemeValue list = SCHEME_NIL;
+    while (argc-- > 0) list = make_pair(argv[argc], list);
+    return list;
+}
+
+static long proper_length(const char *who, SchemeValue list) {
+    long n = list_length(list);
+    if (n < 0) value_error(who, "not a proper list", list);
+    return n;
+}
+
+PRIMITIVE(p_length) { (void)argc; return MAKE_FIXNUM(proper_length("length", argv[0])); }
+
+PRIMITIVE(p_listp) { (void)argc; return BOOLEAN(list_length(argv[0]) >= 0); }
+
+/* All lists but the last are copied */
+PRIMITIVE(p_append) {
+    SchemeValue head = SCHEME_NIL, tail = SCHEME_NIL, l;
+    int i;
+    if (argc == 0) return SCHEME_NIL;
+    for (i = 0; i < argc - 1; i++) {
+        proper_length("append", argv[i]);
+        for (l = argv[i]; l != SCHEME_NIL; l = CDR(l)) {
+            SchemeValue cell = make_pair(CAR(l), SCHEME_NIL);
+            if (head == SCHEME_NIL) head = cell;
+            else CDR(tail) = cell;
+            tail = cell;
+        }
+    }
+    if (head == SCHEME_NIL) return argv[argc - 1];
+    CDR(tail) = argv[argc - 1];
+    return head;
+}
+
+PRIMITIVE(p_reverse) {
+    SchemeValue result = SCHEME_NIL, l;
+    (void)argc;
+    proper_length("reverse", argv[0]);
+    for (l = argv[0]; l != SCHEME_NIL; l = CDR(l)) result = make_pair(CAR(l), result);
+    return result;
+}
+
+PRIMITIVE(p_list_tail) {
+    SchemeValue l = argv[0];
+    long k = integer_value("list-tail", argv[1]);
+    (void)argc;
+    while (k-- > 0) {
+        check_type("list-tail", l, T_PAIR);
+        l = CDR(l);
+    }
+    return l;
+}
+
+PRIMITIVE(p_list_ref) {
+    SchemeValue l = argv[0];
+    long k = integer_value("list-ref", argv[1]);
+    (void)argc;
+    for (;;) {
+        if (TYPE(l) != T_PAIR) value_error("list-ref", "index out of range", argv[1]);
+        if (k-- == 0) return CAR(l);
+        l = CDR(l);
+    }
+}
+
+static int eqv(SchemeValue a, SchemeValue b) {
+    if (a == b) return 1;
+    return TYPE(a) == T_FLONUM && TYPE(b) == T_FLONUM && ((Flonum *)a)->value == ((Flonum *)b)->value;
+}
+
+static int equal(SchemeValue a, SchemeValue b, int depth) {
+    uint32_t i;
+    for (;;) {
+        if (eqv(a, b)) return 1;
+        if (TYPE(a) != TYPE(b)) return 0;
+        if (depth > SCHEME_PRINT_DEPTH) vm_error("equal?: nesting too deep");
+        switch (TYPE(a)) {
+        case T_PAIR:
+            if (!equal(CAR(a), CAR(b), depth + 1)) return 0;
+            a = CDR(a);
+            b = CDR(b);
+            continue;
+        case T_STRING:
+            return HEADER(a)->length == HEADER(b)->length &&
+                memcmp(((String *)a)->chars, ((String *)b)->chars, HEADER(a)->length) == 0;
+        case T_VECTOR:
+            if (HEADER(a)->length != HEADER(b)->length) return 0;
+            for (i = 0; i < HEADER(a)->length; i++)
+                if (!equal(((Vector *)a)->items[i], ((Vector *)b)->items[i], depth + 1)) return 0;
+            return 1;
+        }
+        return 0;
+    }
+}
+
+PRIMITIVE(p_eq) { (void)argc; return BOOLEAN(argv[0] == argv[1]); }
+PRIMITIVE(p_eqv) { (void)argc; return BOOLEAN(eqv(argv[0], argv[1])); }
+PRIMITIVE(p_equal) { (void)argc; return BOOLEAN(equal(argv[0], argv[1], 0)); }
+
+static SchemeValue member(int kind, SchemeValue x, SchemeValue l) {
+    for (; TYPE(l) == T_PAIR; l = CDR(l))
+        if (kind == 0 ? CAR(l) == x : kind == 1 ? eqv(CAR(l), x) : equal(CAR(l), x, 0)) return l;
+    return SCHEME_FALSE;
+}
+
+PRIMITIVE(p_memq) { (void)argc; return member(0, argv[0], argv[1]); }
+PRIMITIVE(p_memv) { (void)argc; return member(1, argv[0], argv[1]); }
+PRIMITIVE(p_member) { (void)argc; return member(2, argv[0], argv[1]); }
+
+static SchemeValue assoc(int kind, SchemeValue x, SchemeValue l) {
+    for (; TYPE(l) == T_PAIR; l = CDR(l)) {
+        SchemeValue entry = CAR(l);
+        if (TYPE(entry) != T_PAIR) continue;
+        if (kind == 0 ? CAR(entry) == x : kind == 1 ? eqv(CAR(entry), x) : equal(CAR(entry), x, 0))
+            return entry;
+    }
+    return SCHEME_FALSE;
+}
+
+PRIMITIVE(p_assq) { (void)argc; return assoc(0, argv[0], argv[1]); }
+PRIMITIVE(p_assv) { (void)argc; return assoc(1, argv[0], argv[1]); }
+PRIMITIVE(p_assoc) { (void)argc; return assoc(2, argv[0], argv[1]); }
+
+/* Predicates */
+
+PRIMITIVE(p_not) { (void)argc; return BOOLEAN(argv[0] == SCHEME_FALSE); }
+PRIMITIVE(p_nullp) { (void)argc; return BOOLEAN(argv[0] == SCHEME_NIL); }
+PRIMITIVE(p_pairp) { (void)argc; return BOOLEAN(TYPE(argv[0]) == T_PAIR); }
+PRIMITIVE(p_symbolp) { (void)argc; return BOOLEAN(TYPE(argv[0]) == T_SYMBOL); }
+PRIMITIVE(p_stringp) { (void)argc; return BOOLEAN(TYPE(argv[0]) == T_STRING); }
+PRIMITIVE(p_vectorp) { (void)argc; return BOOLEAN(TYPE(argv[0]) == T_VECTOR); }
+PRIMITIVE(p_charp) { (void)argc; return BOOLEAN(IS_CHAR(argv[0])); }
+
+PRIMITIVE(p_booleanp) {
+    (void)argc;
+    return BOOLEAN(argv[0] == SCHEME_TRUE || argv[0] == SCHEME_FALSE);
+}
+
+PRIMITIVE(p_procedurep) {
+    (void)argc;
+    return BOOLEAN(TYPE(argv[0]) == T_CLOSURE || TYPE(argv[0]) == T_PRIMITIVE);
+}
+
+/* Strings, symbols and characters */
+
+#define STRING_LENGTH(v) ((long)HEADER(v)->length)
+
+static int char_value(const char *who, SchemeValue v) {
+    if (!IS_CHAR(v)) value_error(who, "not a character", v);
+    return CHAR(v);
+}
+
+PRIMITIVE(p_string_length) {
+    (void)argc;
+    check_type("string-length", argv[0], T_STRING);
+    return MAKE_FIXNUM(STRING_LENGTH(argv[0]));
+}
+
+PRIMITIVE(p_make_string) {
+    long n = integer_value("make-string", argv[0]);
+    SchemeValue s;
+    if (n < 0) value_error("make-string", "negative length", argv[0]);
+    s = make_string(NULL, n);
+    memset(((String *)s)->chars, argc > 1 ? char_value("make-string", argv[1]) : ' ', n);
+    return s;
+}
+
+PRIMITIVE(p_string_ref) {
+    (void)argc;
+    check_type("string-ref", argv[0], T_STRING);
+    return MAKE_CHAR(((String *)argv[0])->chars[index_value("string-ref", argv[1], STRING_LENGTH(argv[0]))]);
+}
+
+PRIMITIVE(p_string_set) {
+    (void)argc;
+    check_type("string-set!", argv[0], T_STRING);
+    ((String *)argv[0])->chars[index_value("string-set!", argv[1], STRING_LENGTH(argv[0]))] =
+        char_value("string-set!", argv[2]);
+    return SCHEME_UNSPECIFIED;
+}
+
+PRIMITIVE(p_string_fill) {
+    (void)argc;
+    check_type("string-fill!", argv[0], T_STRING);
+    memset(((String *)argv[0])->chars, char_value("string-fill!", argv[1]), STRING_LENGTH(argv[0]));
+    return SCHEME_UNSPECIFIED;
+}
+
+/* The characters from start (0 by default) to end (the length) */
+static SchemeValue string_slice(const char *who, int argc, SchemeValue *argv) {
+    long start, end;
+    check_type(who, argv[0], T_STRING);
+    end = argc > 2 ? integer_value(who, argv[2]) : STRING_LENGTH(argv[0]);
+    if (end < 0 || end > STRING_LENGTH(argv[0])) value_error(who, "index out of range", argv[2]);
+    start = argc > 1 ? integer_value(who, argv[1]) : 0;
+    if (start < 0 || start > end) value_error(who, "index out of range", argv[1]);
+    return make_string(((String *)argv[0])->chars + start, end - start);
+}
+
+PRIMITIVE(p_substring) { return string_slice("substring", argc, argv); }
+PRIMITIVE(p_string_copy) { return string_slice("string-copy", argc, argv); }
+
+PRIMITIVE(p_string_append) {
+    size_t len = 0;
+    SchemeValue s;
+    char *p;
+    int i;
+    for (i = 0; i < argc; i++) {
+        check_type("string-append", argv[i], T_STRING);
+        len += STRING_LENGTH(argv[i]);
+    }
+    s = make_string(NULL, len);
+    p = ((String *)s)->chars;
+    for (i = 0; i < argc; i++) {
+        memcpy(p, ((String *)argv[i])->chars, STRING_LENGTH(argv[i]));
+        p += STRING_LENGTH(argv[i]);
+    }
+    return s;
+}
+
+PRIMITIVE(p_string) {
+    SchemeValue s = make_string(NULL, argc);
+    int i;
+    for (i = 0; i < argc; i++) {
+        if (!IS_CHAR(argv[i])) value_error("string", "not a character", argv[i]);
+        ((String *)s)->chars[i] = CHAR(argv[i]);
+    }
+    return s;
+}
+
+static int string_compare(const char *who, SchemeValue a, SchemeValue b) {
+    long la, lb;
+    int c;
+    check_type(who, a, T_STRING);
+    check_type(who, b, T_STRING);
+    la = STRING_LENGTH(a);
+    lb = STRING_LENGTH(b);
+    c = memcmp(((String *)a)->chars, ((String *)b)->chars, la < lb ? la : lb);
+    return c ? c : (la > lb) - (la < lb);
+}
+
+PRIMITIVE(p_string_eq) { (void)argc; return BOOLEAN(string_compare("string=?", argv[0], argv[1]) == 0); }
+PRIMITIVE(p_string_lt) { (void)argc; return BOOLEAN(string_compare("string<?", argv[0], argv[1]) < 0); }
+PRIMITIVE(p_string_gt) { (void)argc; return BOOLEAN(string_compare("string>?", argv[0], argv[1]) > 0); }
+PRIMITIVE(p_string_le) { (void)argc; return BOOLEAN(string_compare("string<=?", argv[0], argv[1]) <= 0); }
+PRIMITIVE(p_string_ge) { (void)argc; return BOOLEAN(string_compare("string>=?", argv[0], argv[1]) >= 0); }
+
+static SchemeValue string_map(const char *who, int (*fn)(int), SchemeValue v) {
+    SchemeValue s;
+    long i;
+    check_type(who, v, T_STRING);
+    s = make_string(((String *)v)->chars, STRING_LENGTH(v));
+    for (i = 0; i < STRING_LENGTH(v); i++)
+        ((String *)s)->chars[i] = fn((unsigned char)((String *)s)->chars[i]);
+    return s;
+}
+
+PRIMITIVE(p_string_upcase) { (void)argc; return string_map("string-upcase", toupper, argv[0]); }
+PRIMITIVE(p_string_downcase) { (void)argc; return string_map("string-downcase", tolower, argv[0]); }
+
+PRIMITIVE(p_string_to_symbol) {
+    (void)argc;
+    check_type("string->symbol", argv[0], T_STRING);
+    return intern(((String *)argv[0])->chars, STRING_LENGTH(argv[0]));
+}
+
+PRIMITIVE(p_symbol_to_string) {
+    (void)argc;
+    check_type("symbol->string", argv[0], T_SYMBOL);
+    return make_string(((Symbol *)argv[0])->name, HEADER(argv[0])->length);
+}
+
+PRIMITIVE(p_string_to_list) {
+    SchemeValue list = SCHEME_NIL;
+    long i;
+    (void)argc;
+    check_type("string->list", argv[0], T_STRING);
+    for (i = STRING_LENGTH(argv[0]); i-- > 0;)
+        list = make_pair(MAKE_CHAR(((String *)argv[0])->chars[i]), list);
+    return list;
+}
+
+PRIMITIVE(p_list_to_string) {
+    SchemeValue s, l;
+    long i;
+    (void)argc;
+    s = make_string(NULL, proper_length("list->string", argv[0]));
+    for (i = 0, l = argv[0]; l != SCHEME_NIL; l = CDR(l), i++) {
+        if (!IS_CHAR(CAR(l))) value_error("list->string", "not a character", CAR(l));
+        ((String *)s)->chars[i] = CHAR(CAR(l));
+    }
+    return s;
+}
+
+PRIMITIVE(p_char_to_integer) { (void)argc; return MAKE_FIXNUM(char_value("char->integer", argv[0])); }
+
+PRIMITIVE(p_integer_to_char) {
+    (void)argc;
+    return MAKE_CHAR(index_value("integer->char", argv[0], 256));
+}
+
+PRIMITIVE(p_char_eq) {
+    (void)argc;
+    return BOOLEAN(char_value("char=?", argv[0]) == char_value("char=?", argv[1]));
+}
+
+PRIMITIVE(p_char_lt) {
+    (void)argc;
+    return BOOLEAN(char_value("char<?", argv[0]) < char_value("char<?", argv[1]));
+}
+
+PRIMITIVE(p_char_gt) {
+    (void)argc;
+    return BOOLEAN(char_value("char>?", argv[0]) > char_value("char>?", argv[1]));
+}
+
+PRIMITIVE(p_char_alphabetic) { (void)argc; return BOOLEAN(isalpha(char_value("char-alphabetic?", argv[0]))); }
+PRIMITIVE(p_char_numeric) { (void)argc; return BOOLEAN(isdigit(char_value("char-numeric?", argv[0]))); }
+PRIMITIVE(p_char_whitespace) { (void)argc; return BOOLEAN(isspace(char_value("char-whitespace?", argv[0]))); }
+PRIMITIVE(p_char_upcase) { (void)argc; return MAKE_CHAR(toupper(char_value("char-upcase", argv[0]))); }
+PRIMITIVE(p_char_downcase) { (void)argc; return MAKE_CHAR(tolower(char_value("char-downcase", argv[0]))); }
+
+/* Vectors */
+
+PRIMITIVE(p_make_vector) {
+    long n = integer_value("make-vector", argv[0]);
+    if (n < 0) value_error("make-vector", "negative length", argv[0]);
+    return make_vector(n, argc > 1 ? argv[1] : MAKE_FIXNUM(0));
+}
+
+PRIMITIVE(p_vector) {
+    SchemeValue v = make_vector(argc, SCHEME_UNSPECIFIED);
+    memcpy(((Vector *)v)->items, argv, argc * sizeof(SchemeValue));
+    return v;
+}
+
+PRIMITIVE(p_vector_length) {
+    (void)argc;
+    check_type("vector-length", argv[0], T_VECTOR);
+    return MAKE_FIXNUM(HEADER(argv[0])->length);
+}
+
+PRIMITIVE(p_vector_ref) {
+    (void)argc;
+    check_type("vector-ref", argv[0], T_VECTOR);
+    return ((Vector *)argv[0])->items[index_value("vector-ref", argv[1], HEADER(argv[0])->length)];
+}
+
+PRIMITIVE(p_vector_set) {
+    (void)argc;
+    check_type("vector-set!", argv[0], T_VECTOR);
+    ((Vector *)argv[0])->items[index_value("vector-set!", argv[1], HEADER(argv[0])->length)] = argv[2];
+    return SCHEME_UNSPECIFIED;
+}
+
+PRIMITIVE(p_vector_fill) {
+    uint32_t i;
+    (void)argc;
+    check_type("vector-fill!", argv[0], T_VECTOR);
+    for (i = 0; i < HEADER(argv[0])->length; i++) ((Vector *)argv[0])->items[i] = argv[1];
+    return SCHEME_UNSPECIFIED;
+}
+
+PRIMITIVE(p_vector_to_list) {
+    SchemeValue list = SCHEME_NIL;
+    uint32_t i;
+    (void)argc;
+    check_type("vector->list", argv[0], T_VECTOR);
+    for (i = HEADER(argv[0])->length; i-- > 0;) list = make_pair(((Vector *)argv[0])->items[i], list);
+    return list;
+}
+
+PRIMITIVE(p_list_to_vector) {
+    long i, n = proper_length("list->vector", argv[0]);
+    SchemeValue v = make_vector(n, SCHEME_UNSPECIFIED), l = argv[0];
+    (void)argc;
+    for (i = 0; i < n; i++, l = CDR(l)) ((Vector *)v)->items[i] = CAR(l);
+    return v;
+}
+
+/* Output and control */
+
+static void write_out(const char *s, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(1, s, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        s += n;
+        len -= n;
+    }
+}
+
+static SchemeValue print_to_output(SchemeValue v, int write) {
+    char *text = value_text(v, write);
+    write_out(text, strlen(text));
+    free(text);
+    return SCHEME_UNSPECIFIED;
+}
+
+PRIMITIVE(p_display) { (void)argc; return print_to_output(argv[0], 0); }
+PRIMITIVE(p_write) { (void)argc; return print_to_output(argv[0], 1); }
+
+PRIMITIVE(p_newline) {
+    (void)argc;
+    (void)argv;
+    write_out("\n", 1);
+    return SCHEME_UNSPECIFIED;
+}
+
+/* (error message irritant...) */
+PRIMITIVE(p_error) {
+    Buf b = { NULL, 0, 0, 0, 0 };
+    int i;
+    buf_add(&b, "", 0);
+    print_value(&b, argv[0], 0);
+    for (i = 1; i < argc; i++) {
+        buf_add(&b, " ", 1);
+        print_value(&b, argv[i], 1);
+    }
+    snprintf(vm.error, sizeof vm.error, "error: %s", b.s);
+    free(b.s);
+    return SCHEME_ERROR;
+}
+
+/* Stands in for the call; the VM spreads the arguments itself */
+PRIMITIVE(p_apply) {
+    (void)argc;
+    (void)argv;
+    return SCHEME_ERROR;
+}
+
+PRIMITIVE(p_gc) {
+    (void)argc;
+    (void)argv;
+    vm.gc_wanted = 1;
+    return SCHEME_UNSPECIFIED;
+}
+
+PRIMITIVE(p_runtime) {
+    struct timespec ts;
+    (void)argc;
+    (void)argv;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return make_real(ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static const struct {
+    const char *name;
+    SchemePrimitive fn;
+    int min_args, max_args;
+    int inline_op, inline_args;
+} primitives[] = {
+    { "+", p_add, 0, -1, OP_ADD, INLINE_FOLD },
+    { "-", p_sub, 1, -1, OP_SUB, INLINE_FOLD },
+    { "*", p_mul, 0, -1, OP_MUL, INLINE_FOLD },
+    { "/", p_div, 1, -1, 0, 0 },
+    { "=", p_numeq, 1, -1, OP_NUMEQ, INLINE_BINARY },
+    { "<", p_lt, 1, -1, OP_LT, INLINE_BINARY },
+    { ">", p_gt, 1, -1, OP_GT, INLINE_BINARY },
+    { "<=", p_le, 1, -1, OP_LE, INLINE_BINARY },
+    { ">=", p_ge, 1, -1, OP_GE, INLINE_BINARY },
+    { "quotient", p_quotient, 2, 2, 0, 0 },
+    { "remainder", p_remainder, 2, 2, 0, 0 },
+    { "modulo", p_modulo, 2, 2, 0, 0 },
+    { "abs", p_abs, 1, 1, 0, 0 },
+    { "min", p_min, 1, -1, 0, 0 },
+    { "max", p_max, 1, -1, 0, 0 },
+    { "number?", p_numberp, 1, 1, 0, 0 },
+    { "integer?", p_integerp, 1, 1, 0, 0 },
+    { "exact?", p_exactp, 1, 1, 0, 0 },
+    { "inexact?", p_inexactp, 1, 1, 0, 0 },
+    { "exact->inexact", p_inexact, 1, 1, 0, 0 },
+    { "inexact->exact", p_exact, 1, 1, 0, 0 },
+    { "inexact", p_inexact, 1, 1, 0, 0 },
+    { "exact", p_exact, 1, 1, 0, 0 },
+    { "floor", p_floor, 1, 1, 0, 0 },
+    { "ceiling", p_ceiling, 1, 1, 0, 0 },
+    { "round", p_round, 1, 1, 0, 0 },
+    { "truncate", p_truncate, 1, 1, 0, 0 },
+    { "sqrt", p_sqrt, 1, 1, 0, 0 },
+    { "expt", p_expt, 2, 2, 0, 0 },
+    { "exp", p_exp, 1, 1, 0, 0 },
+    { "log", p_log, 1, 1, 0, 0 },
+    { "sin", p_sin, 1, 1, 0, 0 },
+    { "cos", p_cos, 1, 1, 0, 0 },
+    { "atan", p_atan, 1, 2, 0, 0 },
+    { "even?", p_evenp, 1, 1, 0, 0 },
+    { "odd?", p_oddp, 1, 1, 0, 0 },
+    { "positive?", p_positivep, 1, 1, 0, 0 },
+    { "negative?", p_negativep, 1, 1, 0, 0 },
+    { "zero?", p_zerop, 1, 1, OP_ZEROP, INLINE_UNARY },
+    { "number->string", p_number_to_string, 1, 1, 0, 0 },
+    { "string->number", p_string_to_number, 1, 1, 0, 0 },
+    { "cons", p_cons, 2, 2, OP_CONS, INLINE_BINARY },
+    { "car", p_car, 1, 1, OP_CAR, INLINE_UNARY },
+    { "cdr", p_cdr, 1, 1, OP_CDR, INLINE_UNARY },
+    { "caar", p_caar, 1, 1, 0, 0 },
+    { "cadr", p_cadr, 1, 1, 0, 0 },
+    { "cdar", p_cdar, 1, 1, 0, 0 },
+    { "cddr", p_cddr, 1, 1, 0, 0 },
+    { "caddr", p_caddr, 1, 1, 0, 0 },
+    { "set-car!", p_set_car, 2, 2, 0, 0 },
+    { "set-cdr!", p_set_cdr, 2, 2, 0, 0 },
+    { "list", p_list, 0, -1, 0, 0 },
+    { "length", p_length, 1, 1, 0, 0 },
+    { "list?", p_listp, 1, 1, 0, 0 },
+    { "append", p_append, 0, -1, 0, 0 },
+    { "reverse", p_reverse, 1, 1, 0, 0 },
+    { "list-tail", p_list_tail, 2, 2, 0, 0 },
+    { "list-ref", p_list_ref, 2, 2, 0, 0 },
+    { "memq", p_memq, 2, 2, 0, 0 },
+    { "memv", p_memv, 2, 2, 0, 0 },
+    { "member", p_member, 2, 2, 0, 0 },
+    { "assq", p_assq, 2, 2, 0, 0 },
+    { "assv", p_assv, 2, 2, 0, 0 },
+    { "assoc", p_assoc, 2, 2, 0, 0 },
+    { "eq?", p_eq, 2, 2, OP_EQ, INLINE_BINARY },
+    { "eqv?", p_eqv, 2, 2, 0, 0 },
+    { "equal?", p_equal, 2, 2, 0, 0 },
+    { "not", p_not, 1, 1, OP_NOT, INLINE_UNARY },
+    { "null?", p_nullp, 1, 1, OP_NULLP, INLINE_UNARY },
+    { "pair?", p_pairp, 1, 1, OP_PAIRP, INLINE_UNARY },
+    { "symbol?", p_symbolp, 1, 1, 0, 0 },
+    { "string?", p_stringp, 1, 1, 0, 0 },
+    { "vector?", p_vectorp, 1, 1, 0, 0 },
+    { "char?", p_charp, 1, 1, 0, 0 },
+    { "boolean?", p_booleanp, 1, 1, 0, 0 },
+    { "procedure?", p_procedurep, 1, 1, 0, 0 },
+    { "string-length", p_string_length, 1, 1, 0, 0 },
+    { "make-string", p_make_string, 1, 2, 0, 0 },
+    { "string-ref", p_string_ref, 2, 2, 0, 0 },
+    { "string-set!", p_string_set, 3, 3, 0, 0 },
+    { "string-fill!", p_string_fill, 2, 2, 0, 0 },
+    { "substring", p_substring, 2, 3, 0, 0 },
+    { "string-copy", p_string_copy, 1, 3, 0, 0 },
+    { "string-append", p_string_append, 0, -1, 0, 0 },
+    { "string", p_string, 0, -1, 0, 0 },
+    { "string=?", p_string_eq, 2, 2, 0, 0 },
+    { "string<?", p_string_lt, 2, 2, 0, 0 },
+    { "string>?", p_string_gt, 2, 2, 0, 0 },
+    { "string<=?", p_string_le, 2, 2, 0, 0 },
+    { "string>=?", p_string_ge, 2, 2, 0, 0 },
+    { "string-upcase", p_string_upcase, 1, 1, 0, 0 },
+    { "string-downcase", p_string_downcase, 1, 1, 0, 0 },
+    { "string->symbol", p_string_to_symbol, 1, 1, 0, 0 },
+    { "symbol->string", p_symbol_to_string, 1, 1, 0, 0 },
+    { "string->list", p_string_to_list, 1, 1, 0, 0 },
+    { "list->string", p_list_to_string, 1, 1, 0, 0 },
+    { "char->integer", p_char_to_integer, 1, 1, 0, 0 },
+    { "integer->char", p_integer_to_char, 1, 1, 0, 0 },
+    { "char=?", p_char_eq, 2, 2, 0, 0 },
+    { "char<?", p_char_lt, 2, 2, 0, 0 },
+    { "char>?", p_char_gt, 2, 2, 0, 0 },
+    { "char-alphabetic?", p_char_alphabetic, 1, 1, 0, 0 },
+    { "char-numeric?", p_char_numeric, 1, 1, 0, 0 },
+    { "char-whitespace?", p_char_whitespace, 1, 1, 0, 0 },
+    { "char-upcase", p_char_upcase, 1, 1, 0, 0 },
+    { "char-downcase", p_char_downcase, 1, 1, 0, 0 },
+    { "make-vector", p_make_vector, 1, 2, 0, 0 },
+    { "vector", p_vector, 0, -1, 0, 0 },
+    { "vector-length", p_vector_length, 1, 1, 0, 0 },
+    { "vector-ref", p_vector_ref, 2, 2, 0, 0 },
+    { "vector-set!", p_vector_set, 3, 3, 0, 0 },
+    { "vector-fill!", p_vector_fill, 2, 2, 0, 0 },
+    { "vector->list", p_vector_to_list, 1, 1, 0, 0 },
+    { "list->vector", p_list_to_vector, 1, 1, 0, 0 },
+    { "display", p_display, 1, 1, 0, 0 },
+    { "write", p_write, 1, 1, 0, 0 },
+    { "newline", p_newline, 0, 0, 0, 0 },
+    { "error", p_error, 1, -1, 0, 0 },
+    { "apply", p_apply, 2, -1, 0, 0 },
+    { "gc", p_gc, 0, 0, 0, 0 },
+    { "runtime", p_runtime, 0, 0, 0, 0 },
+    { NULL, NULL, 0, 0, 0, 0 }
+};
+
+/* Library procedures written in Scheme */
+static const char prelude[] =
+    "(define (%any-null? ls)"
+    "  (and (pair? ls) (or (not (pair? (car ls))) (%any-null? (cdr ls)))))"
+    "(define (map f l . ls)"
+    "  (if (null? ls)"
+    "      (let loop ((l l) (acc '()))"
+    "        (if (pair? l) (loop (cdr l) (cons (f (car l)) acc)) (reverse acc)))"
+    "      (let loop ((ls (cons l ls)) (acc '()))"
+    "        (if (%any-null? ls) (reverse acc)"
+    "            (loop (map cdr ls) (cons (apply f (map car ls)) acc))))))"
+    "(define (for-each f l . ls)"
+    "  (if (null? ls)"
+    "      (let loop ((l l)) (when (pair? l) (f (car l)) (loop (cdr l))))"
+    "      (let loop ((ls (cons l ls)))"
+    "        (unless (%any-null? ls) (apply f (map car ls)) (loop (map cdr ls))))))"
+    "(define (filter keep? l)"
+    "  (let loop ((l l) (acc '()))"
+    "    (cond ((null? l) (reverse acc))"
+    "          ((keep? (car l)) (loop (cdr l) (cons (car l) acc)))"
+    "          (else (loop (cdr l) acc)))))"
+    "(define (fold-left f acc l)"
+    "  (if (pair? l) (fold-left f (f acc (car l)) (cdr l)) acc))"
+    "(define (fold-right f acc l)"
+    "  (let loop ((l (reverse l)) (acc acc))"
+    "    (if (pair? l) (loop (cdr l) (f (car l) acc)) acc)))"
+    "(define (reduce f init l)"
+    "  (if (pair? l) (fold-left (lambda (acc x) (f x acc)) (car l) (cdr l)) init))"
+    "(define (iota n . start)"
+    "  (let ((s (if (pair? start) (car start) 0)))"
+    "    (let loop ((i (- n 1)) (acc '()))"
+    "      (if (< i 0) acc (loop (- i 1) (cons (+ i s) acc))))))"
+    "(define (list-copy l) (fold-right cons '() l))"
+    "(define (vector-map f v) (list->vector (map f (vector->list v))))"
+    "(define (vector-for-each f v) (for-each f (vector->list v)))"
+    "(define (string-for-each f s) (for-each f (string->list s)))"
+    "(define (sort l less?)"
+    "  (define (merge a b acc)"
+    "    (cond ((null? a) (append (reverse acc) b))"
+    "          ((null? b) (append (reverse acc) a))"
+    "          ((less? (car b) (car a)) (merge a (cdr b) (cons (car b) acc)))"
+    "          (else (merge (cdr a) b (cons (car a) acc)))))"
+    "  (define (msort l n)"
+    "    (if (< n 2)"
+    "        (if (= n 1) (list (car l)) '())"
+    "        (let ((h (quotient n 2)))"
+    "          (merge (msort l h) (msort (list-tail l h) (- n h)) '()))))"
+    "  (msort l (length l)))";
+
+/* Entry points */
+
+/* Primitives are never freed before cleanup: compiled code may still
+ * refer to one whose name has been redefined */
+static SchemeValue define_primitive(const char *name, SchemePrimitive fn, int min_args, int max_args) {
+    Symbol *symbol = (Symbol *)scheme_symbol(name);
+    Primitive *prim;
+
+    if (TYPE(symbol->value) == T_PRIMITIVE) {
+        prim = (Primitive *)symbol->value;
+    } else {
+        if (vm.nprimitives == vm.primitive_cap) {
+            vm.primitive_cap = vm.primitive_cap ? vm.primitive_cap * 2 : 256;
+            vm.primitives = vm_realloc(vm.primitives, vm.primitive_cap * sizeof(Primitive *));
+        }
+        prim = vm_malloc(sizeof(Primitive));
+        vm.primitives[vm.nprimitives++] = prim;
+        prim->h.type = T_PRIMITIVE;
+        prim->h.mark = 0;
+        prim->h.flags = PERMANENT;
+        prim->h.size_class = LARGE_CLASS;
+        prim->h.length = 0;
+        prim->name = (SchemeValue)symbol;
+    }
+    prim->fn = fn;
+    prim->min_args = min_args;
+    prim->max_args = max_args;
+    prim->inline_op = 0;
+    prim->inline_args = 0;
+    symbol->value = (SchemeValue)prim;
+    return (SchemeValue)prim;
+}
+
+static void free_symbols(void) {
+    size_t i;
+    if (!vm.symbols) return;
+    for (i = 0; i < SCHEME_SYMBOL_BUCKETS; i++)
+        while (vm.symbols[i]) {
+            Symbol *s = vm.symbols[i];
+            vm.symbols[i] = s->next;
+            free(s);
+        }
+    free(vm.symbols);
+}
+
+void scheme_vm_cleanup(void) {
+    Block *block;
+    Large *large;
+    size_t i;
+
+    while ((block = vm.blocks) != NULL) {
+        uint32_t j;
+        for (j = 0; j < block->count; j++) {
+            Header *h = (Header *)(block->data + (size_t)j * block->size);
+            if (h->type != T_FREE) finalize(h);
+        }
+        vm.blocks = block->next;
+        free(block);
+    }
+    while ((large = vm.large) != NULL) {
+        finalize((Header *)(large + 1));
+        vm.large = large->next;
+        free(large);
+    }
+    for (i = 0; i < vm.nprimitives; i++) free(vm.primitives[i]);
+    free(vm.primitives);
+    free_symbols();
+    free(vm.stack);
+    free(vm.frames);
+    free(vm.marks);
+    memset(&vm, 0, sizeof vm);
+}
+
+int scheme_vm_init(void) {
+    jmp_buf escape;
+    char *output = NULL;
+    int i;
+
+    if (vm.ready) return 0;
+    vm.stack = malloc(SCHEME_STACK_SIZE * sizeof(SchemeValue));
+    vm.frames = malloc(SCHEME_MAX_FRAMES * sizeof(Frame));
+    vm.symbols = calloc(SCHEME_SYMBOL_BUCKETS, sizeof(Symbol *));
+    if (!vm.stack || !vm.frames || !vm.symbols) {
+        scheme_vm_cleanup();
+        return -1;
+    }
+    vm.sp = vm.stack;
+    vm.stack_end = vm.stack + SCHEME_STACK_SIZE;
+    vm.threshold = SCHEME_GC_MIN_BYTES;
+
+    vm.escape = &escape;
+    if (setjmp(escape)) {
+        scheme_vm_cleanup();
+        return -1;
+    }
+    for (i = 0; i < SPECIALS; i++) specials[i] = scheme_symbol(special_names[i]);
+    for (i = 0; primitives[i].name; i++) {
+        Primitive *prim = (Primitive *)define_primitive(primitives[i].name, primitives[i].fn,
+                                                        primitives[i].min_args, primitives[i].max_args);
+        prim->inline_op = primitives[i].inline_op;
+        prim->inline_args = primitives[i].inline_args;
+    }
+    prim_cons = ((Symbol *)scheme_symbol("cons"))->value;
+    prim_list = ((Symbol *)scheme_symbol("list"))->value;
+    prim_append = ((Symbol *)scheme_symbol("append"))->value;
+    prim_list_to_vector = ((Symbol *)scheme_symbol("list->vector"))->value;
+    prim_memv = ((Symbol *)scheme_symbol("memv"))->value;
+    prim_apply = ((Symbol *)scheme_symbol("apply"))->value;
+    vm.escape = NULL;
+    vm.ready = 1;
+
+    if (scheme_vm_eval(prelude, &output) < 0) {
+        fprintf(stderr, "scheme: prelude: %s\n", output ? output : "out of memory");
+        free(output);
+        scheme_vm_cleanup();
+        return -1;
+    }
+    free(output);
+    return 0;
+}
+
+int scheme_vm_define(const char *name, SchemePrimitive fn, int min_args, int max_args) {
+    jmp_buf escape;
+
+    if (!vm.ready || vm.escape) return -1;
+    vm.escape = &escape;
+    if (setjmp(escape)) {
+        vm.escape = NULL;
+        return -1;
+    }
+    define_primitive(name, fn, min_args, max_args);
+    vm.escape = NULL;
+    return 0;
+}
+
+static char *error_text(void) {
+    char *text = malloc(strlen(vm.error) + 1);
+    if (text) strcpy(text, vm.error);
+    return text;
+}
+
+/* Drops everything an error interrupted */
+static void unwind(void) {
+    while (vm.compiling) fn_free(vm.compiling);
+    vm.sp = vm.stack;
+    vm.nframes = 0;
+    vm.escape = NULL;
+}
+
+int scheme_vm_eval(const char *text, char **output) {
+    jmp_buf escape;
+    Reader reader;
+    SchemeValue datum, result = SCHEME_UNSPECIFIED;
+
+    *output = NULL;
+    if (!vm.ready || vm.escape) {
+        snprintf(vm.error, sizeof vm.error, vm.ready ? "scheme: already evaluating" : "scheme: not initialized");
+        *output = error_text();
+        return -1;
+    }
+    reader.p = text;
+    reader.depth = 0;
+    vm.escape = &escape;
+    if (setjmp(escape)) {
+        unwind();
+        *output = error_text();
+        return -1;
+    }
+    while (read_next(&reader, &datum)) {
+        vm.sp = vm.stack;
+        *vm.sp++ = compile_toplevel(datum);
+        result = run(0);
+    }
+    *output = value_text(result, 1);
+    vm.escape = NULL;
+    return 0;
+}
+
+int scheme_vm_call(const char *name, char **args, char **output) {
+    jmp_buf escape;
+    Symbol *symbol;
+    SchemeValue result;
+    int n = 0;
+
+    *output = NULL;
+    if (!vm.ready || vm.escape) {
+        snprintf(vm.error, sizeof vm.error, vm.ready ? "scheme: already evaluating" : "scheme: not initialized");
+        *output = error_text();
+        return -1;
+    }
+    vm.escape = &escape;
+    if (setjmp(escape)) {
+        unwind();
+        *output = error_text();
+        return -1;
+    }
+    symbol = (Symbol *)scheme_symbol(name);
+    if (symbol->value == SCHEME_UNBOUND) vm_error("unbound variable: %s", name);
+    vm.sp = vm.stack;
+    *vm.sp++ = symbol->value;
+    for (; args && args[n]; n++) {
+        if (vm.sp == vm.stack_end) vm_error("%s: too many arguments", name);
+        *vm.sp++ = scheme_string(args[n]);
+    }
+    result = run(n);
+    *output = value_text(result, 1);
+    vm.escape = NULL;
+    return 0;
+}
+
+void scheme_vm_stats(SchemeStats *stats) {
+    stats->heap_bytes = vm.heap_bytes;
+    stats->allocated = vm.allocated;
+    stats->collections = vm.collections;
+    stats->symbols = vm.nsymbols;
+    stats->gc_seconds = vm.gc_seconds;
+}
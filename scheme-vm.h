@@ -0,0 +1,69 @@
+/* Scheme VM Header
+ * Embedded Scheme: reader, bytecode compiler, stack VM and collector
+ */
+
+#ifndef SCHEME_VM_H
+#define SCHEME_VM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Values are tagged words: fixnums have the low bit set, heap objects
+ * are 8-byte aligned pointers, and the constants below are immediates */
+typedef uintptr_t SchemeValue;
+
+#define SCHEME_NIL ((SchemeValue)0x02)
+#define SCHEME_FALSE ((SchemeValue)0x0A)
+#define SCHEME_TRUE ((SchemeValue)0x12)
+#define SCHEME_UNSPECIFIED ((SchemeValue)0x1A)
+#define SCHEME_EOF ((SchemeValue)0x22)
+#define SCHEME_ERROR ((SchemeValue)0x32)    /* returned by a failing primitive */
+
+#define SCHEME_STACK_SIZE (256 * 1024)      /* value stack, in words */
+#define SCHEME_MAX_FRAMES (64 * 1024)       /* call depth for non-tail calls */
+#define SCHEME_GC_MIN_BYTES (4 << 20)       /* allocation between collections */
+
+/* Primitives receive their arguments on the VM stack.  They must not
+ * keep values past their return: the collector only runs between
+ * instructions and only sees what the VM can reach. */
+typedef SchemeValue (*SchemePrimitive)(int argc, SchemeValue *argv);
+
+typedef struct {
+    size_t heap_bytes;          /* in use after the last collection */
+    size_t allocated;           /* since the last collection */
+    size_t collections;
+    size_t symbols;
+    double gc_seconds;
+} SchemeStats;
+
+extern int scheme_vm_init(void);
+extern void scheme_vm_cleanup(void);
+
+/* Evaluates every expression in text.  Returns 0 with the last value
+ * written to *output, or -1 with an error message in *output; either
+ * way *output is malloc'd. */
+extern int scheme_vm_eval(const char *text, char **output);
+
+/* Applies the global procedure name to string arguments */
+extern int scheme_vm_call(const char *name, char **args, char **output);
+
+extern int scheme_vm_define(const char *name, SchemePrimitive fn, int min_args, int max_args);
+extern void scheme_vm_stats(SchemeStats *stats);
+
+/* For primitives.  scheme_fail records the message and returns
+ * SCHEME_ERROR, which the primitive returns in turn.  Called outside an
+ * evaluation, the constructors return SCHEME_ERROR when out of memory. */
+extern SchemeValue scheme_fail(const char *who, const char *message);
+extern SchemeValue scheme_integer(long n);
+extern SchemeValue scheme_real(double d);
+extern SchemeValue scheme_string(const char *s);
+extern SchemeValue scheme_symbol(const char *name);
+extern SchemeValue scheme_cons(SchemeValue car, SchemeValue cdr);
+extern int scheme_is_pair(SchemeValue v);
+extern SchemeValue scheme_car(SchemeValue v);
+extern SchemeValue scheme_cdr(SchemeValue v);
+extern int scheme_get_integer(SchemeValue v, long *n);
+extern int scheme_get_real(SchemeValue v, double *d);
+extern const char *scheme_get_string(SchemeValue v);   /* strings and symbols */
+
+#endif /* SCHEME_VM_H */
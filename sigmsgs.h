@@ -0,0 +1,5 @@
+typedef struct {
+	char *name, *msg;
+} Sigmsgs;
+extern Sigmsgs signals[];
+#define NUMOFSIGNALS 65
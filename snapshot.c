@@ -0,0 +1,476 @@
+/* Membrane Snapshot Implementation
+ * A snapshot is an array of reference-counted pages of
+ * MEMBRANE_PAGE_ELEMENTS elements.  For each membrane that has been
+ * snapshotted we keep a tip, the pages of its latest snapshot, and ask
+ * the membrane to track which pages it writes from then on.  The next
+ * snapshot copies only those pages and shares the rest with the tip, so
+ * checkpointing costs in proportion to what changed.
+ *
+ * Diffs compare page pointers first: pages shared between two states
+ * are skipped without reading them.
+ */
+
+#include "snapshot.h"
+#include "tensor-membrane.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+typedef struct {
+    int refs;
+    float data[MEMBRANE_PAGE_ELEMENTS];
+} SnapshotPage;
+
+typedef struct {
+    uint32_t id;
+    uint32_t membrane_id;
+    uint64_t version;
+    size_t element_count;
+    size_t page_count;
+    SnapshotPage **pages;
+} Snapshot;
+
+/* Latest pages of a tracked membrane; its dirty bits are relative to them */
+typedef struct {
+    uint32_t membrane_id;
+    size_t element_count;
+    size_t page_count;
+    SnapshotPage **pages;
+} SnapshotTip;
+
+static Snapshot *snapshots = NULL;     /* sorted by id */
+static uint32_t snapshot_count = 0;
+static uint32_t snapshot_capacity = 0;
+static uint32_t next_snapshot_id = 1;
+
+static SnapshotTip *tips = NULL;
+static uint32_t tip_count = 0;
+static uint32_t tip_capacity = 0;
+
+static size_t page_count_for(size_t elements) {
+    return (elements + MEMBRANE_PAGE_ELEMENTS - 1) / MEMBRANE_PAGE_ELEMENTS;
+}
+
+/* Elements actually used on page p */
+static size_t page_length(size_t elements, size_t p) {
+    size_t rest = elements - p * MEMBRANE_PAGE_ELEMENTS;
+    return rest < MEMBRANE_PAGE_ELEMENTS ? rest : MEMBRANE_PAGE_ELEMENTS;
+}
+
+static void page_release(SnapshotPage *page) {
+    if (page && --page->refs == 0) free(page);
+}
+
+static void pages_release(SnapshotPage **pages, size_t count) {
+    if (!pages) return;
+    for (size_t i = 0; i < count; i++) page_release(pages[i]);
+    free(pages);
+}
+
+static Snapshot *snapshot_find(uint32_t id) {
+    uint32_t lo = 0, hi = snapshot_count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (snapshots[mid].id < id) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < snapshot_count && snapshots[lo].id == id ? &snapshots[lo] : NULL;
+}
+
+static SnapshotTip *tip_find(uint32_t membrane_id) {
+    for (uint32_t i = 0; i < tip_count; i++) {
+        if (tips[i].membrane_id == membrane_id) return &tips[i];
+    }
+    return NULL;
+}
+
+static void tip_drop(SnapshotTip *tip) {
+    pages_release(tip->pages, tip->page_count);
+    *tip = tips[--tip_count];
+}
+
+/* Start tracking a membrane from scratch: no pages, every page dirty */
+static SnapshotTip *tip_start(TensorMembraneImpl *membrane) {
+    uint32_t id = membrane_get_id(membrane);
+    size_t elements = membrane_element_count(membrane);
+    SnapshotTip *tip = tip_find(id);
+    
+    if (!tip) {
+        if (tip_count == tip_capacity) {
+            uint32_t capacity = tip_capacity ? tip_capacity * 2 : 8;
+            SnapshotTip *grown = realloc(tips, capacity * sizeof(SnapshotTip));
+            if (!grown) return NULL;
+            tips = grown;
+            tip_capacity = capacity;
+        }
+        tip = &tips[tip_count++];
+        tip->membrane_id = id;
+        tip->pages = NULL;
+        tip->page_count = 0;
+    }
+    
+    pages_release(tip->pages, tip->page_count);
+    tip->element_count = elements;
+    tip->page_count = page_count_for(elements);
+    tip->pages = calloc(tip->page_count ? tip->page_count : 1, sizeof(SnapshotPage*));
+    if (!tip->pages || membrane_track_writes(membrane) != 0) {
+        tip->page_count = 0;
+        tip_drop(tip);
+        return NULL;
+    }
+    return tip;
+}
+
+static bool page_dirty(const uint64_t *dirty, size_t p) {
+    return !dirty || (dirty[p / 64] >> (p % 64)) & 1;
+}
+
+/* Snapshots */
+
+uint32_t snapshot_take(uint32_t membrane_id, size_t *pages_copied) {
+    TensorMembraneImpl *membrane = find_membrane_by_id(membrane_id);
+    if (!membrane) return 0;
+    
+    size_t copied = 0;
+    size_t elements = membrane_element_count(membrane);
+    SnapshotTip *tip = tip_find(membrane_id);
+    if (!tip || tip->element_count != elements) tip = tip_start(membrane);
+    if (!tip) return 0;
+    
+    /* Bring the tip up to date, copying dirty pages only.  A mapped
+     * membrane can change behind our back, so every page is compared. */
+    const uint64_t *dirty = membrane_dirty_pages(membrane, NULL);
+    bool mapped = membrane_is_mapped(membrane);
+    for (size_t p = 0; p < tip->page_count; p++) {
+        if (tip->pages[p] && !mapped && !page_dirty(dirty, p)) continue;
+    
+        size_t length = page_length(elements, p);
+        SnapshotPage *page = malloc(sizeof(SnapshotPage));
+        if (!page) return 0;
+        page->refs = 1;
+        memset(page->data + length, 0, (MEMBRANE_PAGE_ELEMENTS - length) * sizeof(float));
+        membrane_get_range(membrane, p * MEMBRANE_PAGE_ELEMENTS, page->data, length);
+    
+        if (tip->pages[p] && memcmp(tip->pages[p]->data, page->data, length * sizeof(float)) == 0) {
+            free(page);
+            continue;
+        }
+        page_release(tip->pages[p]);
+        tip->pages[p] = page;
+        copied++;
+    }
+    membrane_clear_dirty(membrane);
+    
+    if (snapshot_count == snapshot_capacity) {
+        uint32_t capacity = snapshot_capacity ? snapshot_capacity * 2 : 16;
+        Snapshot *grown = realloc(snapshots, capacity * sizeof(Snapshot));
+        if (!grown) return 0;
+        snapshots = grown;
+        snapshot_capacity = capacity;
+    }
+    
+    SnapshotPage **pages = malloc((tip->page_count ? tip->page_count : 1) * sizeof(SnapshotPage*));
+    if (!pages) return 0;
+    for (size_t p = 0; p < tip->page_count; p++) {
+        pages[p] = tip->pages[p];
+        pages[p]->refs++;
+    }
+    
+    Snapshot *snapshot = &snapshots[snapshot_count++];
+    snapshot->id = next_snapshot_id++;
+    snapshot->membrane_id = membrane_id;
+    snapshot->version = membrane_version(membrane);
+    snapshot->element_count = elements;
+    snapshot->page_count = tip->page_count;
+    snapshot->pages = pages;
+    
+    if (pages_copied) *pages_copied = copied;
+    return snapshot->id;
+}
+
+int snapshot_info(uint32_t id, SnapshotInfo *info) {
+    Snapshot *snapshot = snapshot_find(id);
+    if (!snapshot || !info) return -1;
+    
+    info->id = snapshot->id;
+    info->membrane_id = snapshot->membrane_id;
+    info->version = snapshot->version;
+    info->element_count = snapshot->element_count;
+    return 0;
+}
+
+/* Id of the first snapshot after the given one, 0 when there is none */
+uint32_t snapshot_next(uint32_t after) {
+    for (uint32_t i = 0; i < snapshot_count; i++) {
+        if (snapshots[i].id > after) return snapshots[i].id;
+    }
+    return 0;
+}
+
+int snapshot_delete(uint32_t id) {
+    Snapshot *snapshot = snapshot_find(id);
+    if (!snapshot) return -1;
+    
+    uint32_t membrane_id = snapshot->membrane_id;
+    pages_release(snapshot->pages, snapshot->page_count);
+    uint32_t index = (uint32_t)(snapshot - snapshots);
+    memmove(&snapshots[index], &snapshots[index + 1],
+            (snapshot_count - index - 1) * sizeof(Snapshot));
+    snapshot_count--;
+    
+    /* The last snapshot of a membrane takes its tip along */
+    for (uint32_t i = 0; i < snapshot_count; i++) {
+        if (snapshots[i].membrane_id == membrane_id) return 0;
+    }
+    SnapshotTip *tip = tip_find(membrane_id);
+    if (tip) tip_drop(tip);
+    return 0;
+}
+
+/* Page sources for diffing: a snapshot, or a live membrane whose clean
+ * pages are known to equal its tip */
+
+typedef struct {
+    Snapshot *snapshot;
+    TensorMembraneImpl *membrane;
+    SnapshotTip *tip;
+    const uint64_t *dirty;
+    size_t element_count;
+    float scratch[MEMBRANE_PAGE_ELEMENTS];
+} PageSource;
+
+static void source_snapshot(PageSource *source, Snapshot *snapshot) {
+    source->snapshot = snapshot;
+    source->membrane = NULL;
+    source->tip = NULL;
+    source->dirty = NULL;
+    source->element_count = snapshot->element_count;
+}
+
+static void source_membrane(PageSource *source, TensorMembraneImpl *membrane) {
+    source->snapshot = NULL;
+    source->membrane = membrane;
+    source->element_count = membrane_element_count(membrane);
+    source->tip = membrane_is_mapped(membrane) ? NULL : tip_find(membrane_get_id(membrane));
+    if (source->tip && source->tip->element_count != source->element_count) source->tip = NULL;
+    source->dirty = source->tip ? membrane_dirty_pages(membrane, NULL) : NULL;
+}
+
+/* Contents of page p, and through shared the page it is known to be
+ * identical to, if any */
+static const float *source_page(PageSource *source, size_t p, SnapshotPage **shared) {
+    if (source->snapshot) {
+        *shared = source->snapshot->pages[p];
+        return (*shared)->data;
+    }
+    if (source->tip && source->tip->pages[p] && !page_dirty(source->dirty, p)) {
+        *shared = source->tip->pages[p];
+        return (*shared)->data;
+    }
+    
+    *shared = NULL;
+    membrane_get_range(source->membrane, p * MEMBRANE_PAGE_ELEMENTS, source->scratch,
+                       page_length(source->element_count, p));
+    return source->scratch;
+}
+
+void snapshot_delta_init(SnapshotDelta *delta) {
+    memset(delta, 0, sizeof(*delta));
+}
+
+void snapshot_delta_free(SnapshotDelta *delta) {
+    free(delta->runs);
+    free(delta->values);
+    snapshot_delta_init(delta);
+}
+
+/* Append one changed element, extending the last run when adjacent */
+static int delta_push(SnapshotDelta *delta, size_t offset, float value) {
+    if (delta->value_count == delta->value_capacity) {
+        size_t capacity = delta->value_capacity ? delta->value_capacity * 2 : 256;
+        float *values = realloc(delta->values, capacity * sizeof(float));
+        if (!values) return -1;
+        delta->values = values;
+        delta->value_capacity = capacity;
+    }
+    
+    DeltaRun *last = delta->run_count ? &delta->runs[delta->run_count - 1] : NULL;
+    if (!last || last->offset + last->count != offset) {
+        if (delta->run_count == delta->run_capacity) {
+            size_t capacity = delta->run_capacity ? delta->run_capacity * 2 : 64;
+            DeltaRun *runs = realloc(delta->runs, capacity * sizeof(DeltaRun));
+            if (!runs) return -1;
+            delta->runs = runs;
+            delta->run_capacity = capacity;
+        }
+        last = &delta->runs[delta->run_count++];
+        last->offset = offset;
+        last->count = 0;
+        last->first = delta->value_count;
+    }
+    last->count++;
+    delta->values[delta->value_count++] = value;
+    return 0;
+}
+
+/* Elements where b differs from a, bitwise, with b's values */
+static int delta_build(PageSource *a, PageSource *b, SnapshotDelta *delta) {
+    if (a->element_count != b->element_count) return -1;
+    
+    snapshot_delta_free(delta);
+    delta->element_count = a->element_count;
+    
+    size_t pages = page_count_for(a->element_count);
+    for (size_t p = 0; p < pages; p++) {
+        SnapshotPage *shared_a, *shared_b;
+        const float *x = source_page(a, p, &shared_a);
+        const float *y = source_page(b, p, &shared_b);
+        if (shared_a && shared_a == shared_b) continue;
+    
+        size_t length = page_length(a->element_count, p);
+        if (memcmp(x, y, length * sizeof(float)) == 0) continue;
+        for (size_t i = 0; i < length; i++) {
+            if (memcmp(&x[i], &y[i], sizeof(float)) == 0) continue;
+            if (delta_push(delta, p * MEMBRANE_PAGE_ELEMENTS + i, y[i]) != 0) return -1;
+        }
+    }
+    return 0;
+}
+
+int snapshot_diff(uint32_t from, uint32_t to, SnapshotDelta *delta) {
+    Snapshot *older = snapshot_find(from);
+    if (!older || !delta) return -1;
+    
+    PageSource *a = malloc(sizeof(PageSource));
+    PageSource *b = malloc(sizeof(PageSource));
+    int status = -1;
+    if (a && b) {
+        source_snapshot(a, older);
+        if (to) {
+            Snapshot *newer = snapshot_find(to);
+            if (newer) {
+                source_snapshot(b, newer);
+                status = delta_build(a, b, delta);
+            }
+        } else {
+            TensorMembraneImpl *membrane = find_membrane_by_id(older->membrane_id);
+            if (membrane) {
+                source_membrane(b, membrane);
+                status = delta_build(a, b, delta);
+            }
+        }
+    }
+    free(a);
+    free(b);
+    return status;
+}
+
+/* Write back what differs from the snapshot; clean pages are skipped */
+int snapshot_restore(uint32_t id, uint32_t membrane_id) {
+    Snapshot *snapshot = snapshot_find(id);
+    if (!snapshot) return -1;
+    
+    TensorMembraneImpl *membrane = find_membrane_by_id(membrane_id ? membrane_id
+                                                                   : snapshot->membrane_id);
+    if (!membrane) return -1;
+    
+    PageSource *live = malloc(sizeof(PageSource));
+    PageSource *saved = malloc(sizeof(PageSource));
+    SnapshotDelta delta;
+    snapshot_delta_init(&delta);
+    int status = -1;
+    if (live && saved) {
+        source_membrane(live, membrane);
+        source_snapshot(saved, snapshot);
+        if (delta_build(live, saved, &delta) == 0) {
+            status = snapshot_delta_apply(&delta, membrane_get_id(membrane));
+        }
+    }
+    snapshot_delta_free(&delta);
+    free(live);
+    free(saved);
+    return status;
+}
+
+int snapshot_delta_apply(const SnapshotDelta *delta, uint32_t membrane_id) {
+    TensorMembraneImpl *membrane = find_membrane_by_id(membrane_id);
+    if (!membrane || !delta || delta->element_count != membrane_element_count(membrane)) {
+        return -1;
+    }
+    
+    for (size_t i = 0; i < delta->run_count; i++) {
+        const DeltaRun *run = &delta->runs[i];
+        if (membrane_set_range(membrane, run->offset, delta->values + run->first,
+                               run->count) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Text form: a "delta <elements> <runs>" line, then one line per run
+ * of "<offset> <count> <values...>".  Values are printed with enough
+ * digits to read back exactly. */
+int snapshot_delta_write(const SnapshotDelta *delta, FILE *out) {
+    fprintf(out, "delta %zu %zu\n", delta->element_count, delta->run_count);
+    for (size_t i = 0; i < delta->run_count; i++) {
+        const DeltaRun *run = &delta->runs[i];
+        fprintf(out, "%zu %zu", run->offset, run->count);
+        for (size_t j = 0; j < run->count; j++) {
+            fprintf(out, " %.9g", delta->values[run->first + j]);
+        }
+        fputc('\n', out);
+    }
+    return ferror(out) ? -1 : 0;
+}
+
+int snapshot_delta_read(SnapshotDelta *delta, FILE *in, const char **error) {
+    char *line = NULL;
+    size_t cap = 0;
+    size_t runs = 0;
+    
+    *error = NULL;
+    snapshot_delta_free(delta);
+    if (getline(&line, &cap, in) < 0 ||
+        sscanf(line, "delta %zu %zu", &delta->element_count, &runs) != 2) {
+        free(line);
+        *error = "missing delta header";
+        return -1;
+    }
+    
+    for (size_t r = 0; r < runs; r++) {
+        if (getline(&line, &cap, in) < 0) {
+            *error = "delta is truncated";
+            break;
+        }
+    
+        char *p = line, *end;
+        size_t offset = strtoull(p, &end, 10);
+        size_t count = p == end ? 0 : strtoull(end, &p, 10);
+        if (count == 0 || offset > delta->element_count ||
+            count > delta->element_count - offset) {
+            *error = "bad run";
+            break;
+        }
+        for (size_t j = 0; j < count; j++) {
+            float value = strtof(p, &end);
+            if (end == p || delta_push(delta, offset + j, value) != 0) {
+                *error = "bad value";
+                break;
+            }
+            p = end;
+        }
+        if (delta->value_count == 0 || delta->runs[delta->run_count - 1].offset +
+            delta->runs[delta->run_count - 1].count != offset + count) {
+            if (!*error) *error = "bad run";
+            break;
+        }
+    }
+    free(line);
+    
+    if (*error) {
+        snapshot_delta_free(delta);
+        return -1;
+    }
+    return 0;
+}
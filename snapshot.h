@@ -0,0 +1,55 @@
+/* Membrane Snapshot Header
+ * Page-granular copy-on-write snapshots and sparse deltas
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+typedef struct {
+    uint32_t id;
+    uint32_t membrane_id;       /* membrane the snapshot was taken of */
+    uint64_t version;           /* its version at the time */
+    size_t element_count;
+} SnapshotInfo;
+
+/* A run of changed elements; its values start at values[first] */
+typedef struct {
+    size_t offset;
+    size_t count;
+    size_t first;
+} DeltaRun;
+
+/* Sparse difference between two states of equally sized membranes, in
+ * row-major element order; holds the values of the newer state */
+typedef struct {
+    size_t element_count;
+    DeltaRun *runs;
+    size_t run_count;
+    size_t run_capacity;
+    float *values;
+    size_t value_count;
+    size_t value_capacity;
+} SnapshotDelta;
+
+/* Snapshots share unchanged pages with each other; taking one copies
+ * only the pages written since the last snapshot of that membrane */
+extern uint32_t snapshot_take(uint32_t membrane_id, size_t *pages_copied);
+extern int snapshot_info(uint32_t id, SnapshotInfo *info);
+extern uint32_t snapshot_next(uint32_t after);
+extern int snapshot_delete(uint32_t id);
+extern int snapshot_restore(uint32_t id, uint32_t membrane_id);
+
+/* Deltas between snapshots, or from a snapshot to its live membrane
+ * when to is 0 */
+extern void snapshot_delta_init(SnapshotDelta *delta);
+extern void snapshot_delta_free(SnapshotDelta *delta);
+extern int snapshot_diff(uint32_t from, uint32_t to, SnapshotDelta *delta);
+extern int snapshot_delta_apply(const SnapshotDelta *delta, uint32_t membrane_id);
+extern int snapshot_delta_write(const SnapshotDelta *delta, FILE *out);
+extern int snapshot_delta_read(SnapshotDelta *delta, FILE *in, const char **error);
+
+#endif /* SNAPSHOT_H */
@@ -0,0 +1,2 @@
+#define STATUS0 0
+#define STATUS1 256
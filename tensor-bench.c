@@ -0,0 +1,147 @@
+/* Tensor Kernel Benchmark
+ * GFLOP/s of the packed matmul and the direct convolution against
+ * naive loops, on one thread.  Usage: tensor-bench [size...]
+ */
+
+#include "tensor-kernels.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void randomize(float *x, size_t n) {
+    for (size_t i = 0; i < n; i++) x[i] = (float)rand() / RAND_MAX - 0.5f;
+}
+
+static float max_error(const float *x, const float *y, size_t n) {
+    float max = 0.0f;
+    for (size_t i = 0; i < n; i++) {
+        float d = fabsf(x[i] - y[i]);
+        if (d > max) max = d;
+    }
+    return max;
+}
+
+static void naive_matmul(float *c, const float *a, const float *b, size_t m, size_t k, size_t n) {
+    for (size_t i = 0; i < m; i++) {
+        for (size_t j = 0; j < n; j++) {
+            float sum = 0.0f;
+            for (size_t p = 0; p < k; p++) sum += a[i * k + p] * b[p * n + j];
+            c[i * n + j] = sum;
+        }
+    }
+}
+
+static void naive_conv2d(float *out, const float *in, const float *filter, size_t filters,
+                         size_t channels, size_t height, size_t width, size_t kh, size_t kw) {
+    size_t oh = height - kh + 1, ow = width - kw + 1;
+    for (size_t f = 0; f < filters; f++) {
+        for (size_t y = 0; y < oh; y++) {
+            for (size_t x = 0; x < ow; x++) {
+                float sum = 0.0f;
+                for (size_t c = 0; c < channels; c++) {
+                    for (size_t i = 0; i < kh; i++) {
+                        for (size_t j = 0; j < kw; j++) {
+                            sum += filter[((f * channels + c) * kh + i) * kw + j] *
+                                   in[(c * height + y + i) * width + x + j];
+                        }
+                    }
+                }
+                out[(f * oh + y) * ow + x] = sum;
+            }
+        }
+    }
+}
+
+/* Seconds per run of the packed matmul, repeated for at least 0.2s */
+static double time_matmul(float *c, const float *a, const float *b, size_t n) {
+    int runs = 0;
+    double start = now(), elapsed;
+    do {
+        tensor_kernel_matmul(c, a, b, n, n, n);
+        runs++;
+        elapsed = now() - start;
+    } while (elapsed < 0.2);
+    return elapsed / runs;
+}
+
+static void bench_matmul(size_t n) {
+    float *a = tensor_alloc(n * n), *b = tensor_alloc(n * n);
+    float *c = tensor_alloc(n * n), *ref = tensor_alloc(n * n);
+    if (!a || !b || !c || !ref) {
+        fprintf(stderr, "tensor-bench: out of memory\n");
+        exit(1);
+    }
+    randomize(a, n * n);
+    randomize(b, n * n);
+
+    double flops = 2.0 * n * n * n;
+    double start = now();
+    naive_matmul(ref, a, b, n, n, n);
+    double naive = now() - start;
+    double packed = time_matmul(c, a, b, n);
+
+    printf("matmul %4zu: naive %7.2f GFLOP/s  packed %7.2f GFLOP/s  %5.1fx  max error %.2g\n",
+           n, flops / naive * 1e-9, flops / packed * 1e-9, naive / packed,
+           max_error(c, ref, n * n));
+
+    tensor_free(a);
+    tensor_free(b);
+    tensor_free(c);
+    tensor_free(ref);
+}
+
+static void bench_conv2d(size_t channels, size_t size, size_t filters, size_t k) {
+    size_t out_size = size - k + 1;
+    size_t plane = out_size * out_size;
+    float *in = tensor_alloc(channels * size * size);
+    float *filter = tensor_alloc(filters * channels * k * k);
+    float *out = tensor_alloc(filters * plane), *ref = tensor_alloc(filters * plane);
+    if (!in || !filter || !out || !ref) {
+        fprintf(stderr, "tensor-bench: out of memory\n");
+        exit(1);
+    }
+    randomize(in, channels * size * size);
+    randomize(filter, filters * channels * k * k);
+
+    double flops = 2.0 * filters * plane * channels * k * k;
+    double start = now();
+    naive_conv2d(ref, in, filter, filters, channels, size, size, k, k);
+    double naive = now() - start;
+
+    start = now();
+    for (size_t f = 0; f < filters; f++) {
+        tensor_kernel_conv2d(out + f * plane, in, filter + f * channels * k * k, channels,
+                             size, size, k, k, 0, out_size);
+    }
+    double direct = now() - start;
+
+    printf("conv2d %zux%zux%zu * %zux%zux%zu: naive %6.2f GFLOP/s  direct %6.2f GFLOP/s  "
+           "%5.1fx  max error %.2g\n", channels, size, size, filters, k, k,
+           flops / naive * 1e-9, flops / direct * 1e-9, naive / direct,
+           max_error(out, ref, filters * plane));
+
+    tensor_free(in);
+    tensor_free(filter);
+    tensor_free(out);
+    tensor_free(ref);
+}
+
+int main(int argc, char **argv) {
+    static const size_t sizes[] = { 128, 256, 512 };
+
+    printf("kernels: %s\n", tensor_kernel_isa());
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) bench_matmul((size_t)atol(argv[i]));
+    } else {
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) bench_matmul(sizes[i]);
+    }
+    bench_conv2d(16, 128, 16, 3);
+    return 0;
+}
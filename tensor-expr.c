@@ -0,0 +1,568 @@
+/* Tensor Expression Implementation
+ * tensor-op builds a graph instead of touching data.  When a value is
+ * needed, every elementwise node between the requested one and the
+ * nearest stored values is run block by block: each block of
+ * TENSOR_EXPR_BLOCK elements goes through the whole chain while it is
+ * in L1, and is then either reduced or stored.  Matmuls and
+ * convolutions are not elementwise, so they are computed and stored
+ * before the pass, in row bands spread over the worker pool.
+ */
+
+#include "tensor-expr.h"
+#include "tensor-kernels.h"
+#include "or.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+/* Elements per parallel work item */
+#define TENSOR_EXPR_CHUNK (64 * TENSOR_EXPR_BLOCK)
+
+/* Output rows per parallel matmul or convolution work item */
+#define TENSOR_EXPR_BAND 96
+
+typedef enum {
+    EXPR_LEAF,
+    EXPR_MAP,
+    EXPR_BINARY,
+    EXPR_MATMUL,
+    EXPR_CONV2D
+} TensorExprKind;
+
+struct TensorExpr {
+    TensorExprKind kind;
+    int op;                         /* TensorMapOp or TensorBinaryOp */
+    float operand;
+    TensorExpr *inputs[2];          /* dropped once value is stored */
+    int ndims;
+    int dims[TENSOR_MAX_DIMS];
+    size_t size;
+    int depth;                      /* elementwise nodes above stored values */
+    float *value;                   /* leaf data or stored result */
+    int refs;
+};
+
+static TensorExpr *expr_new(TensorExprKind kind, const int *dims, int ndims) {
+    TensorExpr *e = calloc(1, sizeof(TensorExpr));
+    if (!e) return NULL;
+    
+    e->kind = kind;
+    e->ndims = ndims;
+    e->size = 1;
+    for (int i = 0; i < ndims; i++) {
+        e->dims[i] = dims[i];
+        e->size *= (size_t)dims[i];
+    }
+    e->refs = 1;
+    return e;
+}
+
+static int expr_elementwise(const TensorExpr *e) {
+    return e->kind == EXPR_MAP || e->kind == EXPR_BINARY;
+}
+
+static int expr_depth(const TensorExpr *e) {
+    return e->value ? 0 : e->depth;
+}
+
+static int same_shape(const TensorExpr *a, const TensorExpr *b) {
+    return a->ndims == b->ndims && memcmp(a->dims, b->dims, a->ndims * sizeof(int)) == 0;
+}
+
+/* Keep chains short enough for the fixed scratch stack */
+static int expr_bound(TensorExpr *e) {
+    if (expr_depth(e) < TENSOR_EXPR_MAX_DEPTH) return 0;
+    return tensor_expr_eval(e) ? 0 : -1;
+}
+
+TensorExpr *tensor_expr_leaf(float *data, const int *dims, int ndims) {
+    if (!data || !dims || ndims <= 0 || ndims > TENSOR_MAX_DIMS) return NULL;
+    for (int i = 0; i < ndims; i++) {
+        if (dims[i] <= 0) return NULL;
+    }
+    
+    TensorExpr *e = expr_new(EXPR_LEAF, dims, ndims);
+    if (e) e->value = data;
+    return e;
+}
+
+TensorExpr *tensor_expr_map(TensorExpr *x, TensorMapOp op, float operand) {
+    if (!x || op < TENSOR_RELU || op > TENSOR_SHIFT || expr_bound(x) != 0) return NULL;
+    
+    TensorExpr *e = expr_new(EXPR_MAP, x->dims, x->ndims);
+    if (!e) return NULL;
+    e->op = op;
+    e->operand = operand;
+    e->inputs[0] = x;
+    e->depth = expr_depth(x) + 1;
+    tensor_expr_retain(x);
+    return e;
+}
+
+TensorExpr *tensor_expr_binary(TensorExpr *a, TensorBinaryOp op, TensorExpr *b) {
+    if (!a || !b || !same_shape(a, b) || op < TENSOR_ADD || op > TENSOR_MUL) return NULL;
+    if (expr_bound(a) != 0 || expr_bound(b) != 0) return NULL;
+    
+    TensorExpr *e = expr_new(EXPR_BINARY, a->dims, a->ndims);
+    if (!e) return NULL;
+    e->op = op;
+    e->inputs[0] = a;
+    e->inputs[1] = b;
+    e->depth = (expr_depth(a) > expr_depth(b) ? expr_depth(a) : expr_depth(b)) + 1;
+    tensor_expr_retain(a);
+    tensor_expr_retain(b);
+    return e;
+}
+
+TensorExpr *tensor_expr_matmul(TensorExpr *a, TensorExpr *b) {
+    if (!a || !b || a->ndims != 2 || b->ndims != 2 || a->dims[1] != b->dims[0]) return NULL;
+    
+    int dims[2] = { a->dims[0], b->dims[1] };
+    TensorExpr *e = expr_new(EXPR_MATMUL, dims, 2);
+    if (!e) return NULL;
+    e->inputs[0] = a;
+    e->inputs[1] = b;
+    tensor_expr_retain(a);
+    tensor_expr_retain(b);
+    return e;
+}
+
+/* Valid, stride-1 convolution of x (channels x height x width, or
+ * height x width) with filters (count x channels x kh x kw, or kh x kw) */
+TensorExpr *tensor_expr_conv2d(TensorExpr *x, TensorExpr *filters) {
+    if (!x || !filters) return NULL;
+    
+    int planar = x->ndims == 2 && filters->ndims == 2;
+    if (!planar && (x->ndims != 3 || filters->ndims != 4 || filters->dims[1] != x->dims[0])) {
+        return NULL;
+    }
+    
+    int kh = filters->dims[filters->ndims - 2], kw = filters->dims[filters->ndims - 1];
+    int height = x->dims[x->ndims - 2], width = x->dims[x->ndims - 1];
+    if (kh > height || kw > width) return NULL;
+    
+    int dims[3] = { filters->dims[0], height - kh + 1, width - kw + 1 };
+    TensorExpr *e = planar ? expr_new(EXPR_CONV2D, dims + 1, 2) : expr_new(EXPR_CONV2D, dims, 3);
+    if (!e) return NULL;
+    e->inputs[0] = x;
+    e->inputs[1] = filters;
+    tensor_expr_retain(x);
+    tensor_expr_retain(filters);
+    return e;
+}
+
+void tensor_expr_retain(TensorExpr *e) {
+    if (e) e->refs++;
+}
+
+static void expr_drop_inputs(TensorExpr *e) {
+    tensor_expr_release(e->inputs[0]);
+    tensor_expr_release(e->inputs[1]);
+    e->inputs[0] = e->inputs[1] = NULL;
+}
+
+void tensor_expr_release(TensorExpr *e) {
+    if (!e || --e->refs > 0) return;
+    
+    expr_drop_inputs(e);
+    tensor_free(e->value);
+    free(e);
+}
+
+int tensor_expr_shape(const TensorExpr *e, const int **dims) {
+    if (!e) return 0;
+    if (dims) *dims = e->dims;
+    return e->ndims;
+}
+
+size_t tensor_expr_size(const TensorExpr *e) {
+    return e ? e->size : 0;
+}
+
+/* Block evaluation.  A node writes its block to dst and hands scratch,
+ * one block per slot, to its inputs: the first input shares dst and the
+ * second starts one slot further on.  Stored values are returned in
+ * place. */
+
+static int expr_slots(const TensorExpr *e) {
+    if (e->value) return 0;
+    if (e->kind == EXPR_MAP) return expr_slots(e->inputs[0]);
+    
+    int a = expr_slots(e->inputs[0]);
+    int b = expr_slots(e->inputs[1]) + 1;
+    return a > b ? a : b;
+}
+
+static void map_block(float *dst, const float *src, size_t n, TensorMapOp op, float c) {
+    switch (op) {
+    case TENSOR_RELU:
+        tensor_kernel_relu(dst, src, n);
+        break;
+    case TENSOR_ABS:
+        for (size_t i = 0; i < n; i++) dst[i] = fabsf(src[i]);
+        break;
+    case TENSOR_NEG:
+        for (size_t i = 0; i < n; i++) dst[i] = -src[i];
+        break;
+    case TENSOR_SQUARE:
+        for (size_t i = 0; i < n; i++) dst[i] = src[i] * src[i];
+        break;
+    case TENSOR_SQRT:
+        for (size_t i = 0; i < n; i++) dst[i] = sqrtf(src[i]);
+        break;
+    case TENSOR_EXP:
+        for (size_t i = 0; i < n; i++) dst[i] = expf(src[i]);
+        break;
+    case TENSOR_TANH:
+        for (size_t i = 0; i < n; i++) dst[i] = tanhf(src[i]);
+        break;
+    case TENSOR_SIGMOID:
+        for (size_t i = 0; i < n; i++) dst[i] = 1.0f / (1.0f + expf(-src[i]));
+        break;
+    case TENSOR_SCALE:
+        tensor_kernel_copy(dst, src, n);
+        tensor_kernel_scale(dst, c, n);
+        break;
+    case TENSOR_SHIFT:
+        for (size_t i = 0; i < n; i++) dst[i] = src[i] + c;
+        break;
+    }
+}
+
+static void binary_block(float *dst, const float *a, const float *b, size_t n, TensorBinaryOp op) {
+    switch (op) {
+    case TENSOR_ADD:
+        tensor_kernel_copy(dst, a, n);
+        tensor_kernel_add(dst, b, n);
+        break;
+    case TENSOR_SUB:
+        for (size_t i = 0; i < n; i++) dst[i] = a[i] - b[i];
+        break;
+    case TENSOR_MUL:
+        tensor_kernel_copy(dst, a, n);
+        tensor_kernel_mul(dst, b, n);
+        break;
+    }
+}
+
+static const float *eval_block(const TensorExpr *e, size_t offset, size_t n, float *dst,
+                               float *scratch) {
+    if (e->value) return e->value + offset;
+    
+    const float *a = eval_block(e->inputs[0], offset, n, dst, scratch);
+    if (e->kind == EXPR_MAP) {
+        map_block(dst, a, n, (TensorMapOp)e->op, e->operand);
+    } else {
+        const float *b = eval_block(e->inputs[1], offset, n, scratch, scratch + TENSOR_EXPR_BLOCK);
+        binary_block(dst, a, b, n, (TensorBinaryOp)e->op);
+    }
+    return dst;
+}
+
+/* Store every matmul and convolution the pass over e will read */
+static int expr_prepare(TensorExpr *e) {
+    if (e->value) return 0;
+    if (!expr_elementwise(e)) return tensor_expr_eval(e) ? 0 : -1;
+    
+    for (int i = 0; i < 2; i++) {
+        if (e->inputs[i] && expr_prepare(e->inputs[i]) != 0) return -1;
+    }
+    return 0;
+}
+
+/* One fused pass, split into chunks for the worker pool.  Each chunk
+ * stores its blocks into out, or folds them into its partial result. */
+
+typedef struct {
+    const TensorExpr *expr;
+    float *out;
+    TensorReduceOp reduce;
+    int slots;
+    double *partial;
+    int failed;
+} FusedPass;
+
+static void fused_chunk(void *ctx, int index) {
+    FusedPass *pass = ctx;
+    const TensorExpr *e = pass->expr;
+    size_t start = (size_t)index * TENSOR_EXPR_CHUNK;
+    size_t end = e->size - start < TENSOR_EXPR_CHUNK ? e->size : start + TENSOR_EXPR_CHUNK;
+    
+    /* A reduction needs one more block for the result itself */
+    int blocks = pass->slots + (pass->out ? 0 : 1);
+    float *scratch = blocks ? tensor_alloc((size_t)blocks * TENSOR_EXPR_BLOCK) : NULL;
+    if (blocks && !scratch) {
+        pass->failed = 1;
+        return;
+    }
+    
+    double acc = pass->reduce == TENSOR_MAX ? -INFINITY : pass->reduce == TENSOR_MIN ? INFINITY : 0.0;
+    for (size_t offset = start; offset < end; offset += TENSOR_EXPR_BLOCK) {
+        size_t n = end - offset < TENSOR_EXPR_BLOCK ? end - offset : TENSOR_EXPR_BLOCK;
+    
+        if (pass->out) {
+            eval_block(e, offset, n, pass->out + offset, scratch);
+            continue;
+        }
+    
+        const float *x = eval_block(e, offset, n, scratch, scratch + TENSOR_EXPR_BLOCK);
+        switch (pass->reduce) {
+        case TENSOR_SUM:
+        case TENSOR_MEAN:
+            acc += tensor_kernel_sum(x, n);
+            break;
+        case TENSOR_NORM:
+            acc += tensor_kernel_dot(x, x, n);
+            break;
+        case TENSOR_MAX: {
+            float max = tensor_kernel_max(x, n);
+            if (max > acc) acc = max;
+            break;
+        }
+        case TENSOR_MIN:
+            for (size_t i = 0; i < n; i++) {
+                if (x[i] < acc) acc = x[i];
+            }
+            break;
+        }
+    }
+    
+    pass->partial[index] = acc;
+    tensor_free(scratch);
+}
+
+static int fused_run(const TensorExpr *e, float *out, TensorReduceOp reduce, double *result) {
+    int chunks = (int)((e->size + TENSOR_EXPR_CHUNK - 1) / TENSOR_EXPR_CHUNK);
+    FusedPass pass;
+    pass.expr = e;
+    pass.out = out;
+    pass.reduce = reduce;
+    pass.slots = expr_slots(e);
+    pass.partial = malloc(chunks * sizeof(double));
+    pass.failed = 0;
+    if (!pass.partial) return -1;
+    
+    worker_pool_parallel_for(worker_pool_default(), chunks, fused_chunk, &pass);
+    
+    /* Combine in chunk order so results do not depend on scheduling */
+    if (!pass.failed && result) {
+        double acc = pass.partial[0];
+        for (int i = 1; i < chunks; i++) {
+            double x = pass.partial[i];
+            if (reduce == TENSOR_MAX) acc = x > acc ? x : acc;
+            else if (reduce == TENSOR_MIN) acc = x < acc ? x : acc;
+            else acc += x;
+        }
+        *result = acc;
+    }
+    free(pass.partial);
+    return pass.failed ? -1 : 0;
+}
+
+/* Matmuls and convolutions, split into bands of TENSOR_EXPR_BAND output
+ * rows; a convolution has a set of bands per filter */
+
+typedef struct {
+    const TensorExpr *expr;
+    const float *x;
+    const float *y;
+    float *out;
+    int bands;                      /* per output plane */
+} ProductPass;
+
+static void product_band(void *ctx, int index) {
+    ProductPass *pass = ctx;
+    const TensorExpr *a = pass->expr->inputs[0], *b = pass->expr->inputs[1];
+    
+    if (pass->expr->kind == EXPR_MATMUL) {
+        size_t m = a->dims[0], k = a->dims[1], n = b->dims[1];
+        size_t first = (size_t)index * TENSOR_EXPR_BAND;
+        size_t rows = m - first < TENSOR_EXPR_BAND ? m - first : TENSOR_EXPR_BAND;
+        tensor_kernel_matmul(pass->out + first * n, pass->x + first * k, pass->y, rows, k, n);
+        return;
+    }
+    
+    size_t channels = a->ndims == 3 ? a->dims[0] : 1;
+    size_t height = a->dims[a->ndims - 2], width = a->dims[a->ndims - 1];
+    size_t kh = b->dims[b->ndims - 2], kw = b->dims[b->ndims - 1];
+    size_t out_rows = height - kh + 1, plane = out_rows * (width - kw + 1);
+    size_t filter = index / pass->bands;
+    size_t first = (size_t)(index % pass->bands) * TENSOR_EXPR_BAND;
+    size_t rows = out_rows - first < TENSOR_EXPR_BAND ? out_rows - first : TENSOR_EXPR_BAND;
+    
+    tensor_kernel_conv2d(pass->out + filter * plane, pass->x,
+                         pass->y + filter * channels * kh * kw, channels, height, width,
+                         kh, kw, first, rows);
+}
+
+static float *product_run(TensorExpr *e) {
+    ProductPass pass;
+    pass.expr = e;
+    pass.x = tensor_expr_eval(e->inputs[0]);
+    pass.y = tensor_expr_eval(e->inputs[1]);
+    if (!pass.x || !pass.y) return NULL;
+    
+    pass.out = tensor_alloc(e->size);
+    if (!pass.out) return NULL;
+    
+    /* Output rows per plane, and planes */
+    int rows = e->dims[e->ndims - 2];
+    int planes = e->kind == EXPR_CONV2D && e->ndims == 3 ? e->dims[0] : 1;
+    pass.bands = (rows + TENSOR_EXPR_BAND - 1) / TENSOR_EXPR_BAND;
+    worker_pool_parallel_for(worker_pool_default(), pass.bands * planes, product_band, &pass);
+    return pass.out;
+}
+
+/* Store e's value, computing whatever it depends on first */
+const float *tensor_expr_eval(TensorExpr *e) {
+    if (!e) return NULL;
+    if (e->value) return e->value;
+    
+    float *out;
+    if (!expr_elementwise(e)) {
+        out = product_run(e);
+        if (!out) return NULL;
+    } else {
+        if (expr_prepare(e) != 0) return NULL;
+        out = tensor_alloc(e->size);
+        if (!out) return NULL;
+        if (fused_run(e, out, TENSOR_SUM, NULL) != 0) {
+            tensor_free(out);
+            return NULL;
+        }
+    }
+    
+    e->value = out;
+    expr_drop_inputs(e);
+    return out;
+}
+
+/* Reduce e in one pass without storing it */
+int tensor_expr_reduce(TensorExpr *e, TensorReduceOp op, float *result) {
+    if (!e || !result || op < TENSOR_SUM || op > TENSOR_MIN) return -1;
+    if (expr_prepare(e) != 0) return -1;
+    
+    double acc;
+    if (fused_run(e, NULL, op, &acc) != 0) return -1;
+    
+    if (op == TENSOR_MEAN) acc /= (double)e->size;
+    else if (op == TENSOR_NORM) acc = sqrt(acc);
+    *result = (float)acc;
+    return 0;
+}
+
+/* Passes over memory needed to store e (or, if e is already stored,
+ * none) */
+static int expr_store_passes(const TensorExpr *e);
+
+/* Passes to store what a fused pass over e reads */
+static int expr_input_passes(const TensorExpr *e) {
+    if (e->value) return 0;
+    if (!expr_elementwise(e)) return expr_store_passes(e);
+    
+    int passes = 0;
+    for (int i = 0; i < 2; i++) {
+        if (e->inputs[i]) passes += expr_input_passes(e->inputs[i]);
+    }
+    return passes;
+}
+
+static int expr_store_passes(const TensorExpr *e) {
+    if (e->value) return 0;
+    if (!expr_elementwise(e)) {
+        return 1 + expr_store_passes(e->inputs[0]) + expr_store_passes(e->inputs[1]);
+    }
+    return 1 + expr_input_passes(e);
+}
+
+/* Passes a reduction of e costs */
+int tensor_expr_passes(const TensorExpr *e) {
+    return e ? 1 + expr_input_passes(e) : 0;
+}
+
+static const char *map_names[] = {
+    "relu", "abs", "neg", "square", "sqrt", "exp", "tanh", "sigmoid", "scale", "shift"
+};
+
+static const char *binary_names[] = { "add", "sub", "mul" };
+
+static const char *reduce_names[] = { "sum", "mean", "norm", "max", "min" };
+
+/* Append to buf, counting what does not fit */
+static size_t format_append(char *buf, size_t size, size_t used, const char *text) {
+    size_t len = strlen(text);
+    if (used < size) {
+        size_t room = size - used - 1;
+        memcpy(buf + used, text, len < room ? len : room);
+        buf[used + (len < room ? len : room)] = '\0';
+    }
+    return used + len;
+}
+
+static size_t format_into(const TensorExpr *e, char *buf, size_t size, size_t used) {
+    char text[32];
+    
+    if (e->value) {
+        used = format_append(buf, size, used, "<");
+        for (int i = 0; i < e->ndims; i++) {
+            snprintf(text, sizeof(text), i ? "x%d" : "%d", e->dims[i]);
+            used = format_append(buf, size, used, text);
+        }
+        return format_append(buf, size, used, ">");
+    }
+    
+    used = format_append(buf, size, used, e->kind == EXPR_MAP ? map_names[e->op] :
+                         e->kind == EXPR_MATMUL ? "matmul" :
+                         e->kind == EXPR_CONV2D ? "conv2d" : binary_names[e->op]);
+    used = format_append(buf, size, used, "(");
+    used = format_into(e->inputs[0], buf, size, used);
+    if (e->kind != EXPR_MAP) {
+        used = format_append(buf, size, used, ", ");
+        used = format_into(e->inputs[1], buf, size, used);
+    } else if (e->op == TENSOR_SCALE || e->op == TENSOR_SHIFT) {
+        snprintf(text, sizeof(text), ", %g", e->operand);
+        used = format_append(buf, size, used, text);
+    }
+    return format_append(buf, size, used, ")");
+}
+
+/* Write e as text such as "sum(scale(relu(<4x4>), 2))"; returns the
+ * length it needs, like snprintf */
+int tensor_expr_format(const TensorExpr *e, char *buf, size_t size) {
+    if (!e || !buf || size == 0) return -1;
+    
+    buf[0] = '\0';
+    return (int)format_into(e, buf, size, 0);
+}
+
+int tensor_map_op(const char *name, TensorMapOp *op, int *takes_operand) {
+    for (int i = 0; i <= TENSOR_SHIFT; i++) {
+        if (strcmp(name, map_names[i]) == 0) {
+            *op = (TensorMapOp)i;
+            if (takes_operand) *takes_operand = i == TENSOR_SCALE || i == TENSOR_SHIFT;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int tensor_binary_op(const char *name, TensorBinaryOp *op) {
+    for (int i = 0; i <= TENSOR_MUL; i++) {
+        if (strcmp(name, binary_names[i]) == 0) {
+            *op = (TensorBinaryOp)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int tensor_reduce_op(const char *name, TensorReduceOp *op) {
+    for (int i = 0; i <= TENSOR_MIN; i++) {
+        if (strcmp(name, reduce_names[i]) == 0) {
+            *op = (TensorReduceOp)i;
+            return 0;
+        }
+    }
+    return -1;
+}
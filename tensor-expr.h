@@ -0,0 +1,70 @@
+/* Tensor Expression Header
+ * Lazy tensor graphs whose elementwise chains are evaluated fused
+ */
+
+#ifndef TENSOR_EXPR_H
+#define TENSOR_EXPR_H
+
+#include <stddef.h>
+
+#define TENSOR_MAX_DIMS 16
+#define TENSOR_EXPR_BLOCK 1024          /* elements per fused block, kept in L1 */
+#define TENSOR_EXPR_MAX_DEPTH 32        /* longer chains are evaluated first */
+
+typedef enum {
+    TENSOR_RELU,
+    TENSOR_ABS,
+    TENSOR_NEG,
+    TENSOR_SQUARE,
+    TENSOR_SQRT,
+    TENSOR_EXP,
+    TENSOR_TANH,
+    TENSOR_SIGMOID,
+    TENSOR_SCALE,                       /* x * c */
+    TENSOR_SHIFT                        /* x + c */
+} TensorMapOp;
+
+typedef enum {
+    TENSOR_ADD,
+    TENSOR_SUB,
+    TENSOR_MUL
+} TensorBinaryOp;
+
+typedef enum {
+    TENSOR_SUM,
+    TENSOR_MEAN,
+    TENSOR_NORM,
+    TENSOR_MAX,
+    TENSOR_MIN
+} TensorReduceOp;
+
+typedef struct TensorExpr TensorExpr;
+
+/* Nodes are immutable and reference counted.  Constructors take their
+ * own references to their inputs; a leaf takes over data from
+ * tensor_alloc. */
+extern TensorExpr *tensor_expr_leaf(float *data, const int *dims, int ndims);
+extern TensorExpr *tensor_expr_map(TensorExpr *x, TensorMapOp op, float operand);
+extern TensorExpr *tensor_expr_binary(TensorExpr *a, TensorBinaryOp op, TensorExpr *b);
+extern TensorExpr *tensor_expr_matmul(TensorExpr *a, TensorExpr *b);
+extern TensorExpr *tensor_expr_conv2d(TensorExpr *x, TensorExpr *filters);
+extern void tensor_expr_retain(TensorExpr *e);
+extern void tensor_expr_release(TensorExpr *e);
+
+extern int tensor_expr_shape(const TensorExpr *e, const int **dims);
+extern size_t tensor_expr_size(const TensorExpr *e);
+
+/* Evaluation.  An elementwise chain ending in a reduction, or in the
+ * result of tensor_expr_eval, costs one pass over memory; matmuls and
+ * convolutions are computed on their own first. */
+extern const float *tensor_expr_eval(TensorExpr *e);
+extern int tensor_expr_reduce(TensorExpr *e, TensorReduceOp op, float *result);
+extern int tensor_expr_passes(const TensorExpr *e);
+extern int tensor_expr_format(const TensorExpr *e, char *buf, size_t size);
+
+/* Operation names as the shell spells them */
+extern int tensor_map_op(const char *name, TensorMapOp *op, int *takes_operand);
+extern int tensor_binary_op(const char *name, TensorBinaryOp *op);
+extern int tensor_reduce_op(const char *name, TensorReduceOp *op);
+
+#endif /* TENSOR_EXPR_H */
@@ -0,0 +1,607 @@
+/* Tensor Kernels Implementation
+ * Scalar, SSE and AVX2 versions of the membrane data loops.  The best
+ * version the CPU supports is chosen once, on first use.
+ */
+
+#include "tensor-kernels.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TENSOR_KERNELS_X86 1
+#include <immintrin.h>
+#else
+#define TENSOR_KERNELS_X86 0
+#endif
+
+/* Aligned storage.  The block from malloc or calloc is stashed just
+ * below the aligned pointer for tensor_free. */
+
+static float *tensor_align(void *block) {
+    if (!block) return NULL;
+    
+    uintptr_t p = ((uintptr_t)block + sizeof(void*) + TENSOR_ALIGNMENT - 1)
+                  & ~(uintptr_t)(TENSOR_ALIGNMENT - 1);
+    ((void**)p)[-1] = block;
+    return (float*)p;
+}
+
+/* Bytes to request, rounded so vector loops may read whole cache lines;
+ * 0 on overflow */
+static size_t tensor_block_size(size_t count) {
+    if (count > (SIZE_MAX - 2 * TENSOR_ALIGNMENT) / sizeof(float)) return 0;
+    
+    size_t bytes = count * sizeof(float);
+    bytes = (bytes + TENSOR_ALIGNMENT - 1) & ~(size_t)(TENSOR_ALIGNMENT - 1);
+    if (bytes == 0) bytes = TENSOR_ALIGNMENT;
+    return bytes + TENSOR_ALIGNMENT + sizeof(void*);
+}
+
+float *tensor_alloc(size_t count) {
+    size_t bytes = tensor_block_size(count);
+    return bytes ? tensor_align(malloc(bytes)) : NULL;
+}
+
+/* Zeroed storage.  Large blocks come from calloc as fresh pages, so
+ * nothing is written until the tensor is. */
+float *tensor_alloc_zero(size_t count) {
+    size_t bytes = tensor_block_size(count);
+    return bytes ? tensor_align(calloc(1, bytes)) : NULL;
+}
+
+void tensor_free(float *data) {
+    if (data) free(((void**)data)[-1]);
+}
+
+/* Scalar kernels, also used for the tails of the vector loops */
+
+static void scalar_fill(float *dst, float value, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = value;
+}
+
+static void scalar_scale(float *dst, float alpha, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] *= alpha;
+}
+
+static void scalar_axpy(float *y, float alpha, const float *x, size_t n) {
+    for (size_t i = 0; i < n; i++) y[i] += alpha * x[i];
+}
+
+static void scalar_add(float *dst, const float *src, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] += src[i];
+}
+
+static void scalar_mul(float *dst, const float *src, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] *= src[i];
+}
+
+static void scalar_relu(float *dst, const float *src, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = src[i] > 0.0f ? src[i] : 0.0f;
+}
+
+static float scalar_sum(const float *x, size_t n) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; i++) sum += x[i];
+    return sum;
+}
+
+static float scalar_max(const float *x, size_t n) {
+    float max = -INFINITY;
+    for (size_t i = 0; i < n; i++) {
+        if (x[i] > max) max = x[i];
+    }
+    return max;
+}
+
+static float scalar_dot(const float *x, const float *y, size_t n) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; i++) sum += x[i] * y[i];
+    return sum;
+}
+
+/* Matrix multiply micro-kernel: one GEMM_MR x GEMM_NR tile of c from
+ * packed panels of a (GEMM_MR values per k step) and b (GEMM_NR values
+ * per k step), stored or added to c with row stride ldc */
+#define GEMM_MR 6
+#define GEMM_NR 16
+
+static void scalar_gemm_tile(size_t kc, const float *a, const float *b, float *c, size_t ldc,
+                             int accumulate) {
+    float acc[GEMM_MR][GEMM_NR] = {{0}};
+    for (size_t p = 0; p < kc; p++, a += GEMM_MR, b += GEMM_NR) {
+        for (int i = 0; i < GEMM_MR; i++) {
+            for (int j = 0; j < GEMM_NR; j++) acc[i][j] += a[i] * b[j];
+        }
+    }
+    for (int i = 0; i < GEMM_MR; i++) {
+        for (int j = 0; j < GEMM_NR; j++) {
+            c[i * ldc + j] = accumulate ? c[i * ldc + j] + acc[i][j] : acc[i][j];
+        }
+    }
+}
+
+#if TENSOR_KERNELS_X86
+
+/* SSE kernels, four lanes */
+
+__attribute__((target("sse2")))
+static void sse_fill(float *dst, float value, size_t n) {
+    __m128 v = _mm_set1_ps(value);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_ps(dst + i, v);
+    scalar_fill(dst + i, value, n - i);
+}
+
+__attribute__((target("sse2")))
+static void sse_scale(float *dst, float alpha, size_t n) {
+    __m128 a = _mm_set1_ps(alpha);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(dst + i), a));
+    scalar_scale(dst + i, alpha, n - i);
+}
+
+__attribute__((target("sse2")))
+static void sse_axpy(float *y, float alpha, const float *x, size_t n) {
+    __m128 a = _mm_set1_ps(alpha);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(a, _mm_loadu_ps(x + i)));
+        _mm_storeu_ps(y + i, v);
+    }
+    scalar_axpy(y + i, alpha, x + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void sse_add(float *dst, const float *src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
+    scalar_add(dst + i, src + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void sse_mul(float *dst, const float *src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
+    scalar_mul(dst + i, src + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void sse_relu(float *dst, const float *src, size_t n) {
+    __m128 zero = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_ps(dst + i, _mm_max_ps(_mm_loadu_ps(src + i), zero));
+    scalar_relu(dst + i, src + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static float sse_hsum(__m128 v) {
+    __m128 hi = _mm_movehl_ps(v, v);
+    v = _mm_add_ps(v, hi);
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+
+__attribute__((target("sse2")))
+static float sse_sum(const float *x, size_t n) {
+    __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm_add_ps(s0, _mm_loadu_ps(x + i));
+        s1 = _mm_add_ps(s1, _mm_loadu_ps(x + i + 4));
+    }
+    for (; i + 4 <= n; i += 4) s0 = _mm_add_ps(s0, _mm_loadu_ps(x + i));
+    return sse_hsum(_mm_add_ps(s0, s1)) + scalar_sum(x + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static float sse_max(const float *x, size_t n) {
+    if (n < 4) return scalar_max(x, n);
+    
+    __m128 m = _mm_loadu_ps(x);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) m = _mm_max_ps(m, _mm_loadu_ps(x + i));
+    
+    float lanes[4];
+    _mm_storeu_ps(lanes, m);
+    float max = scalar_max(lanes, 4);
+    float tail = scalar_max(x + i, n - i);
+    return tail > max ? tail : max;
+}
+
+__attribute__((target("sse2")))
+static float sse_dot(const float *x, const float *y, size_t n) {
+    __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i)));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(x + i + 4), _mm_loadu_ps(y + i + 4)));
+    }
+    for (; i + 4 <= n; i += 4)
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i)));
+    return sse_hsum(_mm_add_ps(s0, s1)) + scalar_dot(x + i, y + i, n - i);
+}
+
+/* AVX2 kernels, eight lanes with fused multiply-add */
+
+__attribute__((target("avx2,fma")))
+static void avx2_fill(float *dst, float value, size_t n) {
+    __m256 v = _mm256_set1_ps(value);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_ps(dst + i, v);
+    scalar_fill(dst + i, value, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+static void avx2_scale(float *dst, float alpha, size_t n) {
+    __m256 a = _mm256_set1_ps(alpha);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(dst + i), a));
+    scalar_scale(dst + i, alpha, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+static void avx2_axpy(float *y, float alpha, const float *x, size_t n) {
+    __m256 a = _mm256_set1_ps(alpha);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(y + i, _mm256_fmadd_ps(a, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+    scalar_axpy(y + i, alpha, x + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+static void avx2_add(float *dst, const float *src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
+    scalar_add(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+static void avx2_mul(float *dst, const float *src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
+    scalar_mul(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+static void avx2_relu(float *dst, const float *src, size_t n) {
+    __m256 zero = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_max_ps(_mm256_loadu_ps(src + i), zero));
+    scalar_relu(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+static float avx2_hsum(__m256 v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+__attribute__((target("avx2,fma")))
+static float avx2_sum(const float *x, size_t n) {
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        s0 = _mm256_add_ps(s0, _mm256_loadu_ps(x + i));
+        s1 = _mm256_add_ps(s1, _mm256_loadu_ps(x + i + 8));
+    }
+    for (; i + 8 <= n; i += 8) s0 = _mm256_add_ps(s0, _mm256_loadu_ps(x + i));
+    return avx2_hsum(_mm256_add_ps(s0, s1)) + scalar_sum(x + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+static float avx2_max(const float *x, size_t n) {
+    if (n < 8) return scalar_max(x, n);
+    
+    __m256 m = _mm256_loadu_ps(x);
+    size_t i = 8;
+    for (; i + 8 <= n; i += 8) m = _mm256_max_ps(m, _mm256_loadu_ps(x + i));
+    
+    float lanes[8];
+    _mm256_storeu_ps(lanes, m);
+    float max = scalar_max(lanes, 8);
+    float tail = scalar_max(x + i, n - i);
+    return tail > max ? tail : max;
+}
+
+__attribute__((target("avx2,fma")))
+static float avx2_dot(const float *x, const float *y, size_t n) {
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), s0);
+        s1 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i + 8), _mm256_loadu_ps(y + i + 8), s1);
+    }
+    for (; i + 8 <= n; i += 8)
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), s0);
+    return avx2_hsum(_mm256_add_ps(s0, s1)) + scalar_dot(x + i, y + i, n - i);
+}
+
+/* Twelve accumulators hold the whole 6x16 tile; each k step loads two
+ * vectors of b and broadcasts six values of a */
+__attribute__((target("avx2,fma")))
+static void avx2_gemm_tile(size_t kc, const float *a, const float *b, float *c, size_t ldc,
+                           int accumulate) {
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+    __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+    
+    for (size_t p = 0; p < kc; p++, a += GEMM_MR, b += GEMM_NR) {
+        __m256 b0 = _mm256_load_ps(b), b1 = _mm256_load_ps(b + 8);
+        __m256 x;
+        x = _mm256_broadcast_ss(a);
+        c00 = _mm256_fmadd_ps(x, b0, c00); c01 = _mm256_fmadd_ps(x, b1, c01);
+        x = _mm256_broadcast_ss(a + 1);
+        c10 = _mm256_fmadd_ps(x, b0, c10); c11 = _mm256_fmadd_ps(x, b1, c11);
+        x = _mm256_broadcast_ss(a + 2);
+        c20 = _mm256_fmadd_ps(x, b0, c20); c21 = _mm256_fmadd_ps(x, b1, c21);
+        x = _mm256_broadcast_ss(a + 3);
+        c30 = _mm256_fmadd_ps(x, b0, c30); c31 = _mm256_fmadd_ps(x, b1, c31);
+        x = _mm256_broadcast_ss(a + 4);
+        c40 = _mm256_fmadd_ps(x, b0, c40); c41 = _mm256_fmadd_ps(x, b1, c41);
+        x = _mm256_broadcast_ss(a + 5);
+        c50 = _mm256_fmadd_ps(x, b0, c50); c51 = _mm256_fmadd_ps(x, b1, c51);
+    }
+    
+    __m256 rows[GEMM_MR][2] = {
+        { c00, c01 }, { c10, c11 }, { c20, c21 }, { c30, c31 }, { c40, c41 }, { c50, c51 }
+    };
+    for (int i = 0; i < GEMM_MR; i++, c += ldc) {
+        if (accumulate) {
+            rows[i][0] = _mm256_add_ps(rows[i][0], _mm256_loadu_ps(c));
+            rows[i][1] = _mm256_add_ps(rows[i][1], _mm256_loadu_ps(c + 8));
+        }
+        _mm256_storeu_ps(c, rows[i][0]);
+        _mm256_storeu_ps(c + 8, rows[i][1]);
+    }
+}
+
+#endif /* TENSOR_KERNELS_X86 */
+
+/* Runtime dispatch */
+
+typedef struct {
+    const char *isa;
+    void (*fill)(float *dst, float value, size_t n);
+    void (*scale)(float *dst, float alpha, size_t n);
+    void (*axpy)(float *y, float alpha, const float *x, size_t n);
+    void (*add)(float *dst, const float *src, size_t n);
+    void (*mul)(float *dst, const float *src, size_t n);
+    void (*relu)(float *dst, const float *src, size_t n);
+    float (*sum)(const float *x, size_t n);
+    float (*max)(const float *x, size_t n);
+    float (*dot)(const float *x, const float *y, size_t n);
+    void (*gemm_tile)(size_t kc, const float *a, const float *b, float *c, size_t ldc,
+                      int accumulate);
+} TensorKernelTable;
+
+static const TensorKernelTable scalar_kernels = {
+    "scalar", scalar_fill, scalar_scale, scalar_axpy, scalar_add, scalar_mul, scalar_relu,
+    scalar_sum, scalar_max, scalar_dot, scalar_gemm_tile
+};
+
+#if TENSOR_KERNELS_X86
+static const TensorKernelTable sse_kernels = {
+    "sse", sse_fill, sse_scale, sse_axpy, sse_add, sse_mul, sse_relu,
+    sse_sum, sse_max, sse_dot, scalar_gemm_tile
+};
+
+static const TensorKernelTable avx2_kernels = {
+    "avx2", avx2_fill, avx2_scale, avx2_axpy, avx2_add, avx2_mul, avx2_relu,
+    avx2_sum, avx2_max, avx2_dot, avx2_gemm_tile
+};
+#endif
+
+static const TensorKernelTable *kernels = &scalar_kernels;
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+static void select_kernels(void) {
+#if TENSOR_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        kernels = &avx2_kernels;
+    } else if (__builtin_cpu_supports("sse2")) {
+        kernels = &sse_kernels;
+    }
+#endif
+}
+
+static const TensorKernelTable *active_kernels(void) {
+    pthread_once(&kernels_once, select_kernels);
+    return kernels;
+}
+
+const char *tensor_kernel_isa(void) {
+    return active_kernels()->isa;
+}
+
+/* Public entry points */
+
+void tensor_kernel_fill(float *dst, float value, size_t n) {
+    active_kernels()->fill(dst, value, n);
+}
+
+void tensor_kernel_copy(float *dst, const float *src, size_t n) {
+    /* libc already picks the widest moves available */
+    if (dst != src) memmove(dst, src, n * sizeof(float));
+}
+
+void tensor_kernel_scale(float *dst, float alpha, size_t n) {
+    active_kernels()->scale(dst, alpha, n);
+}
+
+void tensor_kernel_axpy(float *y, float alpha, const float *x, size_t n) {
+    active_kernels()->axpy(y, alpha, x, n);
+}
+
+void tensor_kernel_add(float *dst, const float *src, size_t n) {
+    active_kernels()->add(dst, src, n);
+}
+
+void tensor_kernel_mul(float *dst, const float *src, size_t n) {
+    active_kernels()->mul(dst, src, n);
+}
+
+void tensor_kernel_relu(float *dst, const float *src, size_t n) {
+    active_kernels()->relu(dst, src, n);
+}
+
+float tensor_kernel_sum(const float *x, size_t n) {
+    return active_kernels()->sum(x, n);
+}
+
+float tensor_kernel_max(const float *x, size_t n) {
+    return active_kernels()->max(x, n);
+}
+
+float tensor_kernel_dot(const float *x, const float *y, size_t n) {
+    return active_kernels()->dot(x, y, n);
+}
+
+float tensor_kernel_norm(const float *x, size_t n) {
+    return sqrtf(active_kernels()->dot(x, x, n));
+}
+
+/* Packed SGEMM.  b is copied in GEMM_KC x GEMM_NC blocks into panels of
+ * GEMM_NR columns, a in GEMM_MC x GEMM_KC blocks into panels of GEMM_MR
+ * rows, so the micro-kernel streams both from cache with unit stride.
+ * Panels are zero-padded, and edge tiles go through a small buffer. */
+
+#define GEMM_KC 256
+#define GEMM_MC 96
+#define GEMM_NC 1024
+
+static void gemm_pack_a(float *dst, const float *a, size_t lda, size_t mc, size_t kc) {
+    for (size_t i0 = 0; i0 < mc; i0 += GEMM_MR) {
+        size_t rows = mc - i0 < GEMM_MR ? mc - i0 : GEMM_MR;
+        for (size_t p = 0; p < kc; p++) {
+            for (size_t i = 0; i < GEMM_MR; i++) {
+                *dst++ = i < rows ? a[(i0 + i) * lda + p] : 0.0f;
+            }
+        }
+    }
+}
+
+static void gemm_pack_b(float *dst, const float *b, size_t ldb, size_t kc, size_t nc) {
+    for (size_t j0 = 0; j0 < nc; j0 += GEMM_NR) {
+        size_t cols = nc - j0 < GEMM_NR ? nc - j0 : GEMM_NR;
+        for (size_t p = 0; p < kc; p++) {
+            const float *row = b + p * ldb + j0;
+            size_t j = 0;
+            for (; j < cols; j++) *dst++ = row[j];
+            for (; j < GEMM_NR; j++) *dst++ = 0.0f;
+        }
+    }
+}
+
+/* Unpacked fallback for when the packing buffers cannot be allocated */
+static void gemm_unpacked(const TensorKernelTable *kt, float *c, const float *a, const float *b,
+                          size_t m, size_t k, size_t n) {
+    for (size_t i = 0; i < m; i++) {
+        kt->fill(c + i * n, 0.0f, n);
+        for (size_t p = 0; p < k; p++) kt->axpy(c + i * n, a[i * k + p], b + p * n, n);
+    }
+}
+
+/* c = a * b for row-major a (m x k) and b (k x n) */
+void tensor_kernel_matmul(float *c, const float *a, const float *b, size_t m, size_t k,
+                          size_t n) {
+    const TensorKernelTable *kt = active_kernels();
+    if (m == 0 || n == 0) return;
+    
+    float *packed_a = tensor_alloc(GEMM_MC * GEMM_KC);
+    float *packed_b = tensor_alloc(GEMM_KC * (GEMM_NC + GEMM_NR));
+    if (!packed_a || !packed_b || k == 0) {
+        tensor_free(packed_a);
+        tensor_free(packed_b);
+        gemm_unpacked(kt, c, a, b, m, k, n);
+        return;
+    }
+    
+    float edge[GEMM_MR * GEMM_NR];
+    for (size_t jc = 0; jc < n; jc += GEMM_NC) {
+        size_t nc = n - jc < GEMM_NC ? n - jc : GEMM_NC;
+        for (size_t pc = 0; pc < k; pc += GEMM_KC) {
+            size_t kc = k - pc < GEMM_KC ? k - pc : GEMM_KC;
+            int accumulate = pc > 0;
+            gemm_pack_b(packed_b, b + pc * n + jc, n, kc, nc);
+    
+            for (size_t ic = 0; ic < m; ic += GEMM_MC) {
+                size_t mc = m - ic < GEMM_MC ? m - ic : GEMM_MC;
+                gemm_pack_a(packed_a, a + ic * k + pc, k, mc, kc);
+    
+                for (size_t jr = 0; jr < nc; jr += GEMM_NR) {
+                    size_t cols = nc - jr < GEMM_NR ? nc - jr : GEMM_NR;
+                    const float *panel_b = packed_b + jr * kc;
+                    for (size_t ir = 0; ir < mc; ir += GEMM_MR) {
+                        size_t rows = mc - ir < GEMM_MR ? mc - ir : GEMM_MR;
+                        const float *panel_a = packed_a + ir * kc;
+                        float *tile = c + (ic + ir) * n + jc + jr;
+    
+                        if (rows == GEMM_MR && cols == GEMM_NR) {
+                            kt->gemm_tile(kc, panel_a, panel_b, tile, n, accumulate);
+                            continue;
+                        }
+                        kt->gemm_tile(kc, panel_a, panel_b, edge, GEMM_NR, 0);
+                        for (size_t i = 0; i < rows; i++) {
+                            for (size_t j = 0; j < cols; j++) {
+                                float v = edge[i * GEMM_NR + j];
+                                tile[i * n + j] = accumulate ? tile[i * n + j] + v : v;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    
+    tensor_free(packed_a);
+    tensor_free(packed_b);
+}
+
+/* Direct 2D convolution, without unrolling the input into columns: each
+ * filter tap adds a shifted input row, scaled, to an output row.  Rows
+ * are taken in bands small enough that the band of output stays in
+ * cache while every tap passes over it. */
+
+#define CONV_BAND_ELEMENTS 8192
+
+void tensor_kernel_conv2d(float *out, const float *in, const float *filter, size_t channels,
+                          size_t height, size_t width, size_t kh, size_t kw, size_t first,
+                          size_t rows) {
+    const TensorKernelTable *kt = active_kernels();
+    size_t out_width = width - kw + 1;
+    size_t band = CONV_BAND_ELEMENTS / out_width;
+    if (band == 0) band = 1;
+    
+    for (size_t r0 = first; r0 < first + rows; r0 += band) {
+        size_t r1 = r0 + band < first + rows ? r0 + band : first + rows;
+        for (size_t r = r0; r < r1; r++) kt->fill(out + r * out_width, 0.0f, out_width);
+    
+        for (size_t ch = 0; ch < channels; ch++) {
+            const float *plane = in + ch * height * width;
+            const float *taps = filter + ch * kh * kw;
+            for (size_t i = 0; i < kh; i++) {
+                for (size_t j = 0; j < kw; j++) {
+                    float w = taps[i * kw + j];
+                    for (size_t r = r0; r < r1; r++) {
+                        kt->axpy(out + r * out_width, w, plane + (r + i) * width + j, out_width);
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,48 @@
+/* Tensor Kernels Header
+ * Vectorized loops over flat float arrays, dispatched at runtime
+ */
+
+#ifndef TENSOR_KERNELS_H
+#define TENSOR_KERNELS_H
+
+#include <stddef.h>
+
+/* Alignment of buffers from tensor_alloc, one cache line */
+#define TENSOR_ALIGNMENT 64
+
+/* Aligned storage */
+extern float *tensor_alloc(size_t count);
+extern float *tensor_alloc_zero(size_t count);
+extern void tensor_free(float *data);
+
+/* Elementwise kernels; dst and src may be the same array */
+extern void tensor_kernel_fill(float *dst, float value, size_t n);
+extern void tensor_kernel_copy(float *dst, const float *src, size_t n);
+extern void tensor_kernel_scale(float *dst, float alpha, size_t n);
+extern void tensor_kernel_axpy(float *y, float alpha, const float *x, size_t n);
+extern void tensor_kernel_add(float *dst, const float *src, size_t n);
+extern void tensor_kernel_mul(float *dst, const float *src, size_t n);
+extern void tensor_kernel_relu(float *dst, const float *src, size_t n);
+
+/* Reductions */
+extern float tensor_kernel_sum(const float *x, size_t n);
+extern float tensor_kernel_max(const float *x, size_t n);
+extern float tensor_kernel_dot(const float *x, const float *y, size_t n);
+extern float tensor_kernel_norm(const float *x, size_t n);
+
+/* Row-major matrix product, c = a (m x k) * b (k x n), packed and
+ * register-blocked */
+extern void tensor_kernel_matmul(float *c, const float *a, const float *b, size_t m, size_t k,
+                                 size_t n);
+
+/* Rows first..first+rows-1 of one output plane of a valid, stride-1 2D
+ * convolution: in is channels x height x width, filter channels x kh x kw,
+ * and out (height-kh+1) x (width-kw+1) */
+extern void tensor_kernel_conv2d(float *out, const float *in, const float *filter, size_t channels,
+                                 size_t height, size_t width, size_t kh, size_t kw, size_t first,
+                                 size_t rows);
+
+/* Name of the instruction set selected for this CPU */
+extern const char *tensor_kernel_isa(void);
+
+#endif /* TENSOR_KERNELS_H */
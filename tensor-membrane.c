@@ -4,12 +4,22 @@
 
 #include "rc.h"
 #include "cognitive.h"
+#include "tensor-membrane.h"
+#include "tensor-kernels.h"
+#include "intern.h"
 #include <math.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <ctype.h>
+#include <pthread.h>
 
 /* Prime Factorization Utilities */
 
@@ -73,62 +83,22 @@ bool factors_compatible(uint32_t *f1, uint32_t c1, uint32_t *f2, uint32_t c2) {
     return prime_product(f1, c1) == prime_product(f2, c2);
 }
 
+/* Layout: each factor is one axis of that extent, in order, so
+ * [2,2,3] is a 2x2x3 tensor.  Storage is row-major: the last axis
+ * varies fastest. */
+
 uint32_t compute_tensor_dimensions(uint32_t *factors, uint32_t count) {
     if (!factors || count == 0) return 0;
-    
-    /* Each unique prime factor represents a dimension */
-    uint32_t unique_primes[16];
-    uint32_t unique_count = 0;
-    
-    for (uint32_t i = 0; i < count && unique_count < 16; i++) {
-        bool found = false;
-        for (uint32_t j = 0; j < unique_count; j++) {
-            if (unique_primes[j] == factors[i]) {
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
-            unique_primes[unique_count++] = factors[i];
-        }
-    }
-    
-    return unique_count;
+    return count;
 }
 
 size_t compute_tensor_size(uint32_t *factors, uint32_t count) {
     if (!factors || count == 0) return 0;
     
-    /* Group factors by prime value and use powers as dimension sizes */
-    uint32_t unique_primes[16];
-    uint32_t prime_powers[16];
-    uint32_t unique_count = 0;
-    
-    for (uint32_t i = 0; i < count && unique_count < 16; i++) {
-        uint32_t prime = factors[i];
-        bool found = false;
-        
-        for (uint32_t j = 0; j < unique_count; j++) {
-            if (unique_primes[j] == prime) {
-                prime_powers[j]++;
-                found = true;
-                break;
-            }
-        }
-        
-        if (!found) {
-            unique_primes[unique_count] = prime;
-            prime_powers[unique_count] = 1;
-            unique_count++;
-        }
-    }
-    
-    /* Calculate total size as product of dimension sizes */
     size_t total_size = 1;
-    for (uint32_t i = 0; i < unique_count; i++) {
-        total_size *= prime_powers[i];
+    for (uint32_t i = 0; i < count; i++) {
+        total_size *= factors[i];
     }
-    
     return total_size;
 }
 
@@ -138,13 +108,66 @@ bool can_reshape(uint32_t *from_factors, uint32_t *to_factors,
     return factors_compatible(from_factors, from_count, to_factors, to_count);
 }
 
+/* Reference-counted element storage.  A membrane and any views of it
+ * share one buffer; whoever writes to a shared buffer copies first.
+ * A buffer mapped from a file is instead written in place by the one
+ * membrane it is pinned to, and copied by everyone else. */
+typedef struct {
+    float *data;
+    size_t count;
+    int refs;
+    void *map;                      /* file mapping, header first, or NULL */
+    size_t map_size;
+    bool readonly;
+    bool shm;                       /* path names a shared memory segment */
+    char *path;
+    TensorMembraneImpl *pinned;     /* the membrane that owns the file */
+} TensorBuffer;
+
+static TensorBuffer *buffer_create(size_t count, bool zero) {
+    TensorBuffer *buffer = malloc(sizeof(TensorBuffer));
+    if (!buffer) return NULL;
+    
+    buffer->data = zero ? tensor_alloc_zero(count) : tensor_alloc(count);
+    if (!buffer->data) {
+        free(buffer);
+        return NULL;
+    }
+    buffer->count = count;
+    buffer->refs = 1;
+    buffer->map = NULL;
+    buffer->map_size = 0;
+    buffer->readonly = false;
+    buffer->shm = false;
+    buffer->path = NULL;
+    buffer->pinned = NULL;
+    return buffer;
+}
+
+static void buffer_release(TensorBuffer *buffer) {
+    if (!buffer || --buffer->refs > 0) return;
+    if (buffer->map) {
+        munmap(buffer->map, buffer->map_size);
+        free(buffer->path);
+    } else {
+        tensor_free(buffer->data);
+    }
+    free(buffer);
+}
+
 /* Enhanced Tensor Membrane Structure */
 typedef struct TensorMembraneImpl {
     uint32_t id;                    /* Unique membrane identifier */
     uint32_t prime_factors[16];     /* Prime factorization shape */
     uint32_t factor_count;          /* Number of prime factors */
-    float *data;                    /* Tensor data storage */
-    size_t data_size;               /* Size in bytes */
+    uint32_t rank;                  /* Shape descriptor, derived from */
+    uint32_t shape[16];             /*   the factors by membrane_layout */
+    size_t strides[16];             /*   and kept until the next resize */
+    size_t element_count;
+    TensorBuffer *buffer;           /* Tensor data storage, maybe shared */
+    float *data;                    /* First element, inside buffer */
+    bool contiguous;                /* Strides are the row-major ones */
+    uint32_t view_of;               /* Membrane this was sliced from, or 0 */
     uint64_t version;               /* Version for synchronization */
     struct TensorMembraneImpl *parent;  /* Parent membrane (for nesting) */
     struct TensorMembraneImpl **children; /* Child membranes */
@@ -155,9 +178,10 @@ typedef struct TensorMembraneImpl {
     
     /* P-system specific fields */
     uint32_t energy_level;          /* Available energy for operations */
-    char **objects;                 /* Object symbols in membrane */
-    uint32_t object_count;          /* Number of objects */
-    uint32_t max_objects;           /* Maximum object capacity */
+    Multiset objects;               /* Interned object symbols with multiplicities */
+    
+    /* Write tracking for snapshots, one bit per page; NULL when off */
+    uint64_t *dirty;
     
     /* Performance metrics */
     uint64_t operation_count;
@@ -165,23 +189,499 @@ typedef struct TensorMembraneImpl {
     float utilization;
 } TensorMembraneImpl;
 
-/* Global membrane registry */
-static TensorMembraneImpl *membrane_registry[64];
+/* Recompute the cached shape descriptor from the factors */
+static void membrane_layout(TensorMembraneImpl *membrane) {
+    membrane->rank = compute_tensor_dimensions(membrane->prime_factors, membrane->factor_count);
+    
+    size_t stride = 1;
+    for (int i = (int)membrane->rank - 1; i >= 0; i--) {
+        membrane->shape[i] = membrane->prime_factors[i];
+        membrane->strides[i] = stride;
+        stride *= membrane->shape[i];
+    }
+    for (uint32_t i = membrane->rank; i < 16; i++) {
+        membrane->shape[i] = 0;
+        membrane->strides[i] = 0;
+    }
+    membrane->element_count = stride;
+    membrane->contiguous = true;
+}
+
+/* Copy count elements, in row-major order of the membrane's shape and
+ * starting at logical offset start, into out.  Works for any strides;
+ * runs along the last axis are copied in one go. */
+static void membrane_gather(TensorMembraneImpl *membrane, size_t start, float *out,
+                            size_t count) {
+    if (membrane->contiguous) {
+        memcpy(out, membrane->data + start, count * sizeof(float));
+        return;
+    }
+    
+    uint32_t last = membrane->rank - 1;
+    uint32_t index[16];
+    size_t position = 0;
+    for (int i = (int)last; i >= 0; i--) {
+        index[i] = start % membrane->shape[i];
+        start /= membrane->shape[i];
+        position += index[i] * membrane->strides[i];
+    }
+    
+    size_t step = membrane->strides[last];
+    while (count > 0) {
+        size_t run = membrane->shape[last] - index[last];
+        if (run > count) run = count;
+        
+        const float *p = membrane->data + position;
+        for (size_t k = 0; k < run; k++) out[k] = p[k * step];
+        out += run;
+        count -= run;
+        
+        /* Carry into the outer axes */
+        index[last] += run;
+        position += run * step;
+        for (uint32_t i = last; i > 0 && index[i] == membrane->shape[i]; i--) {
+            position -= membrane->shape[i] * membrane->strides[i];
+            index[i] = 0;
+            index[i - 1]++;
+            position += membrane->strides[i - 1];
+        }
+    }
+}
+
+/* Give membrane a private, contiguous buffer before it is written.  Does
+ * nothing when it already has one, or owns its file; keep = false skips
+ * copying the old contents for writes that overwrite every element. */
+static bool membrane_owns_buffer(TensorMembraneImpl *membrane) {
+    TensorBuffer *buffer = membrane->buffer;
+    return buffer->map ? buffer->pinned == membrane : buffer->refs == 1;
+}
+
+static int membrane_own(TensorMembraneImpl *membrane, bool keep) {
+    if (membrane->contiguous && membrane_owns_buffer(membrane)) return 0;
+    
+    TensorBuffer *buffer = buffer_create(membrane->element_count, false);
+    if (!buffer) return -1;
+    if (keep) membrane_gather(membrane, 0, buffer->data, membrane->element_count);
+    
+    buffer_release(membrane->buffer);
+    membrane->buffer = buffer;
+    membrane->data = buffer->data;
+    membrane_layout(membrane);
+    membrane->view_of = 0;
+    return 0;
+}
+
+/* Contiguous elements for a read: the membrane's own data, or a gathered
+ * copy in *scratch which the caller frees */
+static const float *membrane_read(TensorMembraneImpl *membrane, float **scratch) {
+    *scratch = NULL;
+    if (membrane->contiguous) return membrane->data;
+    
+    *scratch = tensor_alloc(membrane->element_count);
+    if (!*scratch) return NULL;
+    membrane_gather(membrane, 0, *scratch, membrane->element_count);
+    return *scratch;
+}
+
+/* File-backed membranes.  The file is a header page followed by the
+ * elements in row-major order, in host byte order.  Opening maps it
+ * without reading the data; writes land in the page cache and
+ * membrane_flush pushes them out with a fresh checksum.  A POSIX shared
+ * memory segment works the same way, minus the disk.
+ *
+ * Every process with the file open writes to the same pages.  The live
+ * part of the header is shared state: the version is bumped atomically
+ * by each write, and bulk writes and flushes hold a process-shared,
+ * robust mutex. */
+#define MEMBRANE_FILE_MAGIC "RCMEMBR"
+#define MEMBRANE_FILE_FORMAT 2
+#define MEMBRANE_FILE_HEADER 4096
+#define MEMBRANE_FILE_DIRTY 1       /* written since the last flush */
+#define MEMBRANE_SHM_PREFIX "/rc-membrane-"
+
+typedef struct {
+    char magic[8];
+    uint32_t format;                /* stored last when a file is created */
+    
+    /* Set on creation and flush, covered by header_checksum */
+    uint32_t factor_count;
+    uint32_t factors[16];
+    uint64_t element_count;
+    uint64_t checksum;              /* of the data as of the last flush */
+    uint64_t header_checksum;       /* of the fields above */
+    
+    /* Live state */
+    uint64_t version;
+    uint32_t flags;
+    uint32_t reserved;
+    pthread_mutex_t lock;
+} MembraneFileHeader;
+
+/* FNV-1a over 64-bit words, with any tail bytes folded in last */
+static uint64_t membrane_checksum(const void *data, size_t bytes) {
+    const unsigned char *p = data;
+    uint64_t hash = 14695981039346656037ull;
+    size_t i = 0;
+    
+    for (; i + 8 <= bytes; i += 8) {
+        uint64_t word;
+        memcpy(&word, p + i, 8);
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    for (; i < bytes; i++) {
+        hash = (hash ^ p[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+#define FILE_HEADER_SEALED(field) \
+    (offsetof(MembraneFileHeader, field) - offsetof(MembraneFileHeader, factor_count))
+
+static uint64_t file_header_checksum(MembraneFileHeader *header) {
+    return membrane_checksum(&header->factor_count, FILE_HEADER_SEALED(header_checksum));
+}
+
+static void file_header_seal(MembraneFileHeader *header) {
+    header->header_checksum = file_header_checksum(header);
+}
+
+static MembraneFileHeader *membrane_file(TensorMembraneImpl *membrane) {
+    TensorBuffer *buffer = membrane->buffer;
+    return buffer->map && buffer->pinned == membrane ? buffer->map : NULL;
+}
+
+/* Hold the file's mutex around a bulk write.  When a holder died the
+ * next taker inherits the lock; the data may be half-written, but the
+ * file is already marked stale. */
+static void membrane_lock(TensorMembraneImpl *membrane) {
+    MembraneFileHeader *header = membrane_file(membrane);
+    if (header && pthread_mutex_lock(&header->lock) == EOWNERDEAD) {
+        pthread_mutex_consistent(&header->lock);
+    }
+}
+
+static void membrane_unlock(TensorMembraneImpl *membrane) {
+    MembraneFileHeader *header = membrane_file(membrane);
+    if (header) pthread_mutex_unlock(&header->lock);
+}
+
+/* Record a write to count elements from row-major offset */
+static void membrane_touch(TensorMembraneImpl *membrane, size_t offset, size_t count) {
+    membrane->operation_count++;
+    
+    if (membrane->dirty && count > 0) {
+        size_t last = (offset + count - 1) / MEMBRANE_PAGE_ELEMENTS;
+        for (size_t page = offset / MEMBRANE_PAGE_ELEMENTS; page <= last; page++) {
+            membrane->dirty[page / 64] |= 1ull << (page % 64);
+        }
+    }
+    
+    /* A file's version counts writes from every process, and any write
+     * makes the checksum stale */
+    MembraneFileHeader *header = membrane_file(membrane);
+    if (header) {
+        membrane->version = __atomic_add_fetch(&header->version, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_or(&header->flags, MEMBRANE_FILE_DIRTY, __ATOMIC_RELAXED);
+    } else {
+        membrane->version++;
+    }
+}
+
+/* Write shape and checksum to the header and sync the file */
+int membrane_flush(TensorMembraneImpl *membrane) {
+    MembraneFileHeader *header = membrane ? membrane_file(membrane) : NULL;
+    if (!header) return -1;
+    
+    TensorBuffer *buffer = membrane->buffer;
+    membrane_lock(membrane);
+    header->factor_count = membrane->factor_count;
+    memcpy(header->factors, membrane->prime_factors, sizeof(header->factors));
+    header->checksum = membrane_checksum(buffer->data, buffer->count * sizeof(float));
+    file_header_seal(header);
+    __atomic_fetch_and(&header->flags, ~MEMBRANE_FILE_DIRTY, __ATOMIC_RELAXED);
+    membrane_unlock(membrane);
+    
+    return msync(buffer->map, buffer->map_size, MS_SYNC) == 0 ? 0 : -1;
+}
+
+/* Compare the data against the checksum of the last flush: 1 if they
+ * agree, 0 if not or if the file was written since */
+int membrane_verify(TensorMembraneImpl *membrane) {
+    if (!membrane || !membrane->buffer->map) return -1;
+    
+    TensorBuffer *buffer = membrane->buffer;
+    MembraneFileHeader *header = buffer->map;
+    if (__atomic_load_n(&header->flags, __ATOMIC_RELAXED) & MEMBRANE_FILE_DIRTY) return 0;
+    return membrane_checksum(buffer->data, buffer->count * sizeof(float)) == header->checksum;
+}
+
+/* Remove the file or segment name; mappings stay valid until unmapped */
+int membrane_unlink(TensorMembraneImpl *membrane) {
+    if (!membrane || !membrane->buffer->map) return -1;
+    
+    TensorBuffer *buffer = membrane->buffer;
+    if (!buffer->shm) return unlink(buffer->path);
+    
+    char name[256];
+    snprintf(name, sizeof(name), "%s%s", MEMBRANE_SHM_PREFIX, buffer->path);
+    return shm_unlink(name);
+}
+
+static void file_header_init(MembraneFileHeader *header, uint32_t *factors, uint32_t count,
+                             size_t elements) {
+    memcpy(header->magic, MEMBRANE_FILE_MAGIC, sizeof(header->magic));
+    header->factor_count = count;
+    memset(header->factors, 0, sizeof(header->factors));
+    memcpy(header->factors, factors, count * sizeof(uint32_t));
+    header->element_count = elements;
+    header->version = 1;
+    header->flags = 0;
+    header->reserved = 0;
+    
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&header->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+/* Open a file or shared memory segment, creating it exclusively when
+ * create is set so only one process initializes it */
+static int membrane_file_open(const char *path, bool shm, bool readonly, bool create,
+                              bool *created) {
+    char name[256];
+    if (shm) {
+        if (strchr(path, '/') || strlen(path) + sizeof(MEMBRANE_SHM_PREFIX) > sizeof(name)) {
+            errno = EINVAL;
+            return -1;
+        }
+        snprintf(name, sizeof(name), "%s%s", MEMBRANE_SHM_PREFIX, path);
+        path = name;
+    }
+    
+    int flags = (readonly ? O_RDONLY : O_RDWR) | O_CLOEXEC;
+    int fd = -1;
+    *created = false;
+    if (create && !readonly) {
+        fd = shm ? shm_open(path, flags | O_CREAT | O_EXCL, 0666)
+                 : open(path, flags | O_CREAT | O_EXCL, 0666);
+        if (fd >= 0) *created = true;
+        else if (errno != EEXIST) return -1;
+    }
+    if (fd < 0) fd = shm ? shm_open(path, flags, 0666) : open(path, flags);
+    return fd;
+}
+
+/* Map path as a buffer.  With factors the file is created if missing,
+ * otherwise its shape must match; without, the shape comes from the
+ * header.  The shape used is returned through factors_out. */
+static TensorBuffer *buffer_map(const char *path, bool shm, uint32_t *factors, uint32_t count,
+                                bool readonly, uint32_t *factors_out, uint32_t *count_out,
+                                uint64_t *version, const char **error) {
+    bool created;
+    int fd = membrane_file_open(path, shm, readonly, factors != NULL, &created);
+    if (fd < 0) {
+        *error = "cannot open file";
+        return NULL;
+    }
+    
+    /* Someone else's fresh file may still be getting its size */
+    struct stat st;
+    for (int tries = 0; ; tries++) {
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            *error = "cannot stat file";
+            return NULL;
+        }
+        if (created || st.st_size > 0 || tries == 100) break;
+        usleep(1000);
+    }
+    
+    /* An empty file of our own is ours to lay out */
+    bool fresh = created || (st.st_size == 0 && factors && !readonly && !shm);
+    size_t elements = fresh ? compute_tensor_size(factors, count) : 0;
+    size_t size = fresh ? MEMBRANE_FILE_HEADER + elements * sizeof(float) : (size_t)st.st_size;
+    if (size < MEMBRANE_FILE_HEADER) {
+        close(fd);
+        *error = st.st_size == 0 ? "file is empty" : "not a membrane file";
+        return NULL;
+    }
+    if (fresh && ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        *error = "cannot size file";
+        return NULL;
+    }
+    
+    void *map = mmap(NULL, size, readonly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED,
+                     fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        *error = "cannot map file";
+        return NULL;
+    }
+    
+    MembraneFileHeader *header = map;
+    if (fresh) {
+        file_header_init(header, factors, count, elements);
+        header->checksum = membrane_checksum((char*)map + MEMBRANE_FILE_HEADER,
+                                             elements * sizeof(float));
+        file_header_seal(header);
+        __atomic_store_n(&header->format, MEMBRANE_FILE_FORMAT, __ATOMIC_RELEASE);
+    } else {
+        for (int tries = 0; tries < 100 &&
+             __atomic_load_n(&header->format, __ATOMIC_ACQUIRE) == 0; tries++) {
+            usleep(1000);
+        }
+    }
+    
+    /* Only the header is read here; the data pages fault in on use */
+    const char *problem = NULL;
+    bool locked = false;
+    if (memcmp(header->magic, MEMBRANE_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->format != MEMBRANE_FILE_FORMAT) {
+        problem = "not a membrane file";
+    } else {
+        if (!readonly) {
+            if (pthread_mutex_lock(&header->lock) == EOWNERDEAD) {
+                pthread_mutex_consistent(&header->lock);
+            }
+            locked = true;
+        }
+        if (header->header_checksum != file_header_checksum(header)) {
+            problem = "corrupt header";
+        } else if (header->factor_count == 0 || header->factor_count > 16 ||
+                   compute_tensor_size(header->factors, header->factor_count) !=
+                   header->element_count ||
+                   header->element_count > (size - MEMBRANE_FILE_HEADER) / sizeof(float)) {
+            problem = "corrupt header";
+        } else if (factors && (count != header->factor_count ||
+                               memcmp(factors, header->factors,
+                                      count * sizeof(uint32_t)) != 0)) {
+            problem = "shape does not match file";
+        }
+    }
+    if (!problem) {
+        elements = header->element_count;
+        *count_out = header->factor_count;
+        memcpy(factors_out, header->factors, header->factor_count * sizeof(uint32_t));
+        *version = __atomic_load_n(&header->version, __ATOMIC_RELAXED);
+    }
+    if (locked) pthread_mutex_unlock(&header->lock);
+    
+    TensorBuffer *buffer = problem ? NULL : malloc(sizeof(TensorBuffer));
+    char *name = buffer ? strdup(path) : NULL;
+    if (!name) {
+        free(buffer);
+        munmap(map, size);
+        *error = problem ? problem : "out of memory";
+        return NULL;
+    }
+    
+    buffer->data = (float*)((char*)map + MEMBRANE_FILE_HEADER);
+    buffer->count = elements;
+    buffer->refs = 1;
+    buffer->map = map;
+    buffer->map_size = size;
+    buffer->readonly = readonly;
+    buffer->shm = shm;
+    buffer->path = name;
+    buffer->pinned = NULL;
+    return buffer;
+}
+
+/* Global membrane registry: a slot map.  A membrane id packs the slot
+ * index (plus one, so ids start at 1) in the low 24 bits and the slot's
+ * generation above it; destroying a membrane bumps the generation so
+ * stale ids stop resolving.  Generations are kept to 7 bits so ids stay
+ * positive ints for the shell, and a slot that exhausts them is retired
+ * instead of recycled. */
+#define MEMBRANE_INDEX_BITS 24
+#define MEMBRANE_INDEX_MASK ((1u << MEMBRANE_INDEX_BITS) - 1)
+#define MEMBRANE_GENERATION_MAX 0x7F
+#define MEMBRANE_SLOT_NONE UINT32_MAX
+
+typedef struct {
+    TensorMembraneImpl *membrane;   /* NULL while the slot is free */
+    uint32_t generation;
+    uint32_t next_free;             /* free list link */
+} MembraneSlot;
+
+static MembraneSlot *membrane_slots = NULL;
+static uint32_t slot_capacity = 0;
+static uint32_t slot_high = 0;      /* slots ever handed out */
+static uint32_t free_slot = MEMBRANE_SLOT_NONE;
 static uint32_t membrane_count = 0;
-static uint32_t next_membrane_id = 1;
+
+/* Claim a slot for membrane and return its id, 0 if the map is full */
+static uint32_t membrane_slot_acquire(TensorMembraneImpl *membrane) {
+    uint32_t index;
+    
+    if (free_slot != MEMBRANE_SLOT_NONE) {
+        index = free_slot;
+        free_slot = membrane_slots[index].next_free;
+    } else {
+        if (slot_high >= MEMBRANE_INDEX_MASK) return 0;
+        if (slot_high == slot_capacity) {
+            uint32_t capacity = slot_capacity ? slot_capacity * 2 : 64;
+            if (capacity > MEMBRANE_INDEX_MASK) capacity = MEMBRANE_INDEX_MASK;
+            MembraneSlot *slots = realloc(membrane_slots, capacity * sizeof(MembraneSlot));
+            if (!slots) return 0;
+            membrane_slots = slots;
+            slot_capacity = capacity;
+        }
+        index = slot_high++;
+        membrane_slots[index].generation = 0;
+    }
+    
+    membrane_slots[index].membrane = membrane;
+    membrane_slots[index].next_free = MEMBRANE_SLOT_NONE;
+    membrane_count++;
+    return (membrane_slots[index].generation << MEMBRANE_INDEX_BITS) | (index + 1);
+}
+
+static MembraneSlot *membrane_slot_lookup(uint32_t id) {
+    uint32_t index = (id & MEMBRANE_INDEX_MASK) - 1;
+    if ((id & MEMBRANE_INDEX_MASK) == 0 || index >= slot_high) return NULL;
+    
+    MembraneSlot *slot = &membrane_slots[index];
+    if (!slot->membrane || slot->generation != id >> MEMBRANE_INDEX_BITS) return NULL;
+    return slot;
+}
+
+static void membrane_slot_release(uint32_t id) {
+    MembraneSlot *slot = membrane_slot_lookup(id);
+    if (!slot) return;
+    
+    slot->membrane = NULL;
+    membrane_count--;
+    if (slot->generation == MEMBRANE_GENERATION_MAX) return; /* retired */
+    
+    slot->generation++;
+    slot->next_free = free_slot;
+    free_slot = (uint32_t)(slot - membrane_slots);
+}
 
 /* Membrane Lifecycle Management */
 
-TensorMembraneImpl *membrane_create(uint32_t *prime_factors, uint32_t count) {
-    if (!prime_factors || count == 0 || count > 16 || membrane_count >= 64) {
+/* Build and register a membrane.  Given a buffer it takes over the
+ * caller's reference and starts at the buffer's first element with
+ * row-major strides, which the caller may then adjust; otherwise it gets
+ * fresh zeroed storage. */
+static TensorMembraneImpl *membrane_new(uint32_t *prime_factors, uint32_t count,
+                                        TensorBuffer *buffer) {
+    if (!prime_factors || count == 0 || count > 16) {
+        buffer_release(buffer);
         return NULL;
     }
     
     TensorMembraneImpl *membrane = malloc(sizeof(TensorMembraneImpl));
-    if (!membrane) return NULL;
+    if (!membrane) {
+        buffer_release(buffer);
+        return NULL;
+    }
     
     /* Initialize membrane structure */
-    membrane->id = next_membrane_id++;
     membrane->factor_count = count;
     for (uint32_t i = 0; i < count; i++) {
         membrane->prime_factors[i] = prime_factors[i];
@@ -191,18 +691,14 @@ TensorMembraneImpl *membrane_create(uint32_t *prime_factors, uint32_t count) {
     }
     
     /* Calculate and allocate tensor data */
-    membrane->data_size = compute_tensor_size(prime_factors, count) * sizeof(float);
-    membrane->data = malloc(membrane->data_size);
-    if (!membrane->data) {
+    membrane_layout(membrane);
+    membrane->buffer = buffer ? buffer : buffer_create(membrane->element_count, true);
+    if (!membrane->buffer) {
         free(membrane);
         return NULL;
     }
-    
-    /* Initialize tensor data with small random values */
-    size_t element_count = membrane->data_size / sizeof(float);
-    for (size_t i = 0; i < element_count; i++) {
-        membrane->data[i] = ((float)rand() / RAND_MAX) * 0.1f;
-    }
+    membrane->data = membrane->buffer->data;
+    membrane->view_of = 0;
     
     /* Initialize P-system state */
     membrane->version = 1;
@@ -215,34 +711,130 @@ TensorMembraneImpl *membrane_create(uint32_t *prime_factors, uint32_t count) {
     membrane->energy_level = 100; /* Start with full energy */
     
     /* Initialize object container */
-    membrane->objects = malloc(16 * sizeof(char*));
-    membrane->object_count = 0;
-    membrane->max_objects = 16;
-    if (!membrane->objects) {
-        free(membrane->data);
-        free(membrane);
-        return NULL;
-    }
+    multiset_init(&membrane->objects);
     
     /* Initialize metrics */
     membrane->operation_count = 0;
     membrane->access_count = 0;
     membrane->utilization = 0.0f;
+    membrane->dirty = NULL;
     
     /* Register membrane */
-    membrane_registry[membrane_count++] = membrane;
+    membrane->id = membrane_slot_acquire(membrane);
+    if (membrane->id == 0) {
+        buffer_release(membrane->buffer);
+        free(membrane);
+        return NULL;
+    }
     
     return membrane;
 }
 
-TensorMembraneImpl *membrane_create_child(TensorMembraneImpl *parent, 
-                                         uint32_t *factors, uint32_t count) {
-    if (!parent || parent->child_count >= parent->max_children) {
+TensorMembraneImpl *membrane_create(uint32_t *prime_factors, uint32_t count) {
+    return membrane_new(prime_factors, count, NULL);
+}
+
+/* A membrane backed by a file, see buffer_map.  Read-only membranes can
+ * be shared by any number of processes; writing to one copies it into
+ * memory and leaves the file alone. */
+TensorMembraneImpl *membrane_open(const char *path, uint32_t *factors, uint32_t count,
+                                  int flags, const char **error) {
+    bool readonly = (flags & MEMBRANE_READONLY) != 0;
+    const char *ignored;
+    if (!error) error = &ignored;
+    *error = NULL;
+    if (!path || (factors && (count == 0 || count > 16))) {
+        *error = "invalid arguments";
         return NULL;
     }
     
-    TensorMembraneImpl *child = membrane_create(factors, count);
+    uint32_t shape[16];
+    uint32_t rank;
+    uint64_t version;
+    TensorBuffer *buffer = buffer_map(path, (flags & MEMBRANE_SHM) != 0, factors, count,
+                                      readonly, shape, &rank, &version, error);
+    if (!buffer) return NULL;
+    
+    TensorMembraneImpl *membrane = membrane_new(shape, rank, buffer);
+    if (!membrane) {
+        *error = "out of memory";
+        return NULL;
+    }
+    membrane->version = version;
+    
+    if (!readonly) {
+        buffer->pinned = membrane;
+        MembraneFileHeader *header = buffer->map;
+        if (__atomic_load_n(&header->flags, __ATOMIC_RELAXED) & MEMBRANE_FILE_DIRTY) {
+            *error = "checksum is stale";
+        }
+    }
+    return membrane;
+}
+
+/* Views share the source's buffer.  A slice takes elements start[i],
+ * start[i] + step[i], ... below stop[i] on each axis, with stop clamped
+ * to the extent; axes past count are taken whole.  Nothing is copied
+ * until one side writes. */
+TensorMembraneImpl *membrane_view(TensorMembraneImpl *source, uint32_t *start, uint32_t *stop,
+                                  uint32_t *step, uint32_t count) {
+    if (!source || count > source->rank) return NULL;
+    
+    uint32_t extents[16];
+    size_t offset = 0;
+    for (uint32_t i = 0; i < source->rank; i++) {
+        uint32_t first = i < count ? start[i] : 0;
+        uint32_t end = i < count ? stop[i] : source->shape[i];
+        uint32_t stride = i < count ? step[i] : 1;
+        if (end > source->shape[i]) end = source->shape[i];
+        if (stride == 0 || first >= end) return NULL;
+        
+        extents[i] = (end - first + stride - 1) / stride;
+        offset += first * source->strides[i];
+    }
+    
+    source->buffer->refs++;
+    TensorMembraneImpl *view = membrane_new(extents, source->rank, source->buffer);
+    if (!view) return NULL;
+    
+    /* Contiguous only if the strides still match the view's own
+     * row-major ones; extent-1 axes never move, so they don't count */
+    view->data = source->data + offset;
+    view->view_of = source->id;
+    bool contiguous = true;
+    for (uint32_t i = 0; i < source->rank; i++) {
+        size_t stride = source->strides[i] * (i < count ? step[i] : 1);
+        if (view->shape[i] > 1 && stride != view->strides[i]) contiguous = false;
+        view->strides[i] = stride;
+    }
+    view->contiguous = contiguous;
+    return view;
+}
+
+/* A reshaped alias of a contiguous membrane, sharing its buffer */
+TensorMembraneImpl *membrane_reshape_view(TensorMembraneImpl *source, uint32_t *factors,
+                                          uint32_t count) {
+    if (!source || !factors || count == 0 || count > 16) return NULL;
+    if (!source->contiguous) return NULL;
+    if (!can_reshape(source->prime_factors, factors, source->factor_count, count)) return NULL;
+    
+    source->buffer->refs++;
+    TensorMembraneImpl *view = membrane_new(factors, count, source->buffer);
+    if (!view) return NULL;
+    
+    view->data = source->data;
+    view->view_of = source->id;
+    return view;
+}
+
+/* Nest a new membrane in parent, destroying it if the parent is full */
+static TensorMembraneImpl *membrane_adopt(TensorMembraneImpl *parent,
+                                          TensorMembraneImpl *child) {
     if (!child) return NULL;
+    if (parent->child_count >= parent->max_children) {
+        membrane_destroy(child);
+        return NULL;
+    }
     
     /* Set up parent-child relationship */
     child->parent = parent;
@@ -260,27 +852,24 @@ TensorMembraneImpl *membrane_create_child(TensorMembraneImpl *parent,
     return child;
 }
 
+TensorMembraneImpl *membrane_create_child(TensorMembraneImpl *parent, 
+                                         uint32_t *factors, uint32_t count) {
+    if (!parent || parent->child_count >= parent->max_children) {
+        return NULL;
+    }
+    return membrane_adopt(parent, membrane_create(factors, count));
+}
+
 int membrane_destroy(TensorMembraneImpl *membrane) {
     if (!membrane) return -1;
     
     /* Remove from registry */
-    for (uint32_t i = 0; i < membrane_count; i++) {
-        if (membrane_registry[i] == membrane) {
-            /* Shift remaining entries */
-            for (uint32_t j = i; j < membrane_count - 1; j++) {
-                membrane_registry[j] = membrane_registry[j + 1];
-            }
-            membrane_count--;
-            break;
-        }
-    }
+    membrane_slot_release(membrane->id);
     
-    /* Destroy all children first */
+    /* Destroy all children first; each unlinks itself from our list */
     if (membrane->children) {
-        for (uint32_t i = 0; i < membrane->child_count; i++) {
-            if (membrane->children[i]) {
-                membrane_destroy(membrane->children[i]);
-            }
+        while (membrane->child_count > 0) {
+            membrane_destroy(membrane->children[0]);
         }
         free(membrane->children);
     }
@@ -299,14 +888,14 @@ int membrane_destroy(TensorMembraneImpl *membrane) {
         }
     }
     
-    /* Free resources */
-    if (membrane->data) free(membrane->data);
-    if (membrane->objects) {
-        for (uint32_t i = 0; i < membrane->object_count; i++) {
-            if (membrane->objects[i]) free(membrane->objects[i]);
-        }
-        free(membrane->objects);
+    /* Free resources; a file keeps what was last written to it */
+    if (membrane->buffer->pinned == membrane) {
+        membrane_flush(membrane);
+        membrane->buffer->pinned = NULL;
     }
+    buffer_release(membrane->buffer);
+    multiset_clear(&membrane->objects);
+    free(membrane->dirty);
     
     free(membrane);
     return 0;
@@ -321,17 +910,10 @@ int membrane_resize(TensorMembraneImpl *membrane, uint32_t *new_factors, uint32_
         return -1; /* Incompatible shapes */
     }
     
-    /* Calculate new size */
-    size_t new_size = compute_tensor_size(new_factors, count) * sizeof(float);
-    
-    /* Reallocate data if size changed */
-    if (new_size != membrane->data_size) {
-        float *new_data = realloc(membrane->data, new_size);
-        if (!new_data) return -1;
-        
-        membrane->data = new_data;
-        membrane->data_size = new_size;
-    }
+    /* The element count is unchanged, so a contiguous membrane keeps its
+     * buffer and only the shape changes.  A strided view has no row-major
+     * order to reinterpret and is compacted first. */
+    if (!membrane->contiguous && membrane_own(membrane, true) != 0) return -1;
     
     /* Update shape */
     membrane->factor_count = count;
@@ -341,6 +923,7 @@ int membrane_resize(TensorMembraneImpl *membrane, uint32_t *new_factors, uint32_
     for (uint32_t i = count; i < 16; i++) {
         membrane->prime_factors[i] = 0;
     }
+    membrane_layout(membrane);
     
     membrane->version++;
     return 0;
@@ -348,141 +931,567 @@ int membrane_resize(TensorMembraneImpl *membrane, uint32_t *new_factors, uint32_
 
 /* P-System Operations */
 
-int membrane_add_object(TensorMembraneImpl *membrane, const char *symbol) {
-    if (!membrane || !symbol || membrane->object_count >= membrane->max_objects) {
-        return -1;
-    }
+/* Structure access */
+
+uint32_t membrane_get_id(TensorMembraneImpl *membrane) {
+    return membrane ? membrane->id : 0;
+}
+
+Multiset *membrane_objects(TensorMembraneImpl *membrane) {
+    return membrane ? &membrane->objects : NULL;
+}
+
+TensorMembraneImpl *membrane_parent(TensorMembraneImpl *membrane) {
+    return membrane ? membrane->parent : NULL;
+}
+
+uint32_t membrane_children(TensorMembraneImpl *membrane, TensorMembraneImpl ***children) {
+    if (!membrane) return 0;
+    if (children) *children = membrane->children;
+    return membrane->child_count;
+}
+
+/* Write tracking.  Pages are MEMBRANE_PAGE_ELEMENTS elements in
+ * row-major order, so they survive reshapes and copy-on-write.  Only
+ * writes made through this process are seen; a membrane mapped from a
+ * shared file can also change under us. */
+
+int membrane_track_writes(TensorMembraneImpl *membrane) {
+    if (!membrane) return -1;
     
-    /* Check if object already exists */
-    for (uint32_t i = 0; i < membrane->object_count; i++) {
-        if (membrane->objects[i] && strcmp(membrane->objects[i], symbol) == 0) {
-            return 0; /* Already present */
-        }
+    size_t pages = (membrane->element_count + MEMBRANE_PAGE_ELEMENTS - 1) / MEMBRANE_PAGE_ELEMENTS;
+    size_t words = (pages + 63) / 64;
+    if (!membrane->dirty) {
+        membrane->dirty = malloc(words * sizeof(uint64_t));
+        if (!membrane->dirty) return -1;
+    }
+    memset(membrane->dirty, 0xFF, words * sizeof(uint64_t));
+    return 0;
+}
+
+const uint64_t *membrane_dirty_pages(TensorMembraneImpl *membrane, size_t *pages) {
+    if (!membrane) return NULL;
+    if (pages) {
+        *pages = (membrane->element_count + MEMBRANE_PAGE_ELEMENTS - 1) / MEMBRANE_PAGE_ELEMENTS;
+    }
+    return membrane->dirty;
+}
+
+void membrane_clear_dirty(TensorMembraneImpl *membrane) {
+    size_t pages;
+    if (!membrane || !membrane->dirty) return;
+    membrane_dirty_pages(membrane, &pages);
+    memset(membrane->dirty, 0, (pages + 63) / 64 * sizeof(uint64_t));
+}
+
+size_t membrane_element_count(TensorMembraneImpl *membrane) {
+    return membrane ? membrane->element_count : 0;
+}
+
+uint64_t membrane_version(TensorMembraneImpl *membrane) {
+    return membrane ? membrane->version : 0;
+}
+
+/* Whether the data can change other than through this membrane */
+bool membrane_is_mapped(TensorMembraneImpl *membrane) {
+    return membrane && membrane->buffer->map;
+}
+
+/* Objects form a multiset of interned symbols: adding, removing and
+ * transferring are counter updates on symbol ids. */
+
+int membrane_add_symbol(TensorMembraneImpl *membrane, uint32_t symbol, uint32_t count) {
+    if (!membrane) return -1;
+    return multiset_add(&membrane->objects, symbol, count);
+}
+
+int membrane_remove_symbol(TensorMembraneImpl *membrane, uint32_t symbol, uint32_t count) {
+    if (!membrane) return -1;
+    return multiset_remove(&membrane->objects, symbol, count);
+}
+
+uint32_t membrane_symbol_count(TensorMembraneImpl *membrane, uint32_t symbol) {
+    if (!membrane) return 0;
+    return multiset_count(&membrane->objects, symbol);
+}
+
+int membrane_transfer_symbol(TensorMembraneImpl *from, TensorMembraneImpl *to,
+                             uint32_t symbol, uint32_t count) {
+    if (!from || !to) return -1;
+    if (multiset_remove(&from->objects, symbol, count) != 0) return -1;
+    if (multiset_add(&to->objects, symbol, count) != 0) {
+        multiset_add(&from->objects, symbol, count); /* put them back */
+        return -1;
     }
-    
-    /* Add new object */
-    membrane->objects[membrane->object_count] = malloc(strlen(symbol) + 1);
-    if (!membrane->objects[membrane->object_count]) return -1;
-    
-    strcpy(membrane->objects[membrane->object_count], symbol);
-    membrane->object_count++;
-    
     return 0;
 }
 
+int membrane_add_object(TensorMembraneImpl *membrane, const char *symbol) {
+    if (!membrane || !symbol) return -1;
+    return membrane_add_symbol(membrane, symbol_intern(symbol), 1);
+}
+
 int membrane_remove_object(TensorMembraneImpl *membrane, const char *symbol) {
     if (!membrane || !symbol) return -1;
-    
-    for (uint32_t i = 0; i < membrane->object_count; i++) {
-        if (membrane->objects[i] && strcmp(membrane->objects[i], symbol) == 0) {
-            free(membrane->objects[i]);
-            
-            /* Shift remaining objects */
-            for (uint32_t j = i; j < membrane->object_count - 1; j++) {
-                membrane->objects[j] = membrane->objects[j + 1];
-            }
-            membrane->object_count--;
-            return 0;
-        }
-    }
-    
-    return -1; /* Object not found */
+    return membrane_remove_symbol(membrane, symbol_lookup(symbol), 1);
 }
 
 const char *membrane_find_object(TensorMembraneImpl *membrane, const char *symbol) {
     if (!membrane || !symbol) return NULL;
     
-    for (uint32_t i = 0; i < membrane->object_count; i++) {
-        if (membrane->objects[i] && strcmp(membrane->objects[i], symbol) == 0) {
-            return membrane->objects[i];
-        }
-    }
-    
-    return NULL;
+    uint32_t id = symbol_lookup(symbol);
+    return membrane_symbol_count(membrane, id) > 0 ? symbol_name(id) : NULL;
 }
 
 int membrane_transfer_object(TensorMembraneImpl *from, TensorMembraneImpl *to, 
                             const char *symbol) {
-    if (!from || !to || !symbol) return -1;
-    
-    /* Check if object exists in source */
-    if (!membrane_find_object(from, symbol)) return -1;
-    
-    /* Add to destination */
-    if (membrane_add_object(to, symbol) != 0) return -1;
-    
-    /* Remove from source */
-    return membrane_remove_object(from, symbol);
+    if (!symbol) return -1;
+    return membrane_transfer_symbol(from, to, symbol_lookup(symbol), 1);
 }
 
 /* Basic Tensor Operations */
 
-float membrane_get_element(TensorMembraneImpl *membrane, uint32_t *indices) {
-    if (!membrane || !indices || !membrane->data) return 0.0f;
+/* Flat offset of an element; indices has one entry per axis */
+int membrane_offset(TensorMembraneImpl *membrane, uint32_t *indices, size_t *offset) {
+    if (!membrane || !indices || !offset) return -1;
     
-    /* Calculate flat index from multi-dimensional indices */
     size_t flat_index = 0;
-    size_t stride = 1;
-    
-    /* Simple row-major calculation for now */
-    uint32_t dims = compute_tensor_dimensions(membrane->prime_factors, membrane->factor_count);
-    for (int i = dims - 1; i >= 0; i--) {
-        flat_index += indices[i] * stride;
-        stride *= membrane->prime_factors[i]; /* Use prime as dimension size */
+    for (uint32_t i = 0; i < membrane->rank; i++) {
+        if (indices[i] >= membrane->shape[i]) return -1;
+        flat_index += indices[i] * membrane->strides[i];
     }
-    
-    size_t max_elements = membrane->data_size / sizeof(float);
-    if (flat_index >= max_elements) return 0.0f;
+    *offset = flat_index;
+    return 0;
+}
+
+float membrane_get_element(TensorMembraneImpl *membrane, uint32_t *indices) {
+    size_t flat_index;
+    if (!membrane || !membrane->data) return 0.0f;
+    if (membrane_offset(membrane, indices, &flat_index) != 0) return 0.0f;
     
     membrane->access_count++;
     return membrane->data[flat_index];
 }
 
 int membrane_set_element(TensorMembraneImpl *membrane, uint32_t *indices, float value) {
-    if (!membrane || !indices || !membrane->data) return -1;
+    size_t flat_index;
+    if (!membrane || !membrane->data) return -1;
+    if (membrane_offset(membrane, indices, &flat_index) != 0) return -1;
     
-    /* Calculate flat index */
-    size_t flat_index = 0;
-    size_t stride = 1;
+    /* A lone strided view can be written in place; a shared one copies */
+    if (!membrane_owns_buffer(membrane)) {
+        if (membrane_own(membrane, true) != 0) return -1;
+        membrane_offset(membrane, indices, &flat_index);
+    }
+    membrane->data[flat_index] = value;
     
-    uint32_t dims = compute_tensor_dimensions(membrane->prime_factors, membrane->factor_count);
-    for (int i = dims - 1; i >= 0; i--) {
-        flat_index += indices[i] * stride;
-        stride *= membrane->prime_factors[i];
+    size_t position = 0;
+    for (uint32_t i = 0; i < membrane->rank; i++) {
+        position = position * membrane->shape[i] + indices[i];
     }
+    membrane_touch(membrane, position, 1);
     
-    size_t max_elements = membrane->data_size / sizeof(float);
-    if (flat_index >= max_elements) return -1;
+    return 0;
+}
+
+/* Copy count elements starting at row-major offset into out */
+int membrane_get_range(TensorMembraneImpl *membrane, size_t offset, float *out, size_t count) {
+    if (!membrane || !membrane->data || !out) return -1;
+    if (offset > membrane->element_count || count > membrane->element_count - offset) return -1;
     
-    membrane->data[flat_index] = value;
-    membrane->operation_count++;
-    membrane->version++;
+    if (count > 0) membrane_gather(membrane, offset, out, count);
+    membrane->access_count++;
+    return 0;
+}
+
+/* Overwrite count elements starting at row-major offset from values */
+int membrane_set_range(TensorMembraneImpl *membrane, size_t offset, const float *values,
+                       size_t count) {
+    if (!membrane || !membrane->data || !values) return -1;
+    if (offset > membrane->element_count || count > membrane->element_count - offset) return -1;
+    if (membrane_own(membrane, count < membrane->element_count) != 0) return -1;
+    
+    membrane_lock(membrane);
+    memcpy(membrane->data + offset, values, count * sizeof(float));
+    membrane_touch(membrane, offset, count);
+    membrane_unlock(membrane);
+    return 0;
+}
+
+/* Streaming I/O.  Elements move through a fixed chunk in row-major
+ * order, as raw host-order floats or as whitespace-separated text. */
+
+#define MEMBRANE_IO_CHUNK 65536     /* elements per read or write */
+
+/* Read up to size bytes, retrying short reads from pipes */
+static ssize_t read_full(int fd, void *buf, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = read(fd, (char*)buf + done, size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        if (n == 0) break;
+        done += n;
+    }
+    return (ssize_t)done;
+}
+
+static int write_full(int fd, const void *buf, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, buf, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        buf = (const char*)buf + n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int load_binary(TensorMembraneImpl *membrane, int fd, float *chunk, size_t *loaded,
+                       const char **error) {
+    size_t total = membrane->element_count;
+    while (*loaded < total) {
+        size_t want = total - *loaded < MEMBRANE_IO_CHUNK ? total - *loaded : MEMBRANE_IO_CHUNK;
+        ssize_t got = read_full(fd, chunk, want * sizeof(float));
+        if (got < 0) {
+            *error = "read error";
+            return -1;
+        }
+        size_t count = (size_t)got / sizeof(float);
+        if (count > 0) {
+            membrane_set_range(membrane, *loaded, chunk, count);
+            *loaded += count;
+        }
+        if ((size_t)got < want * sizeof(float)) {
+            *error = got % sizeof(float) ? "input ends inside an element" : "input is too short";
+            return -1;
+        }
+    }
     
+    char extra;
+    if (read_full(fd, &extra, 1) != 0) {
+        *error = "input is longer than the membrane";
+        return -1;
+    }
     return 0;
 }
 
+static int load_text(TensorMembraneImpl *membrane, int fd, float *chunk, size_t *loaded,
+                     const char **error) {
+    size_t total = membrane->element_count;
+    size_t held = 0, pending = 0;
+    char *text = malloc(MEMBRANE_IO_CHUNK + 1);
+    if (!text) {
+        *error = "out of memory";
+        return -1;
+    }
+    
+    int status = 0, eof = 0;
+    while (!eof && status == 0) {
+        ssize_t got = read_full(fd, text + held, MEMBRANE_IO_CHUNK - held);
+        if (got < 0) {
+            *error = "read error";
+            status = -1;
+            break;
+        }
+        eof = (size_t)got < MEMBRANE_IO_CHUNK - held;
+        held += got;
+    
+        /* Only parse up to the last separator, which becomes the
+         * terminator; a number cut by the end of the buffer is finished by
+         * the next read */
+        size_t end = held;
+        text[held] = '\0';
+        if (!eof) {
+            while (end > 0 && !isspace((unsigned char)text[end - 1])) end--;
+            if (end == 0) {
+                *error = "malformed number";
+                status = -1;
+                break;
+            }
+            text[end - 1] = '\0';
+        }
+    
+        char *p = text;
+        for (;;) {
+            while (isspace((unsigned char)*p)) p++;
+            if (!*p) break;
+            char *next;
+            float value = strtof(p, &next);
+            if (next == p || (*next && !isspace((unsigned char)*next))) {
+                *error = "malformed number";
+                status = -1;
+                break;
+            }
+            if (*loaded + pending == total) {
+                *error = "input is longer than the membrane";
+                status = -1;
+                break;
+            }
+            chunk[pending++] = value;
+            if (pending == MEMBRANE_IO_CHUNK) {
+                membrane_set_range(membrane, *loaded, chunk, pending);
+                *loaded += pending;
+                pending = 0;
+            }
+            p = next;
+        }
+    
+        memmove(text, text + end, held - end);
+        held -= end;
+    }
+    
+    if (pending > 0) {
+        membrane_set_range(membrane, *loaded, chunk, pending);
+        *loaded += pending;
+    }
+    if (status == 0 && *loaded < total) {
+        *error = "input is too short";
+        status = -1;
+    }
+    free(text);
+    return status;
+}
+
+/* Overwrite every element from fd.  On error *loaded elements, from the
+ * start, have been written. */
+int membrane_load(TensorMembraneImpl *membrane, int fd, bool binary, size_t *loaded,
+                  const char **error) {
+    size_t count = 0;
+    if (!loaded) loaded = &count;
+    *loaded = 0;
+    if (!membrane || !membrane->data || fd < 0) {
+        *error = "invalid arguments";
+        return -1;
+    }
+    
+    float *chunk = tensor_alloc(MEMBRANE_IO_CHUNK);
+    if (!chunk) {
+        *error = "out of memory";
+        return -1;
+    }
+    int status = binary ? load_binary(membrane, fd, chunk, loaded, error)
+                        : load_text(membrane, fd, chunk, loaded, error);
+    tensor_free(chunk);
+    return status;
+}
+
+/* Write every element to fd; text puts one innermost row, or for a
+ * vector one element, on each line */
+int membrane_dump(TensorMembraneImpl *membrane, int fd, bool binary) {
+    if (!membrane || !membrane->data || fd < 0) return -1;
+    
+    float *chunk = tensor_alloc(MEMBRANE_IO_CHUNK);
+    char *text = binary ? NULL : malloc(MEMBRANE_IO_CHUNK + 32);
+    if (!chunk || (!binary && !text)) {
+        tensor_free(chunk);
+        free(text);
+        return -1;
+    }
+    
+    size_t row = membrane->rank > 1 ? membrane->shape[membrane->rank - 1] : 1;
+    size_t total = membrane->element_count, held = 0;
+    int status = 0;
+    for (size_t offset = 0; offset < total && status == 0; ) {
+        size_t count = total - offset < MEMBRANE_IO_CHUNK ? total - offset : MEMBRANE_IO_CHUNK;
+        membrane_get_range(membrane, offset, chunk, count);
+    
+        if (binary) {
+            status = write_full(fd, chunk, count * sizeof(float));
+            offset += count;
+            continue;
+        }
+    
+        for (size_t i = 0; i < count && status == 0; i++) {
+            size_t position = offset + i;
+            held += snprintf(text + held, 32, "%.9g%c", chunk[i],
+                             (position + 1) % row == 0 ? '\n' : ' ');
+            if (held > MEMBRANE_IO_CHUNK) {
+                status = write_full(fd, text, held);
+                held = 0;
+            }
+        }
+        offset += count;
+    }
+    if (status == 0 && held > 0) status = write_full(fd, text, held);
+    
+    tensor_free(chunk);
+    free(text);
+    return status;
+}
+
 int membrane_fill(TensorMembraneImpl *membrane, float value) {
     if (!membrane || !membrane->data) return -1;
+    if (membrane_own(membrane, false) != 0) return -1;
     
-    size_t element_count = membrane->data_size / sizeof(float);
-    for (size_t i = 0; i < element_count; i++) {
-        membrane->data[i] = value;
+    membrane_lock(membrane);
+    tensor_kernel_fill(membrane->data, value, membrane->element_count);
+    membrane_touch(membrane, 0, membrane->element_count);
+    membrane_unlock(membrane);
+    return 0;
+}
+
+/* Data arithmetic.  Binary operations need equal element counts and
+ * write into their first membrane. */
+
+static int membranes_conform(TensorMembraneImpl *a, TensorMembraneImpl *b) {
+    return a && b && a->data && b->data && a->element_count == b->element_count;
+}
+
+int membrane_copy(TensorMembraneImpl *dst, TensorMembraneImpl *src) {
+    if (!membranes_conform(dst, src)) return -1;
+    if (dst == src) return 0;
+    
+    /* Sharing is the cheapest copy: a whole, contiguous source hands its
+     * buffer over and the next write to either side splits them */
+    if (src->contiguous && src->data == src->buffer->data && !src->buffer->map &&
+        !dst->buffer->map) {
+        src->buffer->refs++;
+        buffer_release(dst->buffer);
+        dst->buffer = src->buffer;
+        dst->data = src->data;
+        dst->view_of = 0;
+        membrane_layout(dst);
+    } else {
+        if (membrane_own(dst, false) != 0) return -1;
+        membrane_lock(dst);
+        membrane_gather(src, 0, dst->data, dst->element_count);
+        membrane_unlock(dst);
+    }
+    membrane_touch(dst, 0, dst->element_count);
+    return 0;
+}
+
+int membrane_scale(TensorMembraneImpl *membrane, float alpha) {
+    if (!membrane || !membrane->data) return -1;
+    if (membrane_own(membrane, true) != 0) return -1;
+    membrane_lock(membrane);
+    tensor_kernel_scale(membrane->data, alpha, membrane->element_count);
+    membrane_touch(membrane, 0, membrane->element_count);
+    membrane_unlock(membrane);
+    return 0;
+}
+
+/* Binary updates: read src (gathered if strided) before dst copies, so
+ * a view of dst's own buffer still sees the old values */
+typedef void (*MembraneUpdate)(float *dst, float alpha, const float *src, size_t count);
+
+static void update_axpy(float *y, float alpha, const float *x, size_t count) {
+    tensor_kernel_axpy(y, alpha, x, count);
+}
+
+static void update_add(float *dst, float alpha, const float *src, size_t count) {
+    (void)alpha;
+    tensor_kernel_add(dst, src, count);
+}
+
+static void update_mul(float *dst, float alpha, const float *src, size_t count) {
+    (void)alpha;
+    tensor_kernel_mul(dst, src, count);
+}
+
+static int membrane_update(TensorMembraneImpl *dst, float alpha, TensorMembraneImpl *src,
+                           MembraneUpdate update) {
+    if (!membranes_conform(dst, src)) return -1;
+    
+    /* Updating a membrane with itself works in place: the kernels read
+     * each element before writing it */
+    if (dst == src) {
+        if (membrane_own(dst, true) != 0) return -1;
+        membrane_lock(dst);
+        update(dst->data, alpha, dst->data, dst->element_count);
+        membrane_touch(dst, 0, dst->element_count);
+        membrane_unlock(dst);
+        return 0;
     }
     
-    membrane->operation_count++;
-    membrane->version++;
+    float *scratch;
+    const float *values = membrane_read(src, &scratch);
+    if (!values) return -1;
+    
+    /* dst and src may share a buffer; keep src's data alive across the copy */
+    TensorBuffer *held = src->buffer;
+    held->refs++;
+    int status = membrane_own(dst, true);
+    if (status == 0) {
+        membrane_lock(dst);
+        update(dst->data, alpha, values, dst->element_count);
+        membrane_touch(dst, 0, dst->element_count);
+        membrane_unlock(dst);
+    }
+    buffer_release(held);
+    tensor_free(scratch);
+    return status;
+}
+
+/* y += alpha * x */
+int membrane_axpy(TensorMembraneImpl *y, float alpha, TensorMembraneImpl *x) {
+    return membrane_update(y, alpha, x, update_axpy);
+}
+
+int membrane_add(TensorMembraneImpl *dst, TensorMembraneImpl *src) {
+    return membrane_update(dst, 0.0f, src, update_add);
+}
+
+int membrane_mul(TensorMembraneImpl *dst, TensorMembraneImpl *src) {
+    return membrane_update(dst, 0.0f, src, update_mul);
+}
+
+/* Reductions run over the elements in row-major order */
+typedef float (*MembraneReduce)(const float *data, size_t count);
+
+static int membrane_reduce(TensorMembraneImpl *membrane, MembraneReduce reduce, float *result) {
+    if (!membrane || !membrane->data || !result) return -1;
+    
+    float *scratch;
+    const float *values = membrane_read(membrane, &scratch);
+    if (!values) return -1;
+    *result = reduce(values, membrane->element_count);
+    tensor_free(scratch);
+    membrane->access_count++;
     return 0;
 }
 
+int membrane_sum(TensorMembraneImpl *membrane, float *result) {
+    return membrane_reduce(membrane, tensor_kernel_sum, result);
+}
+
+int membrane_max(TensorMembraneImpl *membrane, float *result) {
+    return membrane_reduce(membrane, tensor_kernel_max, result);
+}
+
+int membrane_norm(TensorMembraneImpl *membrane, float *result) {
+    return membrane_reduce(membrane, tensor_kernel_norm, result);
+}
+
+int membrane_dot(TensorMembraneImpl *a, TensorMembraneImpl *b, float *result) {
+    if (!membranes_conform(a, b) || !result) return -1;
+    
+    float *scratch_a, *scratch_b;
+    const float *x = membrane_read(a, &scratch_a);
+    const float *y = membrane_read(b, &scratch_b);
+    if (x && y) *result = tensor_kernel_dot(x, y, a->element_count);
+    tensor_free(scratch_a);
+    tensor_free(scratch_b);
+    if (!x || !y) return -1;
+    
+    a->access_count++;
+    b->access_count++;
+    return 0;
+}
+
+/* Shape descriptor; returns the rank and, if wanted, the extents */
+uint32_t membrane_shape(TensorMembraneImpl *membrane, const uint32_t **shape) {
+    if (!membrane) return 0;
+    if (shape) *shape = membrane->shape;
+    return membrane->rank;
+}
+
 /* Utility Functions */
 
 TensorMembraneImpl *find_membrane_by_id(uint32_t id) {
-    for (uint32_t i = 0; i < membrane_count; i++) {
-        if (membrane_registry[i] && membrane_registry[i]->id == id) {
-            return membrane_registry[i];
-        }
-    }
-    return NULL;
+    MembraneSlot *slot = membrane_slot_lookup(id);
+    return slot ? slot->membrane : NULL;
 }
 
 void membrane_print_structure(TensorMembraneImpl *membrane, int depth) {
@@ -498,14 +1507,28 @@ void membrane_print_structure(TensorMembraneImpl *membrane, int depth) {
         fprint(1, "%d", (int)membrane->prime_factors[i]);
         if (i < membrane->factor_count - 1) fprint(1, ",");
     }
-    fprint(1, "] energy=%d objects=%d children=%d\n", 
-           (int)membrane->energy_level, (int)membrane->object_count, 
+    fprint(1, "] energy=%d objects=%d children=%d", 
+           (int)membrane->energy_level, (int)membrane->objects.total, 
            (int)membrane->child_count);
+    if (membrane->view_of) {
+        fprint(1, " view-of=%d%s", (int)membrane->view_of,
+               membrane->contiguous ? "" : " strided");
+    }
+    if (membrane->buffer->map) {
+        fprint(1, " %s=%s%s", membrane->buffer->shm ? "shm" : "file", membrane->buffer->path,
+               membrane->buffer->readonly ? " (read-only)" : "");
+    }
+    fprint(1, "\n");
     
-    /* Print objects */
-    for (uint32_t i = 0; i < membrane->object_count; i++) {
+    /* Print objects, with multiplicities above one */
+    uint32_t cursor = 0, symbol, count;
+    while (multiset_next(&membrane->objects, &cursor, &symbol, &count)) {
         for (int j = 0; j < depth + 1; j++) fprint(1, "  ");
-        fprint(1, "obj: %s\n", membrane->objects[i] ? membrane->objects[i] : "NULL");
+        if (count > 1) {
+            fprint(1, "obj: %s x%d\n", symbol_name(symbol), (int)count);
+        } else {
+            fprint(1, "obj: %s\n", symbol_name(symbol));
+        }
     }
     
     /* Recursively print children */
@@ -528,6 +1551,18 @@ void *tensor_membrane_create_prime(int prime_factors[], int count) {
     return (void*)membrane_create(factors, (uint32_t)count);
 }
 
+void *tensor_membrane_create_child_prime(void *parent_ptr, int prime_factors[], int count) {
+    if (!parent_ptr || !prime_factors || count <= 0) return NULL;
+    
+    uint32_t factors[16];
+    for (int i = 0; i < count && i < 16; i++) {
+        factors[i] = (uint32_t)prime_factors[i];
+    }
+    
+    return (void*)membrane_create_child((TensorMembraneImpl*)parent_ptr, factors,
+                                        (uint32_t)count);
+}
+
 void tensor_membrane_destroy_prime(void *membrane_ptr) {
     TensorMembraneImpl *membrane = (TensorMembraneImpl*)membrane_ptr;
     membrane_destroy(membrane);
@@ -538,6 +1573,27 @@ int tensor_membrane_add_object_prime(void *membrane_ptr, const char *symbol) {
     return membrane_add_object(membrane, symbol);
 }
 
+/* Object commands with multiplicities: add interns the symbol, remove and
+ * transfer fail if there are fewer than count copies */
+int tensor_membrane_add_objects_prime(void *membrane_ptr, const char *symbol, int count) {
+    if (!symbol || count <= 0) return -1;
+    return membrane_add_symbol((TensorMembraneImpl*)membrane_ptr, symbol_intern(symbol),
+                               (uint32_t)count);
+}
+
+int tensor_membrane_remove_objects_prime(void *membrane_ptr, const char *symbol, int count) {
+    if (!symbol || count <= 0) return -1;
+    return membrane_remove_symbol((TensorMembraneImpl*)membrane_ptr, symbol_lookup(symbol),
+                                  (uint32_t)count);
+}
+
+int tensor_membrane_transfer_objects_prime(void *from_ptr, void *to_ptr, const char *symbol,
+                                           int count) {
+    if (!symbol || count <= 0) return -1;
+    return membrane_transfer_symbol((TensorMembraneImpl*)from_ptr, (TensorMembraneImpl*)to_ptr,
+                                    symbol_lookup(symbol), (uint32_t)count);
+}
+
 void tensor_membrane_print_prime(void *membrane_ptr) {
     TensorMembraneImpl *membrane = (TensorMembraneImpl*)membrane_ptr;
     membrane_print_structure(membrane, 0);
@@ -554,4 +1610,121 @@ void *tensor_membrane_find_by_id_prime(uint32_t id) {
 
 int tensor_membrane_get_count_prime(void) {
     return (int)membrane_count;
-}
\ No newline at end of file
+}
+
+/* Element access from the shell: one index per axis, no more, no less */
+int tensor_membrane_get_element_prime(void *membrane_ptr, uint32_t *indices, int count,
+                                      float *value) {
+    TensorMembraneImpl *membrane = (TensorMembraneImpl*)membrane_ptr;
+    size_t offset;
+    if (!membrane || !value || count != (int)membrane->rank) return -1;
+    if (membrane_offset(membrane, indices, &offset) != 0) return -1;
+    
+    *value = membrane_get_element(membrane, indices);
+    return 0;
+}
+
+int tensor_membrane_set_element_prime(void *membrane_ptr, uint32_t *indices, int count,
+                                      float value) {
+    TensorMembraneImpl *membrane = (TensorMembraneImpl*)membrane_ptr;
+    if (!membrane || count != (int)membrane->rank) return -1;
+    return membrane_set_element(membrane, indices, value);
+}
+
+int tensor_membrane_fill_prime(void *membrane_ptr, float value) {
+    return membrane_fill((TensorMembraneImpl*)membrane_ptr, value);
+}
+
+int tensor_membrane_reshape_prime(void *membrane_ptr, int factors[], int count) {
+    if (!factors || count <= 0 || count > 16) return -1;
+    
+    uint32_t new_factors[16];
+    for (int i = 0; i < count; i++) {
+        new_factors[i] = (uint32_t)factors[i];
+    }
+    return membrane_resize((TensorMembraneImpl*)membrane_ptr, new_factors, (uint32_t)count);
+}
+
+/* File-backed membranes from the shell; a NULL factors means "take the
+ * shape from the file".  *error may be set on success as a warning. */
+void *tensor_membrane_open_prime(const char *path, int factors[], int count, int flags,
+                                 void *parent_ptr, const char **error) {
+    uint32_t shape[16];
+    if (factors) {
+        if (count <= 0 || count > 16) return NULL;
+        for (int i = 0; i < count; i++) {
+            shape[i] = (uint32_t)factors[i];
+        }
+    }
+    
+    TensorMembraneImpl *parent = (TensorMembraneImpl*)parent_ptr;
+    if (parent && parent->child_count >= parent->max_children) {
+        *error = "parent membrane is full";
+        return NULL;
+    }
+    
+    TensorMembraneImpl *membrane = membrane_open(path, factors ? shape : NULL, (uint32_t)count,
+                                                 flags, error);
+    return (void*)(parent ? membrane_adopt(parent, membrane) : membrane);
+}
+
+int tensor_membrane_flush_prime(void *membrane_ptr) {
+    return membrane_flush((TensorMembraneImpl*)membrane_ptr);
+}
+
+int tensor_membrane_verify_prime(void *membrane_ptr) {
+    return membrane_verify((TensorMembraneImpl*)membrane_ptr);
+}
+
+int tensor_membrane_unlink_prime(void *membrane_ptr) {
+    return membrane_unlink((TensorMembraneImpl*)membrane_ptr);
+}
+
+int tensor_membrane_load_prime(void *membrane_ptr, int fd, int binary, size_t *loaded,
+                               const char **error) {
+    return membrane_load((TensorMembraneImpl*)membrane_ptr, fd, binary != 0, loaded, error);
+}
+
+int tensor_membrane_dump_prime(void *membrane_ptr, int fd, int binary) {
+    return membrane_dump((TensorMembraneImpl*)membrane_ptr, fd, binary != 0);
+}
+
+/* Views from the shell: slices come as start/stop/step triples per axis */
+void *tensor_membrane_view_prime(void *membrane_ptr, uint32_t *start, uint32_t *stop,
+                                 uint32_t *step, int count) {
+    if (count < 0 || count > 16) return NULL;
+    return (void*)membrane_view((TensorMembraneImpl*)membrane_ptr, start, stop, step,
+                                (uint32_t)count);
+}
+
+void *tensor_membrane_reshape_view_prime(void *membrane_ptr, int factors[], int count) {
+    if (!factors || count <= 0 || count > 16) return NULL;
+    
+    uint32_t new_factors[16];
+    for (int i = 0; i < count; i++) {
+        new_factors[i] = (uint32_t)factors[i];
+    }
+    return (void*)membrane_reshape_view((TensorMembraneImpl*)membrane_ptr, new_factors,
+                                        (uint32_t)count);
+}
+
+/* Run a membrane-op by name.  Returns 1 when the operation produced a
+ * scalar in *result, 0 when it updated dst, -1 on error. */
+int tensor_membrane_op_prime(const char *op, void *dst_ptr, void *src_ptr, float alpha,
+                             float *result) {
+    TensorMembraneImpl *dst = (TensorMembraneImpl*)dst_ptr;
+    TensorMembraneImpl *src = (TensorMembraneImpl*)src_ptr;
+    if (!op || !dst) return -1;
+    
+    if (strcmp(op, "fill") == 0) return membrane_fill(dst, alpha);
+    if (strcmp(op, "scale") == 0) return membrane_scale(dst, alpha);
+    if (strcmp(op, "copy") == 0) return membrane_copy(dst, src);
+    if (strcmp(op, "axpy") == 0) return membrane_axpy(dst, alpha, src);
+    if (strcmp(op, "add") == 0) return membrane_add(dst, src);
+    if (strcmp(op, "mul") == 0) return membrane_mul(dst, src);
+    if (strcmp(op, "sum") == 0) return membrane_sum(dst, result) == 0 ? 1 : -1;
+    if (strcmp(op, "max") == 0) return membrane_max(dst, result) == 0 ? 1 : -1;
+    if (strcmp(op, "norm") == 0) return membrane_norm(dst, result) == 0 ? 1 : -1;
+    if (strcmp(op, "dot") == 0) return membrane_dot(dst, src, result) == 0 ? 1 : -1;
+    return -1;
+}
@@ -8,6 +8,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include "intern.h"
 
 /* Forward declarations */
 typedef struct TensorMembraneImpl TensorMembraneImpl;
@@ -32,17 +33,75 @@ extern int membrane_destroy(TensorMembraneImpl *membrane);
 extern int membrane_resize(TensorMembraneImpl *membrane, uint32_t *new_factors, 
                           uint32_t count);
 
+/* File-backed membranes, mapped on open and synced by membrane_flush */
+#define MEMBRANE_READONLY 1         /* map read-only */
+#define MEMBRANE_SHM 2              /* path names a POSIX shared memory segment */
+
+extern TensorMembraneImpl *membrane_open(const char *path, uint32_t *factors, uint32_t count,
+                                         int flags, const char **error);
+extern int membrane_flush(TensorMembraneImpl *membrane);
+extern int membrane_verify(TensorMembraneImpl *membrane);
+extern int membrane_unlink(TensorMembraneImpl *membrane);
+
+/* Views share their source's storage until either side writes */
+extern TensorMembraneImpl *membrane_view(TensorMembraneImpl *source, uint32_t *start,
+                                         uint32_t *stop, uint32_t *step, uint32_t count);
+extern TensorMembraneImpl *membrane_reshape_view(TensorMembraneImpl *source, uint32_t *factors,
+                                                 uint32_t count);
+
 /* Object Management (P-system) */
 extern int membrane_add_object(TensorMembraneImpl *membrane, const char *symbol);
 extern int membrane_remove_object(TensorMembraneImpl *membrane, const char *symbol);
 extern const char *membrane_find_object(TensorMembraneImpl *membrane, const char *symbol);
 extern int membrane_transfer_object(TensorMembraneImpl *from, TensorMembraneImpl *to, 
                                    const char *symbol);
+extern int membrane_add_symbol(TensorMembraneImpl *membrane, uint32_t symbol, uint32_t count);
+extern int membrane_remove_symbol(TensorMembraneImpl *membrane, uint32_t symbol, uint32_t count);
+extern uint32_t membrane_symbol_count(TensorMembraneImpl *membrane, uint32_t symbol);
+extern int membrane_transfer_symbol(TensorMembraneImpl *from, TensorMembraneImpl *to,
+                                    uint32_t symbol, uint32_t count);
+
+/* Structure access */
+extern uint32_t membrane_get_id(TensorMembraneImpl *membrane);
+extern Multiset *membrane_objects(TensorMembraneImpl *membrane);
+extern TensorMembraneImpl *membrane_parent(TensorMembraneImpl *membrane);
+extern uint32_t membrane_children(TensorMembraneImpl *membrane, TensorMembraneImpl ***children);
+
+/* Write tracking for snapshots, in pages of row-major elements */
+#define MEMBRANE_PAGE_ELEMENTS 1024
+
+extern int membrane_track_writes(TensorMembraneImpl *membrane);
+extern const uint64_t *membrane_dirty_pages(TensorMembraneImpl *membrane, size_t *pages);
+extern void membrane_clear_dirty(TensorMembraneImpl *membrane);
+extern size_t membrane_element_count(TensorMembraneImpl *membrane);
+extern uint64_t membrane_version(TensorMembraneImpl *membrane);
+extern bool membrane_is_mapped(TensorMembraneImpl *membrane);
 
 /* Element access and modification */
 extern float membrane_get_element(TensorMembraneImpl *membrane, uint32_t *indices);
 extern int membrane_set_element(TensorMembraneImpl *membrane, uint32_t *indices, float value);
 extern int membrane_fill(TensorMembraneImpl *membrane, float value);
+extern int membrane_offset(TensorMembraneImpl *membrane, uint32_t *indices, size_t *offset);
+extern int membrane_get_range(TensorMembraneImpl *membrane, size_t offset, float *out, size_t count);
+extern int membrane_set_range(TensorMembraneImpl *membrane, size_t offset, const float *values,
+                              size_t count);
+extern uint32_t membrane_shape(TensorMembraneImpl *membrane, const uint32_t **shape);
+
+/* Whole-membrane streaming, as raw floats or whitespace-separated text */
+extern int membrane_load(TensorMembraneImpl *membrane, int fd, bool binary, size_t *loaded,
+                         const char **error);
+extern int membrane_dump(TensorMembraneImpl *membrane, int fd, bool binary);
+
+/* Data arithmetic (vectorized, see tensor-kernels.h) */
+extern int membrane_copy(TensorMembraneImpl *dst, TensorMembraneImpl *src);
+extern int membrane_scale(TensorMembraneImpl *membrane, float alpha);
+extern int membrane_axpy(TensorMembraneImpl *y, float alpha, TensorMembraneImpl *x);
+extern int membrane_add(TensorMembraneImpl *dst, TensorMembraneImpl *src);
+extern int membrane_mul(TensorMembraneImpl *dst, TensorMembraneImpl *src);
+extern int membrane_sum(TensorMembraneImpl *membrane, float *result);
+extern int membrane_max(TensorMembraneImpl *membrane, float *result);
+extern int membrane_norm(TensorMembraneImpl *membrane, float *result);
+extern int membrane_dot(TensorMembraneImpl *a, TensorMembraneImpl *b, float *result);
 
 /* Utility Functions */
 extern TensorMembraneImpl *find_membrane_by_id(uint32_t id);
@@ -50,11 +109,35 @@ extern void membrane_print_structure(TensorMembraneImpl *membrane, int depth);
 
 /* Shell Command Integration Functions */
 extern void *tensor_membrane_create_prime(int prime_factors[], int count);
+extern void *tensor_membrane_create_child_prime(void *parent_ptr, int prime_factors[], int count);
 extern void tensor_membrane_destroy_prime(void *membrane_ptr);
 extern int tensor_membrane_add_object_prime(void *membrane_ptr, const char *symbol);
+extern int tensor_membrane_add_objects_prime(void *membrane_ptr, const char *symbol, int count);
+extern int tensor_membrane_remove_objects_prime(void *membrane_ptr, const char *symbol, int count);
+extern int tensor_membrane_transfer_objects_prime(void *from_ptr, void *to_ptr, const char *symbol,
+                                                  int count);
 extern void tensor_membrane_print_prime(void *membrane_ptr);
 extern uint32_t tensor_membrane_get_id_prime(void *membrane_ptr);
 extern void *tensor_membrane_find_by_id_prime(uint32_t id);
 extern int tensor_membrane_get_count_prime(void);
+extern int tensor_membrane_get_element_prime(void *membrane_ptr, uint32_t *indices, int count,
+                                             float *value);
+extern int tensor_membrane_set_element_prime(void *membrane_ptr, uint32_t *indices, int count,
+                                             float value);
+extern int tensor_membrane_fill_prime(void *membrane_ptr, float value);
+extern int tensor_membrane_reshape_prime(void *membrane_ptr, int factors[], int count);
+extern void *tensor_membrane_open_prime(const char *path, int factors[], int count, int flags,
+                                        void *parent_ptr, const char **error);
+extern int tensor_membrane_flush_prime(void *membrane_ptr);
+extern int tensor_membrane_verify_prime(void *membrane_ptr);
+extern int tensor_membrane_unlink_prime(void *membrane_ptr);
+extern int tensor_membrane_load_prime(void *membrane_ptr, int fd, int binary, size_t *loaded,
+                                      const char **error);
+extern int tensor_membrane_dump_prime(void *membrane_ptr, int fd, int binary);
+extern void *tensor_membrane_view_prime(void *membrane_ptr, uint32_t *start, uint32_t *stop,
+                                        uint32_t *step, int count);
+extern void *tensor_membrane_reshape_view_prime(void *membrane_ptr, int factors[], int count);
+extern int tensor_membrane_op_prime(const char *op, void *dst_ptr, void *src_ptr, float alpha,
+                                    float *result);
 
 #endif /* TENSOR_MEMBRANE_H */
\ No newline at end of file
@@ -1,20 +1,187 @@
 #!/bin/bash
 # Test script for enhanced cognitive kernel functionality
 
+failures=0
+
+# check <description> <expected> <actual>
+check() {
+    if [ "$2" = "$3" ]; then
+        echo "✓ $1"
+    else
+        echo "✗ $1: expected '$2', got '$3'"
+        failures=$((failures + 1))
+    fi
+}
+
+# kernel <script>: run commands in one shell, dropping the startup banner
+kernel() {
+    ./rc -p 2>&1 | grep -v '^Started agent discovery'
+}
+
+# probe <c-source>: build a program against the shell's objects, with
+# the globals main.c would define, and run it; for state the builtins
+# do not show
+probe() {
+    local dir
+    dir=$(mktemp -d)
+    { cat <<'EOF'
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "rc.h"
+#include "or.h"
+bool dashdee, dashee, dasheye, dashell, dashen;
+bool dashpee, dashoh, dashess, dashvee, dashex;
+bool interactive;
+char *dashsee[2];
+pid_t rc_pid;
+EOF
+      cat; } >"$dir/probe.c"
+    cc -I. -o "$dir/probe" "$dir/probe.c" \
+        $(make -s --eval 'objects: ; @echo $(filter-out main.o,$(OBJS))' objects) -lm -ldl -lpthread &&
+        "$dir/probe"
+    rm -r "$dir"
+}
+
 echo "Testing Cognitive Grammar Kernel..."
 
 echo "=== Testing Hypergraph Encoding ==="
 ./rc -c "hypergraph-encode 'hello world'"
 ./rc -c "hypergraph-encode 'complex cognitive processing system'"
 
+out=$(kernel <<'EOF'
+hypergraph-encode 'hello world'
+hypergraph-encode 'hello world'
+hypergraph-query -s
+hypergraph-query '(ListLink (ConceptNode "hello") (ConceptNode "world"))'
+hypergraph-query 3
+hypergraph-query '(ConceptNode "hello") (ConceptNode "world")'
+EOF
+)
+check "encoding the same text twice gives one atom" 2 "$(echo "$out" | head -2 | grep -c '^4 (ListLink')"
+check "encoding adds no duplicates" "atoms: 4 (nodes: 2, links: 2)" "$(echo "$out" | grep '^atoms:')"
+check "an S-expression resolves to its handle" '4 (ListLink (ConceptNode "hello") (ConceptNode "world"))' "$(echo "$out" | sed -n 7p)"
+check "a handle resolves to its atom" '3 (OrderedLink (ConceptNode "hello") (ConceptNode "world"))' "$(echo "$out" | grep '^3 ')"
+check "trailing text is rejected" "hypergraph-query: trailing text" "$(echo "$out" | tail -1)"
+check "a missing atom is not found" "hypergraph-query: atom not found" "$(kernel <<<"hypergraph-query '(ConceptNode \"zz\")'")"
+
+# A saved image loads back with its truth values and indexes, new atoms
+# continue after it, and a damaged image is turned away without
+# touching the store
+images=$(mktemp -d)
+kernel >/dev/null <<EOF
+hypergraph-encode '(InheritanceLink (stv 0.9 0.8) (ConceptNode "cat") (ConceptNode "mammal"))'
+hypergraph-encode 'hello world'
+hypergraph-save $images/store.img
+EOF
+head -c 100 "$images/store.img" >"$images/truncated.img"
+cp "$images/store.img" "$images/magic.img"
+printf 'X' | dd of="$images/magic.img" bs=1 conv=notrunc 2>/dev/null
+cp "$images/store.img" "$images/header.img"
+printf '\377\377' | dd of="$images/header.img" bs=1 seek=24 conv=notrunc 2>/dev/null
+cp "$images/store.img" "$images/outgoing.img"
+printf '\377' | dd of="$images/outgoing.img" bs=1 seek=5000 conv=notrunc 2>/dev/null
+out=$(./rc -i 2>&1 <<EOF | grep -v '^Started agent discovery' | sed 's/^\(; \)*//'
+hypergraph-load $images/store.img
+hypergraph-query -s
+pln-infer -b '(InheritanceLink (ConceptNode "cat") (ConceptNode "mammal"))'
+hypergraph-query -i '(ConceptNode "hello")'
+hypergraph-load $images/truncated.img
+hypergraph-load $images/magic.img
+hypergraph-load $images/header.img
+hypergraph-load $images/outgoing.img
+hypergraph-encode '(ConceptNode "dog")'
+EOF
+)
+rm -r "$images"
+check "an image loads every atom" "Loaded 7 atoms (3 links) from $images/store.img" "$(echo "$out" | sed -n 1p)"
+check "a loaded store has the saved atoms" "atoms: 7 (nodes: 4, links: 3)" "$(echo "$out" | sed -n 2p)"
+check "truth values survive a round trip" '3 (InheritanceLink (stv 0.9 0.8) (ConceptNode "cat") (ConceptNode "mammal"))' "$(echo "$out" | grep '^3 ')"
+check "incoming sets survive a round trip" "7 6" "$(echo "$out" | grep -E '^[67] \((List|Ordered)Link' | cut -d' ' -f1 | tr '\n' ' ' | sed 's/ $//')"
+check "a truncated image is rejected" "hypergraph-load: $images/truncated.img: not a hypergraph image" "$(echo "$out" | grep truncated.img)"
+check "an image with a bad magic is rejected" "hypergraph-load: $images/magic.img: not a hypergraph image" "$(echo "$out" | grep magic.img)"
+check "an image with a bad header is rejected" "hypergraph-load: $images/header.img: corrupt header" "$(echo "$out" | grep header.img)"
+check "an image with a bad handle is rejected" "hypergraph-load: $images/outgoing.img: corrupt outgoing set" "$(echo "$out" | grep outgoing.img)"
+check "a rejected image leaves the store alone" '8 (ConceptNode "dog")' "$(echo "$out" | grep '^8 ')"
+
+echo -e "\n=== Testing Pattern Groundings ==="
+# Filler links make the planner climb from anchors rather than scan,
+# and a link holding the anchor twice must still ground once
+out=$( (for i in $(seq 1 50); do
+            echo "hypergraph-encode '(ListLink (ConceptNode \"n$i\") (ConceptNode \"m$i\"))'"
+        done
+        cat <<'EOF'
+hypergraph-encode '(ListLink (ConceptNode "a") (ConceptNode "a"))'
+hypergraph-encode '(ListLink (ConceptNode "a") (ConceptNode "b"))'
+hypergraph-encode '(ListLink (ConceptNode "b") (ConceptNode "a"))'
+hypergraph-query -n a
+hypergraph-query -n b
+echo anchored; pattern-match '(ListLink (ConceptNode "a") $y)'
+echo joined; pattern-match '(ListLink $x $y)' '(ListLink $y $x)'
+echo repeated; pattern-match '(ListLink $x (ConceptNode "a"))' '(ListLink $x $x)'
+echo plan; pattern-match -p '(ListLink (ConceptNode "a") $y)'
+EOF
+) | kernel | grep -v 'ConceptNode "[nm][0-9]')
+a=$(echo "$out" | sed -n 's/^\([0-9]*\) (ConceptNode "a")$/\1/p')
+b=$(echo "$out" | sed -n 's/^\([0-9]*\) (ConceptNode "b")$/\1/p')
+grounds() { echo "$out" | sed -n "/^$1\$/,/^[a-z]/p" | grep '^[0-9]' | sort | tr '\n' ' ' | sed 's/ $//'; }
+check "an anchored clause grounds each link once" "$a $b" "$(grounds anchored)"
+check "a join grounds each symmetric pair once" "$a $a $a $b $b $a" "$(grounds joined)"
+check "a repeated variable grounds once" "$a" "$(grounds repeated)"
+check "the anchored clause climbs from its constant" "plan: \$y; clause 1: incoming of $a (~4)" "$(echo "$out" | grep '^plan:')"
+
 echo -e "\n=== Testing ECAN Attention Allocation ==="
 ./rc -c "attention-allocate 'simple'"
 ./rc -c "attention-allocate 'complex multi-word cognitive processing task with sophisticated reasoning'"
 
+# STI only moves between the funds and the atoms: after stimulus,
+# rent, diffusion and forgetting, the funds and the STI every atom
+# holds still add up to the initial 10000
+out=$(kernel <<'EOF'
+hypergraph-encode 'the quick brown fox' 'jumps over the lazy dog'
+scheme-eval '(define (sti-of atoms) (if (null? atoms) 0 (+ (car (atom-av (car atoms))) (sti-of (cdr atoms)))))'
+scheme-eval '(define (total-sti) (+ (sti-of (atoms-of-type "ConceptNode")) (sti-of (atoms-of-type "ListLink")) (sti-of (atoms-of-type "OrderedLink"))))'
+attention-allocate 'the quick brown fox' 300
+scheme-eval '(total-sti)'
+attention-allocate -n 20 'jumps over the lazy dog' 20000
+scheme-eval '(total-sti)'
+attention-allocate -n 200
+scheme-eval '(total-sti)'
+EOF
+)
+check "each argument is encoded on its own" 2 "$(echo "$out" | grep -c '^[0-9]* (ListLink')"
+funds=($(echo "$out" | sed -n 's/^ECAN tick.*funds \([0-9.]*\),.*/\1/p'))
+held=($(echo "$out" | grep -E '^[0-9.]+$'))
+for i in 0 1 2; do
+    check "STI is conserved after stage $((i + 1))" ok \
+        "$(awk -v f="${funds[$i]}" -v h="${held[$i]}" 'BEGIN { d = f + h - 10000; exit !(h != "" && d < 0.05 && d > -0.05) }' && echo ok)"
+done
+stimulus=($(echo "$out" | sed -n 's/^ECAN tick.*stimulus \([0-9.]*\),.*/\1/p'))
+check "a stimulus is limited to the funds" "${funds[0]}" "${stimulus[1]}"
+
 echo -e "\n=== Testing PLN Probabilistic Reasoning ==="
 ./rc -c "pln-infer 'All birds fly'"
 ./rc -c "pln-infer 'If cognitive agents reason then they exhibit intelligence'"
 
+# Deduction: cat→mammal and mammal→animal at (stv 0.9 0.9), with the
+# terms at the 0.2 prior, give cat→animal at
+# 0.9·0.9 + 0.1·(0.2 - 0.2·0.9)/0.8 = 0.8125 with confidence 0.9·0.9.
+# Premises given by handle are not added as new concepts.
+out=$(kernel <<'EOF'
+hypergraph-encode '(InheritanceLink (stv 0.9 0.9) (ConceptNode "cat") (ConceptNode "mammal"))'
+hypergraph-encode '(InheritanceLink (stv 0.9 0.9) (ConceptNode "mammal") (ConceptNode "animal"))'
+pln-infer 3 5
+hypergraph-query -s
+pln-infer -b '(InheritanceLink (ConceptNode "cat") (ConceptNode "animal"))'
+pln-infer 99
+EOF
+)
+deduced='6 (InheritanceLink (stv 0.8125 0.81) (ConceptNode "cat") (ConceptNode "animal"))'
+check "deduction chains forward from handles" "$deduced" "$(echo "$out" | sed -n 4p)"
+check "handles add no concepts" "  ConceptNode: 3" "$(echo "$out" | grep ConceptNode:)"
+check "backward chaining finds the deduction" "$deduced" "$(echo "$out" | grep '^6 ' | tail -1)"
+check "an unknown handle is rejected" "pln-infer: atom not found" "$(echo "$out" | tail -1)"
+
 echo -e "\n=== Testing Cognitive Pattern Transformations ==="
 ./rc -c "cognitive-transform 'greeting' 'hello world'"
 ./rc -c "cognitive-transform 'command' 'ls -la /tmp'"
@@ -25,9 +192,329 @@ echo -e "\n=== Testing Scheme Integration ==="
 ./rc -c "scheme-eval '(* 6 9)'"
 ./rc -c "scheme-eval 'complex-expression'"
 
+# Closures, tail calls far past the 64K frame limit, and collection
+# under load; then errors, each unwinding a deep stack, must leave the
+# live heap as it was.  Interactive mode carries on after an error.
+out=$( (cat <<'EOF'
+scheme-eval '(define (make-counter) (let ((n 0)) (lambda () (set! n (+ n 1)) n)))'
+scheme-eval '(define a (make-counter)) (define b (make-counter)) (a) (a) (b) (list (a) (b))'
+scheme-eval '(map (lambda (f) (f 10)) (map (lambda (k) (lambda (x) (+ x k))) (list 1 2 3)))'
+scheme-eval '(define (count-down n) (if (= n 0) (quote done) (count-down (- n 1))))'
+scheme-eval '(count-down 1000000)'
+scheme-eval '(define (ev? n) (if (= n 0) #t (od? (- n 1)))) (define (od? n) (if (= n 0) #f (ev? (- n 1))))'
+scheme-eval '(ev? 1000001)'
+scheme-eval '(define (depth n) (if (= n 0) 0 (+ 1 (depth (- n 1)))))'
+scheme-eval '(depth 60000)'
+scheme-eval '(define kept (iota 10000))'
+scheme-eval '(let loop ((i 0)) (when (< i 100000) (make-vector 100) (loop (+ i 1)))) (apply + kept)'
+scheme-eval '(let ((s (make-string 3 #\a))) (string-set! s 1 #\b) (list s (string-copy "hello" 1 3) (string>? "b" "a")))'
+scheme-eval '(gc) 0'
+scheme-eval -s
+EOF
+    for i in $(seq 1 100); do
+        echo "scheme-eval '(depth 100000)'"
+        echo "scheme-eval '(let loop ((i 0) (l (quote ()))) (if (< i 1000) (loop (+ i 1) (cons i l)) (car 5)))'"
+        echo "scheme-eval '(and 1 (if))'"
+    done
+    cat <<'EOF'
+scheme-eval '(gc) 0'
+scheme-eval -s
+scheme-eval '(depth 60000)'
+EOF
+) | ./rc -i 2>/dev/null | grep -v '^Started agent discovery')
+check "closures keep their own state" "(3 2)" "$(echo "$out" | sed -n 1p)"
+check "closures capture loop values" "(11 12 13)" "$(echo "$out" | sed -n 2p)"
+check "a tail call loop runs in constant space" "done" "$(echo "$out" | sed -n 3p)"
+check "mutual tail calls run in constant space" "#f" "$(echo "$out" | sed -n 4p)"
+check "non-tail recursion nests below the frame limit" "60000" "$(echo "$out" | sed -n 5p)"
+check "live data survives collections" "49995000" "$(echo "$out" | sed -n 6p)"
+check "string primitives" '("aba" "el" #t)' "$(echo "$out" | sed -n 7p)"
+heap() { echo "$out" | grep '^heap:' | sed -n "$1p" | sed 's/ bytes live.*//;s/heap: //'; }
+check "allocation under load is collected" ok "$(echo "$out" | grep '^heap:' | head -1 | awk '$8 > 0 && $2 < 1048576 { print "ok" }')"
+check "errors leave the live heap as it was" "$(heap 1)" "$(heap 2)"
+check "the VM recovers after errors" "60000" "$(echo "$out" | tail -1)"
+
+# A malformed define is a syntax error wherever it appears
+out=$(./rc -i 2>&1 <<'EOF' | sed 's/^\(; \)*//' | grep -v '^Started agent discovery'
+scheme-eval '(define)'
+scheme-eval '(begin (define))'
+scheme-eval '(define x (define))'
+scheme-eval '(let () (define) 1)'
+scheme-eval '(+ 1 2)'
+EOF
+)
+check "malformed defines are rejected" 4 "$(echo "$out" | grep -c '^scheme-eval: define: bad syntax')"
+check "the shell survives malformed defines" 3 "$(echo "$out" | grep -v '^scheme-eval:' | grep -v '^$' | head -1)"
+
+echo -e "\n=== Testing Kernel Hot-Swap ==="
+# Two builds of a kernel library: loading the second under the same
+# name replaces the first for the next command, and the registry takes
+# far more names than its initial table holds
+kernels=$(mktemp -d)
+for v in 1 2; do
+    cat >"$kernels/k$v.c" <<EOF
+#include <stdlib.h>
+#include <string.h>
+static int transform(const char *pattern, const char *input, char **output) {
+    (void)pattern; (void)input;
+    *output = strdup("version $v");
+    return *output ? 0 : -1;
+}
+const struct { void *encode, *pln_infer; int (*transform)(const char *, const char *, char **); }
+    hypergraph_kernel = { NULL, NULL, transform };
+EOF
+    cc -shared -fPIC -o "$kernels/k$v.so" "$kernels/k$v.c"
+done
+out=$( (echo "kernel-load swap $kernels/k1.so"
+        echo "cognitive-transform -k swap p x"
+        echo "kernel-load swap $kernels/k2.so"
+        echo "cognitive-transform -k swap p x"
+        for i in $(seq 1 300); do echo "kernel-load k$i $kernels/k1.so"; done
+        echo "kernel-load swap $kernels/k1.so"
+        echo "cognitive-transform -k swap p x"
+        echo "kernel-load | grep -c loaded"
+        echo "cognitive-transform -k k300 p x") | kernel | grep -v '^Kernel ')
+rm -r "$kernels"
+transforms=$(echo "$out" | sed -n 's/^  Transform: //p' | tr '\n' ' ')
+check "a reloaded kernel replaces the old one" "version 1 version 2 version 1 version 1 " "$transforms"
+check "the registry grows past its initial table" 301 "$(echo "$out" | grep -x '[0-9]*')"
+
+echo -e "\n=== Testing Neural Tree Resonance ==="
+# A root with three children, two under the first: propagation decays
+# activation 1 to 0.8 and 0.64, so frequencies are 2, 1.8 and 1.64.
+# Aggregates kept along dirty paths must match a walk of every subtree
+# through growth, activation changes, propagation and pruning.
+out=$(probe <<'EOF'
+static void tally(NeuralNode *n, uint32_t *count, double *sum, double *sq, uint32_t *spectrum) {
+    float f = 1.0f + n->activation_level;
+    int bin = (int)(f / RESONANCE_BIN_WIDTH);
+    if (bin >= RESONANCE_SPECTRUM_BINS) bin = RESONANCE_SPECTRUM_BINS - 1;
+    (*count)++;
+    *sum += f;
+    *sq += (double)f * f;
+    spectrum[bin]++;
+    for (int i = 0; i < n->child_count; i++) tally(n->children[i], count, sum, sq, spectrum);
+}
+
+static int consistent(NeuralNode *n) {
+    uint32_t count = 0, spectrum[RESONANCE_SPECTRUM_BINS] = { 0 };
+    double sum = 0, sq = 0;
+    tally(n, &count, &sum, &sq, spectrum);
+    if (count != n->subtree_count || fabs(sum - n->subtree_resonance) > 1e-3 ||
+        fabs(sq - n->subtree_resonance_sq) > 1e-3 ||
+        memcmp(spectrum, n->subtree_spectrum, sizeof spectrum) != 0)
+        return 0;
+    for (int i = 0; i < n->child_count; i++)
+        if (!consistent(n->children[i])) return 0;
+    return 1;
+}
+
+int main(void) {
+    NeuralNode *root = neural_node_create("root", NULL), *nodes[600] = { root };
+    ResonanceDepth *resonance = resonance_create();
+    NeuralNode *a = neural_node_create("a", root), *a2;
+    int n = 1, ok = 1;
+
+    neural_node_create("b", root);
+    neural_node_create("c", root);
+    neural_node_create("a1", a);
+    a2 = neural_node_create("a2", a);
+    neural_tree_propagate(root, 1.0f);
+    resonance_analyze(resonance, root);
+    printf("nodes %d mean %d spectrum", resonance->resonance_nodes, (int)(resonance->depth_level * 100 + 0.5f));
+    for (int i = 0; i < RESONANCE_SPECTRUM_BINS; i++)
+        if (resonance->frequency_spectrum[i] > 0) printf(" %d:%d", i, (int)(resonance->frequency_spectrum[i] * 6 + 0.5f));
+    neural_node_set_activation(a2, 3.0f);
+    resonance_analyze(resonance, root);
+    printf("\nmean %d top %d\n", (int)(resonance->depth_level * 100 + 0.5f),
+           (int)(resonance->frequency_spectrum[RESONANCE_SPECTRUM_BINS - 1] * 6 + 0.5f));
+    neural_node_destroy(a);
+    resonance_analyze(resonance, root);
+    printf("nodes %d\n", resonance->resonance_nodes);
+
+    srand(1);
+    for (int round = 0; round < 200 && ok; round++) {
+        for (int i = 0; i < 3 && n < 600; i++) nodes[n] = neural_node_create("x", nodes[rand() % n]), n++;
+        for (int i = 0; i < 5; i++) neural_node_set_activation(nodes[rand() % n], (rand() % 400) / 100.0f);
+        if (round % 10 == 0) neural_tree_propagate(root, (rand() % 200) / 100.0f);
+        neural_tree_update_resonance(root);
+        ok = consistent(root);
+    }
+    printf("aggregates %s\n", ok ? "consistent" : "diverged");
+    return 0;
+}
+EOF
+)
+check "the whole tree is analyzed" "nodes 6 mean 178 spectrum 6:2 7:3 8:1" "$(echo "$out" | sed -n 1p)"
+check "an activation change reaches the root" "mean 217 top 1" "$(echo "$out" | sed -n 2p)"
+check "a pruned subtree leaves the aggregates" "nodes 3" "$(echo "$out" | sed -n 3p)"
+check "incremental aggregates match a full walk" "aggregates consistent" "$(echo "$out" | sed -n 4p)"
+
+echo -e "\n=== Testing Pattern Sketch ==="
+# A million updates, 420000 of them distinct noise, in 32 counters:
+# the five patterns above N/K come out on top in order, and every
+# reported count bounds the true one from above within its error
+out=$(probe <<'EOF'
+int main(void) {
+    static const int band[] = { 20, 35, 45, 53, 58 }; /* per 100 updates */
+    PatternSketch sketch;
+    const PatternCounter *top[5];
+    char text[32];
+    uint64_t seen[5] = { 0 };
+    int bounded = 1, noise = 0;
+
+    pattern_sketch_init(&sketch);
+    for (int i = 0; i < 1000000; i++) {
+        int h = 0;
+        while (h < 5 && i % 100 >= band[h]) h++;
+        if (h < 5) {
+            seen[h]++;
+            snprintf(text, sizeof text, "h%d", h + 1);
+        } else {
+            snprintf(text, sizeof text, "n%d", noise++);
+        }
+        pattern_sketch_add(&sketch, text, strlen(text), 1);
+    }
+    int n = pattern_sketch_top(&sketch, top, 5);
+    for (int i = 0; i < n; i++) {
+        int h = top[i]->text[1] - '1';
+        printf("%s ", top[i]->text);
+        if (top[i]->text[0] != 'h' || top[i]->count - top[i]->error > seen[h] || top[i]->count < seen[h])
+            bounded = 0;
+    }
+    printf("\ncounters %d total %d %s\n", sketch.used, (int)sketch.total, bounded ? "bounded" : "unbounded");
+    return 0;
+}
+EOF
+)
+check "heavy hitters rank first among a million updates" "h1 h2 h3 h4 h5 " "$(echo "$out" | sed -n 1p)"
+check "memory stays at K counters and counts stay bounded" "counters 32 total 1000000 bounded" "$(echo "$out" | sed -n 2p)"
+
+# Through the shell: prompts feed the orchestrator's sketch word by word
+prompts=$(mktemp)
+for i in $(seq 1 2000); do
+    echo "alpha w$i"
+    [ $((i % 2)) = 0 ] && echo beta
+done >"$prompts"
+model=$(mktemp)
+printf 'GGUF\003\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0' >"$model"
+out=$(kernel <<EOF
+orchestrator-create agent
+orchestrator-load-model agent $model
+orchestrator-inference -f $prompts -o /dev/null agent
+orchestrator-status agent
+EOF
+)
+rm -f "$prompts" "$model"
+check "status counts every pattern in K counters" "Patterns: 32 of 5001 observed" \
+    "$(echo "$out" | sed -n 's/^ *\(Patterns: [0-9]* of [0-9]* observed\),.*/\1/p')"
+check "status ranks the frequent patterns first" "alpha: 2000|beta: 1000" \
+    "$(echo "$out" | grep -A2 'Patterns:' | tail -2 | sed 's/^ *//' | paste -sd'|')"
+
+echo -e "\n=== Testing Orchestrator Inference ==="
+# A header-only GGUF file is enough for the simulated forward pass
+model=$(mktemp)
+prompts=$(mktemp)
+printf 'GGUF\003\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0' >"$model"
+
+# Batches span lines without a prompt: every line gets one record, in
+# input order, numbered by its line
+for i in $(seq 1 300); do
+    if [ $((i % 7)) = 0 ]; then echo
+    elif [ $((i % 11)) = 0 ]; then echo '{"x":1}'
+    elif [ $((i % 2)) = 0 ]; then echo "{\"prompt\":\"p$i\"}"
+    else echo "p$i"
+    fi
+done >"$prompts"
+out=$(kernel <<EOF
+orchestrator-create agent
+orchestrator-load-model agent $model
+orchestrator-inference -f $prompts -j 2 agent
+EOF
+)
+records=$(echo "$out" | grep '^{"id"')
+check "every line gets a record" 300 "$(echo "$records" | wc -l)"
+check "records keep input order" "$(seq 1 300 | tr '\n' ' ')" \
+    "$(echo "$records" | sed 's/^{"id":\([0-9]*\),.*/\1/' | tr '\n' ' ')"
+check "empty lines are error records" '{"id":14,"error":"empty line"}' "$(echo "$records" | sed -n 14p)"
+check "objects without a prompt are error records" '{"id":11,"error":"no prompt member"}' "$(echo "$records" | sed -n 11p)"
+check "prompts are answered in place" \
+    '{"id":130,"prompt":"p130","response":"Inference response to: \"p130\" (simulated from agent)"}' \
+    "$(echo "$records" | sed -n 130p)"
+check "the summary counts failed lines" 66 "$(echo "$out" | sed -n 's/.* \([0-9]*\) failed)$/\1/p')"
+
+# Jobs started with -b are listed in $apids until wait collects them; a
+# subshell's wait must not swallow the parent's wake-up, so a hang here
+# fails the test rather than stalling it
+out=$(timeout 20 ./rc -p 2>&1 <<EOF | grep -v '^Started agent discovery'
+orchestrator-create agent
+orchestrator-load-model agent $model
+orchestrator-inference -b -v a agent 'first question'
+orchestrator-inference -b -v b agent 'second question'
+echo jobs \$#apids
+wait
+echo status \$status jobs \$#apids
+echo a \$a
+echo b \$b
+orchestrator-inference -b agent 'third question'
+wait \$apid
+echo waited
+orchestrator-inference -b -v c agent 'fourth question'
+@{ wait; echo subshell \$status }
+wait
+echo c \$c
+EOF
+)
+check "-b jobs are listed in \$apids" "jobs 2" "$(echo "$out" | grep '^jobs')"
+check "wait collects every pseudo-job" "status 0 jobs 0" "$(echo "$out" | grep '^status')"
+check "-v assigns the response when waited for" \
+    'a Inference response to: "first question" (simulated from agent)' "$(echo "$out" | grep '^a ')"
+check "jobs keep their own responses" \
+    'b Inference response to: "second question" (simulated from agent)' "$(echo "$out" | grep '^b ')"
+check "wait \$apid waits for that job's output" \
+    'Inference response to: "third question" (simulated from agent)|waited' \
+    "$(echo "$out" | grep -A1 'third question' | paste -sd'|')"
+check "a subshell's wait leaves the parent's jobs alone" \
+    'c Inference response to: "fourth question" (simulated from agent)' "$(echo "$out" | grep '^c ')"
+
+# Coordination merges every orchestrator's published snapshot into a
+# view of its own: merging twice gives the same view, the sources keep
+# their own patterns, and inference runs on under a background tick
+out=$(timeout 20 ./rc -p 2>&1 <<EOF | grep -v '^Started agent discovery'
+orchestrator-create agent
+orchestrator-load-model agent $model
+orchestrator-create other
+orchestrator-load-model other $model
+orchestrator-inference agent 'alpha beta gamma'
+orchestrator-inference agent 'alpha beta'
+orchestrator-inference other 'delta alpha'
+orchestrator-coordinate agent
+orchestrator-coordinate agent
+orchestrator-status agent
+orchestrator-coordinate agent 5
+orchestrator-inference -f $prompts -o /dev/null other
+orchestrator-coordinate -s agent
+orchestrator-coordinate agent 0
+EOF
+)
+rm -f "$model" "$prompts"
+views=$(echo "$out" | grep -A7 '^Coordinated view' | grep -v '^--$')
+check "coordination merges every orchestrator" "Coordinated view of 2 orchestrators in agent:" \
+    "$(echo "$views" | sed -n 1p)"
+check "merged counts are the sums" "Patterns: 5 of 9 observed|alpha: 3|beta: 2|delta: 1|gamma: 1|initialization: 2" \
+    "$(echo "$views" | sed -n '3,8p' | sed 's/^ *//' | sort | paste -sd'|')"
+check "merging again gives the same view" "$(echo "$views" | sed -n 1,8p)" "$(echo "$views" | sed -n 9,16p)"
+check "sources keep their own patterns" "alpha: 2" "$(echo "$out" | grep -A1 '^ *Patterns: 4 of 6' | tail -1 | sed 's/^ *//')"
+check "a background coordinator starts and stops" \
+    "Coordinating all orchestrators into agent every 5 ms|Stopped coordinator for agent" \
+    "$(echo "$out" | grep '^Coordinating\|^Stopped' | paste -sd'|')"
+check "a tick must be positive" "rc: line 14: orchestrator-coordinate: failed to start coordinator" \
+    "$(echo "$out" | tail -1)"
+
 echo -e "\n=== Testing Combined Cognitive Pipeline ==="
 echo "Loading cognitive modules and testing integrated functionality..."
 ./rc -c 'load-example-modules; cognitive-status'
 ./rc -c 'load-example-modules; test-pattern "hello"; hypergraph-encode "hello world"; attention-allocate "hello world"; pln-infer "greeting detected"'
 
-echo -e "\nCognitive Grammar Kernel test completed!"
\ No newline at end of file
+echo -e "\nCognitive Grammar Kernel test completed!"
+exit $((failures > 0))
\ No newline at end of file
@@ -1,6 +1,27 @@
 #!/bin/bash
 # Test script for tensor membrane functionality
 
+failures=0
+
+# check <description> <expected> <actual>
+check() {
+    if [ "$2" = "$3" ]; then
+        echo "✓ $1"
+    else
+        echo "✗ $1: expected '$2', got '$3'"
+        failures=$((failures + 1))
+    fi
+}
+
+# close <expected> <actual>: equal to a relative 1e-4
+close() {
+    awk -v a="$1" -v b="$2" 'BEGIN {
+        d = a - b; if (d < 0) d = -d
+        m = a < 0 ? -a : a; if (m < 1) m = 1
+        exit !(b != "" && d <= 1e-4 * m)
+    }' && echo ok
+}
+
 echo "=== Testing Tensor Membrane Customization ==="
 
 echo "Testing prime factorization-based tensor shapes..."
@@ -22,8 +43,8 @@ membrane-add-object 1 pattern_a
 membrane-add-object 1 pattern_b
 membrane-info 1
 membrane-fill 1 3.14
-membrane-set 1 0,1 2.71
-membrane-get 1 0,1
+membrane-set 1 0,1,2 2.71
+membrane-get 1 0,1,2
 EOF
 
 echo
@@ -70,4 +91,501 @@ membrane-list
 EOF
 
 echo
-echo "Tensor membrane customization tests completed!"
\ No newline at end of file
+
+echo "=== Testing membrane handles ==="
+
+# Past the old 64-slot cap; a destroyed slot is reused under a new
+# generation, and its old id stops working everywhere
+out=$( (for i in $(seq 1 100); do echo "membrane-create [2]"; done
+        cat <<EOF
+membrane-destroy 2
+membrane-create [3]
+membrane-list
+membrane-info 16777218
+membrane-info 2
+membrane-destroy 2
+membrane-fill 2 1
+membrane-add-object 2 a
+EOF
+) | ./rc -i 2>&1 | sed 's/^\(; \)*//')
+check "more than 64 membranes" "Created tensor membrane (ID: 100) with prime factors: [2]" \
+    "$(echo "$out" | grep 'ID: 100)')"
+check "a reused slot gets a new generation" "Created tensor membrane (ID: 16777218) with prime factors: [3]" \
+    "$(echo "$out" | grep '\[3\]$')"
+check "the list counts live membranes" "Active tensor membranes: 100" "$(echo "$out" | grep '^Active')"
+check "the new id resolves" "Membrane 16777218: [3] energy=100 objects=0 children=0" \
+    "$(echo "$out" | grep '^Membrane 16777218:')"
+check "a stale id is rejected" "info destroy fill add-object" \
+    "$(echo "$out" | sed -n 's/^rc: membrane-\(.*\): membrane not found$/\1/p' | paste -sd' ')"
+
+echo
+
+echo "=== Testing object multisets ==="
+
+# Objects carry multiplicities that add, transfer and remove move as
+# counts; a transfer short of copies changes nothing, and a membrane
+# holds any number of distinct symbols
+out=$( (cat <<EOF
+membrane-create [2]
+membrane-create [3]
+membrane-add-object 1 a 5
+membrane-transfer 1 2 a 3
+membrane-remove-object 1 a 2
+membrane-info 1
+membrane-transfer 2 1 a 4
+membrane-add-object 1 big 1000000
+membrane-transfer 1 2 big 999999
+membrane-info 1
+membrane-info 2
+EOF
+        for i in $(seq 1 40); do echo "membrane-add-object 1 s$i"; done
+        echo "membrane-info 1") | ./rc -i 2>&1 | sed 's/^\(; \)*//' | grep -v '^Added')
+infos=$(echo "$out" | grep '^Membrane [12]:' | sed 's/ children=0$//; s/.*objects=//' | paste -sd' ')
+check "transfer and remove move counts" "0 1 1000002 41" "$infos"
+check "multiplicities are listed" "obj: a x3|obj: big x999999" \
+    "$(echo "$out" | sed -n '/^Membrane 2:/,/^Membrane/p' | grep 'obj:' | sed 's/^ *//' | paste -sd'|')"
+check "a short transfer is refused" "rc: membrane-transfer: not enough copies of object in source membrane" \
+    "$(echo "$out" | grep '^rc:')"
+check "there is no cap on symbols" 41 "$(echo "$out" | tail -41 | grep -c 'obj:')"
+
+echo
+
+echo "=== Testing P-system evolution ==="
+
+# evolve <seed>: the split between two rules competing for 1000 copies
+evolve() {
+    cat <<EOF | ./rc -p 2>&1 | grep 'obj:' | sed 's/^ *obj: //' | paste -sd' '
+membrane-create [2]
+membrane-add-object 1 a 1000
+membrane-rule 1 'a -> x'
+membrane-rule 1 'a -> y'
+membrane-evolve 10 $1
+membrane-info 1
+EOF
+}
+split=$(evolve 3)
+check "a seed fixes the choices" "$split" "$(evolve 3)"
+check "every copy is used once" 1000 "$(echo "$split" | grep -o '[0-9][0-9]*' | awk '{ s += $1 } END { print s }')"
+
+# Products arrive at the end of a step: a chain a -> b -> c takes two
+# steps, and objects sent in and out cross one membrane per step
+out=$( (cat <<EOF
+membrane-create [2]
+membrane-add-object 1 a 10
+membrane-rule 1 'a -> b'
+membrane-rule 1 'b -> c'
+membrane-evolve 10
+membrane-info 1
+membrane-destroy 1
+membrane-create [2]
+membrane-create [2] 16777217
+membrane-add-object 16777217 a 100
+membrane-rule 16777217 'a a -> b (c, in)'
+membrane-rule 2 'c -> (d, out)'
+membrane-evolve 50 7
+membrane-info 16777217
+EOF
+        # Seven more children, filling the skin's eight slots, evolve in
+        # the same step
+        for i in $(seq 3 9); do
+            echo "membrane-create [2] 16777217"
+            echo "membrane-add-object $i e 10"
+            echo "membrane-rule $i 'e -> (f, out)'"
+        done
+        echo "membrane-evolve 10"
+        echo "membrane-info 16777217") | ./rc -i 2>&1 | sed 's/^\(; \)*//')
+evolved=$(echo "$out" | grep '^Evolved' | sed 's/ in .*(.*steps\/s, / /; s/)//')
+check "evolve reports its rate" ok \
+    "$(echo "$out" | grep -m1 '^Evolved' | grep -q 'in [0-9]* ms ([0-9.]* steps/s, ' && echo ok)"
+check "products are used from the next step on" "Evolved 2 steps 20 rule applications, halted" \
+    "$(echo "$evolved" | sed -n 1p)"
+check "a chain runs to its end" "obj: c x10" "$(echo "$out" | grep -m1 'obj: c' | sed 's/^ *//')"
+check "objects cross one membrane per step" "Evolved 2 steps 100 rule applications, halted" \
+    "$(echo "$evolved" | sed -n 2p)"
+check "in and out reach the right membranes" "obj: b x50|obj: d x50" \
+    "$(echo "$out" | sed -n '/^Membrane 16777217:/,/^ *Membrane/p' | sed -n '2,3p' | sed 's/^ *//' | paste -sd'|')"
+check "nested membranes evolve together" "Evolved 1 steps 70 rule applications, halted|obj: f x70" \
+    "$(echo "$evolved" | sed -n 3p)|$(echo "$out" | grep 'obj: f' | sed 's/^ *//')"
+check "a malformed rule is refused" "membrane-rule: missing '->'" \
+    "$( (echo "membrane-create [2]"; echo "membrane-rule 1 'bad rule'") | ./rc -i 2>&1 | grep -o "membrane-rule: .*")"
+
+echo
+
+echo "=== Testing views and copy-on-write ==="
+
+# Views read their source's elements through their own strides; the
+# first write on either side of a shared buffer copies it, and a view
+# outlives its source
+out=$(cat <<EOF | ./rc -i 2>&1 | sed 's/^\(; \)*//'
+membrane-create [2,3,4]
+membrane-set 1 1,2,3 7
+membrane-set 1 0,2,2 4
+membrane-view 1 1,0:3:2
+membrane-info 2
+membrane-get 2 0,1,3
+membrane-set 2 0,1,3 9
+membrane-get 1 1,2,3
+membrane-view -r 1 [4,6]
+membrane-info 3
+membrane-get 3 1,4
+membrane-set 1 0,2,2 6
+membrane-get 3 1,4
+membrane-destroy 1
+membrane-get 3 3,5
+EOF
+)
+values=$(echo "$out" | sed -n 's/^Element at membrane \([0-9]*\), indices \[\(.*\)\] = \(.*\) (x100)$/\1:\2=\3/p' | paste -sd' ')
+check "a strided view has its own shape" "Membrane 2: [1,2,4] energy=100 objects=0 children=0 view-of=1 strided" \
+    "$(echo "$out" | grep '^Membrane 2:')"
+check "a reshaped view is contiguous" "Membrane 3: [4,6] energy=100 objects=0 children=0 view-of=1" \
+    "$(echo "$out" | grep '^Membrane 3:')"
+check "views read through their strides" "2:0,1,3=700 3:1,4=400" "$(echo "$values" | cut -d' ' -f1,3)"
+check "writes copy the shared buffer" "1:1,2,3=700 3:1,4=400" "$(echo "$values" | cut -d' ' -f2,4)"
+check "a view outlives its source" "3:3,5=700" "$(echo "$values" | cut -d' ' -f5)"
+
+# Reshaping keeps every element where it was in row-major order
+check "reshape keeps the data" "Element at membrane 1, indices [5,4] = 300 (x100)" \
+    "$(cat <<EOF | ./rc -p 2>&1 | grep '^Element'
+membrane-create [2,3,5]
+membrane-set 1 1,2,4 3
+membrane-reshape 1 [6,5]
+membrane-get 1 5,4
+EOF
+)"
+
+echo
+
+echo "=== Testing persistent membranes ==="
+
+# A file-backed membrane keeps its data across shells; the header's
+# shape and checksum guard reopening, and a read-only mapping copies
+# on write instead of touching the file
+files=$(mktemp -d)
+out=$( (echo "membrane-create -f $files/data.mem [2,3,5]"
+        echo "membrane-set 1 1,2,4 3"
+        echo "membrane-flush 1"
+        echo "membrane-flush -c 1") | ./rc -i 2>&1 | sed 's/^\(; \)*//'
+      ./rc -i 2>&1 <<EOF | sed 's/^\(; \)*//'
+membrane-create -f $files/data.mem
+membrane-get 1 1,2,4
+membrane-info 1
+membrane-create -f $files/data.mem [7]
+membrane-create -r -f $files/data.mem
+membrane-set 2 1,2,4 8
+membrane-get 1 1,2,4
+EOF
+)
+check "a flushed membrane checks out" "Membrane 1 checksum ok" "$(echo "$out" | grep checksum)"
+check "data survives the shell and read-only writes stay private" "Element at membrane 1, indices [1,2,4] = 300 (x100)|Element at membrane 1, indices [1,2,4] = 300 (x100)" \
+    "$(echo "$out" | grep '^Element' | paste -sd'|')"
+check "info names the file" "Membrane 1: [2,3,5] energy=100 objects=0 children=0 file=$files/data.mem" \
+    "$(echo "$out" | grep '^Membrane 1:')"
+check "a different shape is refused" "membrane-create: $files/data.mem: shape does not match file" \
+    "$(echo "$out" | grep 'shape does not match')"
+
+# Unflushed writes are still there, but the header says they were not
+# checked; damaged data fails the check
+./rc -c "membrane-create -f $files/data.mem; membrane-set 1 0,0,0 5" >/dev/null 2>&1
+out=$(cat <<EOF | ./rc -i 2>&1 | sed 's/^\(; \)*//'
+membrane-create -f $files/data.mem
+membrane-get 1 0,0,0
+membrane-flush 1
+EOF
+)
+printf 'X' | dd of="$files/data.mem" bs=1 seek=4100 conv=notrunc 2>/dev/null
+check "an unflushed file is reported stale" "membrane-create: $files/data.mem: checksum is stale" \
+    "$(echo "$out" | grep stale)"
+check "unflushed writes persist" "Element at membrane 1, indices [0,0,0] = 500 (x100)" "$(echo "$out" | grep '^Element')"
+check "damaged data fails the check" "Membrane 1 checksum mismatch or stale" \
+    "$( (echo "membrane-create -f $files/data.mem"; echo "membrane-flush -c 1") | ./rc -i 2>&1 | grep -o 'Membrane 1 checksum.*')"
+./rc -c "membrane-create -f $files/data.mem; membrane-destroy -u 1" >/dev/null 2>&1
+check "destroy -u removes the file" "" "$(ls "$files")"
+rm -r "$files"
+
+echo
+
+echo "=== Testing shared membranes ==="
+
+# A segment is shared by every shell that opens it and by children
+# forked after it was opened: pipeline stages, background jobs and
+# subshells write to the same elements, and bulk operations from
+# concurrent stages are serialized
+segment=rc-test-$$
+out=$(cat <<EOF | ./rc -i 2>&1 | sed 's/^\(; \)*//'
+membrane-create -s $segment [4,4]
+membrane-fill 1 1
+{ membrane-set 1 0,0 7 } | { membrane-set 1 3,3 9 }
+membrane-op sum 1
+{ membrane-set 1 1,1 5 } &
+wait
+( membrane-set 1 2,2 4 )
+membrane-get 1 1,1
+membrane-get 1 2,2
+{ membrane-op scale 1 2 } | { membrane-op scale 1 3 }
+membrane-op sum 1
+membrane-flush 1
+EOF
+)
+check "pipeline stages write the same tensor" "sum of membrane 1 = 3000 (x100)" \
+    "$(echo "$out" | grep -m1 '^sum')"
+check "background jobs and subshells write it too" \
+    "Element at membrane 1, indices [1,1] = 500 (x100)|Element at membrane 1, indices [2,2] = 400 (x100)" \
+    "$(echo "$out" | grep '^Element' | paste -sd'|')"
+check "concurrent bulk operations both apply" "sum of membrane 1 = 22200 (x100)" \
+    "$(echo "$out" | grep '^sum' | sed -n 2p)"
+out=$(cat <<EOF | ./rc -i 2>&1 | sed 's/^\(; \)*//'
+membrane-create -s $segment
+membrane-info 1
+membrane-op sum 1
+membrane-flush -c 1
+membrane-destroy -u 1
+EOF
+)
+check "another shell opens the segment" "Membrane 1: [4,4] energy=100 objects=0 children=0 shm=$segment" \
+    "$(echo "$out" | grep '^Membrane 1:')"
+check "and sees every write" "sum of membrane 1 = 22200 (x100)|Membrane 1 checksum ok" \
+    "$(echo "$out" | grep '^sum\|checksum' | paste -sd'|')"
+check "destroy -u removes the segment" "membrane-create: $segment: cannot open file" \
+    "$(./rc -c "membrane-create -s $segment" 2>&1 | grep -o 'membrane-create: .*')"
+
+echo
+
+echo "=== Testing snapshots and deltas ==="
+
+# Later snapshots copy only the pages written since the last one; a
+# delta lists runs of changed elements and applies to any membrane of
+# the same size
+files=$(mktemp -d)
+out=$(cat <<EOF | ./rc -i 2>&1 | sed 's/^\(; \)*//'
+membrane-create [3000]
+membrane-create [3000]
+membrane-snapshot 1
+membrane-set 1 5 2
+membrane-set 1 6 3
+membrane-set 1 2500 4
+membrane-snapshot 1
+membrane-snapshot -l
+membrane-diff 1 2
+membrane-set 1 7 1
+membrane-diff 2
+membrane-diff 1 > $files/changes.delta
+membrane-patch 2 $files/changes.delta
+membrane-op sum 2
+membrane-snapshot -r 1
+membrane-op sum 1
+membrane-snapshot -r 2 2
+membrane-op sum 2
+membrane-snapshot -d 1
+membrane-snapshot -l
+membrane-diff 1
+membrane-create [5]
+membrane-patch 3 $files/changes.delta
+EOF
+)
+check "only written pages are copied" "3 of 3 pages copied|2 of 3 pages copied" \
+    "$(echo "$out" | grep -o '[0-9]* of [0-9]* pages copied' | paste -sd'|')"
+check "snapshots are listed" "Snapshot 1: membrane 1, version 1, 3000 elements|Snapshot 2: membrane 1, version 4, 3000 elements" \
+    "$(echo "$out" | grep '^Snapshot [12]:' | head -2 | paste -sd'|')"
+check "a diff lists runs of changes" "delta 3000 2|5 2 2 3|2500 1 4|delta 3000 1|7 1 1" \
+    "$(echo "$out" | grep '^delta\|^[0-9]* [0-9]* ' | paste -sd'|')"
+check "a diff against the membrane sees later writes" "delta 3000 2|5 3 2 3 1|2500 1 4" \
+    "$(paste -sd'|' "$files/changes.delta")"
+check "a patch applies the delta" "Patched 4 elements of membrane 2|sum of membrane 2 = 1000 (x100)" \
+    "$(echo "$out" | grep '^Patched\|^sum' | head -2 | paste -sd'|')"
+check "a snapshot restores in place or into another membrane" "sum of membrane 1 = 0 (x100)|sum of membrane 2 = 900 (x100)" \
+    "$(echo "$out" | grep '^sum' | sed -n '2,3p' | paste -sd'|')"
+check "a deleted snapshot is gone" "Snapshot 2: membrane 1, version 4, 3000 elements|rc: membrane-diff: no such snapshot or membrane, or sizes differ" \
+    "$(echo "$out" | sed -n '/^Deleted snapshot 1/,$p' | grep '^Snapshot\|^rc: membrane-diff' | paste -sd'|')"
+check "a delta must fit the membrane" "rc: membrane-patch: delta does not fit the membrane" \
+    "$(echo "$out" | grep '^rc: membrane-patch')"
+check "a delta needs its header" "membrane-patch: missing delta header" \
+    "$( (echo "membrane-create [5]"; echo "membrane-patch 1 /dev/null") | ./rc -i 2>&1 | grep -o 'membrane-patch: .*')"
+rm -r "$files"
+
+echo
+
+echo "=== Testing bulk loading and dumping ==="
+
+# Text dumps carry enough digits to read back the same floats, so a
+# million elements survive text and raw round trips bit for bit
+files=$(mktemp -d)
+awk 'BEGIN { srand(1); for (i = 0; i < 1048576; i++) printf "%.12g\n", (rand() - 0.5) * 10 ^ int(rand() * 60 - 30) }' \
+    > "$files/values.txt"
+./rc -c "membrane-create [1024,1024]; membrane-load 1 $files/values.txt
+         membrane-dump -b 1 $files/first.bin; membrane-dump 1 $files/first.txt
+         membrane-create [1024,1024]; membrane-load 2 $files/first.txt; membrane-dump -b 2 $files/second.bin
+         membrane-create [1048576]; membrane-load -b 3 $files/first.bin; membrane-dump 3 $files/second.txt" \
+    > "$files/out" 2>&1
+check "a million elements load" 3 "$(grep -c '^Loaded 1048576 elements' "$files/out")"
+check "text reads back the same floats" same "$(cmp -s "$files/first.bin" "$files/second.bin" && echo same)"
+check "raw floats read back the same text" same \
+    "$(tr ' ' '\n' < "$files/first.txt" | cmp -s - "$files/second.txt" && echo same)"
+check "raw floats are four bytes each" 4194304 "$(wc -c < "$files/first.bin" | tr -d ' ')"
+
+printf '1 2.5 -3\n4 5 6\n' > "$files/rows.txt"
+printf '# comment\n\n0,1 7\n1,2 8\nbad line\n0,0 9\n' > "$files/set.txt"
+printf '9 8\n' > "$files/short.txt"
+out=$(cat <<EOF | ./rc -i 2>&1 | sed 's/^\(; \)*//'
+membrane-create [2,3]
+membrane-load 1 $files/rows.txt
+membrane-dump 1
+membrane-create [6]
+membrane-load 2 $files/rows.txt
+membrane-dump 2
+membrane-set 1 - $files/set.txt
+membrane-dump 1
+membrane-load 1 $files/short.txt
+membrane-dump 1
+membrane-load 2 $files/first.txt
+EOF
+)
+check "a dump writes a row per line" "1 2.5 -3|4 5 6|1|2.5|-3|4|5|6" \
+    "$(echo "$out" | grep -v '^[A-Za-z]' | head -8 | paste -sd'|')"
+check "membrane-set - stops at the first bad line" "membrane-set: line 5: expected in-range indices and a value|Set 2 elements of membrane 1|1 7 -3|4 5 8" \
+    "$(echo "$out" | sed -n '/^membrane-set:/,/^[0-9].* 8$/p' | paste -sd'|')"
+check "a short load keeps what it read" "membrane-load: input is too short after 2 elements|9 8 -3|4 5 8" \
+    "$(echo "$out" | sed -n '/^membrane-load: input is too short/,$p' | grep -v '^membrane-load: input is longer' | paste -sd'|')"
+check "a long load is refused" "membrane-load: input is longer than the membrane after 6 elements" \
+    "$(echo "$out" | grep -o 'membrane-load: input is longer.*')"
+check "membrane-set - reads standard input" "Set 2 elements of membrane 1|0 7 0|2 0 0" \
+    "$(printf '0,1 7\n1,0 2\n' | ./rc -c 'membrane-create [2,3]; membrane-set 1 -; membrane-dump 1' 2>&1 | grep -v '^Started\|^Created' | paste -sd'|')"
+rm -r "$files"
+
+echo
+
+echo "=== Testing membrane arithmetic ==="
+
+out=$(cat <<EOF | ./rc -i 2>&1 | sed 's/^\(; \)*//'
+membrane-create [2,3]
+membrane-create [2,3]
+membrane-create [5]
+membrane-fill 1 1.5
+membrane-fill 2 2
+membrane-op sum 1
+membrane-op max 1
+membrane-op norm 1
+membrane-op dot 1 2
+membrane-op axpy 1 2 2
+membrane-op sum 1
+membrane-op mul 1 2
+membrane-op scale 1 -0.5
+membrane-op sum 1
+membrane-op copy 1 2
+membrane-op add 1 2
+membrane-op sum 1
+membrane-op add 1 3
+EOF
+)
+results=$(echo "$out" | grep ' = .* (x100)$' | sed 's/ (x100)$//' | paste -sd'|')
+check "reductions print fixed point" "sum of membrane 1 = 900|max of membrane 1 = 150|norm of membrane 1 = 367" \
+    "$(echo "$results" | cut -d'|' -f1-3)"
+check "dot names both operands" "dot of membranes 1 and 2 = 1800" "$(echo "$results" | cut -d'|' -f4)"
+check "axpy, mul and scale update in place" "sum of membrane 1 = 3300|sum of membrane 1 = -3300" \
+    "$(echo "$results" | cut -d'|' -f5-6)"
+check "copy and add update in place" "sum of membrane 1 = 2400" "$(echo "$results" | cut -d'|' -f7)"
+check "operands must have the same size" "membrane-op: membrane not found or shapes differ" \
+    "$(echo "$out" | sed -n 's/^rc: membrane-op:/membrane-op:/p')"
+
+echo
+
+echo "=== Testing tensor handles and names ==="
+
+out=$(cat <<EOF | ./rc -p 2>&1
+tensor-create 2,2 tensor_2
+tensor-create 3
+tensor-create 5 v
+tensor-op v scale 2
+tensor-op 3 sum
+tensor-op v sum
+tensor-destroy 2
+tensor-create 4 reused
+tensor-list
+tensor-op 2 sum
+EOF
+)
+sums=$(echo "$out" | grep "'sum' result")
+check "a default name steps past a chosen one" "tensor_2_2" "$(echo "$out" | grep 'handle: 2,' | sed 's/.*name: //; s/)//')"
+check "names resolve like handles" "$(echo "$sums" | head -1)" "$(echo "$sums" | tail -1)"
+check "a reused slot gets a new handle" "16777218 reused <4>" "$(echo "$out" | grep 'reused <')"
+check "a destroyed handle goes stale" "rc: line 10: tensor-op: tensor not found" "$(echo "$out" | grep 'tensor-op:')"
+
+echo
+echo "=== Testing fused tensor operations ==="
+
+# An elementwise chain is recorded and runs in one pass, with the same
+# result as evaluating every step: c starts as a copy of a's random data
+out=$(cat <<EOF | ./rc -p 2>&1
+tensor-create 1000,1000 a
+tensor-create 1000,1000 c
+tensor-op c scale 0
+tensor-op c add a
+tensor-op c eval
+tensor-op a relu
+tensor-op a scale 2
+tensor-op a shift -1
+tensor-op a plan
+tensor-op a sum
+tensor-op c relu
+tensor-op c eval
+tensor-op c scale 2
+tensor-op c eval
+tensor-op c shift -1
+tensor-op c eval
+tensor-op c plan
+tensor-op c sum
+tensor-create 3,3 m
+tensor-op m scale 0
+tensor-op m shift 1
+tensor-op m matmul m
+tensor-op m shift -2
+tensor-op m relu
+tensor-op m sum
+EOF
+)
+plans=$(echo "$out" | grep ': [0-9]* pass')
+check "a chain fuses into one pass" "shift(scale(relu(<1000x1000>), 2), -1): 1 pass" "$(echo "$plans" | sed -n 1p)"
+check "eval stores the value" "<1000x1000>: 1 pass" "$(echo "$plans" | sed -n 2p)"
+sums=$(echo "$out" | sed -n "s/.*'sum' result: //p")
+set -- $sums
+check "fusion matches step by step evaluation" ok "$(close "$2" "$1")"
+check "elementwise steps fuse after a matmul" 9 "$3"
+check "an operation is recorded, not run" "Tensor operation 'relu' recorded: relu(<1000x1000>)" \
+    "$(echo "$out" | grep -m1 "'relu' recorded")"
+
+echo
+echo "=== Testing SGEMM and conv2d ==="
+
+# Against the naive loops, at sizes that leave partial register tiles
+make -s tensor-bench >/dev/null
+./tensor-bench 7 33 97 | grep 'max error' | while read -r line; do
+    error=${line##* }
+    check "${line%%:*} matches naive loops" ok "$(awk -v e="$error" 'BEGIN { exit !(e < 1e-4) }' && echo ok)"
+done
+
+# Through the shell, where products run in bands on the worker pool:
+# a matrix times ones gives its row sums, and ones convolved with a
+# filter give the filter's sum at every position
+sums=$(cat <<EOF | ./rc -p 2>&1 | sed -n "s/.*'sum' result: //p"
+tensor-create 200,300 a
+tensor-create 300,150 b
+tensor-op b scale 0
+tensor-op b shift 1
+tensor-op a sum
+tensor-op a matmul b
+tensor-op a sum
+tensor-create 3,20,20 x
+tensor-op x scale 0
+tensor-op x shift 1
+tensor-create 2,3,3,3 f
+tensor-op f sum
+tensor-op x conv2d f
+tensor-op x sum
+EOF
+)
+set -- $sums
+check "matmul agrees with row sums" ok "$(close "$(awk -v s="$1" 'BEGIN { print s * 150 }')" "$2")"
+check "conv2d agrees with filter sums" ok "$(close "$(awk -v s="$3" 'BEGIN { print s * 18 * 18 }')" "$4")"
+
+echo
+echo "Tensor membrane customization tests completed!"
+exit $((failures > 0))
\ No newline at end of file
@@ -1,6 +1,9 @@
 #include "rc.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 
 #include "wait.h"
 
@@ -13,9 +16,57 @@ static struct Pid {
 	int stat;
 	bool alive;
 	bool waiting;
+	bool pseudo;		/* runs on a thread, not in a child process */
+	void (*reap)(void *, int);
+	void *arg;
 	Pid *n;
 } *plist = NULL;
 
+/*
+   Pseudo-jobs are builtins running on threads of this process.  They get
+   ids above any real pid so that $apids and wait treat them uniformly.
+   Threads report completion on donelist and wake the shell through
+   donepipe; only the shell thread touches plist.
+*/
+
+#define PSEUDO_PID_BASE 0x40000000
+#define PSEUDO_POLL_MS 20
+
+typedef struct Done Done;
+
+static struct Done {
+	pid_t pid;
+	int stat;
+	Done *n;
+} *donelist = NULL;
+
+static pthread_mutex_t donelock = PTHREAD_MUTEX_INITIALIZER;
+static int donepipe[2] = { -1, -1 };
+static pid_t nextpseudo = PSEUDO_PID_BASE;
+
+/*
+   A forked child has none of the parent's threads.  It drops their
+   completions and its copy of donepipe, so that reaping in the child
+   cannot take a wake-up meant for the parent; the lock may have been
+   held by a thread that no longer exists.
+*/
+
+static void pseudoforget(void) {
+	Done *d, *next;
+	int i;
+	pthread_mutex_init(&donelock, NULL);
+	for (d = donelist; d != NULL; d = next) {
+		next = d->n;
+		free(d);
+	}
+	donelist = NULL;
+	for (i = 0; i < 2; i++)
+		if (donepipe[i] >= 0) {
+			close(donepipe[i]);
+			donepipe[i] = -1;
+		}
+}
+
 extern pid_t rc_fork() {
 	Pid *new;
 	struct Pid *p, *q;
@@ -38,18 +89,88 @@ extern pid_t rc_fork() {
 		}
 		if (q) efree(q);
 		plist = 0;
+		pseudoforget();
 		return 0;
 	default:
 		new = enew(Pid);
 		new->pid = pid;
 		new->alive = TRUE;
 		new->waiting = FALSE;
+		new->pseudo = FALSE;
+		new->reap = NULL;
+		new->arg = NULL;
 		new->n = plist;
 		plist = new;
 		return pid;
 	}
 }
 
+extern pid_t rc_pseudofork(void (*reap)(void *, int), void *arg) {
+	Pid *new;
+	int i;
+	if (donepipe[0] < 0) {
+		if (pipe(donepipe) < 0) {
+			uerror("pipe");
+			rc_error(NULL);
+		}
+		for (i = 0; i < 2; i++) {
+			fcntl(donepipe[i], F_SETFD, FD_CLOEXEC);
+			fcntl(donepipe[i], F_SETFL, O_NONBLOCK);
+		}
+	}
+	new = enew(Pid);
+	new->pid = nextpseudo++;
+	new->alive = TRUE;
+	new->waiting = FALSE;
+	new->pseudo = TRUE;
+	new->reap = reap;
+	new->arg = arg;
+	new->n = plist;
+	plist = new;
+	return new->pid;
+}
+
+/* Called from any thread when a pseudo-job finishes. */
+extern void rc_pseudoexit(pid_t pid, int stat) {
+	Done *d = malloc(sizeof *d);
+	if (d == NULL)
+		panic("out of memory");
+	d->pid = pid;
+	d->stat = stat;
+	pthread_mutex_lock(&donelock);
+	d->n = donelist;
+	donelist = d;
+	pthread_mutex_unlock(&donelock);
+	(void) write(donepipe[1], "", 1); /* a full pipe already means "wake up" */
+}
+
+/* Mark finished pseudo-jobs dead and run their reapers. */
+static void pseudoreap(void) {
+	char buf[64];
+	Done *d, *next;
+	Pid *q;
+	if (donepipe[0] < 0)
+		return;
+	while (read(donepipe[0], buf, sizeof buf) > 0)
+		;
+	pthread_mutex_lock(&donelock);
+	d = donelist;
+	donelist = NULL;
+	pthread_mutex_unlock(&donelock);
+	for (; d != NULL; d = next) {
+		next = d->n;
+		for (q = plist; q != NULL; q = q->n)
+			if (q->pid == d->pid && q->pseudo) {
+				q->alive = FALSE;
+				q->stat = d->stat;
+				if (q->reap != NULL)
+					(*q->reap)(q->arg, d->stat);
+				break;
+			}
+		free(d);
+	}
+}
+
 static int markwaiting(pid_t pid, bool clear) {
 	Pid *p;
 	int n = 0;
@@ -65,7 +186,11 @@ static int markwaiting(pid_t pid, bool clear) {
 static pid_t dowait(int *stat, bool nointr) {
 	Pid **p, *q;
 	pid_t pid;
+	bool pseudo, real;
+	struct pollfd pfd;
 	for (;;) {
+		pseudoreap();
+		pseudo = real = FALSE;
 		for (p = &plist; *p != NULL; p = &(*p)->n) {
 			q = *p;
 			if (q->waiting && !q->alive) {
@@ -75,8 +200,27 @@ static pid_t dowait(int *stat, bool nointr) {
 				efree(q);
 				return pid;
 			}
+			if (q->waiting && q->pseudo)
+				pseudo = TRUE;
+			else if (q->waiting)
+				real = TRUE;
 		}
-		pid = rc_wait(stat);
+		if (pseudo) {
+			/*
+			   Sleep until a pseudo-job finishes; with real children
+			   to wait for as well, wake up periodically to poll them.
+			*/
+			pfd.fd = donepipe[0];
+			pfd.events = POLLIN;
+			if (poll(&pfd, 1, real ? PSEUDO_POLL_MS : -1) < 0 && errno == EINTR && !nointr)
+				return -1;
+			if (!real)
+				continue;
+			pid = waitpid(-1, stat, WNOHANG);
+			if (pid == 0)
+				continue;
+		} else
+			pid = rc_wait(stat);
 		if (pid < 0) {
 			if (errno == ECHILD)
 				panic("lost child");